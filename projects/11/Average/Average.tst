@@ -0,0 +1,124 @@
+// Types in 3 numbers, 10, 20 and 33. The output is the average printed on the fifth line, 21.
+// The first key is held past the compiled OS's start up, about 600000 steps, and every budget
+// leaves the compiled OS several times what it needs, so runs on it pass as well.
+
+load,
+output-file Average.out,
+compare-to Average.cmp,
+output-list RAM[17831]%D2.6.2 RAM[17832]%D2.6.2 RAM[17863]%D2.6.2 RAM[17864]%D2.6.2 RAM[17895]%D2.6.2 RAM[17896]%D2.6.2 RAM[17927]%D2.6.2 RAM[17928]%D2.6.2 RAM[17959]%D2.6.2 RAM[17960]%D2.6.2 RAM[17991]%D2.6.2 RAM[17992]%D2.6.2 RAM[18023]%D2.6.2 RAM[18024]%D2.6.2 RAM[18055]%D2.6.2 RAM[18056]%D2.6.2 RAM[18087]%D2.6.2 RAM[18088]%D2.6.2 RAM[18119]%D2.6.2 RAM[18120]%D2.6.2 RAM[18151]%D2.6.2 RAM[18152]%D2.6.2;
+
+set RAM[24576] 51,
+repeat 2000000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 128,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 49,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 48,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 128,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 50,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 48,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 128,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 51,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 51,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 128,
+repeat 200000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 200000 {
+  vmstep;
+}
+
+repeat 10000000 {
+  vmstep;
+}
+
+output;
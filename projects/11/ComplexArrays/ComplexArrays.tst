@@ -0,0 +1,25 @@
+// Prints the expected and actual result of five tests, one a line. The output is each line's
+// actual result, after "actual result: ".
+
+load,
+output-file ComplexArrays.out,
+compare-to ComplexArrays.cmp,
+
+repeat 1000000 {
+  vmstep;
+}
+
+output-list RAM[16437]%D2.6.2 RAM[16438]%D2.6.2 RAM[16469]%D2.6.2 RAM[16470]%D2.6.2 RAM[16501]%D2.6.2 RAM[16502]%D2.6.2 RAM[16533]%D2.6.2 RAM[16534]%D2.6.2 RAM[16565]%D2.6.2 RAM[16566]%D2.6.2 RAM[16597]%D2.6.2 RAM[16598]%D2.6.2 RAM[16629]%D2.6.2 RAM[16630]%D2.6.2 RAM[16661]%D2.6.2 RAM[16662]%D2.6.2 RAM[16693]%D2.6.2 RAM[16694]%D2.6.2 RAM[16725]%D2.6.2 RAM[16726]%D2.6.2 RAM[16757]%D2.6.2 RAM[16758]%D2.6.2;
+output;
+
+output-list RAM[16790]%D2.6.2 RAM[16791]%D2.6.2 RAM[16822]%D2.6.2 RAM[16823]%D2.6.2 RAM[16854]%D2.6.2 RAM[16855]%D2.6.2 RAM[16886]%D2.6.2 RAM[16887]%D2.6.2 RAM[16918]%D2.6.2 RAM[16919]%D2.6.2 RAM[16950]%D2.6.2 RAM[16951]%D2.6.2 RAM[16982]%D2.6.2 RAM[16983]%D2.6.2 RAM[17014]%D2.6.2 RAM[17015]%D2.6.2 RAM[17046]%D2.6.2 RAM[17047]%D2.6.2 RAM[17078]%D2.6.2 RAM[17079]%D2.6.2 RAM[17110]%D2.6.2 RAM[17111]%D2.6.2;
+output;
+
+output-list RAM[17141]%D2.6.2 RAM[17142]%D2.6.2 RAM[17173]%D2.6.2 RAM[17174]%D2.6.2 RAM[17205]%D2.6.2 RAM[17206]%D2.6.2 RAM[17237]%D2.6.2 RAM[17238]%D2.6.2 RAM[17269]%D2.6.2 RAM[17270]%D2.6.2 RAM[17301]%D2.6.2 RAM[17302]%D2.6.2 RAM[17333]%D2.6.2 RAM[17334]%D2.6.2 RAM[17365]%D2.6.2 RAM[17366]%D2.6.2 RAM[17397]%D2.6.2 RAM[17398]%D2.6.2 RAM[17429]%D2.6.2 RAM[17430]%D2.6.2 RAM[17461]%D2.6.2 RAM[17462]%D2.6.2;
+output;
+
+output-list RAM[17494]%D2.6.2 RAM[17495]%D2.6.2 RAM[17526]%D2.6.2 RAM[17527]%D2.6.2 RAM[17558]%D2.6.2 RAM[17559]%D2.6.2 RAM[17590]%D2.6.2 RAM[17591]%D2.6.2 RAM[17622]%D2.6.2 RAM[17623]%D2.6.2 RAM[17654]%D2.6.2 RAM[17655]%D2.6.2 RAM[17686]%D2.6.2 RAM[17687]%D2.6.2 RAM[17718]%D2.6.2 RAM[17719]%D2.6.2 RAM[17750]%D2.6.2 RAM[17751]%D2.6.2 RAM[17782]%D2.6.2 RAM[17783]%D2.6.2 RAM[17814]%D2.6.2 RAM[17815]%D2.6.2;
+output;
+
+output-list RAM[17846]%D2.6.2 RAM[17847]%D2.6.2 RAM[17878]%D2.6.2 RAM[17879]%D2.6.2 RAM[17910]%D2.6.2 RAM[17911]%D2.6.2 RAM[17942]%D2.6.2 RAM[17943]%D2.6.2 RAM[17974]%D2.6.2 RAM[17975]%D2.6.2 RAM[18006]%D2.6.2 RAM[18007]%D2.6.2 RAM[18038]%D2.6.2 RAM[18039]%D2.6.2 RAM[18070]%D2.6.2 RAM[18071]%D2.6.2 RAM[18102]%D2.6.2 RAM[18103]%D2.6.2 RAM[18134]%D2.6.2 RAM[18135]%D2.6.2 RAM[18166]%D2.6.2 RAM[18167]%D2.6.2;
+output;
@@ -0,0 +1,14 @@
+// Unpacks RAM[8000] into RAM[8001..8016], one bit a word from the lowest.
+
+load,
+output-file ConvertToBin.out,
+compare-to ConvertToBin.cmp,
+output-list RAM[8001]%D2.6.1 RAM[8002]%D2.6.1 RAM[8003]%D2.6.1 RAM[8004]%D2.6.1 RAM[8005]%D2.6.1 RAM[8006]%D2.6.1 RAM[8007]%D2.6.1 RAM[8008]%D2.6.1 RAM[8009]%D2.6.1 RAM[8010]%D2.6.1 RAM[8011]%D2.6.1 RAM[8012]%D2.6.1 RAM[8013]%D2.6.1 RAM[8014]%D2.6.1 RAM[8015]%D2.6.1 RAM[8016]%D2.6.1;
+
+set RAM[8000] 21931,
+
+repeat 1000000 {
+  vmstep;
+}
+
+output;
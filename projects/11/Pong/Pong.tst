@@ -0,0 +1,20 @@
+// Leaves the bat where it starts until the ball gets past it. The output is the score at the
+// bottom of the screen, and Game Over in the middle. The game ends after about 48000 steps on
+// the builtins and 10 million on the compiled OS.
+
+load,
+output-file Pong.out,
+compare-to Pong.cmp,
+
+repeat 50000000 {
+  vmstep;
+}
+
+output-list RAM[24163]%D2.6.2 RAM[24164]%D2.6.2 RAM[24195]%D2.6.2 RAM[24196]%D2.6.2 RAM[24227]%D2.6.2 RAM[24228]%D2.6.2 RAM[24259]%D2.6.2 RAM[24260]%D2.6.2 RAM[24291]%D2.6.2 RAM[24292]%D2.6.2 RAM[24323]%D2.6.2 RAM[24324]%D2.6.2 RAM[24355]%D2.6.2 RAM[24356]%D2.6.2 RAM[24387]%D2.6.2 RAM[24388]%D2.6.2 RAM[24419]%D2.6.2 RAM[24420]%D2.6.2 RAM[24451]%D2.6.2 RAM[24452]%D2.6.2 RAM[24483]%D2.6.2 RAM[24484]%D2.6.2;
+output;
+
+output-list RAM[19949]%D2.6.2 RAM[19950]%D2.6.2 RAM[19951]%D2.6.2 RAM[19952]%D2.6.2 RAM[19953]%D2.6.2 RAM[19981]%D2.6.2 RAM[19982]%D2.6.2 RAM[19983]%D2.6.2 RAM[19984]%D2.6.2 RAM[19985]%D2.6.2 RAM[20013]%D2.6.2 RAM[20014]%D2.6.2 RAM[20015]%D2.6.2 RAM[20016]%D2.6.2 RAM[20017]%D2.6.2 RAM[20045]%D2.6.2 RAM[20046]%D2.6.2 RAM[20047]%D2.6.2 RAM[20048]%D2.6.2 RAM[20049]%D2.6.2 RAM[20077]%D2.6.2 RAM[20078]%D2.6.2 RAM[20079]%D2.6.2 RAM[20080]%D2.6.2 RAM[20081]%D2.6.2 RAM[20109]%D2.6.2 RAM[20110]%D2.6.2 RAM[20111]%D2.6.2 RAM[20112]%D2.6.2 RAM[20113]%D2.6.2 RAM[20141]%D2.6.2 RAM[20142]%D2.6.2 RAM[20143]%D2.6.2 RAM[20144]%D2.6.2 RAM[20145]%D2.6.2 RAM[20173]%D2.6.2 RAM[20174]%D2.6.2 RAM[20175]%D2.6.2 RAM[20176]%D2.6.2 RAM[20177]%D2.6.2 RAM[20205]%D2.6.2 RAM[20206]%D2.6.2 RAM[20207]%D2.6.2 RAM[20208]%D2.6.2;
+output;
+
+output-list RAM[20209]%D2.6.2 RAM[20237]%D2.6.2 RAM[20238]%D2.6.2 RAM[20239]%D2.6.2 RAM[20240]%D2.6.2 RAM[20241]%D2.6.2 RAM[20269]%D2.6.2 RAM[20270]%D2.6.2 RAM[20271]%D2.6.2 RAM[20272]%D2.6.2 RAM[20273]%D2.6.2;
+output;
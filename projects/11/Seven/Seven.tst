@@ -0,0 +1,12 @@
+// Prints 7 at the top left of the screen. The output is the first character's pixel rows.
+
+load,
+output-file Seven.out,
+compare-to Seven.cmp,
+output-list RAM[16384]%D2.6.2 RAM[16416]%D2.6.2 RAM[16448]%D2.6.2 RAM[16480]%D2.6.2 RAM[16512]%D2.6.2 RAM[16544]%D2.6.2 RAM[16576]%D2.6.2 RAM[16608]%D2.6.2 RAM[16640]%D2.6.2 RAM[16672]%D2.6.2 RAM[16704]%D2.6.2 RAM[16736]%D2.6.2;
+
+repeat 1000000 {
+  vmstep;
+}
+
+output;
@@ -0,0 +1,41 @@
+// Sends the square right and then down with the arrow keys, where it keeps going until it
+// stops in the bottom right corner. The output is the rows above, along the top, along the
+// bottom and below the square, the last 64 pixels of each.
+// Each key is held past the compiled OS's start up, about 600000 steps, and every budget
+// leaves the compiled OS several times what it needs, so runs on it pass as well.
+
+load,
+output-file Square.out,
+compare-to Square.cmp,
+
+set RAM[24576] 132,
+repeat 2000000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 10000000 {
+  vmstep;
+}
+
+set RAM[24576] 133,
+repeat 2000000 {
+  vmstep;
+}
+
+set RAM[24576] 0,
+repeat 10000000 {
+  vmstep;
+}
+
+output-list RAM[23548]%D2.6.2 RAM[23549]%D2.6.2 RAM[23550]%D2.6.2 RAM[23551]%D2.6.2;
+output;
+
+output-list RAM[23580]%D2.6.2 RAM[23581]%D2.6.2 RAM[23582]%D2.6.2 RAM[23583]%D2.6.2;
+output;
+
+output-list RAM[24540]%D2.6.2 RAM[24541]%D2.6.2 RAM[24542]%D2.6.2 RAM[24543]%D2.6.2;
+output;
+
+output-list RAM[24572]%D2.6.2 RAM[24573]%D2.6.2 RAM[24574]%D2.6.2 RAM[24575]%D2.6.2;
+output;
@@ -0,0 +1,31 @@
+// Draws the house and the sun. The output is the sun, rows 30 to 90 from x 96 to 175 with the
+// circle and the ends of its rays, then the door handle, a circle of radius 3 at 360,170.
+
+load,
+output-file ScreenTest.out,
+compare-to ScreenTest.cmp,
+
+repeat 20000000 {
+  vmstep;
+}
+
+output-list RAM[17350]%D2.6.2 RAM[17351]%D2.6.2 RAM[17352]%D2.6.2 RAM[17353]%D2.6.2 RAM[17354]%D2.6.2 RAM[17382]%D2.6.2 RAM[17383]%D2.6.2 RAM[17384]%D2.6.2 RAM[17385]%D2.6.2 RAM[17386]%D2.6.2 RAM[17414]%D2.6.2 RAM[17415]%D2.6.2 RAM[17416]%D2.6.2 RAM[17417]%D2.6.2 RAM[17418]%D2.6.2 RAM[17446]%D2.6.2 RAM[17447]%D2.6.2 RAM[17448]%D2.6.2 RAM[17449]%D2.6.2 RAM[17450]%D2.6.2 RAM[17478]%D2.6.2 RAM[17479]%D2.6.2 RAM[17480]%D2.6.2 RAM[17481]%D2.6.2 RAM[17482]%D2.6.2 RAM[17510]%D2.6.2 RAM[17511]%D2.6.2 RAM[17512]%D2.6.2 RAM[17513]%D2.6.2 RAM[17514]%D2.6.2 RAM[17542]%D2.6.2 RAM[17543]%D2.6.2 RAM[17544]%D2.6.2 RAM[17545]%D2.6.2 RAM[17546]%D2.6.2 RAM[17574]%D2.6.2 RAM[17575]%D2.6.2 RAM[17576]%D2.6.2 RAM[17577]%D2.6.2 RAM[17578]%D2.6.2 RAM[17606]%D2.6.2 RAM[17607]%D2.6.2 RAM[17608]%D2.6.2 RAM[17609]%D2.6.2 RAM[17610]%D2.6.2 RAM[17638]%D2.6.2 RAM[17639]%D2.6.2 RAM[17640]%D2.6.2 RAM[17641]%D2.6.2 RAM[17642]%D2.6.2 RAM[17670]%D2.6.2 RAM[17671]%D2.6.2 RAM[17672]%D2.6.2 RAM[17673]%D2.6.2 RAM[17674]%D2.6.2 RAM[17702]%D2.6.2 RAM[17703]%D2.6.2 RAM[17704]%D2.6.2 RAM[17705]%D2.6.2 RAM[17706]%D2.6.2;
+output;
+
+output-list RAM[17734]%D2.6.2 RAM[17735]%D2.6.2 RAM[17736]%D2.6.2 RAM[17737]%D2.6.2 RAM[17738]%D2.6.2 RAM[17766]%D2.6.2 RAM[17767]%D2.6.2 RAM[17768]%D2.6.2 RAM[17769]%D2.6.2 RAM[17770]%D2.6.2 RAM[17798]%D2.6.2 RAM[17799]%D2.6.2 RAM[17800]%D2.6.2 RAM[17801]%D2.6.2 RAM[17802]%D2.6.2 RAM[17830]%D2.6.2 RAM[17831]%D2.6.2 RAM[17832]%D2.6.2 RAM[17833]%D2.6.2 RAM[17834]%D2.6.2 RAM[17862]%D2.6.2 RAM[17863]%D2.6.2 RAM[17864]%D2.6.2 RAM[17865]%D2.6.2 RAM[17866]%D2.6.2 RAM[17894]%D2.6.2 RAM[17895]%D2.6.2 RAM[17896]%D2.6.2 RAM[17897]%D2.6.2 RAM[17898]%D2.6.2 RAM[17926]%D2.6.2 RAM[17927]%D2.6.2 RAM[17928]%D2.6.2 RAM[17929]%D2.6.2 RAM[17930]%D2.6.2 RAM[17958]%D2.6.2 RAM[17959]%D2.6.2 RAM[17960]%D2.6.2 RAM[17961]%D2.6.2 RAM[17962]%D2.6.2 RAM[17990]%D2.6.2 RAM[17991]%D2.6.2 RAM[17992]%D2.6.2 RAM[17993]%D2.6.2 RAM[17994]%D2.6.2 RAM[18022]%D2.6.2 RAM[18023]%D2.6.2 RAM[18024]%D2.6.2 RAM[18025]%D2.6.2 RAM[18026]%D2.6.2 RAM[18054]%D2.6.2 RAM[18055]%D2.6.2 RAM[18056]%D2.6.2 RAM[18057]%D2.6.2 RAM[18058]%D2.6.2 RAM[18086]%D2.6.2 RAM[18087]%D2.6.2 RAM[18088]%D2.6.2 RAM[18089]%D2.6.2 RAM[18090]%D2.6.2;
+output;
+
+output-list RAM[18118]%D2.6.2 RAM[18119]%D2.6.2 RAM[18120]%D2.6.2 RAM[18121]%D2.6.2 RAM[18122]%D2.6.2 RAM[18150]%D2.6.2 RAM[18151]%D2.6.2 RAM[18152]%D2.6.2 RAM[18153]%D2.6.2 RAM[18154]%D2.6.2 RAM[18182]%D2.6.2 RAM[18183]%D2.6.2 RAM[18184]%D2.6.2 RAM[18185]%D2.6.2 RAM[18186]%D2.6.2 RAM[18214]%D2.6.2 RAM[18215]%D2.6.2 RAM[18216]%D2.6.2 RAM[18217]%D2.6.2 RAM[18218]%D2.6.2 RAM[18246]%D2.6.2 RAM[18247]%D2.6.2 RAM[18248]%D2.6.2 RAM[18249]%D2.6.2 RAM[18250]%D2.6.2 RAM[18278]%D2.6.2 RAM[18279]%D2.6.2 RAM[18280]%D2.6.2 RAM[18281]%D2.6.2 RAM[18282]%D2.6.2 RAM[18310]%D2.6.2 RAM[18311]%D2.6.2 RAM[18312]%D2.6.2 RAM[18313]%D2.6.2 RAM[18314]%D2.6.2 RAM[18342]%D2.6.2 RAM[18343]%D2.6.2 RAM[18344]%D2.6.2 RAM[18345]%D2.6.2 RAM[18346]%D2.6.2 RAM[18374]%D2.6.2 RAM[18375]%D2.6.2 RAM[18376]%D2.6.2 RAM[18377]%D2.6.2 RAM[18378]%D2.6.2 RAM[18406]%D2.6.2 RAM[18407]%D2.6.2 RAM[18408]%D2.6.2 RAM[18409]%D2.6.2 RAM[18410]%D2.6.2 RAM[18438]%D2.6.2 RAM[18439]%D2.6.2 RAM[18440]%D2.6.2 RAM[18441]%D2.6.2 RAM[18442]%D2.6.2 RAM[18470]%D2.6.2 RAM[18471]%D2.6.2 RAM[18472]%D2.6.2 RAM[18473]%D2.6.2 RAM[18474]%D2.6.2;
+output;
+
+output-list RAM[18502]%D2.6.2 RAM[18503]%D2.6.2 RAM[18504]%D2.6.2 RAM[18505]%D2.6.2 RAM[18506]%D2.6.2 RAM[18534]%D2.6.2 RAM[18535]%D2.6.2 RAM[18536]%D2.6.2 RAM[18537]%D2.6.2 RAM[18538]%D2.6.2 RAM[18566]%D2.6.2 RAM[18567]%D2.6.2 RAM[18568]%D2.6.2 RAM[18569]%D2.6.2 RAM[18570]%D2.6.2 RAM[18598]%D2.6.2 RAM[18599]%D2.6.2 RAM[18600]%D2.6.2 RAM[18601]%D2.6.2 RAM[18602]%D2.6.2 RAM[18630]%D2.6.2 RAM[18631]%D2.6.2 RAM[18632]%D2.6.2 RAM[18633]%D2.6.2 RAM[18634]%D2.6.2 RAM[18662]%D2.6.2 RAM[18663]%D2.6.2 RAM[18664]%D2.6.2 RAM[18665]%D2.6.2 RAM[18666]%D2.6.2 RAM[18694]%D2.6.2 RAM[18695]%D2.6.2 RAM[18696]%D2.6.2 RAM[18697]%D2.6.2 RAM[18698]%D2.6.2 RAM[18726]%D2.6.2 RAM[18727]%D2.6.2 RAM[18728]%D2.6.2 RAM[18729]%D2.6.2 RAM[18730]%D2.6.2 RAM[18758]%D2.6.2 RAM[18759]%D2.6.2 RAM[18760]%D2.6.2 RAM[18761]%D2.6.2 RAM[18762]%D2.6.2 RAM[18790]%D2.6.2 RAM[18791]%D2.6.2 RAM[18792]%D2.6.2 RAM[18793]%D2.6.2 RAM[18794]%D2.6.2 RAM[18822]%D2.6.2 RAM[18823]%D2.6.2 RAM[18824]%D2.6.2 RAM[18825]%D2.6.2 RAM[18826]%D2.6.2 RAM[18854]%D2.6.2 RAM[18855]%D2.6.2 RAM[18856]%D2.6.2 RAM[18857]%D2.6.2 RAM[18858]%D2.6.2;
+output;
+
+output-list RAM[18886]%D2.6.2 RAM[18887]%D2.6.2 RAM[18888]%D2.6.2 RAM[18889]%D2.6.2 RAM[18890]%D2.6.2 RAM[18918]%D2.6.2 RAM[18919]%D2.6.2 RAM[18920]%D2.6.2 RAM[18921]%D2.6.2 RAM[18922]%D2.6.2 RAM[18950]%D2.6.2 RAM[18951]%D2.6.2 RAM[18952]%D2.6.2 RAM[18953]%D2.6.2 RAM[18954]%D2.6.2 RAM[18982]%D2.6.2 RAM[18983]%D2.6.2 RAM[18984]%D2.6.2 RAM[18985]%D2.6.2 RAM[18986]%D2.6.2 RAM[19014]%D2.6.2 RAM[19015]%D2.6.2 RAM[19016]%D2.6.2 RAM[19017]%D2.6.2 RAM[19018]%D2.6.2 RAM[19046]%D2.6.2 RAM[19047]%D2.6.2 RAM[19048]%D2.6.2 RAM[19049]%D2.6.2 RAM[19050]%D2.6.2 RAM[19078]%D2.6.2 RAM[19079]%D2.6.2 RAM[19080]%D2.6.2 RAM[19081]%D2.6.2 RAM[19082]%D2.6.2 RAM[19110]%D2.6.2 RAM[19111]%D2.6.2 RAM[19112]%D2.6.2 RAM[19113]%D2.6.2 RAM[19114]%D2.6.2 RAM[19142]%D2.6.2 RAM[19143]%D2.6.2 RAM[19144]%D2.6.2 RAM[19145]%D2.6.2 RAM[19146]%D2.6.2 RAM[19174]%D2.6.2 RAM[19175]%D2.6.2 RAM[19176]%D2.6.2 RAM[19177]%D2.6.2 RAM[19178]%D2.6.2 RAM[19206]%D2.6.2 RAM[19207]%D2.6.2 RAM[19208]%D2.6.2 RAM[19209]%D2.6.2 RAM[19210]%D2.6.2 RAM[19238]%D2.6.2 RAM[19239]%D2.6.2 RAM[19240]%D2.6.2 RAM[19241]%D2.6.2 RAM[19242]%D2.6.2;
+output;
+
+output-list RAM[19270]%D2.6.2 RAM[19271]%D2.6.2 RAM[19272]%D2.6.2 RAM[19273]%D2.6.2 RAM[19274]%D2.6.2;
+output;
+
+output-list RAM[21750]%D2.6.2 RAM[21782]%D2.6.2 RAM[21814]%D2.6.2 RAM[21846]%D2.6.2 RAM[21878]%D2.6.2 RAM[21910]%D2.6.2 RAM[21942]%D2.6.2;
+output;
@@ -0,0 +1,14 @@
+@echo off
+
+rem Every .tst script under projects, with the OS on native builtins and then compiled
+toolchain\bin\Release\testrunner.exe projects || exit /b 1
+toolchain\bin\Release\testrunner.exe -os tools\OS projects\11 projects\12 || exit /b 1
+
+rem Every VM program on the VM interpreter and, translated, on the Hack CPU, compared as they run.
+rem projects\12 is the OS for the tests under it.
+toolchain\bin\Release\vmdiff.exe -os tools\OS projects\07 projects\08 projects\11 || exit /b 1
+toolchain\bin\Release\vmdiff.exe projects\12 || exit /b 1
+
+rem Every rom, assembled or translated, built to native code through hack2c and compared with the
+rem Hack emulator. Needs a C compiler that takes -o, clang comes with Visual Studio.
+toolchain\bin\Release\vmdiff.exe -hack2c clang projects\06 projects\07 projects\08 || exit /b 1
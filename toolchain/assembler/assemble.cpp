@@ -0,0 +1,753 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "assemble.h"
+#include "../common/textscan.h"
+
+// Everything but the functions in assemble.h stays local so the assembler can be linked into other tools
+namespace
+{
+
+bool isDigit(char v)
+{
+    return v >= '0' && v <= '9';
+}
+
+bool isWhitespace(char v)
+{
+    return v <= ' ' && v > 0;
+}
+
+bool isEOL(char v)
+{
+    return v == '\r' || v == '\n';
+}
+
+int toDigit(char v)
+{
+    return v - '0';
+}
+
+enum Jump {
+    JMP_NONE = 0,
+    JMP_GT,
+    JMP_EQ,
+    JMP_GE,
+    JMP_LT,
+    JMP_NE,
+    JMP_LE,
+    JMP_ALL,
+};
+
+enum Type
+{
+    L_INSTRUCTION,
+    A_INSTRUCTION,
+    C_INSTRUCTION
+};
+
+struct Command {
+    Type type;
+    char* text;
+    int length;
+    int value;
+};
+
+struct Symbol {
+    const char* text;
+    int length;
+    int value;
+};
+
+// A power of two
+#define SYMBOL_BUCKETS 65536
+#define MAX_SYMBOLS 32000
+
+struct SymbolTable
+{
+    int count;
+    Symbol symbols[MAX_SYMBOLS];
+
+    // Everything pushed with a length owns a copy of its text
+    bool owned[MAX_SYMBOLS];
+
+    // Symbol index + 1 of the first symbol with each hash and of the next one after each
+    // symbol, so a lookup doesn't compare against every label of a big program
+    int buckets[SYMBOL_BUCKETS];
+    int next[MAX_SYMBOLS];
+
+    static unsigned Hash(const char* text, int length)
+    {
+        unsigned hash = 2166136261u;
+        for (int i = 0; i < length; ++i)
+        {
+            hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+        }
+
+        return hash & (SYMBOL_BUCKETS - 1);
+    }
+
+    void Link()
+    {
+        Symbol* symbol = symbols + count;
+        unsigned hash = Hash(symbol->text, symbol->length);
+        next[count] = buckets[hash];
+        buckets[hash] = ++count;
+    }
+
+    void Push(const char* text, int value)
+    {
+        symbols[count] = { text, (int)strlen(text), value };
+        Link();
+    }
+
+    void Push(const char* text, int length, int value)
+    {
+        char* newText = (char*)malloc(length + 1);
+        strncpy(newText, text, length);
+        newText[length] = 0;
+        owned[count] = true;
+        symbols[count] = { newText, length, value };
+        Link();
+    }
+
+    void Free()
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            if (owned[i])
+            {
+                free((void*)symbols[i].text);
+            }
+        }
+
+        free(this);
+    }
+
+    Symbol* Find(const char* text, int length)
+    {
+        for (int i = buckets[Hash(text, length)]; i; i = next[i - 1])
+        {
+            Symbol* symbol = symbols + i - 1;
+            if (symbol->length == length && memcmp(symbol->text, text, length) == 0)
+            {
+                return symbol;
+            }
+        }
+
+        return 0;
+    }
+};
+
+struct Parser {
+    char* At;
+};
+
+// A program being assembled: the symbols found so far and every instruction, with the
+// symbols that weren't known yet when their instruction was read left as text
+struct Assembly
+{
+    SymbolTable* symbols;
+    Command* commands;
+    int numCommands;
+
+    // What AssembleSource reads, for error positions. The encoder's lines don't outlive the
+    // call, so without a source the commands own copies of their symbols.
+    char* source;
+};
+
+void StartAssembly(Assembly* assembly, char* source)
+{
+    // Far too big for the stack of a worker thread
+    SymbolTable& symbols = *(SymbolTable*)calloc(1, sizeof(SymbolTable));
+    symbols.Push("SP", 0);
+    symbols.Push("LCL", 1);
+    symbols.Push("ARG", 2);
+    symbols.Push("THIS", 3);
+    symbols.Push("THAT", 4);
+    symbols.Push("R0", 0);
+    symbols.Push("R1", 1);
+    symbols.Push("R2", 2);
+    symbols.Push("R3", 3);
+    symbols.Push("R4", 4);
+    symbols.Push("R5", 5);
+    symbols.Push("R6", 6);
+    symbols.Push("R7", 7);
+    symbols.Push("R8", 8);
+    symbols.Push("R9", 9);
+    symbols.Push("R10", 10);
+    symbols.Push("R11", 11);
+    symbols.Push("R12", 12);
+    symbols.Push("R13", 13);
+    symbols.Push("R14", 14);
+    symbols.Push("R15", 15);
+    symbols.Push("SCREEN", 0x4000);
+    symbols.Push("KBD", 0x6000);
+
+    assembly->symbols = &symbols;
+    // Zeroed, the duplicate checks below read the slot after the last command
+    assembly->commands = (Command*)calloc(100000, sizeof(Command));
+    assembly->numCommands = 0;
+    assembly->source = source;
+}
+
+void FreeAssembly(Assembly* assembly)
+{
+    if (!assembly->source)
+    {
+        for (int i = 0; i < assembly->numCommands; ++i)
+        {
+            free(assembly->commands[i].text);
+        }
+    }
+
+    assembly->symbols->Free();
+    free(assembly->commands);
+}
+
+// Reads the instruction or label At points to, leaving At at the end of its line. Returns
+// false on a label that's already defined.
+bool AssembleLine(Assembly* assembly, char*& At)
+{
+    SymbolTable& symbols = *assembly->symbols;
+    Command* commands = assembly->commands;
+    int& numCommands = assembly->numCommands;
+
+    if (*At == '@')
+    {
+        Command command = {};
+        command.type = A_INSTRUCTION;
+
+        ++At;
+
+        // Constant
+        if (isDigit(*At))
+        {
+            do
+            {
+                command.value *= 10;
+                command.value += toDigit(*At++);
+            } while (isDigit(*At));
+        }
+        // symbol
+        else
+        {
+            char* firstChar = At;
+            while (!isWhitespace(*At))
+            {
+                ++At;
+            }
+
+            int length = At - firstChar;
+            Symbol* existingSymbol = symbols.Find(firstChar, length);
+            if (existingSymbol)
+            {
+                command.value = existingSymbol->value;
+            }
+            else
+            {
+                command.text = firstChar;
+                command.length = length;
+                if (!assembly->source)
+                {
+                    command.text = (char*)malloc(length);
+                    memcpy(command.text, firstChar, length);
+                }
+            }
+        }
+
+        At = FindLineEnd(At);
+
+        if (numCommands > 0)
+        {
+            Command lastCommand = commands[numCommands];
+            if (lastCommand.type == command.type &&
+                lastCommand.length == command.length &&
+                lastCommand.text == command.text &&
+                lastCommand.value == command.value)
+            {
+                printf("Duplicate Command\n");
+            }
+        }
+
+        commands[numCommands++] = command;
+    }
+    else if (*At == '(')
+    {
+        char* firstChar = At + 1;
+        while (!isWhitespace(*At) && *At != ')')
+        {
+            ++At;
+        }
+
+        int length = At - firstChar;
+        Symbol* existingSymbol = symbols.Find(firstChar, length);
+        if (existingSymbol)
+        {
+            if (assembly->source)
+            {
+                printf("Duplicate Symbol, chars %d\n", (int)(firstChar - assembly->source));
+            }
+            else
+            {
+                printf("Duplicate Symbol %.*s\n", length, firstChar);
+            }
+
+            return false;
+        }
+        else
+        {
+            symbols.Push(firstChar, length, numCommands);
+        }
+
+        At = FindLineEnd(At);
+    }
+    else
+    {
+        // C instruction
+        // destination=computation;jump
+
+        char* firstPart = At;
+        while (*At
+            && *At != '='
+            && *At != ';'
+            && !isEOL(*At))
+        {
+            ++At;
+        }
+
+        int dest = 0;
+        Jump jump = JMP_NONE;
+
+        if (*At == '=')
+        {
+            // dest portion
+            while (firstPart < At)
+            {
+                switch (*firstPart)
+                {
+                case 'D':
+                    dest |= 0b010;
+                    break;
+
+                case 'M':
+                    dest |= 0b001;
+                    break;
+
+                case 'A':
+                    dest |= 0b100;
+                    break;
+                }
+
+                ++firstPart;
+            }
+
+            ++At;
+            firstPart = At;
+
+            while (*At && *At != ';' && !isEOL(*At))
+            {
+                ++At;
+            }
+        }
+
+        int comp = -1;
+
+        // process command
+        if (*firstPart == '0')
+        {
+            comp = 0b101010;
+        }
+        else if (*firstPart == '1')
+        {
+            comp = 0b111111;
+        }
+        else if (*firstPart == '!')
+        {
+            ++firstPart;
+            if (*firstPart == 'M')
+            {
+                comp = 0b1110001;
+            }
+            else if (*firstPart == 'A')
+            {
+                comp = 0b0110001;
+            }
+            else if (*firstPart == 'D')
+            {
+                comp = 0b0001101;
+            }
+        }
+        else if (*firstPart == '-')
+        {
+            ++firstPart;
+            if (*firstPart == 'M')
+            {
+                comp = 0b1110011;
+            }
+            else if (*firstPart == 'A')
+            {
+                comp = 0b0110011;
+            }
+            else if (*firstPart == 'D')
+            {
+                comp = 0b0001111;
+            }
+            else if (*firstPart == '1')
+            {
+                comp = 0b0111010;
+            }
+        }
+        else if (*firstPart == 'M')
+        {
+            ++firstPart;
+            if (*firstPart == '+')
+            {
+                ++firstPart;
+                if (*firstPart == 'D')
+                {
+                    comp = 0b1000010;
+                }
+                else if (*firstPart == '1')
+                {
+                    comp = 0b1110111;
+                }
+            }
+            else if (*firstPart == '-')
+            {
+                ++firstPart;
+                if (*firstPart == 'D')
+                {
+                    comp = 0b1000111;
+                }
+                else if (*firstPart == '1')
+                {
+                    comp = 0b1110010;
+                }
+            }
+            else if (*firstPart == '&')
+            {
+                comp = 0b1000000;
+            }
+            else if (*firstPart == '|')
+            {
+                comp = 0b1010101;
+            }
+            else
+            {
+                comp = 0b1110000;
+            }
+        }
+        else if (*firstPart == 'D')
+        {
+            ++firstPart;
+            if (*firstPart == '+')
+            {
+                ++firstPart;
+                if (*firstPart == 'M')
+                {
+                    comp = 0b1000010;
+                }
+                else if (*firstPart == 'A')
+                {
+                    comp = 0b0000010;
+                }
+                else if (*firstPart == '1')
+                {
+                    comp = 0b0011111;
+                }
+            }
+            else if (*firstPart == '-')
+            {
+                ++firstPart;
+                if (*firstPart == 'M')
+                {
+                    comp = 0b1010011;
+                }
+                else if (*firstPart == 'A')
+                {
+                    comp = 0b0010011;
+                }
+                else if (*firstPart == '1')
+                {
+                    comp = 0b0001110;
+                }
+            }
+            else if (*firstPart == '&')
+            {
+                ++firstPart;
+                if (*firstPart == 'M')
+                {
+                    comp = 0b1000000;
+                }
+                else if (*firstPart == 'A')
+                {
+                    comp = 0b0000000;
+                }
+            }
+            else if (*firstPart == '|')
+            {
+                ++firstPart;
+                if (*firstPart == 'M')
+                {
+                    comp = 0b1010101;
+                }
+                else if (*firstPart == 'A')
+                {
+                    comp = 0b0010101;
+                }
+            }
+            else
+            {
+                comp = 0b0001100;
+            }
+        }
+        else if (*firstPart == 'A')
+        {
+            ++firstPart;
+            if (*firstPart == '+')
+            {
+                ++firstPart;
+                if (*firstPart == 'D')
+                {
+                    comp = 0b0000010;
+                }
+                else if (*firstPart == '1')
+                {
+                    comp = 0b0110111;
+                }
+            }
+            else if (*firstPart == '-')
+            {
+                ++firstPart;
+                if (*firstPart == 'D')
+                {
+                    comp = 0b0000111;
+                }
+                else if (*firstPart == '1')
+                {
+                    comp = 0b0110010;
+                }
+            }
+            else if (*firstPart == '&')
+            {
+                comp = 0b0000000;
+            }
+            else if (*firstPart == '|')
+            {
+                comp = 0b0010101;
+            }
+            else
+            {
+                comp = 0b0110000;
+            }
+        }
+
+        // Add jmp
+        if (*At == ';')
+        {
+            At++;
+
+            // The course's own Fill.asm writes "D; JEQ"
+            while (*At == ' ' || *At == '\t')
+            {
+                At++;
+            }
+
+            if (strncmp("JGT", At, 3) == 0)
+            {
+                jump = JMP_GT;
+            }
+            else if (strncmp("JEQ", At, 3) == 0)
+            {
+                jump = JMP_EQ;
+            }
+            else if (strncmp("JGE", At, 3) == 0)
+            {
+                jump = JMP_GE;
+            }
+            else if (strncmp("JLT", At, 3) == 0)
+            {
+                jump = JMP_LT;
+            }
+            else if (strncmp("JNE", At, 3) == 0)
+            {
+                jump = JMP_NE;
+            }
+            else if (strncmp("JLE", At, 3) == 0)
+            {
+                jump = JMP_LE;
+            }
+            else if (strncmp("JMP", At, 3) == 0)
+            {
+                jump = JMP_ALL;
+            }
+
+            At += 3;
+        }
+
+        Command command = {};
+        command.type = C_INSTRUCTION;
+        command.value = jump | (dest << 3) | (comp << 6) | (0b111 << 13);
+        if (numCommands > 0)
+        {
+            Command lastCommand = commands[numCommands];
+            if (lastCommand.type == command.type &&
+                lastCommand.length == command.length &&
+                lastCommand.text == command.text &&
+                lastCommand.value == command.value)
+            {
+                printf("Duplicate Command\n");
+            }
+        }
+
+        At = FindLineEnd(At);
+
+        commands[numCommands++] = command;
+    }
+
+    return true;
+}
+
+// Gives every symbol still unknown the next variable address and writes out the words
+char* FinishAssembly(Assembly* assembly, long* outputSize, char** variables)
+{
+    SymbolTable& symbols = *assembly->symbols;
+    Command* commands = assembly->commands;
+    int numCommands = assembly->numCommands;
+
+    long outSize = numCommands * 17 + 1;
+    char* output = (char*)malloc(outSize);
+    *outputSize = 0;
+
+    int variable = 16;
+    int firstVariable = symbols.count;
+    for (int i = 0; i < numCommands; ++i)
+    {
+        Command command = commands[i];
+        int value = command.value;
+        if (command.type == A_INSTRUCTION && command.text)
+        {
+            Symbol* existingSymbol = symbols.Find(command.text, command.length);
+            if (existingSymbol)
+            {
+                value = existingSymbol->value;
+            }
+            else
+            {
+                value = variable++;
+                symbols.Push(command.text, command.length, value);
+            }
+        }
+
+        for (int shift = 15; shift >= 0; --shift)
+        {
+            if (((value >> shift) & 1) > 0)
+            {
+                output[(*outputSize)++] = '1';
+            }
+            else
+            {
+                output[(*outputSize)++] = '0';
+            }
+        }
+
+        output[(*outputSize)++] = '\n';
+    }
+
+    output[*outputSize] = 0;
+
+    if (variables)
+    {
+        // Every symbol pushed since the labels is a variable, in address order
+        long listSize = 1;
+        for (int i = firstVariable; i < symbols.count; ++i)
+        {
+            listSize += symbols.symbols[i].length + 8;
+        }
+
+        *variables = (char*)malloc(listSize);
+        char* listAt = *variables;
+        *listAt = 0;
+        for (int i = firstVariable; i < symbols.count; ++i)
+        {
+            listAt += sprintf(listAt, "%s %d\n", symbols.symbols[i].text, symbols.symbols[i].value);
+        }
+    }
+
+    FreeAssembly(assembly);
+    return output;
+}
+
+}
+
+struct HackEncoder
+{
+    Assembly assembly;
+    bool failed;
+};
+
+char* AssembleSource(char* source, long* outputSize, char** variables)
+{
+    // Eat any leading whitespace
+    char* At = SkipWhitespace(source);
+
+    Assembly assembly;
+    StartAssembly(&assembly, source);
+
+    int lineNumber = 1;
+
+    while (*At)
+    {
+        // Process comment, TODO: handle syntax error of a single /
+        if (*(At + 1) == '/' && *At == '/')
+        {
+            At = FindLineEnd(At + 2);
+            ++lineNumber;
+        }
+        else if (!AssembleLine(&assembly, At))
+        {
+            FreeAssembly(&assembly);
+            return 0;
+        }
+
+        // Eat any remaining whitespace to next command
+        At = SkipWhitespace(At);
+    }
+
+    return FinishAssembly(&assembly, outputSize, variables);
+}
+
+HackEncoder* CreateEncoder()
+{
+    HackEncoder* encoder = (HackEncoder*)calloc(1, sizeof(HackEncoder));
+    StartAssembly(&encoder->assembly, 0);
+    return encoder;
+}
+
+bool EncodeLine(HackEncoder* encoder, char* line)
+{
+    if (!AssembleLine(&encoder->assembly, line))
+    {
+        encoder->failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+char* FinishEncoder(HackEncoder* encoder, long* outputSize, char** variables)
+{
+    char* output = 0;
+    if (encoder->failed)
+    {
+        FreeAssembly(&encoder->assembly);
+    }
+    else
+    {
+        output = FinishAssembly(&encoder->assembly, outputSize, variables);
+    }
+
+    free(encoder);
+    return output;
+}
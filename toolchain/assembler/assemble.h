@@ -0,0 +1,22 @@
+#pragma once
+
+// Assembles null terminated Hack assembly into the text .hack format, one 16 character
+// binary word per line, null terminated. Returns a malloc'd buffer the caller frees, or 0 on an error.
+// When variables is set it also gets a malloc'd, null terminated list of the ram addresses given
+// to variables, one "name address" per line.
+char* AssembleSource(char* source, long* outputSize, char** variables = 0);
+
+// Assembles a program handed over a line at a time, for tools that generate the assembly and
+// have no use for it as text. The lines are the same as AssembleSource reads, one instruction
+// or label each ending in a newline, but without comments or surrounding whitespace.
+struct HackEncoder;
+
+HackEncoder* CreateEncoder();
+
+// The line only needs to live until the call returns. Returns false on a label that's already
+// defined, which fails the whole program.
+bool EncodeLine(HackEncoder* encoder, char* line);
+
+// Gives the symbols still unknown their variable addresses and frees the encoder. Returns what
+// AssembleSource would for the same lines.
+char* FinishEncoder(HackEncoder* encoder, long* outputSize, char** variables = 0);
@@ -0,0 +1,347 @@
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "fileio.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define _stricmp strcasecmp
+#endif
+
+#define FILE_WRITER_BUFFER_SIZE (256 * 1024)
+
+static size_t PageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+bool FileView::Open(const char* path)
+{
+    *this = FileView();
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(handle, &fileSize);
+    size = (size_t)fileSize.QuadPart;
+    if (size % PageSize() != 0)
+    {
+        mapping = CreateFileMappingA(handle, 0, PAGE_WRITECOPY, 0, 0, 0);
+        text = mapping ? (char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0) : 0;
+        if (text)
+        {
+            file = handle;
+            mapped = true;
+            return true;
+        }
+
+        if (mapping)
+        {
+            CloseHandle(mapping);
+            mapping = 0;
+        }
+    }
+
+    CloseHandle(handle);
+#else
+    int handle = open(path, O_RDONLY);
+    struct stat info;
+    if (handle < 0 || fstat(handle, &info) != 0)
+    {
+        if (handle >= 0)
+        {
+            close(handle);
+        }
+
+        return false;
+    }
+
+    size = (size_t)info.st_size;
+    if (size % PageSize() != 0)
+    {
+        void* data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, handle, 0);
+        if (data != MAP_FAILED)
+        {
+            close(handle);
+            text = (char*)data;
+            mapped = true;
+            return true;
+        }
+    }
+
+    close(handle);
+#endif
+
+    // Empty, a whole number of pages with nowhere to put the null, or not something that maps
+    text = ReadWholeFile(path, &size);
+    return text != 0;
+}
+
+void FileView::Close()
+{
+    if (mapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(text);
+        CloseHandle(mapping);
+        CloseHandle(file);
+#else
+        munmap(text, size);
+#endif
+    }
+    else
+    {
+        free(text);
+    }
+
+    *this = FileView();
+}
+
+bool FileWriter::Open(const char* path)
+{
+    *this = FileWriter();
+    file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    // Everything is buffered here already
+    setvbuf(file, 0, _IONBF, 0);
+    buffer = (char*)malloc(FILE_WRITER_BUFFER_SIZE);
+    return true;
+}
+
+void FileWriter::Flush()
+{
+    if (used && fwrite(buffer, 1, used, file) != used)
+    {
+        failed = true;
+    }
+
+    used = 0;
+}
+
+void FileWriter::Write(const void* data, size_t size)
+{
+    if (used + size > FILE_WRITER_BUFFER_SIZE)
+    {
+        Flush();
+        if (size >= FILE_WRITER_BUFFER_SIZE)
+        {
+            if (fwrite(data, 1, size, file) != size)
+            {
+                failed = true;
+            }
+
+            return;
+        }
+    }
+
+    memcpy(buffer + used, data, size);
+    used += size;
+}
+
+void FileWriter::Print(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+
+    // Formatted straight into the buffer when there's room, which there nearly always is
+    va_list retry;
+    va_copy(retry, args);
+    size_t room = FILE_WRITER_BUFFER_SIZE - used;
+    int length = vsnprintf(buffer + used, room, format, args);
+    if (length >= 0 && (size_t)length < room)
+    {
+        used += length;
+    }
+    else if (length >= 0 && length < FILE_WRITER_BUFFER_SIZE)
+    {
+        Flush();
+        used = vsnprintf(buffer, FILE_WRITER_BUFFER_SIZE, format, retry);
+    }
+    else if (length >= 0)
+    {
+        char* text = (char*)malloc(length + 1);
+        vsnprintf(text, length + 1, format, retry);
+        Write(text, length);
+        free(text);
+    }
+    else
+    {
+        failed = true;
+    }
+
+    va_end(retry);
+    va_end(args);
+}
+
+bool FileWriter::Close()
+{
+    if (!file)
+    {
+        return false;
+    }
+
+    Flush();
+    bool written = !failed && fclose(file) == 0;
+    free(buffer);
+    *this = FileWriter();
+    return written;
+}
+
+char* ReadWholeFile(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* text = length >= 0 ? (char*)malloc(length + 1) : 0;
+    if (text && fread(text, 1, length, file) != (size_t)length)
+    {
+        free(text);
+        text = 0;
+    }
+
+    fclose(file);
+    if (text)
+    {
+        text[length] = 0;
+        *size = (size_t)length;
+    }
+
+    return text;
+}
+
+bool WriteWholeFile(const char* path, const void* data, size_t size)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    bool written = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+bool FormatPath(char* path, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(path, MAX_PATH, format, args);
+    va_end(args);
+    return length >= 0 && length < MAX_PATH;
+}
+
+bool IsDirectory(const char* path)
+{
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && ((attributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+#else
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+// The files or the folders in folder, leaving out "." and ".."
+static std::vector<std::string> ListEntries(const char* folder, bool folders, const char* extension)
+{
+    std::vector<std::string> names;
+    auto add = [&](const char* name, bool isFolder)
+    {
+        if (isFolder != folders || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        {
+            return;
+        }
+
+        const char* dot = strrchr(name, '.');
+        if (!extension || (dot && _stricmp(dot, extension) == 0))
+        {
+            names.push_back(name);
+        }
+    };
+
+#ifdef _WIN32
+    char searchPath[MAX_PATH];
+    if (snprintf(searchPath, sizeof(searchPath), "%s\\*", folder) >= (int)sizeof(searchPath))
+    {
+        return names;
+    }
+
+    WIN32_FIND_DATAA fdFile;
+    HANDLE hFind = FindFirstFileA(searchPath, &fdFile);
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            add(fdFile.cFileName, (fdFile.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+        }
+        while (FindNextFileA(hFind, &fdFile));
+
+        FindClose(hFind);
+    }
+#else
+    DIR* directory = opendir(folder);
+    if (directory)
+    {
+        std::string path;
+        while (dirent* entry = readdir(directory))
+        {
+            path = std::string(folder) + PATH_SEPARATOR + entry->d_name;
+            struct stat info;
+            if (stat(path.c_str(), &info) == 0)
+            {
+                add(entry->d_name, S_ISDIR(info.st_mode));
+            }
+        }
+
+        closedir(directory);
+    }
+#endif
+
+    std::sort(names.begin(), names.end(), [](const std::string& a, const std::string& b)
+    {
+        int order = _stricmp(a.c_str(), b.c_str());
+        return order ? order < 0 : a < b;
+    });
+
+    return names;
+}
+
+std::vector<std::string> ListFiles(const char* folder, const char* extension)
+{
+    return ListEntries(folder, false, extension);
+}
+
+std::vector<std::string> ListFolders(const char* folder)
+{
+    return ListEntries(folder, true, 0);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define PATH_SEPARATOR "\\"
+#else
+#define PATH_SEPARATOR "/"
+#endif
+
+#ifndef MAX_PATH
+#define MAX_PATH 260
+#endif
+
+// A whole file in memory followed by a null, so a tokenizer can scan it as one string. It's
+// mapped straight from the file when the last page has room left for the null, which the system
+// fills with zeroes, and read into memory of its own otherwise. Either way it's copy on write,
+// so text can be written to without changing the file. Open and Close are explicit: whatever
+// points into text has to be done with it by the time Close is called.
+struct FileView
+{
+    char* text = 0;
+    size_t size = 0;
+
+    /// <summary>
+    /// Maps or reads the file at path. Returns false, with nothing to close, if it can't be read.
+    /// </summary>
+    bool Open(const char* path);
+    void Close();
+
+    bool mapped = false;
+#ifdef _WIN32
+    void* file = 0;
+    void* mapping = 0;
+#endif
+};
+
+// Collects output in a large buffer and writes it in binary, so the file holds exactly the bytes
+// written, with the same line endings on every platform. Anything larger than the buffer goes
+// straight to the file without a copy.
+struct FileWriter
+{
+    FILE* file = 0;
+    char* buffer = 0;
+    size_t used = 0;
+
+    // Set by a write that didn't make it to the file, and reported by Close
+    bool failed = false;
+
+    /// <summary>
+    /// Creates or truncates the file at path. Returns false if it can't be opened for writing.
+    /// </summary>
+    bool Open(const char* path);
+    bool IsOpen() { return file != 0; }
+
+    void Write(const void* data, size_t size);
+    void Print(const char* format, ...);
+
+    /// <summary>
+    /// Writes out what's still buffered and closes the file. Returns false if any of the output
+    /// didn't get written.
+    /// </summary>
+    bool Close();
+
+    void Flush();
+};
+
+/// <summary>
+/// Reads the file at path into memory from malloc, null terminated, for input that's kept or
+/// freed by whoever reads it. Returns 0 if it can't be read.
+/// </summary>
+char* ReadWholeFile(const char* path, size_t* size);
+
+/// <summary>
+/// Writes size bytes to the file at path in one go. Returns false if it couldn't be written.
+/// </summary>
+bool WriteWholeFile(const char* path, const void* data, size_t size);
+
+/// <summary>
+/// Formats a path into a buffer of MAX_PATH characters. Returns false if it doesn't fit, with the
+/// path cut short.
+/// </summary>
+bool FormatPath(char* path, const char* format, ...);
+
+bool IsDirectory(const char* path);
+
+/// <summary>
+/// Lists the names of the files in folder, only those ending in extension if there is one.
+/// They're sorted ignoring case, the order Windows lists them in, so a folder is read in the
+/// same order on every platform.
+/// </summary>
+std::vector<std::string> ListFiles(const char* folder, const char* extension = 0);
+
+/// <summary>
+/// Lists the names of the folders in folder, in the same order as ListFiles.
+/// </summary>
+std::vector<std::string> ListFolders(const char* folder);
@@ -0,0 +1,210 @@
+#include <cstdint>
+#include "textscan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+#else
+#define SCAN_WIDTH 0
+#endif
+
+#if SCAN_WIDTH && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+
+// Control characters and the space, everything from 1 to ' '
+inline bool isWhitespace(char v)
+{
+    return (uint8_t)(v - 1) < ' ';
+}
+
+#if SCAN_WIDTH
+
+// One bit a byte of a block, the first byte in the lowest bit
+typedef uint32_t ScanMask;
+
+#if SCAN_WIDTH == 32
+#define ALL_BYTES 0xFFFFFFFFu
+
+typedef __m256i ScanBlock;
+
+inline ScanBlock LoadBlock(const char* block)
+{
+    return _mm256_load_si256((const __m256i*)block);
+}
+
+inline ScanMask BytesEqual(ScanBlock bytes, char v)
+{
+    return (ScanMask)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(v)));
+}
+
+inline ScanMask WhitespaceBytes(ScanBlock bytes)
+{
+    // One less, the null wraps around to 255 and everything from 1 to ' ' is at most 31
+    __m256i less = _mm256_sub_epi8(bytes, _mm256_set1_epi8(1));
+    return (ScanMask)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(less, _mm256_set1_epi8(31)), less));
+}
+#else
+#define ALL_BYTES 0xFFFFu
+
+typedef __m128i ScanBlock;
+
+inline ScanBlock LoadBlock(const char* block)
+{
+    return _mm_load_si128((const __m128i*)block);
+}
+
+inline ScanMask BytesEqual(ScanBlock bytes, char v)
+{
+    return (ScanMask)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(v)));
+}
+
+inline ScanMask WhitespaceBytes(ScanBlock bytes)
+{
+    __m128i less = _mm_sub_epi8(bytes, _mm_set1_epi8(1));
+    return (ScanMask)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(less, _mm_set1_epi8(31)), less));
+}
+#endif
+
+inline int FirstByte(ScanMask mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// The block At is in, and a mask without the bytes before At
+inline const char* BlockOf(const char* At, ScanMask* from)
+{
+    const char* block = (const char*)((uintptr_t)At & ~(uintptr_t)(SCAN_WIDTH - 1));
+    *from = (ALL_BYTES << (At - block)) & ALL_BYTES;
+    return block;
+}
+
+#endif
+
+}
+
+const char* ScanWhitespace(const char* At)
+{
+#if SCAN_WIDTH
+    ScanMask from;
+    const char* block = BlockOf(At, &from);
+    for (;;)
+    {
+        ScanMask stops = ~WhitespaceBytes(LoadBlock(block)) & from;
+        if (stops)
+        {
+            return block + FirstByte(stops);
+        }
+
+        block += SCAN_WIDTH;
+        from = ALL_BYTES;
+    }
+#else
+    while (isWhitespace(*At)) ++At;
+    return At;
+#endif
+}
+
+const char* FindLineEnd(const char* At)
+{
+#if SCAN_WIDTH
+    ScanMask from;
+    const char* block = BlockOf(At, &from);
+    for (;;)
+    {
+        ScanBlock bytes = LoadBlock(block);
+        ScanMask stops = (BytesEqual(bytes, '\n') | BytesEqual(bytes, '\r') | BytesEqual(bytes, 0)) & from;
+        if (stops)
+        {
+            return block + FirstByte(stops);
+        }
+
+        block += SCAN_WIDTH;
+        from = ALL_BYTES;
+    }
+#else
+    while (*At && *At != '\n' && *At != '\r') ++At;
+    return At;
+#endif
+}
+
+const char* FindCommentEnd(const char* At)
+{
+#if SCAN_WIDTH
+    ScanMask from;
+    const char* block = BlockOf(At, &from);
+
+    // Whether the last byte of the block before was a '*', for a "*/" split between two blocks
+    ScanMask starBefore = 0;
+    for (;;)
+    {
+        ScanBlock bytes = LoadBlock(block);
+        ScanMask stars = BytesEqual(bytes, '*') & from;
+        ScanMask ends = BytesEqual(bytes, '/') & ((stars << 1) | starBefore);
+        ScanMask nulls = BytesEqual(bytes, 0) & from;
+        if (ends | nulls)
+        {
+            // A '/' is found a byte after its '*'
+            int end = ends ? FirstByte(ends) - 1 : SCAN_WIDTH;
+            int null = nulls ? FirstByte(nulls) : SCAN_WIDTH;
+            return block + (end < null ? end : null);
+        }
+
+        starBefore = stars >> (SCAN_WIDTH - 1);
+        block += SCAN_WIDTH;
+        from = ALL_BYTES;
+    }
+#else
+    while (*At && !(At[0] == '*' && At[1] == '/')) ++At;
+    return At;
+#endif
+}
+
+int CountNewlines(const char* begin, const char* end)
+{
+    int count = 0;
+#if SCAN_WIDTH
+    if (begin >= end)
+    {
+        return 0;
+    }
+
+    // Every block read holds at least one byte of the range, so none is past the end of the input
+    ScanMask from;
+    const char* block = BlockOf(begin, &from);
+    for (; block < end; block += SCAN_WIDTH)
+    {
+        ScanMask newlines = BytesEqual(LoadBlock(block), '\n') & from;
+        if (end - block < SCAN_WIDTH)
+        {
+            newlines &= ~(ALL_BYTES << (end - block)) & ALL_BYTES;
+        }
+
+        for (; newlines; newlines &= newlines - 1)
+        {
+            ++count;
+        }
+
+        from = ALL_BYTES;
+    }
+#else
+    for (; begin < end; ++begin)
+    {
+        count += *begin == '\n';
+    }
+#endif
+
+    return count;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// Scans over the null terminated source the tokenizers read, a vector register at a time where
+// the compiler targets one: 32 bytes with AVX2, 16 with SSE2, and a byte at a time otherwise.
+// Loads stay aligned, so reading on past the null never crosses into a page that isn't there.
+
+// SkipWhitespace past the first two characters, which it checks itself
+const char* ScanWhitespace(const char* At);
+
+/// <summary>
+/// Returns the first character from At on that isn't a space, a tab, a line break or any other
+/// control character, which is the null at the end if nothing else is left.
+/// </summary>
+inline const char* SkipWhitespace(const char* At)
+{
+    // Most runs are the one space or line break between two words, too short to be worth a block
+    if ((unsigned char)(At[0] - 1) >= ' ')
+    {
+        return At;
+    }
+
+    if ((unsigned char)(At[1] - 1) >= ' ')
+    {
+        return At + 1;
+    }
+
+    return ScanWhitespace(At + 2);
+}
+
+/// <summary>
+/// Returns the first '\r' or '\n' from At on, or the null at the end.
+/// </summary>
+const char* FindLineEnd(const char* At);
+
+/// <summary>
+/// Returns the '*' of the first "*/" from At on, or the null at the end.
+/// </summary>
+const char* FindCommentEnd(const char* At);
+
+/// <summary>
+/// Counts the '\n' characters from begin up to end.
+/// </summary>
+int CountNewlines(const char* begin, const char* end);
+
+inline char* SkipWhitespace(char* At) { return (char*)SkipWhitespace((const char*)At); }
+inline char* FindLineEnd(char* At) { return (char*)FindLineEnd((const char*)At); }
+inline char* FindCommentEnd(char* At) { return (char*)FindCommentEnd((const char*)At); }
@@ -0,0 +1,955 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "hackcpu.h"
+#include "hackjit.h"
+#include "hackbatch.h"
+#include "hackscreen.h"
+#include "hackprofile.h"
+#include "hacksnapshot.h"
+#include "hacktrace.h"
+#include "hackheatmap.h"
+#include "../common/fileio.h"
+
+// Reads a whole input file, saying which one when it can't
+char* ReadInputFile(const char* path)
+{
+    size_t size;
+    char* text = ReadWholeFile(path, &size);
+    if (!text)
+    {
+        printf("Failed to open file: %s\n", path);
+    }
+
+    return text;
+}
+
+void PrintUsage()
+{
+    printf("Usage: emulator <program.hack> [options]\n");
+    printf("  -cycles <n>             Stop after n instructions (default 100000000)\n");
+    printf("  -set <address>=<value>  Write a ram value before starting, may be repeated\n");
+    printf("  -dump <first> <last>    Print ram[first..last] when the program stops\n");
+    printf("  -jit                    Translate the program to native code as it runs\n");
+    printf("  -skipidle               Count off loops that wait, idling or counting down, instead of running them\n");
+    printf("  -batch <file>           Run one instance per line of file, each line a list of\n");
+    printf("                          address=value ram assignments, %d at a time in lockstep\n", BATCH_LANES);
+    printf("  -scalar                 Run -batch instances one after another instead, for comparison\n");
+    printf("  -keys <file>            Keyboard script, one \"<cycle> <key>\" per line, key being a code or\n");
+    printf("                          a quoted character. The key stays down until the next line changes it.\n");
+    printf("  -capture <prefix> <n>   Every n cycles, and when the program stops, write the screen to\n");
+    printf("                          <prefix>_<cycle>.pbm if it changed since the last frame\n");
+    printf("  -profile <asm> <file>   Count how often every instruction runs, write the program's .asm\n");
+    printf("                          to file annotated with the counts and print the hottest blocks and loops\n");
+    printf("  -callgraph <map> <file> Follow calls and returns using the .map from VMTranslator -map and\n");
+    printf("                          write cycles per call stack to file in folded flame graph format\n");
+    printf("  -save <file> <point>    Write a snapshot of the machine to file at point, a cycle count or\n");
+    printf("                          @<address> for the first time pc gets there, like a function's from the .map\n");
+    printf("  -restore <file>         Start from a snapshot of the same program instead of from reset. -set and\n");
+    printf("                          -batch assignments are made on top of it.\n");
+    printf("  -trace <file>           Record every jump, ram write and key to file, for -replay\n");
+    printf("                          On a single core, encoding and writing it nearly doubles the run time\n");
+    printf("  -keyframe <n>           Keep the whole machine in the trace every n cycles (default %d)\n", TRACE_DEFAULT_KEYFRAME_INTERVAL);
+    printf("  -replay <file> <cycle>  Rerun a trace of the program from its last keyframe before cycle up to it\n");
+    printf("                          and check the result against the recording. -dump shows ram there.\n");
+    printf("  -events <n>             List the last n events a replay got to\n");
+    printf("  -heatmap <file>         Count the reads and writes of every ram word, write them to file and\n");
+    printf("                          print the traffic by region and the hottest words\n");
+    printf("  -symbols <file>         Name the statics in the heatmap after the .sym from assembler -symbols\n");
+    printf("  -watch <first>[-<last>] Stop once the program writes to these addresses, may be repeated\n");
+    printf("  -watchread <range>      Stop once the program reads or writes these addresses\n");
+}
+
+void PrintStop(StopReason reason, HackCPU* cpu)
+{
+    switch (reason)
+    {
+        case STOP_CYCLE_LIMIT:
+            printf("Reached the cycle limit at pc %d\n", cpu->PC);
+            break;
+
+        case STOP_HALTED:
+            printf("Halted at pc %d\n", cpu->PC);
+            break;
+
+        case STOP_END_OF_PROGRAM:
+            printf("Ran past the end of the program\n");
+            break;
+
+        case STOP_WATCHPOINT:
+            cpu->heatmap->PrintHit();
+            break;
+    }
+}
+
+void PrintDump(HackCPU* cpu, int dumpFirst, int dumpLast)
+{
+    for (int address = dumpFirst; address <= dumpLast; ++address)
+    {
+        printf("RAM[%d] = %d\n", address, (int16_t)cpu->ram[address]);
+    }
+}
+
+// Reads the next instance's ram assignments from a batch file into cpu, returning false at the end
+bool ReadBatchLine(char*& At, int& lineNumber, HackCPU* cpu, bool& valid)
+{
+    valid = true;
+    while (*At == '\r' || *At == '\n')
+    {
+        lineNumber += *At++ == '\n';
+    }
+
+    if (!*At)
+    {
+        return false;
+    }
+
+    while (*At && *At != '\n')
+    {
+        if (*At == ' ' || *At == '\t' || *At == '\r')
+        {
+            ++At;
+            continue;
+        }
+
+        char* end;
+        long address = strtol(At, &end, 10);
+        if (end == At || *end != '=' || address < 0 || address >= ADDRESS_SPACE)
+        {
+            printf("Line %d: expected address=value\n", lineNumber);
+            valid = false;
+            return true;
+        }
+
+        At = end + 1;
+        long value = strtol(At, &end, 10);
+        if (end == At)
+        {
+            printf("Line %d: expected a value after %ld=\n", lineNumber, address);
+            valid = false;
+            return true;
+        }
+
+        cpu->ram[address] = (uint16_t)value;
+        At = end;
+    }
+
+    return true;
+}
+
+struct KeyEvent
+{
+    uint64_t cycle;
+    uint16_t key;
+};
+
+// Reads a keyboard script into a malloc'd array, returning the number of events or -1 on an error
+int ReadKeyScript(char* path, KeyEvent** events)
+{
+    char* script = ReadInputFile(path);
+    if (!script)
+    {
+        return -1;
+    }
+
+    // No more events than lines
+    int capacity = 1;
+    for (char* At = script; *At; ++At)
+    {
+        capacity += *At == '\n';
+    }
+
+    *events = (KeyEvent*)malloc(sizeof(KeyEvent) * capacity);
+    int count = 0;
+    int lineNumber = 1;
+    for (char* At = script; *At; ++lineNumber)
+    {
+        char* line = At;
+        while (*At && *At != '\n') ++At;
+        if (*At) *At++ = 0;
+
+        while (*line == ' ' || *line == '\t') ++line;
+        if (!*line || *line == '\r' || (line[0] == '/' && line[1] == '/'))
+        {
+            continue;
+        }
+
+        char* end;
+        KeyEvent event = {};
+        event.cycle = strtoull(line, &end, 10);
+        while (*end == ' ' || *end == '\t') ++end;
+        if (end == line)
+        {
+            printf("Line %d: expected a cycle\n", lineNumber);
+            return -1;
+        }
+
+        if (end[0] == '\'' && end[1] && end[2] == '\'')
+        {
+            event.key = (uint8_t)end[1];
+        }
+        else
+        {
+            char* keyStart = end;
+            event.key = (uint16_t)strtol(keyStart, &end, 10);
+            if (end == keyStart)
+            {
+                printf("Line %d: expected a key code or a quoted character\n", lineNumber);
+                return -1;
+            }
+        }
+
+        if (count > 0 && event.cycle < (*events)[count - 1].cycle)
+        {
+            printf("Line %d: cycles must be in order\n", lineNumber);
+            return -1;
+        }
+
+        (*events)[count++] = event;
+    }
+
+    free(script);
+    return count;
+}
+
+int RunBatch(HackCPU* program, char* batchPath, uint64_t maxCycles, int dumpFirst, int dumpLast, bool scalar)
+{
+    char* batchFile = ReadInputFile(batchPath);
+    if (!batchFile)
+    {
+        return 1;
+    }
+
+    HackBatch* batch = (HackBatch*)malloc(sizeof(HackBatch));
+    for (int lane = 0; lane < BATCH_LANES; ++lane)
+    {
+        batch->lanes[lane] = (HackCPU*)malloc(sizeof(HackCPU));
+    }
+
+    char* At = batchFile;
+    int lineNumber = 1;
+    int instanceCount = 0;
+    uint64_t totalCycles = 0;
+    uint64_t lockstepCycles = 0;
+    double seconds = 0;
+    bool moreInstances = true;
+
+    while (moreInstances)
+    {
+        batch->laneCount = 0;
+        while (batch->laneCount < BATCH_LANES)
+        {
+            HackCPU* cpu = batch->lanes[batch->laneCount];
+            memcpy(cpu, program, sizeof(HackCPU));
+
+            bool valid;
+            if (!ReadBatchLine(At, lineNumber, cpu, valid))
+            {
+                moreInstances = false;
+                break;
+            }
+
+            if (!valid)
+            {
+                return 1;
+            }
+
+            ++batch->laneCount;
+        }
+
+        if (batch->laneCount == 0)
+        {
+            break;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if (scalar)
+        {
+            for (int lane = 0; lane < batch->laneCount; ++lane)
+            {
+                batch->reasons[lane] = batch->lanes[lane]->Run(maxCycles);
+                batch->lockstepCycles[lane] = 0;
+            }
+        }
+        else
+        {
+            batch->Run(maxCycles);
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        seconds += std::chrono::duration<double>(end - start).count();
+
+        for (int lane = 0; lane < batch->laneCount; ++lane)
+        {
+            HackCPU* cpu = batch->lanes[lane];
+            printf("Instance %d: ", instanceCount++);
+            PrintStop(batch->reasons[lane], cpu);
+            printf("%llu cycles, %llu in lockstep\n", (unsigned long long)cpu->cycles, (unsigned long long)batch->lockstepCycles[lane]);
+            PrintDump(cpu, dumpFirst, dumpLast);
+
+            totalCycles += cpu->cycles;
+            lockstepCycles += batch->lockstepCycles[lane];
+        }
+    }
+
+    printf("%d instances, %llu cycles in %.3fs (%.1f million per second), %.1f%% in lockstep\n",
+        instanceCount, (unsigned long long)totalCycles, seconds, seconds > 0 ? totalCycles / seconds / 1000000.0 : 0.0,
+        totalCycles ? 100.0 * lockstepCycles / totalCycles : 0.0);
+
+    return 0;
+}
+
+void PrintEvent(const TraceEvent& event)
+{
+    switch (event.kind)
+    {
+        case TRACE_JUMP:
+            printf("  cycle %llu: jump to %d\n", (unsigned long long)event.cycle, event.address);
+            break;
+
+        case TRACE_WRITE:
+            printf("  cycle %llu: RAM[%d] = %d\n", (unsigned long long)event.cycle, event.address, (int16_t)event.value);
+            break;
+
+        case TRACE_KEY:
+            printf("  cycle %llu: key %d\n", (unsigned long long)event.cycle, event.value);
+            break;
+    }
+}
+
+// Reruns a traced program from the keyframe before cycle, feeding it the recorded keys, then
+// checks the ram it ends up with against the keyframe with the recorded writes applied
+int RunReplay(HackCPU* cpu, char* tracePath, uint64_t cycle, int eventsShown, int dumpFirst, int dumpLast)
+{
+    TraceWindow window;
+    window.keyframe = (HackState*)malloc(sizeof(HackState));
+    if (!ReadTrace(cpu, tracePath, cycle, &window))
+    {
+        return 1;
+    }
+
+    if (cycle < window.keyframe->cycles)
+    {
+        printf("The trace starts at cycle %llu\n", (unsigned long long)window.keyframe->cycles);
+        return 1;
+    }
+
+    if (cycle > window.endCycle)
+    {
+        printf("The trace ends at cycle %llu, replaying to there\n", (unsigned long long)window.endCycle);
+        cycle = window.endCycle;
+    }
+
+    window.keyframe->Apply(cpu);
+    std::vector<TraceEvent>& events = window.events;
+
+    StopReason reason = STOP_CYCLE_LIMIT;
+    size_t nextEvent = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (;;)
+    {
+        while (nextEvent < events.size() && events[nextEvent].cycle <= cpu->cycles)
+        {
+            if (events[nextEvent].kind == TRACE_KEY)
+            {
+                cpu->ram[KEYBOARD_ADDRESS] = events[nextEvent].value;
+            }
+
+            ++nextEvent;
+        }
+
+        uint64_t until = cycle;
+        for (size_t i = nextEvent; i < events.size(); ++i)
+        {
+            if (events[i].kind == TRACE_KEY)
+            {
+                until = events[i].cycle;
+                break;
+            }
+        }
+
+        reason = cpu->Run(until);
+        if (reason != STOP_CYCLE_LIMIT || cpu->cycles >= cycle)
+        {
+            break;
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    printf("Replayed %llu cycles from the keyframe at cycle %llu in %.3fs\n",
+        (unsigned long long)(cpu->cycles - window.keyframe->cycles), (unsigned long long)window.keyframe->cycles, seconds);
+    PrintStop(reason, cpu);
+    printf("Cycle %llu: pc %d, A %d, D %d\n", (unsigned long long)cpu->cycles, cpu->PC, (int16_t)cpu->A, (int16_t)cpu->D);
+
+    uint16_t* recorded = window.keyframe->ram;
+    for (size_t i = 0; i < events.size() && events[i].cycle <= cpu->cycles; ++i)
+    {
+        if (events[i].kind != TRACE_JUMP)
+        {
+            recorded[events[i].address] = events[i].value;
+        }
+    }
+
+    int mismatches = 0;
+    for (int address = 0; address < ADDRESS_SPACE; ++address)
+    {
+        if (recorded[address] != cpu->ram[address] && mismatches++ == 0)
+        {
+            printf("The replay differs from the recording first at RAM[%d]: recorded %d, replayed %d\n",
+                address, (int16_t)recorded[address], (int16_t)cpu->ram[address]);
+        }
+    }
+
+    if (mismatches)
+    {
+        printf("%d ram words differ in all\n", mismatches);
+    }
+    else
+    {
+        printf("Ram matches the recording\n");
+    }
+
+    size_t shownEnd = 0;
+    while (shownEnd < events.size() && events[shownEnd].cycle <= cpu->cycles) ++shownEnd;
+    size_t shownStart = shownEnd > (size_t)eventsShown ? shownEnd - eventsShown : 0;
+    if (eventsShown > 0 && shownEnd > shownStart)
+    {
+        printf("The last %d events:\n", (int)(shownEnd - shownStart));
+        for (size_t i = shownStart; i < shownEnd; ++i)
+        {
+            PrintEvent(events[i]);
+        }
+    }
+
+    PrintDump(cpu, dumpFirst, dumpLast);
+    free(window.keyframe);
+    return mismatches ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        PrintUsage();
+        return 0;
+    }
+
+    HackCPU* cpu = (HackCPU*)malloc(sizeof(HackCPU));
+    cpu->Reset();
+    BuildDecodeTable();
+
+    uint64_t maxCycles = 100000000;
+    int dumpFirst = 0;
+    int dumpLast = -1;
+    bool useJit = false;
+    char* batchPath = nullptr;
+    bool scalar = false;
+    KeyEvent* keys = nullptr;
+    int keyCount = 0;
+    char* capturePrefix = nullptr;
+    uint64_t captureInterval = 0;
+    char* profileSource = nullptr;
+    char* profilePath = nullptr;
+    char* callMapPath = nullptr;
+    char* foldedPath = nullptr;
+    char* savePath = nullptr;
+    uint64_t saveCycle = 0;
+    int saveAddress = -1;
+    char* restorePath = nullptr;
+    char* tracePath = nullptr;
+    uint64_t keyframeInterval = TRACE_DEFAULT_KEYFRAME_INTERVAL;
+    char* replayPath = nullptr;
+    uint64_t replayCycle = 0;
+    int eventsShown = 0;
+    char* heatmapPath = nullptr;
+    HackHeatmap* heatmap = nullptr;
+    auto useHeatmap = [&]()
+    {
+        if (!heatmap)
+        {
+            heatmap = (HackHeatmap*)malloc(sizeof(HackHeatmap));
+            heatmap->Clear();
+        }
+
+        return heatmap;
+    };
+
+    // Made once the program is loaded, so they land on top of a restored snapshot
+    int* setAddresses = (int*)malloc(sizeof(int) * argc);
+    int* setValues = (int*)malloc(sizeof(int) * argc);
+    int setCount = 0;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-cycles") == 0 && i + 1 < argc)
+        {
+            maxCycles = strtoull(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "-set") == 0 && i + 1 < argc)
+        {
+            int address = 0;
+            int value = 0;
+            if (sscanf(argv[++i], "%d=%d", &address, &value) != 2 || address < 0 || address >= ADDRESS_SPACE)
+            {
+                printf("Invalid ram assignment: %s\n", argv[i]);
+                return 1;
+            }
+
+            setAddresses[setCount] = address;
+            setValues[setCount++] = value;
+        }
+        else if (strcmp(argv[i], "-dump") == 0 && i + 2 < argc)
+        {
+            dumpFirst = atoi(argv[++i]);
+            dumpLast = atoi(argv[++i]);
+            if (dumpFirst < 0 || dumpLast >= ADDRESS_SPACE)
+            {
+                printf("Dump range must be within 0-%d\n", ADDRESS_SPACE - 1);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-jit") == 0)
+        {
+            useJit = true;
+        }
+        else if (strcmp(argv[i], "-skipidle") == 0)
+        {
+            cpu->skipIdleLoops = true;
+        }
+        else if (strcmp(argv[i], "-batch") == 0 && i + 1 < argc)
+        {
+            batchPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-scalar") == 0)
+        {
+            scalar = true;
+        }
+        else if (strcmp(argv[i], "-keys") == 0 && i + 1 < argc)
+        {
+            keyCount = ReadKeyScript(argv[++i], &keys);
+            if (keyCount < 0)
+            {
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-profile") == 0 && i + 2 < argc)
+        {
+            profileSource = argv[++i];
+            profilePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-callgraph") == 0 && i + 2 < argc)
+        {
+            callMapPath = argv[++i];
+            foldedPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-save") == 0 && i + 2 < argc)
+        {
+            savePath = argv[++i];
+            char* point = argv[++i];
+            char* end;
+            if (*point == '@')
+            {
+                saveAddress = (int)strtol(point + 1, &end, 10);
+                if (end == point + 1 || *end || saveAddress < 0 || saveAddress >= ROM_SIZE)
+                {
+                    printf("Invalid snapshot address: %s\n", point);
+                    return 1;
+                }
+            }
+            else
+            {
+                saveCycle = strtoull(point, &end, 10);
+                if (end == point || *end)
+                {
+                    printf("Invalid snapshot cycle: %s\n", point);
+                    return 1;
+                }
+            }
+        }
+        else if (strcmp(argv[i], "-restore") == 0 && i + 1 < argc)
+        {
+            restorePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+        {
+            tracePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-keyframe") == 0 && i + 1 < argc)
+        {
+            keyframeInterval = strtoull(argv[++i], 0, 10);
+            if (keyframeInterval == 0 || keyframeInterval > TRACE_MAX_KEYFRAME_INTERVAL)
+            {
+                printf("The keyframe interval must be 1-%u cycles\n", TRACE_MAX_KEYFRAME_INTERVAL);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-replay") == 0 && i + 2 < argc)
+        {
+            replayPath = argv[++i];
+            replayCycle = strtoull(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "-events") == 0 && i + 1 < argc)
+        {
+            eventsShown = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-heatmap") == 0 && i + 1 < argc)
+        {
+            heatmapPath = argv[++i];
+            useHeatmap();
+        }
+        else if (strcmp(argv[i], "-symbols") == 0 && i + 1 < argc)
+        {
+            char* symbols = ReadInputFile(argv[++i]);
+            if (!symbols || !useHeatmap()->LoadSymbols(symbols))
+            {
+                return 1;
+            }
+
+            free(symbols);
+        }
+        else if ((strcmp(argv[i], "-watch") == 0 || strcmp(argv[i], "-watchread") == 0) && i + 1 < argc)
+        {
+            uint8_t kinds = strcmp(argv[i], "-watchread") == 0 ? WATCH_READ | WATCH_WRITE : WATCH_WRITE;
+            if (!useHeatmap()->Watch(argv[++i], kinds))
+            {
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-capture") == 0 && i + 2 < argc)
+        {
+            capturePrefix = argv[++i];
+            captureInterval = strtoull(argv[++i], 0, 10);
+            if (captureInterval == 0)
+            {
+                printf("The capture interval must be at least one cycle\n");
+                return 1;
+            }
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    char* input = ReadInputFile(argv[1]);
+    if (!input || !cpu->LoadHack(input))
+    {
+        return 1;
+    }
+
+    if (replayPath)
+    {
+        return RunReplay(cpu, replayPath, replayCycle, eventsShown, dumpFirst, dumpLast);
+    }
+
+    if (restorePath && !LoadSnapshot(cpu, restorePath))
+    {
+        return 1;
+    }
+
+    for (int i = 0; i < setCount; ++i)
+    {
+        cpu->ram[setAddresses[i]] = (uint16_t)setValues[i];
+    }
+
+    if (batchPath)
+    {
+        if (useJit)
+        {
+            printf("Batches always run on the interpreter, ignoring -jit\n");
+        }
+
+        if (keyCount || capturePrefix || savePath || tracePath || heatmap)
+        {
+            printf("Batches run without keyboard scripts, screen capture, snapshots, traces or heatmaps, ignoring -keys, -capture, -save,\n");
+            printf("-trace, -heatmap and -watch\n");
+        }
+
+        return RunBatch(cpu, batchPath, maxCycles, dumpFirst, dumpLast, scalar);
+    }
+
+    if (profilePath || callMapPath)
+    {
+        if (useJit || cpu->skipIdleLoops)
+        {
+            printf("Profiles are taken on the interpreter running every cycle, ignoring -jit and -skipidle\n");
+            useJit = false;
+            cpu->skipIdleLoops = false;
+        }
+
+        cpu->profile = (HackProfile*)malloc(sizeof(HackProfile));
+        cpu->profile->Clear();
+    }
+
+    if (callMapPath)
+    {
+        char* callMap = ReadInputFile(callMapPath);
+        if (!callMap || !cpu->profile->LoadCallMap(callMap))
+        {
+            return 1;
+        }
+
+        free(callMap);
+    }
+
+    if (heatmap)
+    {
+        if (useJit || cpu->skipIdleLoops)
+        {
+            printf("Heatmaps and watchpoints run on the interpreter running every cycle, ignoring -jit and -skipidle\n");
+            useJit = false;
+            cpu->skipIdleLoops = false;
+        }
+
+        cpu->heatmap = heatmap;
+    }
+
+    if (tracePath && (useJit || cpu->skipIdleLoops))
+    {
+        printf("Traces are recorded on the interpreter running every cycle, ignoring -jit and -skipidle\n");
+        useJit = false;
+        cpu->skipIdleLoops = false;
+    }
+
+    if (useJit && capturePrefix)
+    {
+        printf("Screen writes are only tracked by the interpreter, ignoring -jit\n");
+        useJit = false;
+    }
+
+    if (useJit && cpu->skipIdleLoops)
+    {
+        printf("Idle loops are only skipped by the interpreter, ignoring -jit\n");
+        useJit = false;
+    }
+
+    HackJit* jit = nullptr;
+    if (useJit)
+    {
+        jit = (HackJit*)malloc(sizeof(HackJit));
+        if (!jit->Init())
+        {
+            printf("The jit isn't available on this platform, interpreting instead\n");
+            free(jit);
+            jit = nullptr;
+        }
+    }
+
+    HackScreen* screen = nullptr;
+    if (capturePrefix)
+    {
+        screen = (HackScreen*)malloc(sizeof(HackScreen));
+        screen->Init(cpu);
+    }
+
+    int framesWritten = 0;
+    int framesUnchanged = 0;
+    auto captureFrame = [&]()
+    {
+        // The first frame is always written so there's something to compare against
+        if (screen->Update(cpu) || framesWritten == 0)
+        {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s_%llu.pbm", capturePrefix, (unsigned long long)cpu->cycles);
+            framesWritten += screen->WritePbm(path);
+        }
+        else
+        {
+            ++framesUnchanged;
+        }
+    };
+
+    // A restored run starts with the keys the original had down by then
+    int nextKey = 0;
+    while (nextKey < keyCount && keys[nextKey].cycle < cpu->cycles)
+    {
+        cpu->ram[KEYBOARD_ADDRESS] = keys[nextKey++].key;
+    }
+
+    // Opened before any instruction is covered, the trace is tagged with the program's hash
+    HackTrace* trace = nullptr;
+    if (tracePath)
+    {
+        trace = new HackTrace();
+        if (!trace->Open(cpu, tracePath))
+        {
+            return 1;
+        }
+
+        cpu->trace = trace;
+    }
+
+    // A snapshot at an address is taken by covering the instruction there with an
+    // END_OF_PROGRAM word, which stops the run in front of it like the end of rom does
+    bool savePending = savePath != nullptr;
+    uint32_t coveredWord = 0;
+    if (savePending && saveAddress >= 0)
+    {
+        coveredWord = cpu->rom[saveAddress];
+        cpu->rom[saveAddress] = END_OF_PROGRAM;
+    }
+
+    // Run in stretches up to the next key, frame, keyframe or snapshot, so skipped idle loops
+    // never run past any of them. A restored run keeps to the same frame times as the original.
+    uint64_t nextKeyframe = (cpu->cycles / keyframeInterval + 1) * keyframeInterval;
+    uint64_t nextCapture = captureInterval ? (cpu->cycles / captureInterval + 1) * captureInterval : 0;
+    StopReason reason = STOP_CYCLE_LIMIT;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (;;)
+    {
+        uint64_t until = maxCycles;
+        if (nextKey < keyCount && keys[nextKey].cycle < until) until = keys[nextKey].cycle;
+        if (screen && nextCapture < until) until = nextCapture;
+        if (trace && nextKeyframe < until) until = nextKeyframe;
+        if (savePending && saveAddress < 0 && saveCycle < until) until = saveCycle;
+
+        // The jit would compile the covering word into its blocks, so it waits until it's gone
+        bool covered = savePending && saveAddress >= 0;
+        reason = jit && !covered ? jit->Run(cpu, until) : cpu->Run(until);
+        if (savePending && (covered ? reason == STOP_END_OF_PROGRAM && cpu->PC == saveAddress : cpu->cycles >= saveCycle))
+        {
+            if (covered)
+            {
+                cpu->rom[saveAddress] = coveredWord;
+                reason = STOP_CYCLE_LIMIT;
+            }
+
+            savePending = false;
+            if (!SaveSnapshot(cpu, savePath))
+            {
+                return 1;
+            }
+
+            printf("Saved a snapshot at cycle %llu, pc %d\n", (unsigned long long)cpu->cycles, cpu->PC);
+        }
+
+        if (reason != STOP_CYCLE_LIMIT || cpu->cycles >= maxCycles)
+        {
+            break;
+        }
+
+        while (nextKey < keyCount && keys[nextKey].cycle <= cpu->cycles)
+        {
+            cpu->ram[KEYBOARD_ADDRESS] = keys[nextKey].key;
+            if (trace) trace->Record(TRACE_KEY, cpu->cycles, KEYBOARD_ADDRESS, keys[nextKey].key);
+            ++nextKey;
+        }
+
+        if (screen && cpu->cycles >= nextCapture)
+        {
+            captureFrame();
+            nextCapture += captureInterval;
+        }
+
+        if (trace && cpu->cycles >= nextKeyframe)
+        {
+            trace->Keyframe(cpu);
+            nextKeyframe += keyframeInterval;
+        }
+    }
+
+    if (screen)
+    {
+        captureFrame();
+    }
+
+    if (savePending)
+    {
+        printf("The program stopped before the snapshot point, no snapshot was written\n");
+        if (saveAddress >= 0)
+        {
+            cpu->rom[saveAddress] = coveredWord;
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    PrintStop(reason, cpu);
+    printf("%llu cycles in %.3fs (%.1f million per second)\n",
+        (unsigned long long)cpu->cycles, seconds, seconds > 0 ? cpu->cycles / seconds / 1000000.0 : 0.0);
+
+    if (cpu->idleCycles)
+    {
+        printf("%llu of those cycles were skipped in idle loops\n", (unsigned long long)cpu->idleCycles);
+    }
+
+    if (trace)
+    {
+        if (!trace->Close(cpu))
+        {
+            printf("Failed to write trace file: %s\n", tracePath);
+            return 1;
+        }
+
+        long size = 0;
+        FILE* written = fopen(tracePath, "rb");
+        if (written)
+        {
+            fseek(written, 0, SEEK_END);
+            size = ftell(written);
+            fclose(written);
+        }
+
+        printf("Traced %llu events and %llu keyframes in %ld bytes (%.2f per event), the writer held the run up %llu times\n",
+            (unsigned long long)trace->eventCount, (unsigned long long)trace->keyframeCount, size,
+            trace->eventCount ? (double)size / trace->eventCount : 0.0, (unsigned long long)trace->waits);
+    }
+
+    if (foldedPath)
+    {
+        FILE* folded = fopen(foldedPath, "w");
+        if (folded)
+        {
+            cpu->profile->WriteFoldedStacks(cpu->cycles, folded);
+            fclose(folded);
+        }
+        else
+        {
+            printf("Failed to open output file: %s\n", foldedPath);
+        }
+    }
+
+    if (heatmapPath)
+    {
+        FILE* output = fopen(heatmapPath, "w");
+        if (output)
+        {
+            heatmap->WriteHeatmap(output);
+            fclose(output);
+            heatmap->PrintReport();
+        }
+        else
+        {
+            printf("Failed to open output file: %s\n", heatmapPath);
+        }
+    }
+
+    if (profilePath)
+    {
+        char* source = ReadInputFile(profileSource);
+        FILE* listing = source ? fopen(profilePath, "w") : nullptr;
+        if (listing)
+        {
+            cpu->profile->WriteListing(cpu, source, listing);
+            fclose(listing);
+            cpu->profile->PrintHotSpots(cpu, source);
+        }
+        else if (source)
+        {
+            printf("Failed to open output file: %s\n", profilePath);
+        }
+    }
+
+    if (screen)
+    {
+        printf("Wrote %d frames, %d more were unchanged\n", framesWritten, framesUnchanged);
+    }
+
+    PrintDump(cpu, dumpFirst, dumpLast);
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include <cstring>
+#include "hackbatch.h"
+
+#define FOR_EACH_LANE for (int lane = 0; lane < BATCH_LANES; ++lane)
+
+// The lane loops below read lanes that have already left lockstep, or were never used, as
+// well as live ones. Their values are garbage but always in range, and nothing is kept.
+static void GenericAlu(uint8_t comp, const uint16_t* x, const uint16_t* y, uint16_t* out)
+{
+    FOR_EACH_LANE
+    {
+        uint16_t first = (comp & 0b100000) ? 0 : x[lane];
+        if (comp & 0b010000) first = ~first;
+        uint16_t second = (comp & 0b001000) ? 0 : y[lane];
+        if (comp & 0b000100) second = ~second;
+
+        uint16_t result = (comp & 0b000010) ? (uint16_t)(first + second) : (uint16_t)(first & second);
+        out[lane] = (comp & 0b000001) ? (uint16_t)~result : result;
+    }
+}
+
+void HackBatch::Run(uint64_t maxCycles)
+{
+    uint32_t active = 0;
+    memset(A, 0, sizeof(A));
+    memset(D, 0, sizeof(D));
+    for (int lane = 0; lane < laneCount; ++lane)
+    {
+        HackCPU* cpu = lanes[lane];
+        lockstepCycles[lane] = cpu->cycles;
+
+        // Lanes that don't start where the first one does never join in
+        if (cpu->PC != lanes[0]->PC || cpu->cycles != lanes[0]->cycles)
+        {
+            reasons[lane] = cpu->Run(maxCycles);
+            continue;
+        }
+
+        for (int address = 0; address < ADDRESS_SPACE; ++address)
+        {
+            ram[address][lane] = cpu->ram[address];
+        }
+
+        A[lane] = cpu->A;
+        D[lane] = cpu->D;
+        active |= 1u << lane;
+    }
+
+    const uint32_t* rom = lanes[0]->rom;
+    uint16_t pc = lanes[0]->PC;
+    uint64_t cycle = lanes[0]->cycles;
+    StopReason lockstepReason = STOP_CYCLE_LIMIT;
+
+    uint16_t m[BATCH_LANES];
+    uint16_t out[BATCH_LANES];
+    uint16_t address[BATCH_LANES];
+    uint16_t next[BATCH_LANES];
+
+    while (active && cycle < maxCycles)
+    {
+        uint32_t word = rom[pc];
+        DecodedInstruction instruction = decodeTable[word];
+        if (instruction.op == OP_LOAD_A)
+        {
+            FOR_EACH_LANE A[lane] = (uint16_t)word;
+            ++pc;
+            ++cycle;
+            continue;
+        }
+
+        if (instruction.op == OP_END_OF_PROGRAM)
+        {
+            lockstepReason = STOP_END_OF_PROGRAM;
+            break;
+        }
+
+        // Every lane has its own A, so M is a gather
+        if (word & 0x1000)
+        {
+            FOR_EACH_LANE m[lane] = ram[A[lane]][lane];
+        }
+
+        switch (instruction.op)
+        {
+            case OP_ZERO: FOR_EACH_LANE out[lane] = 0; break;
+            case OP_ONE: FOR_EACH_LANE out[lane] = 1; break;
+            case OP_NEG_ONE: FOR_EACH_LANE out[lane] = 0xFFFF; break;
+            case OP_D: FOR_EACH_LANE out[lane] = D[lane]; break;
+            case OP_A: FOR_EACH_LANE out[lane] = A[lane]; break;
+            case OP_M: FOR_EACH_LANE out[lane] = m[lane]; break;
+            case OP_NOT_D: FOR_EACH_LANE out[lane] = ~D[lane]; break;
+            case OP_NOT_A: FOR_EACH_LANE out[lane] = ~A[lane]; break;
+            case OP_NOT_M: FOR_EACH_LANE out[lane] = ~m[lane]; break;
+            case OP_NEG_D: FOR_EACH_LANE out[lane] = -D[lane]; break;
+            case OP_NEG_A: FOR_EACH_LANE out[lane] = -A[lane]; break;
+            case OP_NEG_M: FOR_EACH_LANE out[lane] = -m[lane]; break;
+            case OP_D_PLUS_ONE: FOR_EACH_LANE out[lane] = D[lane] + 1; break;
+            case OP_A_PLUS_ONE: FOR_EACH_LANE out[lane] = A[lane] + 1; break;
+            case OP_M_PLUS_ONE: FOR_EACH_LANE out[lane] = m[lane] + 1; break;
+            case OP_D_MINUS_ONE: FOR_EACH_LANE out[lane] = D[lane] - 1; break;
+            case OP_A_MINUS_ONE: FOR_EACH_LANE out[lane] = A[lane] - 1; break;
+            case OP_M_MINUS_ONE: FOR_EACH_LANE out[lane] = m[lane] - 1; break;
+            case OP_D_PLUS_A: FOR_EACH_LANE out[lane] = D[lane] + A[lane]; break;
+            case OP_D_PLUS_M: FOR_EACH_LANE out[lane] = D[lane] + m[lane]; break;
+            case OP_D_MINUS_A: FOR_EACH_LANE out[lane] = D[lane] - A[lane]; break;
+            case OP_D_MINUS_M: FOR_EACH_LANE out[lane] = D[lane] - m[lane]; break;
+            case OP_A_MINUS_D: FOR_EACH_LANE out[lane] = A[lane] - D[lane]; break;
+            case OP_M_MINUS_D: FOR_EACH_LANE out[lane] = m[lane] - D[lane]; break;
+            case OP_D_AND_A: FOR_EACH_LANE out[lane] = D[lane] & A[lane]; break;
+            case OP_D_AND_M: FOR_EACH_LANE out[lane] = D[lane] & m[lane]; break;
+            case OP_D_OR_A: FOR_EACH_LANE out[lane] = D[lane] | A[lane]; break;
+            case OP_D_OR_M: FOR_EACH_LANE out[lane] = D[lane] | m[lane]; break;
+            case OP_GENERIC_A: GenericAlu(instruction.comp, D, A, out); break;
+            default: GenericAlu(instruction.comp, D, m, out); break;
+        }
+
+        ++cycle;
+
+        // Everything in the instruction sees A as it was before the instruction, like the hardware
+        FOR_EACH_LANE address[lane] = A[lane];
+        if (instruction.dest & DEST_M) FOR_EACH_LANE ram[address[lane]][lane] = out[lane];
+        if (instruction.dest & DEST_A) FOR_EACH_LANE A[lane] = out[lane];
+        if (instruction.dest & DEST_D) FOR_EACH_LANE D[lane] = out[lane];
+
+        if (!instruction.jump)
+        {
+            ++pc;
+            continue;
+        }
+
+        FOR_EACH_LANE
+        {
+            int16_t value = (int16_t)out[lane];
+            uint8_t condition = value < 0 ? JUMP_LT : (value == 0 ? JUMP_EQ : JUMP_GT);
+            next[lane] = (instruction.jump & condition) ? address[lane] : (uint16_t)(pc + 1);
+        }
+
+        // "(HERE) @HERE 0;JMP" with nothing written can never leave, treat it as a halt
+        bool canHalt = !instruction.dest && rom[(uint16_t)(pc - 1)] == (uint16_t)(pc - 1);
+
+        // Carry on with whichever next pc most lanes agree on and let the rest go
+        int bestCount = 0;
+        uint16_t bestPc = 0;
+        for (int lane = 0; lane < laneCount; ++lane)
+        {
+            if (!(active & (1u << lane)) || (canHalt && next[lane] == (uint16_t)(pc - 1)))
+            {
+                continue;
+            }
+
+            int count = 0;
+            for (int other = 0; other < laneCount; ++other)
+            {
+                count += (active & (1u << other)) && next[other] == next[lane];
+            }
+
+            if (count > bestCount)
+            {
+                bestCount = count;
+                bestPc = next[lane];
+            }
+        }
+
+        for (int lane = 0; lane < laneCount; ++lane)
+        {
+            if ((active & (1u << lane)) && (bestCount == 0 || next[lane] != bestPc))
+            {
+                HackCPU* cpu = lanes[lane];
+                for (int i = 0; i < ADDRESS_SPACE; ++i)
+                {
+                    cpu->ram[i] = ram[i][lane];
+                }
+
+                cpu->A = A[lane];
+                cpu->D = D[lane];
+                cpu->PC = next[lane];
+                cpu->cycles = cycle;
+                lockstepCycles[lane] = cycle;
+                active &= ~(1u << lane);
+
+                if (canHalt && next[lane] == (uint16_t)(pc - 1))
+                {
+                    reasons[lane] = STOP_HALTED;
+                }
+                else
+                {
+                    reasons[lane] = cpu->Run(maxCycles);
+                }
+            }
+        }
+
+        pc = bestPc;
+    }
+
+    for (int lane = 0; lane < laneCount; ++lane)
+    {
+        HackCPU* cpu = lanes[lane];
+        if (active & (1u << lane))
+        {
+            for (int i = 0; i < ADDRESS_SPACE; ++i)
+            {
+                cpu->ram[i] = ram[i][lane];
+            }
+
+            cpu->A = A[lane];
+            cpu->D = D[lane];
+            cpu->PC = pc;
+            cpu->cycles = cycle;
+            lockstepCycles[lane] = cycle;
+            reasons[lane] = lockstepReason;
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include "hackcpu.h"
+
+// Machines run side by side in lockstep. Every per lane loop in hackbatch.cpp runs over the
+// full width so the compiler can turn it into 16 bit vector operations, 16 lanes being one
+// AVX2 register or two SSE2 ones.
+#define BATCH_LANES 16
+
+struct HackBatch
+{
+    // Lane strided, so the lanes' copies of one address sit next to each other
+    uint16_t ram[ADDRESS_SPACE][BATCH_LANES];
+    uint16_t A[BATCH_LANES];
+    uint16_t D[BATCH_LANES];
+
+    // Each lane's starting state is loaded from its HackCPU, and its final state is written back
+    HackCPU* lanes[BATCH_LANES];
+    int laneCount;
+
+    StopReason reasons[BATCH_LANES];
+
+    // Cycle each lane left lockstep at, because it diverged, stopped or hit the limit
+    uint64_t lockstepCycles[BATCH_LANES];
+
+    /// <summary>
+    /// Runs every lane to maxCycles like HackCPU::Run. Lanes run in lockstep while they all
+    /// agree on the next pc; a lane that jumps somewhere else is handed back to its own
+    /// HackCPU and finished on the scalar interpreter.
+    /// </summary>
+    void Run(uint64_t maxCycles);
+};
@@ -0,0 +1,697 @@
+#include <cstdio>
+#include <cstring>
+#include "hackcpu.h"
+#include "hackprofile.h"
+#include "hacktrace.h"
+#include "hackheatmap.h"
+
+DecodedInstruction decodeTable[END_OF_PROGRAM + 1];
+
+// Raw ALU for comp bits that aren't in the documented table
+static uint16_t GenericAlu(uint8_t comp, uint16_t x, uint16_t y)
+{
+    if (comp & 0b100000) x = 0;
+    if (comp & 0b010000) x = ~x;
+    if (comp & 0b001000) y = 0;
+    if (comp & 0b000100) y = ~y;
+
+    uint16_t out = (comp & 0b000010) ? (uint16_t)(x + y) : (uint16_t)(x & y);
+    if (comp & 0b000001) out = ~out;
+    return out;
+}
+
+// Everything that reads M, for counting reads
+static bool ReadsMemory(Operation op)
+{
+    switch (op)
+    {
+        case OP_M:
+        case OP_NOT_M:
+        case OP_NEG_M:
+        case OP_M_PLUS_ONE:
+        case OP_M_MINUS_ONE:
+        case OP_D_PLUS_M:
+        case OP_D_MINUS_M:
+        case OP_M_MINUS_D:
+        case OP_D_AND_M:
+        case OP_D_OR_M:
+        case OP_GENERIC_M:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static Operation DecodeComp(int comp, bool useM)
+{
+    switch (comp)
+    {
+        case 0b101010: return OP_ZERO;
+        case 0b111111: return OP_ONE;
+        case 0b111010: return OP_NEG_ONE;
+        case 0b001100: return OP_D;
+        case 0b110000: return useM ? OP_M : OP_A;
+        case 0b001101: return OP_NOT_D;
+        case 0b110001: return useM ? OP_NOT_M : OP_NOT_A;
+        case 0b001111: return OP_NEG_D;
+        case 0b110011: return useM ? OP_NEG_M : OP_NEG_A;
+        case 0b011111: return OP_D_PLUS_ONE;
+        case 0b110111: return useM ? OP_M_PLUS_ONE : OP_A_PLUS_ONE;
+        case 0b001110: return OP_D_MINUS_ONE;
+        case 0b110010: return useM ? OP_M_MINUS_ONE : OP_A_MINUS_ONE;
+        case 0b000010: return useM ? OP_D_PLUS_M : OP_D_PLUS_A;
+        case 0b010011: return useM ? OP_D_MINUS_M : OP_D_MINUS_A;
+        case 0b000111: return useM ? OP_M_MINUS_D : OP_A_MINUS_D;
+        case 0b000000: return useM ? OP_D_AND_M : OP_D_AND_A;
+        case 0b010101: return useM ? OP_D_OR_M : OP_D_OR_A;
+        default: return useM ? OP_GENERIC_M : OP_GENERIC_A;
+    }
+}
+
+void BuildDecodeTable()
+{
+    for (int word = 0; word < END_OF_PROGRAM; ++word)
+    {
+        DecodedInstruction instruction = {};
+        if ((word & 0x8000) == 0)
+        {
+            instruction.op = OP_LOAD_A;
+        }
+        else
+        {
+            instruction.comp = (word >> 6) & 0b111111;
+            instruction.op = DecodeComp(instruction.comp, (word & 0x1000) != 0);
+            instruction.dest = (word >> 3) & 0b111;
+            instruction.jump = word & 0b111;
+        }
+
+        decodeTable[word] = instruction;
+    }
+
+    decodeTable[END_OF_PROGRAM] = { OP_END_OF_PROGRAM, 0, 0, 0 };
+}
+
+void HackCPU::Reset()
+{
+    for (int i = 0; i < ADDRESS_SPACE; ++i)
+    {
+        rom[i] = END_OF_PROGRAM;
+    }
+
+    memset(ram, 0, sizeof(ram));
+    romSize = 0;
+    A = 0;
+    D = 0;
+    PC = 0;
+    cycles = 0;
+    skipIdleLoops = false;
+    idleCycles = 0;
+    writeGeneration = 0;
+    memset(writeStamp, 0, sizeof(writeStamp));
+    trackScreen = false;
+    memset(screenDirty, 0, sizeof(screenDirty));
+    profile = nullptr;
+    trace = nullptr;
+    heatmap = nullptr;
+}
+
+bool HackCPU::LoadHack(const char* source)
+{
+    int lineNumber = 1;
+    const char* At = source;
+    while (*At)
+    {
+        if (*At == '0' || *At == '1')
+        {
+            uint32_t word = 0;
+            int length = 0;
+            while (*At == '0' || *At == '1')
+            {
+                word = (word << 1) | (*At - '0');
+                ++length;
+                ++At;
+            }
+
+            if (length != 16)
+            {
+                printf("Line %d: expected 16 bits but found %d\n", lineNumber, length);
+                return false;
+            }
+
+            if (romSize == ROM_SIZE)
+            {
+                printf("Program is larger than the %d word rom\n", ROM_SIZE);
+                return false;
+            }
+
+            rom[romSize++] = word;
+        }
+        else if (*At == '\n')
+        {
+            ++lineNumber;
+            ++At;
+        }
+        else if (*At == ' ' || *At == '\t' || *At == '\r')
+        {
+            ++At;
+        }
+        else
+        {
+            printf("Line %d: unexpected character '%c'\n", lineNumber, *At);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Idle loop detection watches for the machine coming back to exactly the state it was in at
+// some earlier jump target: same pc, A and D, and every ram word written in between holding
+// its old value again. With the rom fixed and no input arriving, everything from then on
+// repeats with the same period, so whole periods can be counted off without running them.
+//
+// Loops that count something, like Sys.wait, never come back to the same state. Once the
+// armed target comes round twice in a row after the same number of cycles, the next two
+// periods are run again recording every instruction, and make a counter loop if they run
+// the same instructions on the same addresses, none of them an and or an or, and change A, D
+// and every word they write by the same amounts. Adds, subtracts and negations keep every
+// value on the path moving by the same amount each period, so the loop keeps doing that until
+// some conditional jump on the path sees the value it tests change sign, and the periods
+// before that are counted off all at once.
+
+// Cycles to wait for the armed jump target to come round again before trying another
+#define IDLE_WINDOW 65536
+
+// Distinct ram words a loop may write per period and still be recognized
+#define IDLE_LOG_SIZE 256
+
+// Instructions other than A loads a counter loop may run per period
+#define IDLE_STEPS 256
+
+struct IdleTracker
+{
+    bool armed;
+    uint16_t pc;
+    uint16_t a;
+    uint16_t d;
+    uint64_t cycle;
+
+    // First value of every word written since arming, stamped so each is logged once
+    int logCount;
+    uint16_t logAddress[IDLE_LOG_SIZE];
+    uint16_t logValue[IDLE_LOG_SIZE];
+
+    // When the armed target last came round and how long it took before that
+    uint64_t returnCycle;
+    uint64_t lastPeriod;
+
+    // The last target that turned out not to be a counter loop, not worth checking again
+    // every time it's armed
+    bool anyChecked;
+    uint16_t notCounter;
+
+    // The last backward jump into the armed loop, which is moved in to once it's taken again
+    uint16_t nested;
+};
+
+// An instruction run in a recorded period, with ram[address] as it was before it
+struct IdleStep
+{
+    uint16_t pc;
+    uint16_t address;
+    uint16_t out;
+    uint16_t old;
+};
+
+struct IdlePeriod
+{
+    int stepCount;
+    IdleStep steps[IDLE_STEPS];
+};
+
+template <bool TrackScreen>
+static uint64_t SkipCounterLoop(HackCPU* cpu, uint64_t period, uint64_t maxCycles, StopReason* reason);
+
+template <bool SkipIdle, bool TrackScreen, bool Profile, bool Trace, bool Heatmap, bool Record = false>
+static StopReason RunLoop(HackCPU* cpu, uint64_t maxCycles, IdlePeriod* recording = nullptr)
+{
+    // Work on locals so the compiler can keep the registers out of memory
+    uint16_t a = cpu->A;
+    uint16_t d = cpu->D;
+    uint16_t pc = cpu->PC;
+    uint64_t cycle = cpu->cycles;
+    uint16_t* memory = cpu->ram;
+    const uint32_t* rom = cpu->rom;
+    StopReason reason = STOP_CYCLE_LIMIT;
+
+    IdleTracker idle = {};
+
+    // Set by an access the heatmap watches, the run stops once its instruction is done
+    bool watched = false;
+
+    // Events go straight into the trace's chunk, it only hears about them when that fills up
+    TraceRecord* traceNext = Trace ? cpu->trace->next : nullptr;
+    TraceRecord* traceEnd = Trace ? cpu->trace->end : nullptr;
+    auto record = [&](TraceEventKind kind, uint16_t address, uint16_t value)
+    {
+        traceNext->stamp = ((uint32_t)kind << TRACE_CYCLE_BITS) | ((uint32_t)cycle & TRACE_CYCLE_MASK);
+        traceNext->address = address;
+        traceNext->value = value;
+        if (++traceNext == traceEnd)
+        {
+            cpu->trace->next = traceNext;
+            cpu->trace->HandOff();
+            traceNext = cpu->trace->next;
+            traceEnd = cpu->trace->end;
+        }
+    };
+
+    while (cycle < maxCycles)
+    {
+        if (Heatmap && watched)
+        {
+            break;
+        }
+
+        uint32_t word = rom[pc];
+        DecodedInstruction instruction = decodeTable[word];
+        uint16_t out;
+
+        if (Heatmap && ReadsMemory(instruction.op))
+        {
+            HackHeatmap* heatmap = cpu->heatmap;
+            ++heatmap->reads[a];
+            if ((heatmap->watch[a] & WATCH_READ) && !watched)
+            {
+                heatmap->Hit(WATCH_READ, a, memory[a], pc, cycle + 1);
+                watched = true;
+            }
+        }
+
+        switch (instruction.op)
+        {
+            case OP_LOAD_A:
+                if (Profile) ++cpu->profile->executed[pc];
+                a = (uint16_t)word;
+                ++pc;
+                ++cycle;
+                continue;
+
+            case OP_ZERO: out = 0; break;
+            case OP_ONE: out = 1; break;
+            case OP_NEG_ONE: out = 0xFFFF; break;
+            case OP_D: out = d; break;
+            case OP_A: out = a; break;
+            case OP_M: out = memory[a]; break;
+            case OP_NOT_D: out = ~d; break;
+            case OP_NOT_A: out = ~a; break;
+            case OP_NOT_M: out = ~memory[a]; break;
+            case OP_NEG_D: out = -d; break;
+            case OP_NEG_A: out = -a; break;
+            case OP_NEG_M: out = -memory[a]; break;
+            case OP_D_PLUS_ONE: out = d + 1; break;
+            case OP_A_PLUS_ONE: out = a + 1; break;
+            case OP_M_PLUS_ONE: out = memory[a] + 1; break;
+            case OP_D_MINUS_ONE: out = d - 1; break;
+            case OP_A_MINUS_ONE: out = a - 1; break;
+            case OP_M_MINUS_ONE: out = memory[a] - 1; break;
+            case OP_D_PLUS_A: out = d + a; break;
+            case OP_D_PLUS_M: out = d + memory[a]; break;
+            case OP_D_MINUS_A: out = d - a; break;
+            case OP_D_MINUS_M: out = d - memory[a]; break;
+            case OP_A_MINUS_D: out = a - d; break;
+            case OP_M_MINUS_D: out = memory[a] - d; break;
+            case OP_D_AND_A: out = d & a; break;
+            case OP_D_AND_M: out = d & memory[a]; break;
+            case OP_D_OR_A: out = d | a; break;
+            case OP_D_OR_M: out = d | memory[a]; break;
+            case OP_GENERIC_A: out = GenericAlu(instruction.comp, d, a); break;
+            case OP_GENERIC_M: out = GenericAlu(instruction.comp, d, memory[a]); break;
+
+            default:
+                reason = STOP_END_OF_PROGRAM;
+                goto stopped;
+        }
+
+        if (Profile) ++cpu->profile->executed[pc];
+        ++cycle;
+
+        // Everything in the instruction sees A as it was before the instruction, like the hardware
+        uint16_t address = a;
+        if (Record)
+        {
+            if (recording->stepCount < IDLE_STEPS)
+            {
+                recording->steps[recording->stepCount] = { pc, address, out, memory[address] };
+            }
+
+            ++recording->stepCount;
+        }
+
+        if (instruction.dest & DEST_M)
+        {
+            if (SkipIdle && idle.armed && cpu->writeStamp[address] != cpu->writeGeneration)
+            {
+                if (idle.logCount == IDLE_LOG_SIZE)
+                {
+                    idle.armed = false;
+                }
+                else
+                {
+                    cpu->writeStamp[address] = cpu->writeGeneration;
+                    idle.logAddress[idle.logCount] = address;
+                    idle.logValue[idle.logCount] = memory[address];
+                    ++idle.logCount;
+                }
+            }
+
+            memory[address] = out;
+            if (Trace) record(TRACE_WRITE, address, out);
+            if (Heatmap)
+            {
+                HackHeatmap* heatmap = cpu->heatmap;
+                ++heatmap->writes[address];
+                if ((heatmap->watch[address] & WATCH_WRITE) && !watched)
+                {
+                    heatmap->Hit(WATCH_WRITE, address, out, pc, cycle);
+                    watched = true;
+                }
+            }
+
+            if (TrackScreen && (uint16_t)(address - SCREEN_ADDRESS) < SCREEN_WORDS)
+            {
+                uint16_t offset = address - SCREEN_ADDRESS;
+                cpu->screenDirty[offset >> 6] |= 1ull << (offset & 63);
+            }
+        }
+
+        if (instruction.dest & DEST_A) a = out;
+        if (instruction.dest & DEST_D) d = out;
+
+        if (instruction.jump)
+        {
+            int16_t value = (int16_t)out;
+            uint8_t condition = value < 0 ? JUMP_LT : (value == 0 ? JUMP_EQ : JUMP_GT);
+            if (instruction.jump & condition)
+            {
+                if (Profile)
+                {
+                    ++cpu->profile->taken[pc];
+                    if (cpu->profile->jumpKind[pc])
+                    {
+                        cpu->profile->StackJump(pc, cycle);
+                    }
+                }
+
+                if (Trace) record(TRACE_JUMP, address, 0);
+
+                // "(HERE) @HERE 0;JMP" with nothing written can never leave, treat it as a halt
+                if (!instruction.dest && address == (uint16_t)(pc - 1) && rom[address] == address)
+                {
+                    pc = address;
+                    reason = STOP_HALTED;
+                    break;
+                }
+
+                if (SkipIdle)
+                {
+                    if (idle.armed && address == idle.pc && a == idle.a && d == idle.d)
+                    {
+                        bool sameRam = true;
+                        for (int i = 0; i < idle.logCount && sameRam; ++i)
+                        {
+                            sameRam = memory[idle.logAddress[i]] == idle.logValue[i];
+                        }
+
+                        if (sameRam)
+                        {
+                            uint64_t period = cycle - idle.cycle;
+                            uint64_t skipped = (maxCycles - cycle) / period * period;
+                            cycle += skipped;
+                            cpu->idleCycles += skipped;
+                            idle.armed = false;
+                        }
+                    }
+
+                    if (idle.armed && address == idle.pc)
+                    {
+                        uint64_t period = cycle - idle.returnCycle;
+                        if (period == idle.lastPeriod && !(idle.anyChecked && idle.notCounter == address) &&
+                            !Profile && !Trace && !Heatmap)
+                        {
+                            cpu->A = a;
+                            cpu->D = d;
+                            cpu->PC = address;
+                            cpu->cycles = cycle;
+                            if (!SkipCounterLoop<TrackScreen>(cpu, period, maxCycles, &reason))
+                            {
+                                idle.anyChecked = true;
+                                idle.notCounter = address;
+                            }
+
+                            // The log missed whatever the periods run for the check wrote
+                            idle.armed = false;
+                            a = cpu->A;
+                            d = cpu->D;
+                            pc = cpu->PC;
+                            cycle = cpu->cycles;
+                            if (reason != STOP_CYCLE_LIMIT)
+                            {
+                                goto stopped;
+                            }
+
+                            // Somewhere in the loop again, or back where it was after periods that
+                            // weren't worth skipping, which are carried on with from here
+                            continue;
+                        }
+
+                        idle.lastPeriod = period;
+                        idle.returnCycle = cycle;
+                    }
+
+                    if (idle.armed && cycle - idle.cycle > IDLE_WINDOW)
+                    {
+                        idle.armed = false;
+                    }
+
+                    // Arm on backward jumps, the only way a program can go round in circles, and
+                    // move in to a loop nested in the armed one once it goes round, so a counter
+                    // loop inside another is seen whole. Calls returning backward don't count,
+                    // moving and starting the log over on every one of them costs too much.
+                    bool nested = false;
+                    if (idle.armed && address > idle.pc && address <= pc)
+                    {
+                        nested = address == idle.nested;
+                        idle.nested = address;
+                    }
+
+                    if (address <= pc && (!idle.armed || nested))
+                    {
+                        idle.armed = true;
+                        idle.pc = address;
+                        idle.a = a;
+                        idle.d = d;
+                        idle.cycle = cycle;
+                        idle.logCount = 0;
+                        idle.returnCycle = cycle;
+                        idle.lastPeriod = 0;
+                        if (++cpu->writeGeneration == 0)
+                        {
+                            memset(cpu->writeStamp, 0, sizeof(cpu->writeStamp));
+                            cpu->writeGeneration = 1;
+                        }
+                    }
+                }
+
+                pc = address;
+                continue;
+            }
+        }
+
+        ++pc;
+    }
+
+    if (Heatmap && watched)
+    {
+        reason = STOP_WATCHPOINT;
+    }
+
+stopped:
+    if (Trace) cpu->trace->next = traceNext;
+    cpu->A = a;
+    cpu->D = d;
+    cpu->PC = pc;
+    cpu->cycles = cycle;
+    return reason;
+}
+
+// How many more times a conditional jump that tested value, and tests delta more each time
+// round, sees the same sign
+static uint64_t SameSignFor(int16_t value, int16_t delta)
+{
+    int v = value;
+    int step = delta;
+    if (step == 0)
+    {
+        return UINT64_MAX;
+    }
+
+    if (v == 0)
+    {
+        return 0;
+    }
+
+    if (v > 0)
+    {
+        return step < 0 ? (v - 1) / -step : (32767 - v) / step;
+    }
+
+    return step > 0 ? (-v - 1) / step : (v + 32768) / -step;
+}
+
+// Runs the next two periods of the loop cpu is at the top of recording them, and if they make
+// a counter loop, moves the machine on by as many more periods as are sure to go the same way
+// within maxCycles. Returns the cycles skipped. reason is set if the run stopped meanwhile.
+template <bool TrackScreen>
+static uint64_t SkipCounterLoop(HackCPU* cpu, uint64_t period, uint64_t maxCycles, StopReason* reason)
+{
+    uint16_t top = cpu->PC;
+    if (maxCycles - cpu->cycles < 2 * period)
+    {
+        return 0;
+    }
+
+    IdlePeriod periods[2];
+    uint16_t heads[3][2];
+    for (int i = 0; i < 2; ++i)
+    {
+        heads[i][0] = cpu->A;
+        heads[i][1] = cpu->D;
+        periods[i].stepCount = 0;
+        *reason = RunLoop<false, TrackScreen, false, false, false, true>(cpu, cpu->cycles + period, &periods[i]);
+        if (*reason != STOP_CYCLE_LIMIT || cpu->PC != top || periods[i].stepCount > IDLE_STEPS)
+        {
+            return 0;
+        }
+    }
+
+    heads[2][0] = cpu->A;
+    heads[2][1] = cpu->D;
+
+    const IdlePeriod& first = periods[0];
+    const IdlePeriod& second = periods[1];
+    if (first.stepCount != second.stepCount)
+    {
+        return 0;
+    }
+
+    // Stamped the way the idle log is, so each word written is checked once
+    if (++cpu->writeGeneration == 0)
+    {
+        memset(cpu->writeStamp, 0, sizeof(cpu->writeStamp));
+        cpu->writeGeneration = 1;
+    }
+
+    uint64_t times = (maxCycles - cpu->cycles) / period;
+    for (int i = 0; i < second.stepCount; ++i)
+    {
+        const IdleStep& before = first.steps[i];
+        const IdleStep& step = second.steps[i];
+        if (before.pc != step.pc)
+        {
+            return 0;
+        }
+
+        DecodedInstruction instruction = decodeTable[cpu->rom[step.pc]];
+        switch (instruction.op)
+        {
+            case OP_D_AND_A:
+            case OP_D_AND_M:
+            case OP_D_OR_A:
+            case OP_D_OR_M:
+            case OP_GENERIC_A:
+            case OP_GENERIC_M:
+                return 0;
+
+            default:
+                break;
+        }
+
+        bool usesAddress = ReadsMemory(instruction.op) || (instruction.dest & DEST_M) || instruction.jump;
+        if (usesAddress && before.address != step.address)
+        {
+            return 0;
+        }
+
+        if (instruction.jump && instruction.jump != (JUMP_LT | JUMP_EQ | JUMP_GT))
+        {
+            uint64_t same = SameSignFor((int16_t)step.out, (int16_t)(step.out - before.out));
+            times = same < times ? same : times;
+        }
+
+        // A word's value before its first write in a period is its value at the top then
+        if ((instruction.dest & DEST_M) && cpu->writeStamp[step.address] != cpu->writeGeneration)
+        {
+            cpu->writeStamp[step.address] = cpu->writeGeneration;
+            uint16_t delta = cpu->ram[step.address] - step.old;
+            if ((uint16_t)(step.old - before.old) != delta)
+            {
+                return 0;
+            }
+        }
+    }
+
+    uint16_t deltaA = heads[2][0] - heads[1][0];
+    uint16_t deltaD = heads[2][1] - heads[1][1];
+    if (times == 0 || (uint16_t)(heads[1][0] - heads[0][0]) != deltaA || (uint16_t)(heads[1][1] - heads[0][1]) != deltaD)
+    {
+        return 0;
+    }
+
+    // Only the low 16 bits of the count matter to 16 bit values
+    uint16_t count = (uint16_t)times;
+    for (int i = 0; i < second.stepCount; ++i)
+    {
+        const IdleStep& step = second.steps[i];
+        if ((decodeTable[cpu->rom[step.pc]].dest & DEST_M) && cpu->writeStamp[step.address] == cpu->writeGeneration)
+        {
+            cpu->writeStamp[step.address] = 0;
+            cpu->ram[step.address] += (uint16_t)((uint16_t)(cpu->ram[step.address] - step.old) * count);
+            uint16_t offset = step.address - SCREEN_ADDRESS;
+            if (TrackScreen && offset < SCREEN_WORDS)
+            {
+                cpu->screenDirty[offset >> 6] |= 1ull << (offset & 63);
+            }
+        }
+    }
+
+    cpu->A += (uint16_t)(deltaA * count);
+    cpu->D += (uint16_t)(deltaD * count);
+    cpu->cycles += times * period;
+    cpu->idleCycles += times * period;
+    return times * period;
+}
+
+typedef StopReason (*RunFunction)(HackCPU* cpu, uint64_t maxCycles);
+
+template <int Flags>
+static StopReason RunWith(HackCPU* cpu, uint64_t maxCycles)
+{
+    return RunLoop<(Flags & 1) != 0, (Flags & 2) != 0, (Flags & 4) != 0, (Flags & 8) != 0, (Flags & 16) != 0>(cpu, maxCycles);
+}
+
+// Indexed by the flags that are set, one loop compiled for every combination
+static const RunFunction runFunctions[32] =
+{
+    RunWith<0>, RunWith<1>, RunWith<2>, RunWith<3>, RunWith<4>, RunWith<5>, RunWith<6>, RunWith<7>,
+    RunWith<8>, RunWith<9>, RunWith<10>, RunWith<11>, RunWith<12>, RunWith<13>, RunWith<14>, RunWith<15>,
+    RunWith<16>, RunWith<17>, RunWith<18>, RunWith<19>, RunWith<20>, RunWith<21>, RunWith<22>, RunWith<23>,
+    RunWith<24>, RunWith<25>, RunWith<26>, RunWith<27>, RunWith<28>, RunWith<29>, RunWith<30>, RunWith<31>,
+};
+
+StopReason HackCPU::Run(uint64_t maxCycles)
+{
+    int flags = (skipIdleLoops ? 1 : 0) | (trackScreen ? 2 : 0) | (profile ? 4 : 0) | (trace ? 8 : 0) | (heatmap ? 16 : 0);
+    return runFunctions[flags](this, maxCycles);
+}
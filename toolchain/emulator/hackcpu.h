@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+
+// Programs can hold up to 32K instructions, but A and PC are full 16 bit registers so
+// both memories cover every address they could hold
+#define ROM_SIZE 32768
+#define ADDRESS_SPACE 65536
+#define SCREEN_ADDRESS 16384
+#define KEYBOARD_ADDRESS 24576
+#define SCREEN_WORDS (KEYBOARD_ADDRESS - SCREEN_ADDRESS)
+
+// A rom word one past the 16 bit range. Every rom slot past the end of the program holds it so
+// running off the end is caught by the decode table rather than a bounds check on every step.
+#define END_OF_PROGRAM 0x10000
+
+enum Operation : uint8_t
+{
+    OP_LOAD_A,
+
+    OP_ZERO,
+    OP_ONE,
+    OP_NEG_ONE,
+    OP_D,
+    OP_A,
+    OP_M,
+    OP_NOT_D,
+    OP_NOT_A,
+    OP_NOT_M,
+    OP_NEG_D,
+    OP_NEG_A,
+    OP_NEG_M,
+    OP_D_PLUS_ONE,
+    OP_A_PLUS_ONE,
+    OP_M_PLUS_ONE,
+    OP_D_MINUS_ONE,
+    OP_A_MINUS_ONE,
+    OP_M_MINUS_ONE,
+    OP_D_PLUS_A,
+    OP_D_PLUS_M,
+    OP_D_MINUS_A,
+    OP_D_MINUS_M,
+    OP_A_MINUS_D,
+    OP_M_MINUS_D,
+    OP_D_AND_A,
+    OP_D_AND_M,
+    OP_D_OR_A,
+    OP_D_OR_M,
+
+    // Any comp bits outside the documented table, run through the raw ALU
+    OP_GENERIC_A,
+    OP_GENERIC_M,
+
+    OP_END_OF_PROGRAM,
+};
+
+enum Destination : uint8_t
+{
+    DEST_M = 0b001,
+    DEST_D = 0b010,
+    DEST_A = 0b100,
+};
+
+// Jump bits are the condition mask against the sign of the alu output
+enum JumpCondition : uint8_t
+{
+    JUMP_GT = 0b001,
+    JUMP_EQ = 0b010,
+    JUMP_LT = 0b100,
+};
+
+struct DecodedInstruction
+{
+    Operation op;
+    uint8_t dest;
+    uint8_t jump;
+    uint8_t comp;
+};
+
+enum StopReason
+{
+    STOP_CYCLE_LIMIT,
+    STOP_HALTED,
+    STOP_END_OF_PROGRAM,
+    STOP_WATCHPOINT,
+};
+
+// Decoded form of every possible instruction word, plus END_OF_PROGRAM
+extern DecodedInstruction decodeTable[END_OF_PROGRAM + 1];
+
+void BuildDecodeTable();
+
+struct HackProfile;
+struct HackTrace;
+struct HackHeatmap;
+
+struct HackCPU
+{
+    uint32_t rom[ADDRESS_SPACE];
+    uint16_t ram[ADDRESS_SPACE];
+    int romSize;
+
+    uint16_t A;
+    uint16_t D;
+    uint16_t PC;
+    uint64_t cycles;
+
+    // When set, Run counts off loops that have settled into repeating the same state, or into
+    // counting towards their exit, instead of executing them. Cycle counts and final state are
+    // unaffected.
+    bool skipIdleLoops;
+    uint64_t idleCycles;
+    uint32_t writeGeneration;
+    uint32_t writeStamp[ADDRESS_SPACE];
+
+    // When set, Run marks every screen word it writes, one bit per word, so a frame can be
+    // brought up to date without looking at the words that weren't touched
+    bool trackScreen;
+    uint64_t screenDirty[SCREEN_WORDS / 64];
+
+    // When set, Run counts every instruction it executes and every jump it takes here
+    HackProfile* profile;
+
+    // When set, Run records every ram write and taken jump here
+    HackTrace* trace;
+
+    // When set, Run counts the reads and writes of every ram word here and stops on the
+    // accesses it watches
+    HackHeatmap* heatmap;
+
+    /// <summary>
+    /// Clears registers and ram and fills rom with END_OF_PROGRAM
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Loads the text output of the assembler, one 16 character binary word per line
+    /// </summary>
+    bool LoadHack(const char* source);
+
+    /// <summary>
+    /// Runs until maxCycles instructions have executed in total, the program jumps to
+    /// the standard "@HERE 0;JMP" halt loop, or it runs past the end of rom
+    /// </summary>
+    StopReason Run(uint64_t maxCycles);
+};
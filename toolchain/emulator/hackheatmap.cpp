@@ -0,0 +1,236 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "hackheatmap.h"
+
+struct MemoryRegion
+{
+    const char* name;
+    int first;
+    int last;
+};
+
+// The pointers are listed one by one, their traffic is the VM's bookkeeping
+static const MemoryRegion regions[] =
+{
+    { "SP", 0, 0 },
+    { "LCL", 1, 1 },
+    { "ARG", 2, 2 },
+    { "THIS", 3, 3 },
+    { "THAT", 4, 4 },
+    { "temp", 5, 12 },
+    { "R13-R15", 13, 15 },
+    { "statics", 16, 255 },
+    { "stack", 256, 2047 },
+    { "heap", 2048, SCREEN_ADDRESS - 1 },
+    { "screen", SCREEN_ADDRESS, KEYBOARD_ADDRESS - 1 },
+    { "KBD", KEYBOARD_ADDRESS, KEYBOARD_ADDRESS },
+    { "past KBD", KEYBOARD_ADDRESS + 1, ADDRESS_SPACE - 1 },
+};
+
+static const int regionCount = sizeof(regions) / sizeof(regions[0]);
+
+void HackHeatmap::Clear()
+{
+    memset(reads, 0, sizeof(reads));
+    memset(writes, 0, sizeof(writes));
+    memset(watch, 0, sizeof(watch));
+    memset(names, 0, sizeof(names));
+    hit = false;
+}
+
+bool HackHeatmap::LoadSymbols(char* source)
+{
+    int lineNumber = 1;
+    for (char* At = source; *At; ++lineNumber)
+    {
+        char* line = At;
+        while (*At && *At != '\n') ++At;
+        char* end = At;
+        if (*At) ++At;
+        while (end > line && (end[-1] == '\r' || end[-1] == ' ')) --end;
+        if (end == line)
+        {
+            continue;
+        }
+
+        char* nameEnd = line;
+        while (nameEnd < end && *nameEnd != ' ') ++nameEnd;
+        char* addressEnd;
+        long address = strtol(nameEnd, &addressEnd, 10);
+        if (nameEnd == line || addressEnd == nameEnd || addressEnd != end || address < 0 || address >= ADDRESS_SPACE)
+        {
+            printf("Symbol file line %d: expected a name and an address\n", lineNumber);
+            return false;
+        }
+
+        int length = (int)(nameEnd - line);
+        free(names[address]);
+        names[address] = (char*)malloc(length + 1);
+        memcpy(names[address], line, length);
+        names[address][length] = 0;
+    }
+
+    return true;
+}
+
+bool HackHeatmap::Watch(const char* range, uint8_t kinds)
+{
+    char* end;
+    long first = strtol(range, &end, 10);
+    long last = first;
+    if (end != range && *end == '-')
+    {
+        const char* lastStart = end + 1;
+        last = strtol(lastStart, &end, 10);
+        if (end == lastStart)
+        {
+            end = (char*)range;
+        }
+    }
+
+    if (end == range || *end || first < 0 || last < first || last >= ADDRESS_SPACE)
+    {
+        printf("Invalid watch range: %s\n", range);
+        return false;
+    }
+
+    for (long address = first; address <= last; ++address)
+    {
+        watch[address] |= kinds;
+    }
+
+    return true;
+}
+
+static const MemoryRegion* RegionOf(int address)
+{
+    for (int i = 0; i < regionCount; ++i)
+    {
+        if (address <= regions[i].last)
+        {
+            return &regions[i];
+        }
+    }
+
+    return &regions[regionCount - 1];
+}
+
+// The variable the assembler put at address, or else what the region calls it
+static void FormatAddress(char* text, size_t size, HackHeatmap* heatmap, int address)
+{
+    const MemoryRegion* region = RegionOf(address);
+    if (heatmap->names[address])
+    {
+        snprintf(text, size, "%s", heatmap->names[address]);
+    }
+    else if (region->first == region->last)
+    {
+        snprintf(text, size, "%s", region->name);
+    }
+    else if (address < 16)
+    {
+        snprintf(text, size, "R%d", address);
+    }
+    else
+    {
+        snprintf(text, size, "%s+%d", region->name, address - region->first);
+    }
+}
+
+void HackHeatmap::PrintHit()
+{
+    char name[256];
+    FormatAddress(name, sizeof(name), this, hitAddress);
+    printf("Watchpoint at cycle %llu: the instruction at pc %d %s RAM[%d] (%s), value %d\n", (unsigned long long)hitCycle,
+        hitPC, hitKind == WATCH_WRITE ? "wrote" : "read", hitAddress, name, (int16_t)hitValue);
+}
+
+void HackHeatmap::PrintReport()
+{
+    uint64_t total = 0;
+    for (int address = 0; address < ADDRESS_SPACE; ++address)
+    {
+        total += reads[address] + writes[address];
+    }
+
+    if (total == 0)
+    {
+        return;
+    }
+
+    printf("Memory traffic:\n");
+    printf("%-24s %11s %14s %14s %8s\n", "region", "addresses", "reads", "writes", "share");
+    uint64_t pointers = 0;
+    for (int i = 0; i < regionCount; ++i)
+    {
+        const MemoryRegion* region = &regions[i];
+        uint64_t regionReads = 0;
+        uint64_t regionWrites = 0;
+        for (int address = region->first; address <= region->last; ++address)
+        {
+            regionReads += reads[address];
+            regionWrites += writes[address];
+        }
+
+        if (region->last <= 4)
+        {
+            pointers += regionReads + regionWrites;
+        }
+
+        char addresses[32];
+        snprintf(addresses, sizeof(addresses), region->first == region->last ? "%d" : "%d-%d", region->first, region->last);
+        printf("%-24s %11s %14llu %14llu %7.2f%%\n", region->name, addresses, (unsigned long long)regionReads,
+            (unsigned long long)regionWrites, 100.0 * (regionReads + regionWrites) / total);
+    }
+
+    printf("SP, LCL, ARG, THIS and THAT take %.2f%% of all ram traffic\n", 100.0 * pointers / total);
+
+    int* hottest = (int*)malloc(sizeof(int) * ADDRESS_SPACE);
+    int hotCount = 0;
+    for (int address = 0; address < ADDRESS_SPACE; ++address)
+    {
+        if (reads[address] || writes[address])
+        {
+            hottest[hotCount++] = address;
+        }
+    }
+
+    int shown = std::min(hotCount, HEATMAP_REPORT_LENGTH);
+    std::partial_sort(hottest, hottest + shown, hottest + hotCount, [this](int left, int right)
+    {
+        return reads[left] + writes[left] > reads[right] + writes[right];
+    });
+
+    char name[256];
+    printf("Hot words:\n");
+    printf("%-24s %11s %14s %14s %8s\n", "name", "address", "reads", "writes", "share");
+    for (int i = 0; i < shown; ++i)
+    {
+        int address = hottest[i];
+        FormatAddress(name, sizeof(name), this, address);
+        printf("%-24s %11d %14llu %14llu %7.2f%%\n", name, address, (unsigned long long)reads[address],
+            (unsigned long long)writes[address], 100.0 * (reads[address] + writes[address]) / total);
+    }
+
+    free(hottest);
+}
+
+bool HackHeatmap::WriteHeatmap(FILE* output)
+{
+    char name[256];
+    for (int address = 0; address < ADDRESS_SPACE; ++address)
+    {
+        if (reads[address] || writes[address])
+        {
+            FormatAddress(name, sizeof(name), this, address);
+            if (fprintf(output, "%d %llu %llu %s\n", address, (unsigned long long)reads[address],
+                (unsigned long long)writes[address], name) < 0)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "hackcpu.h"
+
+// How many entries the hottest words report lists
+#define HEATMAP_REPORT_LENGTH 10
+
+enum WatchKind : uint8_t
+{
+    WATCH_WRITE = 0b01,
+    WATCH_READ = 0b10,
+};
+
+struct HackHeatmap
+{
+    // Indexed by ram address
+    uint64_t reads[ADDRESS_SPACE];
+    uint64_t writes[ADDRESS_SPACE];
+
+    // WatchKind bits for every address. An access a bit is set for stops the run once its
+    // instruction is done.
+    uint8_t watch[ADDRESS_SPACE];
+
+    // The access that stopped the run, with the cycle count after it
+    bool hit;
+    WatchKind hitKind;
+    uint16_t hitAddress;
+    uint16_t hitValue;
+    uint16_t hitPC;
+    uint64_t hitCycle;
+
+    // Variable names by address, from assembler -symbols
+    char* names[ADDRESS_SPACE];
+
+    void Clear();
+
+    /// <summary>
+    /// Reads a .sym written by assembler -symbols, so the report can name the statics
+    /// </summary>
+    bool LoadSymbols(char* source);
+
+    /// <summary>
+    /// Parses "first" or "first-last" and watches those addresses for the given kinds of access
+    /// </summary>
+    bool Watch(const char* range, uint8_t kinds);
+
+    inline void Hit(WatchKind kind, uint16_t address, uint16_t value, uint16_t pc, uint64_t cycle)
+    {
+        hit = true;
+        hitKind = kind;
+        hitAddress = address;
+        hitValue = value;
+        hitPC = pc;
+        hitCycle = cycle;
+    }
+
+    void PrintHit();
+
+    /// <summary>
+    /// Prints the reads and writes of every region, from the VM's pointers down to the
+    /// keyboard, and the words with the most traffic
+    /// </summary>
+    void PrintReport();
+
+    /// <summary>
+    /// Writes one "address reads writes name" line for every word the run touched
+    /// </summary>
+    bool WriteHeatmap(FILE* output);
+};
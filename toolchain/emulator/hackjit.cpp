@@ -0,0 +1,477 @@
+#include <cstddef>
+#include <cstring>
+#include "hackjit.h"
+
+#if HACK_JIT_SUPPORTED
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Translated code keeps the machine in host registers for the whole time it runs. It never
+// calls out, so everything but rsp is free to use once the enter stub has saved the callee
+// saved registers of both the Windows and System V conventions.
+//
+//   rdi  JitState*
+//   ebx  A, zero extended
+//   ebp  D, zero extended
+//   r12  ram
+//   r13  cycles
+//   r14  maxCycles
+//   r15  blockTable
+//   eax  alu output, and the pc for indirect jumps
+//   ecx  second alu operand
+//   edx  A from before the instruction, when it both writes A and jumps through it
+
+// Worst case size of one translated block including its exit stubs
+#define JIT_BLOCK_MARGIN 8192
+
+static void Emit(uint8_t*& at, uint8_t byte)
+{
+    *at++ = byte;
+}
+
+static void Emit(uint8_t*& at, uint8_t first, uint8_t second)
+{
+    *at++ = first;
+    *at++ = second;
+}
+
+static void Emit(uint8_t*& at, uint8_t first, uint8_t second, uint8_t third)
+{
+    *at++ = first;
+    *at++ = second;
+    *at++ = third;
+}
+
+static void Emit32(uint8_t*& at, uint32_t value)
+{
+    memcpy(at, &value, sizeof(value));
+    at += sizeof(value);
+}
+
+static void Emit64(uint8_t*& at, uint64_t value)
+{
+    memcpy(at, &value, sizeof(value));
+    at += sizeof(value);
+}
+
+static void PatchRel32(uint8_t* rel32, uint8_t* target)
+{
+    int32_t offset = (int32_t)(target - (rel32 + 4));
+    memcpy(rel32, &offset, sizeof(offset));
+}
+
+// mov dword [rdi + field], value
+static void EmitStoreState(uint8_t*& at, size_t field, uint32_t value)
+{
+    Emit(at, 0xC7, 0x47, (uint8_t)field);
+    Emit32(at, value);
+}
+
+static void EmitJump(uint8_t*& at, uint8_t* target)
+{
+    Emit(at, 0xE9);
+    Emit32(at, 0);
+    PatchRel32(at - 4, target);
+}
+
+// movzx reg, word [r12 + rbx * 2], reg being eax or ecx
+static void EmitLoadM(uint8_t*& at, uint8_t reg)
+{
+    Emit(at, 0x41, 0x0F, 0xB7);
+    Emit(at, (uint8_t)(0x04 | (reg << 3)), 0x5C);
+}
+
+static void EmitLoadD(uint8_t*& at)
+{
+    Emit(at, 0x89, 0xE8);
+}
+
+static void EmitLoadA(uint8_t*& at)
+{
+    Emit(at, 0x89, 0xD8);
+}
+
+// Leaves the alu output in eax, not yet truncated to 16 bits
+static void EmitComp(uint8_t*& at, DecodedInstruction instruction)
+{
+    switch (instruction.op)
+    {
+        case OP_ZERO: Emit(at, 0x31, 0xC0); break;
+        case OP_ONE: Emit(at, 0xB8); Emit32(at, 1); break;
+        case OP_NEG_ONE: Emit(at, 0xB8); Emit32(at, 0xFFFF); break;
+        case OP_D: EmitLoadD(at); break;
+        case OP_A: EmitLoadA(at); break;
+        case OP_M: EmitLoadM(at, 0); break;
+        case OP_NOT_D: EmitLoadD(at); Emit(at, 0xF7, 0xD0); break;
+        case OP_NOT_A: EmitLoadA(at); Emit(at, 0xF7, 0xD0); break;
+        case OP_NOT_M: EmitLoadM(at, 0); Emit(at, 0xF7, 0xD0); break;
+        case OP_NEG_D: EmitLoadD(at); Emit(at, 0xF7, 0xD8); break;
+        case OP_NEG_A: EmitLoadA(at); Emit(at, 0xF7, 0xD8); break;
+        case OP_NEG_M: EmitLoadM(at, 0); Emit(at, 0xF7, 0xD8); break;
+        case OP_D_PLUS_ONE: EmitLoadD(at); Emit(at, 0x83, 0xC0, 0x01); break;
+        case OP_A_PLUS_ONE: EmitLoadA(at); Emit(at, 0x83, 0xC0, 0x01); break;
+        case OP_M_PLUS_ONE: EmitLoadM(at, 0); Emit(at, 0x83, 0xC0, 0x01); break;
+        case OP_D_MINUS_ONE: EmitLoadD(at); Emit(at, 0x83, 0xE8, 0x01); break;
+        case OP_A_MINUS_ONE: EmitLoadA(at); Emit(at, 0x83, 0xE8, 0x01); break;
+        case OP_M_MINUS_ONE: EmitLoadM(at, 0); Emit(at, 0x83, 0xE8, 0x01); break;
+        case OP_D_PLUS_A: EmitLoadD(at); Emit(at, 0x01, 0xD8); break;
+        case OP_D_PLUS_M: EmitLoadD(at); EmitLoadM(at, 1); Emit(at, 0x01, 0xC8); break;
+        case OP_D_MINUS_A: EmitLoadD(at); Emit(at, 0x29, 0xD8); break;
+        case OP_D_MINUS_M: EmitLoadD(at); EmitLoadM(at, 1); Emit(at, 0x29, 0xC8); break;
+        case OP_A_MINUS_D: EmitLoadA(at); Emit(at, 0x29, 0xE8); break;
+        case OP_M_MINUS_D: EmitLoadM(at, 0); Emit(at, 0x29, 0xE8); break;
+        case OP_D_AND_A: EmitLoadD(at); Emit(at, 0x21, 0xD8); break;
+        case OP_D_AND_M: EmitLoadD(at); EmitLoadM(at, 1); Emit(at, 0x21, 0xC8); break;
+        case OP_D_OR_A: EmitLoadD(at); Emit(at, 0x09, 0xD8); break;
+        case OP_D_OR_M: EmitLoadD(at); EmitLoadM(at, 1); Emit(at, 0x09, 0xC8); break;
+
+        default:
+        {
+            // Raw alu with x in eax and y in ecx
+            uint8_t comp = instruction.comp;
+            EmitLoadD(at);
+            if (instruction.op == OP_GENERIC_M) EmitLoadM(at, 1);
+            else Emit(at, 0x89, 0xD9);
+
+            if (comp & 0b100000) Emit(at, 0x31, 0xC0);
+            if (comp & 0b010000) Emit(at, 0xF7, 0xD0);
+            if (comp & 0b001000) Emit(at, 0x31, 0xC9);
+            if (comp & 0b000100) Emit(at, 0xF7, 0xD1);
+            if (comp & 0b000010) Emit(at, 0x01, 0xC8);
+            else Emit(at, 0x21, 0xC8);
+            if (comp & 0b000001) Emit(at, 0xF7, 0xD0);
+            break;
+        }
+    }
+}
+
+// Low nibble of the jcc opcode for each set of jump bits, testing the sign of ax
+static uint8_t ConditionCode(uint8_t jump)
+{
+    switch (jump)
+    {
+        case JUMP_GT: return 0xF;
+        case JUMP_EQ: return 0x4;
+        case JUMP_GT | JUMP_EQ: return 0xD;
+        case JUMP_LT: return 0xC;
+        case JUMP_LT | JUMP_GT: return 0x5;
+        default: return 0xE;
+    }
+}
+
+struct ExitStub
+{
+    uint8_t* rel32;
+    uint32_t exit;
+    uint32_t pc;
+};
+
+bool HackJit::Init()
+{
+#ifdef _WIN32
+    code = (uint8_t*)VirtualAlloc(nullptr, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    code = (uint8_t*)mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+    {
+        code = nullptr;
+    }
+#endif
+
+    if (!code)
+    {
+        return false;
+    }
+
+    uint8_t* at = code;
+
+    // enter(JitState* state, uint8_t* block)
+    enter = at;
+    Emit(at, 0x53);
+    Emit(at, 0x55);
+    Emit(at, 0x57);
+    Emit(at, 0x56);
+    Emit(at, 0x41, 0x54);
+    Emit(at, 0x41, 0x55);
+    Emit(at, 0x41, 0x56);
+    Emit(at, 0x41, 0x57);
+#ifdef _WIN32
+    Emit(at, 0x48, 0x89, 0xCF);
+    Emit(at, 0x48, 0x89, 0xD0);
+#else
+    Emit(at, 0x48, 0x89, 0xF0);
+#endif
+    Emit(at, 0x8B, 0x5F, (uint8_t)offsetof(JitState, A));
+    Emit(at, 0x8B, 0x6F, (uint8_t)offsetof(JitState, D));
+    Emit(at, 0x4C, 0x8B, 0x6F); Emit(at, (uint8_t)offsetof(JitState, cycles));
+    Emit(at, 0x4C, 0x8B, 0x77); Emit(at, (uint8_t)offsetof(JitState, maxCycles));
+    Emit(at, 0x4C, 0x8B, 0x67); Emit(at, (uint8_t)offsetof(JitState, ram));
+    Emit(at, 0x4C, 0x8B, 0x7F); Emit(at, (uint8_t)offsetof(JitState, blockTable));
+    Emit(at, 0xFF, 0xE0);
+
+    // Every block leaves through here once pc and exit are stored
+    exit = at;
+    Emit(at, 0x89, 0x5F, (uint8_t)offsetof(JitState, A));
+    Emit(at, 0x89, 0x6F, (uint8_t)offsetof(JitState, D));
+    Emit(at, 0x4C, 0x89, 0x6F); Emit(at, (uint8_t)offsetof(JitState, cycles));
+    Emit(at, 0x41, 0x5F);
+    Emit(at, 0x41, 0x5E);
+    Emit(at, 0x41, 0x5D);
+    Emit(at, 0x41, 0x5C);
+    Emit(at, 0x5E);
+    Emit(at, 0x5F);
+    Emit(at, 0x5D);
+    Emit(at, 0x5B);
+    Emit(at, 0xC3);
+
+    // Indirect jumps to an untranslated address land here with the target in eax
+    miss = at;
+    Emit(at, 0x89, 0x47, (uint8_t)offsetof(JitState, pc));
+    EmitStoreState(at, offsetof(JitState, exit), JIT_EXIT_MISS);
+    EmitJump(at, exit);
+
+    firstBlock = at;
+    Flush();
+    return true;
+}
+
+void HackJit::Flush()
+{
+    codeAt = firstBlock;
+    for (int i = 0; i < ADDRESS_SPACE; ++i)
+    {
+        blockTable[i] = miss;
+    }
+}
+
+uint8_t* HackJit::Translate(HackCPU* cpu, int start)
+{
+    int length = 0;
+    while (start + length < cpu->romSize && length < JIT_MAX_BLOCK_LENGTH)
+    {
+        DecodedInstruction instruction = decodeTable[cpu->rom[start + length++]];
+        if (instruction.op != OP_LOAD_A && instruction.jump)
+        {
+            break;
+        }
+    }
+
+    uint8_t* at = codeAt;
+    uint8_t* entry = at;
+    ExitStub stubs[3];
+    int stubCount = 0;
+
+    // Static branches go straight to the target when it's already translated, otherwise
+    // through a stub that asks the dispatcher to translate it and patch the branch
+    auto branchTo = [&](uint32_t reason, uint32_t target)
+    {
+        if (reason == JIT_EXIT_MISS && target < (uint32_t)cpu->romSize && blockTable[target] != miss)
+        {
+            PatchRel32(at - 4, blockTable[target]);
+        }
+        else
+        {
+            stubs[stubCount++] = { at - 4, reason, target };
+        }
+    };
+
+    // Charge the whole block up front, bailing to the interpreter if it doesn't fit
+    Emit(at, 0x49, 0x8D, 0x85);
+    Emit32(at, length);
+    Emit(at, 0x4C, 0x39, 0xF0);
+    Emit(at, 0x0F, 0x87);
+    Emit32(at, 0);
+    branchTo(JIT_EXIT_CYCLE_LIMIT, start);
+    Emit(at, 0x49, 0x89, 0xC5);
+
+    // -1 when A isn't known at translation time
+    int knownA = -1;
+    bool fallsThrough = true;
+    for (int pc = start; pc < start + length; ++pc)
+    {
+        uint32_t word = cpu->rom[pc];
+        DecodedInstruction instruction = decodeTable[word];
+        if (instruction.op == OP_LOAD_A)
+        {
+            Emit(at, 0xBB);
+            Emit32(at, word);
+            knownA = word;
+            continue;
+        }
+
+        EmitComp(at, instruction);
+        Emit(at, 0x0F, 0xB7, 0xC0);
+
+        // Everything in the instruction sees A as it was before the instruction
+        bool savesAddress = instruction.jump && knownA < 0 && (instruction.dest & DEST_A);
+        if (savesAddress) Emit(at, 0x89, 0xDA);
+        if (instruction.dest & DEST_M) { Emit(at, 0x66, 0x41, 0x89); Emit(at, 0x04, 0x5C); }
+        if (instruction.dest & DEST_A) Emit(at, 0x89, 0xC3);
+        if (instruction.dest & DEST_D) Emit(at, 0x89, 0xC5);
+
+        if (instruction.jump)
+        {
+            bool always = instruction.jump == (JUMP_LT | JUMP_EQ | JUMP_GT);
+            uint8_t condition = ConditionCode(instruction.jump);
+            bool canHalt = !instruction.dest && pc > 0 && cpu->rom[pc - 1] == (uint32_t)(pc - 1);
+            fallsThrough = !always;
+            if (!always)
+            {
+                Emit(at, 0x66, 0x85, 0xC0);
+            }
+
+            if (knownA >= 0)
+            {
+                if (always) Emit(at, 0xE9);
+                else Emit(at, 0x0F, (uint8_t)(0x80 | condition));
+                Emit32(at, 0);
+
+                // "(HERE) @HERE 0;JMP" with nothing written can never leave, treat it as a halt
+                if (canHalt && knownA == pc - 1) branchTo(JIT_EXIT_HALTED, knownA);
+                else branchTo(JIT_EXIT_MISS, knownA);
+            }
+            else
+            {
+                // Skip the indirect jump with the inverse condition
+                uint8_t* skip = nullptr;
+                if (!always)
+                {
+                    Emit(at, (uint8_t)(0x70 | (condition ^ 1)), 0);
+                    skip = at;
+                }
+
+                if (savesAddress) Emit(at, 0x89, 0xD0);
+                else EmitLoadA(at);
+
+                if (canHalt)
+                {
+                    Emit(at, 0x3D);
+                    Emit32(at, pc - 1);
+                    Emit(at, 0x0F, 0x84);
+                    Emit32(at, 0);
+                    branchTo(JIT_EXIT_HALTED, pc - 1);
+                }
+
+                // jmp [r15 + rax * 8]
+                Emit(at, 0x41, 0xFF, 0x24);
+                Emit(at, 0xC7);
+
+                if (skip)
+                {
+                    skip[-1] = (uint8_t)(at - skip);
+                }
+            }
+        }
+
+        if (instruction.dest & DEST_A)
+        {
+            knownA = -1;
+        }
+    }
+
+    if (fallsThrough)
+    {
+        Emit(at, 0xE9);
+        Emit32(at, 0);
+        branchTo(JIT_EXIT_MISS, start + length);
+    }
+
+    for (int i = 0; i < stubCount; ++i)
+    {
+        PatchRel32(stubs[i].rel32, at);
+        EmitStoreState(at, offsetof(JitState, pc), stubs[i].pc);
+        EmitStoreState(at, offsetof(JitState, exit), stubs[i].exit);
+        if (stubs[i].exit == JIT_EXIT_MISS)
+        {
+            // mov rax, rel32; mov [rdi + link], rax
+            Emit(at, 0x48, 0xB8);
+            Emit64(at, (uint64_t)(uintptr_t)stubs[i].rel32);
+            Emit(at, 0x48, 0x89, 0x47);
+            Emit(at, (uint8_t)offsetof(JitState, link));
+        }
+
+        EmitJump(at, exit);
+    }
+
+    codeAt = at;
+    blockTable[start] = entry;
+    return entry;
+}
+
+StopReason HackJit::Run(HackCPU* cpu, uint64_t maxCycles)
+{
+    JitState state = { cpu->A, cpu->D, cpu->PC, JIT_EXIT_MISS, cpu->cycles, maxCycles, cpu->ram, blockTable, nullptr };
+    typedef void (*EnterFunction)(JitState* state, uint8_t* block);
+    EnterFunction enterBlock = (EnterFunction)enter;
+
+    // Past the end of the program, or with the cycle limit inside the next block, the
+    // interpreter takes over and works out exactly where to stop
+    while (state.pc < (uint32_t)cpu->romSize)
+    {
+        uint8_t* block = blockTable[state.pc];
+        if (block == miss)
+        {
+            if (codeAt + JIT_BLOCK_MARGIN > code + JIT_CODE_SIZE)
+            {
+                Flush();
+                state.link = nullptr;
+            }
+
+            block = Translate(cpu, state.pc);
+        }
+
+        if (state.link)
+        {
+            PatchRel32(state.link, block);
+            state.link = nullptr;
+        }
+
+        enterBlock(&state, block);
+        if (state.exit == JIT_EXIT_CYCLE_LIMIT)
+        {
+            break;
+        }
+
+        if (state.exit == JIT_EXIT_HALTED)
+        {
+            cpu->A = (uint16_t)state.A;
+            cpu->D = (uint16_t)state.D;
+            cpu->PC = (uint16_t)state.pc;
+            cpu->cycles = state.cycles;
+            return STOP_HALTED;
+        }
+    }
+
+    cpu->A = (uint16_t)state.A;
+    cpu->D = (uint16_t)state.D;
+    cpu->PC = (uint16_t)state.pc;
+    cpu->cycles = state.cycles;
+    return cpu->Run(maxCycles);
+}
+
+#else
+
+bool HackJit::Init()
+{
+    return false;
+}
+
+void HackJit::Flush()
+{
+}
+
+uint8_t* HackJit::Translate(HackCPU* cpu, int pc)
+{
+    return nullptr;
+}
+
+StopReason HackJit::Run(HackCPU* cpu, uint64_t maxCycles)
+{
+    return cpu->Run(maxCycles);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include "hackcpu.h"
+
+// The jit only knows how to emit x86-64, everywhere else HackJit::Run just interprets
+#if defined(_M_X64) || defined(__x86_64__)
+#define HACK_JIT_SUPPORTED 1
+#else
+#define HACK_JIT_SUPPORTED 0
+#endif
+
+#define JIT_CODE_SIZE (64 * 1024 * 1024)
+
+// Longest run of instructions translated as one block. Blocks also end at every jump.
+#define JIT_MAX_BLOCK_LENGTH 64
+
+enum JitExit : uint32_t
+{
+    // state.pc has no translation yet, or is past the end of the program
+    JIT_EXIT_MISS,
+    // The block at state.pc would have gone over maxCycles
+    JIT_EXIT_CYCLE_LIMIT,
+    JIT_EXIT_HALTED,
+};
+
+// Everything the translated code reads or writes outside of its host registers.
+// Kept small so every field is reachable with an 8 bit displacement.
+struct JitState
+{
+    uint32_t A;
+    uint32_t D;
+    uint32_t pc;
+    uint32_t exit;
+    uint64_t cycles;
+    uint64_t maxCycles;
+    uint16_t* ram;
+    uint8_t** blockTable;
+
+    // When a static jump exits to a block that wasn't translated yet, the address of
+    // the jump's rel32 so it can be pointed straight at the new block
+    uint8_t* link;
+};
+
+struct HackJit
+{
+    uint8_t* code;
+    uint8_t* codeAt;
+    uint8_t* firstBlock;
+
+    // Shared stubs at the start of the code buffer
+    uint8_t* enter;
+    uint8_t* exit;
+    uint8_t* miss;
+
+    // Translated entry point for every rom address, or the miss stub
+    uint8_t* blockTable[ADDRESS_SPACE];
+
+    /// <summary>
+    /// Allocates the executable code buffer and emits the shared stubs. Returns false
+    /// when the platform isn't supported or the buffer can't be allocated.
+    /// </summary>
+    bool Init();
+
+    /// <summary>
+    /// Same contract as HackCPU::Run, executing translated blocks wherever it can and
+    /// finishing with the interpreter when the cycle limit lands inside a block
+    /// </summary>
+    StopReason Run(HackCPU* cpu, uint64_t maxCycles);
+
+    /// <summary>
+    /// Drops every translation, used when the code buffer fills up
+    /// </summary>
+    void Flush();
+
+    /// <summary>
+    /// Translates the block starting at pc and returns its entry point
+    /// </summary>
+    uint8_t* Translate(HackCPU* cpu, int pc);
+};
@@ -0,0 +1,495 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "hackprofile.h"
+
+enum LineKind
+{
+    LINE_NONE,
+    LINE_LABEL,
+    LINE_INSTRUCTION,
+};
+
+struct SourceLabel
+{
+    const char* text;
+    int length;
+};
+
+struct HotRange
+{
+    int first;
+    int last;
+    uint64_t cycles;
+    uint64_t count;
+};
+
+// Sorts out one line of assembly the way the assembler sees it: a label, an instruction,
+// or nothing but whitespace and comments. For a label, text is the name without the ().
+static LineKind ClassifyLine(const char* line, const char* end, const char** text, int* length)
+{
+    while (line < end && (*line == ' ' || *line == '\t'))
+    {
+        ++line;
+    }
+
+    const char* last = line;
+    while (last < end && !(last[0] == '/' && last + 1 < end && last[1] == '/') && *last != '\r')
+    {
+        ++last;
+    }
+
+    while (last > line && (last[-1] == ' ' || last[-1] == '\t'))
+    {
+        --last;
+    }
+
+    if (last == line)
+    {
+        return LINE_NONE;
+    }
+
+    if (*line == '(')
+    {
+        *text = line + 1;
+        *length = (int)(last - line - 1);
+        if (*length > 0 && (*text)[*length - 1] == ')')
+        {
+            --*length;
+        }
+
+        return LINE_LABEL;
+    }
+
+    *text = line;
+    *length = (int)(last - line);
+    return LINE_INSTRUCTION;
+}
+
+// Finds the label each rom address sits under, returning a malloc'd array of them. The
+// rest of the label comes from the offset between the label's address and this one.
+static SourceLabel* FindLabels(char* asmSource, int* labelAddress)
+{
+    SourceLabel* labels = (SourceLabel*)calloc(ADDRESS_SPACE, sizeof(SourceLabel));
+    int address = 0;
+    SourceLabel current = {};
+    int currentAddress = 0;
+
+    for (char* At = asmSource; asmSource && *At;)
+    {
+        char* end = At;
+        while (*end && *end != '\n') ++end;
+
+        const char* text;
+        int length;
+        LineKind kind = ClassifyLine(At, end, &text, &length);
+        if (kind == LINE_LABEL)
+        {
+            current = { text, length };
+            currentAddress = address;
+        }
+        else if (kind == LINE_INSTRUCTION && address < ADDRESS_SPACE)
+        {
+            labels[address] = current;
+            labelAddress[address] = currentAddress;
+            ++address;
+        }
+
+        At = *end ? end + 1 : end;
+    }
+
+    return labels;
+}
+
+// Writes at most 256 characters, label+offset or the bare address when there are no labels
+static void FormatLocation(char* output, SourceLabel* labels, int* labelAddress, int address)
+{
+    SourceLabel label = labels[address];
+    if (!label.text)
+    {
+        snprintf(output, 256, "%d", address);
+    }
+    else if (labelAddress[address] == address)
+    {
+        snprintf(output, 256, "%.*s", label.length, label.text);
+    }
+    else
+    {
+        snprintf(output, 256, "%.*s+%d", label.length, label.text, address - labelAddress[address]);
+    }
+}
+
+void HackProfile::Clear()
+{
+    memset(executed, 0, sizeof(executed));
+    memset(taken, 0, sizeof(taken));
+    memset(jumpKind, 0, sizeof(jumpKind));
+    functionCount = 0;
+    functionNames = nullptr;
+
+    // Everything runs under the root until the first call, normally the bootstrap's call to Sys.init
+    nodeCapacity = 1024;
+    nodes = (StackNode*)malloc(sizeof(StackNode) * nodeCapacity);
+    nodes[0] = { -1, -1, -1, -1, 0, 0 };
+    nodeCount = 1;
+    currentNode = 0;
+    lastCycle = 0;
+}
+
+static int FindFunction(HackProfile* profile, const char* name, int length)
+{
+    for (int i = 0; i < profile->functionCount; ++i)
+    {
+        if ((int)strlen(profile->functionNames[i]) == length && strncmp(profile->functionNames[i], name, length) == 0)
+        {
+            return i;
+        }
+    }
+
+    profile->functionNames = (char**)realloc(profile->functionNames, sizeof(char*) * (profile->functionCount + 1));
+    char* copy = (char*)malloc(length + 1);
+    memcpy(copy, name, length);
+    copy[length] = 0;
+    profile->functionNames[profile->functionCount] = copy;
+    return profile->functionCount++;
+}
+
+bool HackProfile::LoadCallMap(char* source)
+{
+    int lineNumber = 1;
+    for (char* At = source; *At; ++lineNumber)
+    {
+        char* line = At;
+        while (*At && *At != '\n') ++At;
+        char* end = At;
+        if (*At) ++At;
+        while (end > line && (end[-1] == '\r' || end[-1] == ' ')) --end;
+        if (end == line)
+        {
+            continue;
+        }
+
+        char kind[16];
+        int consumed = 0;
+        sscanf(line, "%15s %n", kind, &consumed);
+        char* rest = line + consumed;
+        if (consumed && strcmp(kind, "function") == 0)
+        {
+            // Only the name matters, the stacks are found from the call and return sites
+            char* nameEnd = rest;
+            while (nameEnd < end && *nameEnd != ' ') ++nameEnd;
+            FindFunction(this, rest, (int)(nameEnd - rest));
+        }
+        else if (consumed && (strcmp(kind, "call") == 0 || strcmp(kind, "return") == 0))
+        {
+            char* name;
+            long address = strtol(rest, &name, 10);
+            while (*name == ' ') ++name;
+            if (name == rest || address < 0 || address >= ADDRESS_SPACE || name >= end)
+            {
+                printf("Call map line %d: expected an address and a function\n", lineNumber);
+                return false;
+            }
+
+            jumpKind[address] = kind[0] == 'c' ? JUMP_KIND_CALL : JUMP_KIND_RETURN;
+            callee[address] = FindFunction(this, name, (int)(end - name));
+        }
+        else
+        {
+            printf("Call map line %d: expected function, call or return\n", lineNumber);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void HackProfile::StackJump(uint16_t pc, uint64_t cycle)
+{
+    nodes[currentNode].cycles += cycle - lastCycle;
+    lastCycle = cycle;
+
+    if (jumpKind[pc] == JUMP_KIND_RETURN)
+    {
+        // A return with nothing to return from means the map and the program disagree, stay put
+        if (nodes[currentNode].parent >= 0)
+        {
+            currentNode = nodes[currentNode].parent;
+        }
+
+        return;
+    }
+
+    int function = callee[pc];
+    int child = nodes[currentNode].firstChild;
+    while (child >= 0 && nodes[child].function != function)
+    {
+        child = nodes[child].nextSibling;
+    }
+
+    if (child < 0)
+    {
+        if (nodeCount == nodeCapacity)
+        {
+            nodeCapacity *= 2;
+            nodes = (StackNode*)realloc(nodes, sizeof(StackNode) * nodeCapacity);
+        }
+
+        child = nodeCount++;
+        nodes[child] = { function, currentNode, -1, nodes[currentNode].firstChild, 0, 0 };
+        nodes[currentNode].firstChild = child;
+    }
+
+    ++nodes[child].calls;
+    currentNode = child;
+}
+
+bool HackProfile::WriteFoldedStacks(uint64_t cycle, FILE* output)
+{
+    // Whatever ran since the last call or return belongs to the stack the program stopped in
+    nodes[currentNode].cycles += cycle - lastCycle;
+    lastCycle = cycle;
+
+    uint64_t* exclusive = (uint64_t*)calloc(functionCount + 1, sizeof(uint64_t));
+    uint64_t* inclusive = (uint64_t*)calloc(functionCount + 1, sizeof(uint64_t));
+    uint64_t* calls = (uint64_t*)calloc(functionCount + 1, sizeof(uint64_t));
+    int* seen = (int*)calloc(functionCount + 1, sizeof(int));
+    int* path = (int*)malloc(sizeof(int) * nodeCount);
+
+    // The root has no function, it's counted as slot functionCount
+    for (int node = 0; node < nodeCount; ++node)
+    {
+        int depth = 0;
+        for (int at = node; at >= 0; at = nodes[at].parent)
+        {
+            path[depth++] = at;
+        }
+
+        uint64_t cycles = nodes[node].cycles;
+        int function = nodes[node].function >= 0 ? nodes[node].function : functionCount;
+        exclusive[function] += cycles;
+        calls[function] += nodes[node].calls;
+
+        // Recursion puts a function on the stack more than once, count it once
+        for (int i = 0; i < depth; ++i)
+        {
+            int onStack = nodes[path[i]].function >= 0 ? nodes[path[i]].function : functionCount;
+            if (seen[onStack] != node + 1)
+            {
+                seen[onStack] = node + 1;
+                inclusive[onStack] += cycles;
+            }
+        }
+
+        if (!cycles)
+        {
+            continue;
+        }
+
+        for (int i = depth - 1; i >= 0; --i)
+        {
+            int onStack = nodes[path[i]].function;
+            fprintf(output, "%s%s", onStack >= 0 ? functionNames[onStack] : "[start]", i ? ";" : "");
+        }
+
+        fprintf(output, " %llu\n", (unsigned long long)cycles);
+    }
+
+    int* order = (int*)malloc(sizeof(int) * (functionCount + 1));
+    for (int i = 0; i <= functionCount; ++i)
+    {
+        order[i] = i;
+    }
+
+    std::sort(order, order + functionCount + 1, [&](int left, int right) { return inclusive[left] > inclusive[right]; });
+
+    uint64_t total = inclusive[functionCount];
+    printf("Hot functions:\n");
+    printf("%14s %8s %14s %8s %10s  %s\n", "inclusive", "share", "exclusive", "share", "calls", "function");
+    for (int i = 0; i <= functionCount && i < PROFILE_REPORT_LENGTH * 2; ++i)
+    {
+        int function = order[i];
+        if (!inclusive[function])
+        {
+            break;
+        }
+
+        printf("%14llu %7.2f%% %14llu %7.2f%% %10llu  %s\n", (unsigned long long)inclusive[function], total ? 100.0 * inclusive[function] / total : 0.0,
+            (unsigned long long)exclusive[function], total ? 100.0 * exclusive[function] / total : 0.0, (unsigned long long)calls[function],
+            function < functionCount ? functionNames[function] : "[start]");
+    }
+
+    free(order);
+    free(path);
+    free(seen);
+    free(calls);
+    free(inclusive);
+    free(exclusive);
+    return true;
+}
+
+bool HackProfile::WriteListing(HackCPU* cpu, char* asmSource, FILE* output)
+{
+    uint64_t total = 0;
+    for (int address = 0; address < cpu->romSize; ++address)
+    {
+        total += executed[address];
+    }
+
+    int address = 0;
+    for (char* At = asmSource; *At;)
+    {
+        char* end = At;
+        while (*end && *end != '\n') ++end;
+        char* lineEnd = end > At && end[-1] == '\r' ? end - 1 : end;
+
+        const char* text;
+        int length;
+        if (ClassifyLine(At, end, &text, &length) == LINE_INSTRUCTION)
+        {
+            if (address >= cpu->romSize)
+            {
+                printf("The assembly has more instructions than the program\n");
+                return false;
+            }
+
+            uint64_t count = executed[address];
+            fprintf(output, "%12llu %6.2f%% %6d | %.*s\n", (unsigned long long)count, total ? 100.0 * count / total : 0.0,
+                address, (int)(lineEnd - At), At);
+            ++address;
+        }
+        else
+        {
+            fprintf(output, "%28s| %.*s\n", "", (int)(lineEnd - At), At);
+        }
+
+        At = *end ? end + 1 : end;
+    }
+
+    if (address != cpu->romSize)
+    {
+        printf("The assembly has %d instructions but the program has %d\n", address, cpu->romSize);
+        return false;
+    }
+
+    return true;
+}
+
+void HackProfile::PrintHotSpots(HackCPU* cpu, char* asmSource)
+{
+    int romSize = cpu->romSize;
+    int* labelAddress = (int*)calloc(ADDRESS_SPACE, sizeof(int));
+    SourceLabel* labels = FindLabels(asmSource, labelAddress);
+
+    // Running totals so any range's cycles are one subtraction
+    uint64_t* before = (uint64_t*)malloc(sizeof(uint64_t) * (romSize + 1));
+    before[0] = 0;
+    for (int address = 0; address < romSize; ++address)
+    {
+        before[address + 1] = before[address] + executed[address];
+    }
+
+    uint64_t total = before[romSize];
+    if (total == 0)
+    {
+        free(before);
+        free(labels);
+        free(labelAddress);
+        return;
+    }
+
+    // Blocks begin at labels, jump targets and after jumps
+    bool* leader = (bool*)calloc(romSize + 1, sizeof(bool));
+    leader[0] = true;
+    for (int address = 0; address < romSize; ++address)
+    {
+        if (labels[address].text && labelAddress[address] == address)
+        {
+            leader[address] = true;
+        }
+
+        if (decodeTable[cpu->rom[address]].jump)
+        {
+            leader[address + 1] = true;
+            if (address > 0 && cpu->rom[address - 1] < 0x8000 && (int)cpu->rom[address - 1] < romSize)
+            {
+                leader[cpu->rom[address - 1]] = true;
+            }
+        }
+    }
+
+    HotRange* blocks = (HotRange*)malloc(sizeof(HotRange) * romSize);
+    HotRange* loops = (HotRange*)malloc(sizeof(HotRange) * romSize);
+    int blockCount = 0;
+    int loopCount = 0;
+
+    for (int first = 0; first < romSize;)
+    {
+        int last = first;
+        while (last + 1 < romSize && !leader[last + 1])
+        {
+            ++last;
+        }
+
+        if (executed[first])
+        {
+            blocks[blockCount++] = { first, last, before[last + 1] - before[first], executed[first] };
+        }
+
+        first = last + 1;
+    }
+
+    // A taken jump back to an address known from the @ before it closes a loop. Jumps back
+    // to the start of a VM function, a label with a dot and no $, are recursive calls instead.
+    for (int address = 1; address < romSize; ++address)
+    {
+        uint32_t target = cpu->rom[address - 1];
+        if (!taken[address] || !decodeTable[cpu->rom[address]].jump || target >= 0x8000 || (int)target > address)
+        {
+            continue;
+        }
+
+        SourceLabel label = labels[target];
+        if (label.text && labelAddress[target] == (int)target && memchr(label.text, '.', label.length) && !memchr(label.text, '$', label.length))
+        {
+            continue;
+        }
+
+        loops[loopCount++] = { (int)target, address, before[address + 1] - before[target], taken[address] };
+    }
+
+    auto byCycles = [](const HotRange& left, const HotRange& right) { return left.cycles > right.cycles; };
+    std::sort(blocks, blocks + blockCount, byCycles);
+    std::sort(loops, loops + loopCount, byCycles);
+
+    char first[256];
+    char last[256];
+    printf("Hot blocks:\n");
+    printf("%14s %8s %12s  %s\n", "cycles", "share", "entries", "range");
+    for (int i = 0; i < blockCount && i < PROFILE_REPORT_LENGTH; ++i)
+    {
+        HotRange* block = &blocks[i];
+        FormatLocation(first, labels, labelAddress, block->first);
+        FormatLocation(last, labels, labelAddress, block->last);
+        printf("%14llu %7.2f%% %12llu  %d-%d %s .. %s\n", (unsigned long long)block->cycles, 100.0 * block->cycles / total,
+            (unsigned long long)block->count, block->first, block->last, first, last);
+    }
+
+    printf("Hot loops:\n");
+    printf("%14s %8s %12s  %s\n", "cycles", "share", "iterations", "range");
+    for (int i = 0; i < loopCount && i < PROFILE_REPORT_LENGTH; ++i)
+    {
+        HotRange* loop = &loops[i];
+        FormatLocation(first, labels, labelAddress, loop->first);
+        FormatLocation(last, labels, labelAddress, loop->last);
+        printf("%14llu %7.2f%% %12llu  %d-%d %s .. %s\n", (unsigned long long)loop->cycles, 100.0 * loop->cycles / total,
+            (unsigned long long)loop->count, loop->first, loop->last, first, last);
+    }
+
+    free(blocks);
+    free(loops);
+    free(leader);
+    free(before);
+    free(labels);
+    free(labelAddress);
+}
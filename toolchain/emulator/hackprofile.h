@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "hackcpu.h"
+
+// How many entries the hot block and hot loop reports list
+#define PROFILE_REPORT_LENGTH 10
+
+enum JumpKind : uint8_t
+{
+    JUMP_KIND_NONE,
+    JUMP_KIND_CALL,
+    JUMP_KIND_RETURN,
+};
+
+// One distinct call stack, as a tree: the node for a;b;c is a child of the one for a;b
+struct StackNode
+{
+    int function;
+    int parent;
+    int firstChild;
+    int nextSibling;
+
+    // Cycles spent with exactly this stack, and how many times it was entered
+    uint64_t cycles;
+    uint64_t calls;
+};
+
+struct HackProfile
+{
+    // Indexed by rom address
+    uint64_t executed[ADDRESS_SPACE];
+    uint64_t taken[ADDRESS_SPACE];
+
+    // What the translator's call map says each rom address's jump is. Without a map
+    // every address is JUMP_KIND_NONE and no stacks are kept.
+    uint8_t jumpKind[ADDRESS_SPACE];
+    int callee[ADDRESS_SPACE];
+
+    int functionCount;
+    char** functionNames;
+
+    StackNode* nodes;
+    int nodeCount;
+    int nodeCapacity;
+    int currentNode;
+    uint64_t lastCycle;
+
+    void Clear();
+
+    /// <summary>
+    /// Reads a call map written by VMTranslator -map so StackJump knows the calls and returns
+    /// </summary>
+    bool LoadCallMap(char* source);
+
+    /// <summary>
+    /// Called by the interpreter on every taken jump the call map knows about. Charges the
+    /// cycles since the last one to the current stack, then enters the callee or returns.
+    /// </summary>
+    void StackJump(uint16_t pc, uint64_t cycle);
+
+    /// <summary>
+    /// Writes one "caller;callee;... cycles" line per stack, the folded format flame graph
+    /// tools read, and prints the functions with the most inclusive cycles
+    /// </summary>
+    bool WriteFoldedStacks(uint64_t cycle, FILE* output);
+
+    /// <summary>
+    /// Writes every line of the program's .asm source with the number of times its
+    /// instruction ran and its share of all cycles. Labels and comments are kept as they
+    /// are so the listing reads like the source. Returns false if the source has a different
+    /// number of instructions than the loaded program.
+    /// </summary>
+    bool WriteListing(HackCPU* cpu, char* asmSource, FILE* output);
+
+    /// <summary>
+    /// Prints the basic blocks and the loops that took the most cycles. Blocks start at every
+    /// label and after every jump; loops are the ranges closed by a taken backward jump.
+    /// </summary>
+    void PrintHotSpots(HackCPU* cpu, char* asmSource);
+};
@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <cstring>
+#include "hackscreen.h"
+
+static uint8_t ReverseBits(uint8_t value)
+{
+    uint8_t result = 0;
+    for (int bit = 0; bit < 8; ++bit)
+    {
+        result = (result << 1) | ((value >> bit) & 1);
+    }
+
+    return result;
+}
+
+void HackScreen::Init(HackCPU* cpu)
+{
+    memset(pixels, 0, sizeof(pixels));
+    memset(cpu->screenDirty, 0xFF, sizeof(cpu->screenDirty));
+    cpu->trackScreen = true;
+}
+
+bool HackScreen::Update(HackCPU* cpu)
+{
+    bool changed = false;
+    for (int block = 0; block < SCREEN_WORDS / 64; ++block)
+    {
+        uint64_t dirty = cpu->screenDirty[block];
+        if (!dirty)
+        {
+            continue;
+        }
+
+        cpu->screenDirty[block] = 0;
+        for (int bit = 0; bit < 64; ++bit)
+        {
+            if (!((dirty >> bit) & 1))
+            {
+                continue;
+            }
+
+            // Words are laid out 32 to a row, so word n covers bytes 2n and 2n + 1
+            int offset = block * 64 + bit;
+            uint16_t word = cpu->ram[SCREEN_ADDRESS + offset];
+            uint8_t left = ReverseBits((uint8_t)word);
+            uint8_t right = ReverseBits((uint8_t)(word >> 8));
+
+            uint8_t* at = &pixels[offset * 2];
+            changed |= at[0] != left || at[1] != right;
+            at[0] = left;
+            at[1] = right;
+        }
+    }
+
+    return changed;
+}
+
+bool HackScreen::WritePbm(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("Failed to open output file: %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "P4\n%d %d\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    fwrite(pixels, 1, sizeof(pixels), file);
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include "hackcpu.h"
+
+#define SCREEN_WIDTH 512
+#define SCREEN_HEIGHT 256
+#define SCREEN_ROW_BYTES (SCREEN_WIDTH / 8)
+
+// The screen as a 1 bit image in PBM order: rows top to bottom, leftmost pixel in the high
+// bit of each byte, 1 for black. Hack keeps the leftmost pixel of each word in bit 0 instead.
+struct HackScreen
+{
+    uint8_t pixels[SCREEN_HEIGHT * SCREEN_ROW_BYTES];
+
+    /// <summary>
+    /// Turns on the cpu's screen tracking and marks every word dirty, so the first Update
+    /// picks up whatever is already on the screen
+    /// </summary>
+    void Init(HackCPU* cpu);
+
+    /// <summary>
+    /// Converts only the words written since the last update and clears their dirty bits.
+    /// Returns true if any pixel actually changed.
+    /// </summary>
+    bool Update(HackCPU* cpu);
+
+    bool WritePbm(const char* path);
+};
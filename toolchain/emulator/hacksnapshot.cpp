@@ -0,0 +1,207 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "hacksnapshot.h"
+
+#define SNAPSHOT_VERSION 2
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t romSize;
+    uint64_t romHash;
+};
+
+struct StateHeader
+{
+    uint64_t cycles;
+    uint16_t A;
+    uint16_t D;
+    uint16_t PC;
+    uint16_t reserved;
+    uint32_t runCount;
+};
+
+struct StateRun
+{
+    uint32_t address;
+    uint32_t length;
+};
+
+static const char snapshotMagic[8] = { 'H', 'A', 'C', 'K', 'S', 'N', 'A', 'P' };
+
+void HackState::Capture(HackCPU* cpu)
+{
+    cycles = cpu->cycles;
+    A = cpu->A;
+    D = cpu->D;
+    PC = cpu->PC;
+    memcpy(ram, cpu->ram, sizeof(ram));
+}
+
+void HackState::Apply(HackCPU* cpu)
+{
+    cpu->cycles = cycles;
+    cpu->A = A;
+    cpu->D = D;
+    cpu->PC = PC;
+    memcpy(cpu->ram, ram, sizeof(ram));
+}
+
+bool WriteState(HackState* state, FILE* file)
+{
+    StateRun* runs = (StateRun*)malloc(sizeof(StateRun) * (ADDRESS_SPACE / 2 + 1));
+    uint32_t runCount = 0;
+    for (int address = 0; address < ADDRESS_SPACE;)
+    {
+        if (!state->ram[address])
+        {
+            ++address;
+            continue;
+        }
+
+        int end = address + 1;
+        int zeros = 0;
+        for (int next = end; next < ADDRESS_SPACE && zeros < SNAPSHOT_RUN_GAP; ++next)
+        {
+            if (state->ram[next])
+            {
+                end = next + 1;
+                zeros = 0;
+            }
+            else
+            {
+                ++zeros;
+            }
+        }
+
+        runs[runCount++] = { (uint32_t)address, (uint32_t)(end - address) };
+        address = end;
+    }
+
+    StateHeader header = {};
+    header.cycles = state->cycles;
+    header.A = state->A;
+    header.D = state->D;
+    header.PC = state->PC;
+    header.runCount = runCount;
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uint32_t i = 0; i < runCount && written; ++i)
+    {
+        written = fwrite(&runs[i], sizeof(StateRun), 1, file) == 1 &&
+            fwrite(&state->ram[runs[i].address], sizeof(uint16_t), runs[i].length, file) == runs[i].length;
+    }
+
+    free(runs);
+    return written;
+}
+
+bool ReadState(HackState* state, FILE* file)
+{
+    StateHeader header = {};
+    if (fread(&header, sizeof(header), 1, file) != 1)
+    {
+        return false;
+    }
+
+    state->cycles = header.cycles;
+    state->A = header.A;
+    state->D = header.D;
+    state->PC = header.PC;
+    memset(state->ram, 0, sizeof(state->ram));
+    for (uint32_t i = 0; i < header.runCount; ++i)
+    {
+        StateRun run;
+        if (fread(&run, sizeof(run), 1, file) != 1 || run.address >= ADDRESS_SPACE || run.length > ADDRESS_SPACE - run.address ||
+            fread(&state->ram[run.address], sizeof(uint16_t), run.length, file) != run.length)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// FNV-1a over the loaded program
+uint64_t HashRom(HackCPU* cpu)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < cpu->romSize; ++i)
+    {
+        hash = (hash ^ cpu->rom[i]) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+bool SaveSnapshot(HackCPU* cpu, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("Failed to open snapshot file: %s\n", path);
+        return false;
+    }
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.romSize = cpu->romSize;
+    header.romHash = HashRom(cpu);
+
+    HackState* state = (HackState*)malloc(sizeof(HackState));
+    state->Capture(cpu);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && WriteState(state, file);
+    written &= fclose(file) == 0;
+    free(state);
+    if (!written)
+    {
+        printf("Failed to write snapshot file: %s\n", path);
+    }
+
+    return written;
+}
+
+bool LoadSnapshot(HackCPU* cpu, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        printf("Failed to open snapshot file: %s\n", path);
+        return false;
+    }
+
+    SnapshotHeader header = {};
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION)
+    {
+        printf("%s is not a snapshot\n", path);
+        fclose(file);
+        return false;
+    }
+
+    if (header.romSize != (uint32_t)cpu->romSize || header.romHash != HashRom(cpu))
+    {
+        printf("%s is a snapshot of a different program\n", path);
+        fclose(file);
+        return false;
+    }
+
+    // Read into a copy so a truncated file leaves the cpu alone
+    HackState* state = (HackState*)malloc(sizeof(HackState));
+    bool valid = ReadState(state, file);
+    fclose(file);
+    if (valid)
+    {
+        state->Apply(cpu);
+    }
+    else
+    {
+        printf("%s is truncated or corrupt\n", path);
+    }
+
+    free(state);
+    return valid;
+}
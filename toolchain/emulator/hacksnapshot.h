@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "hackcpu.h"
+
+// Zero words a run of ram can take in before it's cheaper to end it and start another
+#define SNAPSHOT_RUN_GAP 3
+
+// Everything a run has changed since reset: the registers, cycle count and ram
+struct HackState
+{
+    uint64_t cycles;
+    uint16_t A;
+    uint16_t D;
+    uint16_t PC;
+    uint16_t ram[ADDRESS_SPACE];
+
+    void Capture(HackCPU* cpu);
+    void Apply(HackCPU* cpu);
+};
+
+/// <summary>
+/// Writes the state with ram as runs of words between stretches of zeros, a few kilobytes
+/// once the OS has initialised
+/// </summary>
+bool WriteState(HackState* state, FILE* file);
+
+bool ReadState(HackState* state, FILE* file);
+
+/// <summary>
+/// Hashes the loaded program, so saved state is never restored under different code
+/// </summary>
+uint64_t HashRom(HackCPU* cpu);
+
+/// <summary>
+/// Writes the machine's state to path, tagged with the program it belongs to
+/// </summary>
+bool SaveSnapshot(HackCPU* cpu, const char* path);
+
+/// <summary>
+/// Restores a snapshot written by SaveSnapshot. Fails, leaving the cpu as it was, if the
+/// file isn't a snapshot of the program the cpu has loaded.
+/// </summary>
+bool LoadSnapshot(HackCPU* cpu, const char* path);
@@ -0,0 +1,452 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "hacktrace.h"
+
+#define TRACE_VERSION 1
+
+// The file is a header and then blocks, each a type byte followed by its contents. Event
+// blocks are delta-encoded against the keyframe before them, so a replay only has to
+// decode the blocks after the keyframe it starts from and can seek past the rest.
+enum TraceBlockType : uint8_t
+{
+    // A TraceBlock and that many bytes of events
+    TRACE_BLOCK_EVENTS,
+    // A state in WriteState's format
+    TRACE_BLOCK_KEYFRAME,
+};
+
+struct TraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t romSize;
+    uint64_t romHash;
+};
+
+struct TraceBlock
+{
+    uint32_t eventCount;
+    uint32_t byteCount;
+};
+
+// Every event starts with a byte holding its kind in the low two bits and the cycles since
+// the event before it in the rest. Gaps that don't fit are 63 there and the remainder follows.
+#define TRACE_DELTA_ESCAPE 63
+
+// Tag byte, an escaped cycle delta and two 16 bit fields
+#define TRACE_MAX_EVENT_BYTES (1 + 10 + 3 + 3)
+
+static const char traceMagic[8] = { 'H', 'A', 'C', 'K', 'T', 'R', 'A', 'C' };
+
+// What each event is encoded against: the one before it, reset at every keyframe
+struct TraceDeltas
+{
+    uint64_t cycle;
+    uint16_t jump;
+    uint16_t write;
+
+    void Reset(HackState* keyframe)
+    {
+        cycle = keyframe->cycles;
+        jump = keyframe->PC;
+        write = 0;
+    }
+};
+
+static uint8_t* PutVarint(uint8_t* At, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *At++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+
+    *At++ = (uint8_t)value;
+    return At;
+}
+
+static bool GetVarint(const uint8_t*& At, const uint8_t* end, uint64_t* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && At < end; shift += 7)
+    {
+        uint8_t byte = *At++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Addresses move by small steps in either direction, mostly round the stack
+static uint16_t ZigZag(uint16_t from, uint16_t to)
+{
+    int16_t step = (int16_t)(to - from);
+    return (uint16_t)((step << 1) ^ (step >> 15));
+}
+
+static uint16_t UnZigZag(uint16_t from, uint64_t encoded)
+{
+    uint16_t zigzag = (uint16_t)encoded;
+    return (uint16_t)(from + ((zigzag >> 1) ^ -(zigzag & 1)));
+}
+
+static uint8_t* EncodeEvent(uint8_t* At, const TraceRecord* record, TraceDeltas* deltas)
+{
+    uint8_t kind = (uint8_t)(record->stamp >> TRACE_CYCLE_BITS);
+    uint64_t gap = ((record->stamp & TRACE_CYCLE_MASK) - (uint32_t)deltas->cycle) & TRACE_CYCLE_MASK;
+    deltas->cycle += gap;
+    if (gap < TRACE_DELTA_ESCAPE)
+    {
+        *At++ = (uint8_t)(kind | gap << 2);
+    }
+    else
+    {
+        *At++ = (uint8_t)(kind | TRACE_DELTA_ESCAPE << 2);
+        At = PutVarint(At, gap - TRACE_DELTA_ESCAPE);
+    }
+
+    switch (kind)
+    {
+        case TRACE_JUMP:
+            At = PutVarint(At, ZigZag(deltas->jump, record->address));
+            deltas->jump = record->address;
+            break;
+
+        case TRACE_WRITE:
+            At = PutVarint(At, ZigZag(deltas->write, record->address));
+            deltas->write = record->address;
+            At = PutVarint(At, record->value);
+            break;
+
+        case TRACE_KEY:
+            At = PutVarint(At, record->value);
+            break;
+    }
+
+    return At;
+}
+
+static bool DecodeEvent(const uint8_t*& At, const uint8_t* end, TraceEvent* event, TraceDeltas* deltas)
+{
+    if (At == end)
+    {
+        return false;
+    }
+
+    uint8_t tag = *At++;
+    uint64_t gap = tag >> 2;
+    uint64_t field;
+    if (gap == TRACE_DELTA_ESCAPE)
+    {
+        if (!GetVarint(At, end, &field))
+        {
+            return false;
+        }
+
+        gap += field;
+    }
+
+    deltas->cycle += gap;
+    event->cycle = deltas->cycle;
+    event->kind = (TraceEventKind)(tag & 3);
+    event->address = 0;
+    event->value = 0;
+    switch (event->kind)
+    {
+        case TRACE_JUMP:
+            if (!GetVarint(At, end, &field)) return false;
+            deltas->jump = event->address = UnZigZag(deltas->jump, field);
+            return true;
+
+        case TRACE_WRITE:
+            if (!GetVarint(At, end, &field)) return false;
+            deltas->write = event->address = UnZigZag(deltas->write, field);
+            if (!GetVarint(At, end, &field)) return false;
+            event->value = (uint16_t)field;
+            return true;
+
+        case TRACE_KEY:
+            if (!GetVarint(At, end, &field)) return false;
+            event->address = KEYBOARD_ADDRESS;
+            event->value = (uint16_t)field;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool HackTrace::Open(HackCPU* cpu, const char* path)
+{
+    file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("Failed to open trace file: %s\n", path);
+        return false;
+    }
+
+    TraceHeader header = {};
+    memcpy(header.magic, traceMagic, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.romSize = cpu->romSize;
+    header.romHash = HashRom(cpu);
+    failed = fwrite(&header, sizeof(header), 1, file) != 1;
+
+    for (int i = 0; i < TRACE_CHUNKS; ++i)
+    {
+        chunks[i] = (TraceChunk*)malloc(sizeof(TraceChunk));
+        chunks[i]->eventCount = 0;
+        chunks[i]->hasKeyframe = false;
+    }
+
+    filling = chunks[0];
+    next = filling->records;
+    end = filling->records + TRACE_CHUNK_EVENTS;
+    for (int i = 1; i < TRACE_CHUNKS; ++i)
+    {
+        idle[i - 1] = chunks[i];
+    }
+
+    idleCount = TRACE_CHUNKS - 1;
+    queuedFirst = 0;
+    queuedCount = 0;
+    closing = false;
+    encoded = (uint8_t*)malloc(TRACE_CHUNK_EVENTS * TRACE_MAX_EVENT_BYTES);
+    eventCount = 0;
+    keyframeCount = 0;
+    waits = 0;
+
+    writer = std::thread(&HackTrace::WriteChunks, this);
+    Keyframe(cpu);
+    return true;
+}
+
+void HackTrace::HandOff()
+{
+    filling->eventCount = (int)(next - filling->records);
+    eventCount += filling->eventCount;
+
+    std::unique_lock<std::mutex> guard(lock);
+    queued[(queuedFirst + queuedCount++) % TRACE_CHUNKS] = filling;
+    changed.notify_all();
+    if (idleCount == 0)
+    {
+        ++waits;
+        changed.wait(guard, [this] { return idleCount > 0; });
+    }
+
+    filling = idle[--idleCount];
+    filling->eventCount = 0;
+    filling->hasKeyframe = false;
+    next = filling->records;
+    end = filling->records + TRACE_CHUNK_EVENTS;
+}
+
+void HackTrace::Keyframe(HackCPU* cpu)
+{
+    filling->keyframe.Capture(cpu);
+    filling->hasKeyframe = true;
+    ++keyframeCount;
+    HandOff();
+}
+
+bool HackTrace::Close(HackCPU* cpu)
+{
+    Keyframe(cpu);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closing = true;
+        changed.notify_all();
+    }
+
+    writer.join();
+    failed |= fclose(file) != 0;
+    for (int i = 0; i < TRACE_CHUNKS; ++i)
+    {
+        free(chunks[i]);
+    }
+
+    free(encoded);
+    return !failed;
+}
+
+void HackTrace::WriteChunks()
+{
+    TraceDeltas deltas = {};
+    for (;;)
+    {
+        TraceChunk* chunk;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [this] { return queuedCount > 0 || closing; });
+            if (queuedCount == 0)
+            {
+                return;
+            }
+
+            chunk = queued[queuedFirst];
+            queuedFirst = (queuedFirst + 1) % TRACE_CHUNKS;
+            --queuedCount;
+        }
+
+        if (chunk->eventCount)
+        {
+            uint8_t* At = encoded;
+            for (int i = 0; i < chunk->eventCount; ++i)
+            {
+                At = EncodeEvent(At, &chunk->records[i], &deltas);
+            }
+
+            uint8_t type = TRACE_BLOCK_EVENTS;
+            TraceBlock block = { (uint32_t)chunk->eventCount, (uint32_t)(At - encoded) };
+            failed |= fwrite(&type, 1, 1, file) != 1 || fwrite(&block, sizeof(block), 1, file) != 1 ||
+                fwrite(encoded, 1, block.byteCount, file) != block.byteCount;
+        }
+
+        if (chunk->hasKeyframe)
+        {
+            uint8_t type = TRACE_BLOCK_KEYFRAME;
+            failed |= fwrite(&type, 1, 1, file) != 1 || !WriteState(&chunk->keyframe, file);
+            deltas.Reset(&chunk->keyframe);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        idle[idleCount++] = chunk;
+        changed.notify_all();
+    }
+}
+
+bool ReadTrace(HackCPU* cpu, const char* path, uint64_t cycle, TraceWindow* window)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        printf("Failed to open trace file: %s\n", path);
+        return false;
+    }
+
+    TraceHeader header = {};
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, traceMagic, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION)
+    {
+        printf("%s is not a trace\n", path);
+        fclose(file);
+        return false;
+    }
+
+    if (header.romSize != (uint32_t)cpu->romSize || header.romHash != HashRom(cpu))
+    {
+        printf("%s is a trace of a different program\n", path);
+        fclose(file);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, sizeof(header), SEEK_SET);
+
+    // Only keyframes are read on the way, the event blocks after the one that's kept are
+    // decoded once the next keyframe is past cycle or the file ends. A run that was killed
+    // before closing its trace leaves a partial block at the end, everything before it replays.
+    HackState* state = (HackState*)malloc(sizeof(HackState));
+    bool found = false;
+    bool ended = true;
+    bool whole = true;
+    std::vector<long> blocks;
+    uint8_t type;
+    while (whole && fread(&type, 1, 1, file) == 1)
+    {
+        if (type == TRACE_BLOCK_KEYFRAME)
+        {
+            whole = ReadState(state, file);
+            if (whole && state->cycles > cycle && found)
+            {
+                window->endCycle = state->cycles;
+                ended = false;
+                break;
+            }
+
+            // The first keyframe is kept even past cycle, the run may have started from a snapshot
+            if (whole)
+            {
+                memcpy(window->keyframe, state, sizeof(HackState));
+                window->endCycle = state->cycles;
+                blocks.clear();
+                found = true;
+            }
+        }
+        else if (type == TRACE_BLOCK_EVENTS)
+        {
+            TraceBlock block;
+            long start = ftell(file);
+            whole = fread(&block, sizeof(block), 1, file) == 1 && start + (long)sizeof(block) + block.byteCount <= fileSize;
+            if (whole)
+            {
+                blocks.push_back(start);
+                fseek(file, block.byteCount, SEEK_CUR);
+            }
+        }
+        else
+        {
+            whole = false;
+        }
+    }
+
+    free(state);
+    if (!found)
+    {
+        printf("%s is truncated or corrupt\n", path);
+        fclose(file);
+        return false;
+    }
+
+    if (!whole)
+    {
+        printf("%s ends in a partial block, the run that wrote it never finished\n", path);
+    }
+
+    bool valid = true;
+    TraceDeltas deltas = {};
+    deltas.Reset(window->keyframe);
+    window->events.clear();
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i < blocks.size() && valid; ++i)
+    {
+        TraceBlock block;
+        fseek(file, blocks[i], SEEK_SET);
+        valid = fread(&block, sizeof(block), 1, file) == 1;
+        bytes.resize(block.byteCount);
+        valid = valid && fread(bytes.data(), 1, block.byteCount, file) == block.byteCount;
+
+        const uint8_t* At = bytes.data();
+        const uint8_t* end = At + block.byteCount;
+        for (uint32_t j = 0; j < block.eventCount && valid; ++j)
+        {
+            TraceEvent event;
+            valid = DecodeEvent(At, end, &event, &deltas);
+            if (valid && event.cycle <= cycle)
+            {
+                window->events.push_back(event);
+            }
+
+            // A trace that wasn't closed ends with its last event rather than a keyframe
+            if (valid && ended && event.cycle > window->endCycle)
+            {
+                window->endCycle = event.cycle;
+            }
+        }
+    }
+
+    fclose(file);
+    if (!valid)
+    {
+        printf("%s is truncated or corrupt\n", path);
+    }
+
+    return valid;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "hackcpu.h"
+#include "hacksnapshot.h"
+
+// Events the interpreter fills in before handing them to the writer thread, and how many
+// handed off chunks can wait for it before the interpreter has to wait instead
+#define TRACE_CHUNK_EVENTS 65536
+#define TRACE_CHUNKS_QUEUED 8
+
+// Every chunk, the one being filled included, since a hand off queues it before it waits
+// for an idle one and so the queue can end up holding all of them
+#define TRACE_CHUNKS (TRACE_CHUNKS_QUEUED + 1)
+
+#define TRACE_DEFAULT_KEYFRAME_INTERVAL 1000000
+
+// Events are recorded with only the low bits of their cycle and the writer works out the
+// rest from the event or keyframe before, so keyframes have to come round often enough
+// that no gap is longer than the bits can count
+#define TRACE_CYCLE_BITS 30
+#define TRACE_CYCLE_MASK ((1u << TRACE_CYCLE_BITS) - 1)
+#define TRACE_MAX_KEYFRAME_INTERVAL TRACE_CYCLE_MASK
+
+enum TraceEventKind : uint8_t
+{
+    // A jump taken, to address
+    TRACE_JUMP,
+    // value written to ram[address]
+    TRACE_WRITE,
+    // value put on the keyboard between runs
+    TRACE_KEY,
+};
+
+struct TraceEvent
+{
+    // The cycle count once the event happened, so a write by the instruction run as
+    // cycle 0 is at cycle 1, the way cpu->cycles reads after it
+    uint64_t cycle;
+    TraceEventKind kind;
+    uint16_t address;
+    uint16_t value;
+};
+
+// An event as the interpreter records it, packed to keep recording down to one small store
+struct TraceRecord
+{
+    // The kind above the low bits of the cycle
+    uint32_t stamp;
+    uint16_t address;
+    uint16_t value;
+};
+
+struct TraceChunk
+{
+    int eventCount;
+
+    // Taken after the last of the events, written once they are
+    bool hasKeyframe;
+    HackState keyframe;
+
+    TraceRecord records[TRACE_CHUNK_EVENTS];
+};
+
+// Records what a run does, for replaying it to any cycle afterwards. The interpreter only
+// stores raw events into a chunk, the writer thread delta-encodes them into the file along
+// with keyframes of the whole machine to start replays from.
+//
+// Storing the events is cheap, about 6% on 200M cycles of projects/06 Pong. With a core to
+// spare the writer works alongside the interpreter. On a single core it takes turns with it,
+// and encoding and writing the file each added about 40%, so the traced run took 1.85x as
+// long as the plain one.
+struct HackTrace
+{
+    // Where the next event goes in the chunk being filled. Run keeps its own copy while it
+    // runs and stores it back when it stops.
+    TraceChunk* filling;
+    TraceRecord* next;
+    TraceRecord* end;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    TraceChunk* chunks[TRACE_CHUNKS];
+    TraceChunk* queued[TRACE_CHUNKS];
+    int queuedFirst;
+    int queuedCount;
+    TraceChunk* idle[TRACE_CHUNKS];
+    int idleCount;
+    bool closing;
+    std::thread writer;
+
+    FILE* file;
+    bool failed;
+    uint8_t* encoded;
+
+    uint64_t eventCount;
+    uint64_t keyframeCount;
+    uint64_t waits;
+
+    /// <summary>
+    /// Starts a trace of the program cpu has loaded, with a keyframe of where it is now
+    /// </summary>
+    bool Open(HackCPU* cpu, const char* path);
+
+    inline void Record(TraceEventKind kind, uint64_t cycle, uint16_t address, uint16_t value)
+    {
+        next->stamp = ((uint32_t)kind << TRACE_CYCLE_BITS) | ((uint32_t)cycle & TRACE_CYCLE_MASK);
+        next->address = address;
+        next->value = value;
+        if (++next == end)
+        {
+            HandOff();
+        }
+    }
+
+    /// <summary>
+    /// Records the whole machine, so replays to later cycles can start here
+    /// </summary>
+    void Keyframe(HackCPU* cpu);
+
+    /// <summary>
+    /// Ends the trace with a keyframe of where cpu stopped and waits for the writer to finish.
+    /// Returns false if anything failed to write.
+    /// </summary>
+    bool Close(HackCPU* cpu);
+
+    // Queues the chunk being filled, waiting for the writer if the queue is full
+    void HandOff();
+    void WriteChunks();
+};
+
+// What a trace recorded from the last keyframe at or before some cycle through that cycle
+struct TraceWindow
+{
+    // Allocated by the caller
+    HackState* keyframe;
+    std::vector<TraceEvent> events;
+
+    // Where the trace stops covering the run, the next keyframe or the end of the file
+    uint64_t endCycle;
+};
+
+/// <summary>
+/// Finds the keyframe to replay cycle from and the events after it. Fails if the file isn't
+/// a trace of the program cpu has loaded.
+/// </summary>
+bool ReadTrace(HackCPU* cpu, const char* path, uint64_t cycle, TraceWindow* window);
@@ -0,0 +1,52 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "romtranslator.h"
+#include "../emulator/hackcpu.h"
+#include "../common/fileio.h"
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        printf("Usage: hack2c <program.hack> <output.c>\n");
+        return 0;
+    }
+
+    HackCPU* cpu = (HackCPU*)malloc(sizeof(HackCPU));
+    cpu->Reset();
+    BuildDecodeTable();
+
+    size_t inputSize;
+    char* input = ReadWholeFile(argv[1], &inputSize);
+    if (!input)
+    {
+        printf("Failed to open file: %s\n", argv[1]);
+        return 1;
+    }
+
+    if (!cpu->LoadHack(input))
+    {
+        return 1;
+    }
+
+    if (cpu->romSize == 0)
+    {
+        printf("%s has no instructions\n", argv[1]);
+        return 1;
+    }
+
+    FILE* outputFile = fopen(argv[2], "w");
+    if (!outputFile)
+    {
+        printf("Failed to open output file: %s\n", argv[2]);
+        return 1;
+    }
+
+    fprintf(outputFile, "/* Generated by hack2c from %s. Build with any C99 compiler. */\n", argv[1]);
+    TranslateRom(cpu, outputFile);
+    fclose(outputFile);
+
+    printf("Translated %d instructions from %s into %s\n", cpu->romSize, argv[1], argv[2]);
+    return 0;
+}
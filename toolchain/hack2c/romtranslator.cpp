@@ -0,0 +1,281 @@
+#include <cstdio>
+#include <cstdlib>
+#include "romtranslator.h"
+
+// Everything but TranslateRom stays local so the translation can be linked into other tools
+namespace
+{
+
+// The runtime half of the generated program. The fallback interpreter handles jumps into the
+// middle of a block and the last few instructions before the cycle limit, so results always
+// match the emulator exactly. Output mirrors the emulator so the two can be diffed.
+const char* runtimeSupport =
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <stdint.h>\n"
+    "#include <time.h>\n"
+    "\n"
+    "enum { STOP_CYCLE_LIMIT, STOP_HALTED, STOP_END_OF_PROGRAM };\n"
+    "\n"
+    "static uint16_t ram[65536];\n"
+    "\n"
+    "static uint16_t alu(int comp, uint16_t x, uint16_t y)\n"
+    "{\n"
+    "    if (comp & 32) x = 0;\n"
+    "    if (comp & 16) x = ~x;\n"
+    "    if (comp & 8) y = 0;\n"
+    "    if (comp & 4) y = ~y;\n"
+    "    uint16_t out = (comp & 2) ? (uint16_t)(x + y) : (uint16_t)(x & y);\n"
+    "    if (comp & 1) out = ~out;\n"
+    "    return out;\n"
+    "}\n"
+    "\n";
+
+const char* runtimeMain =
+    "int main(int argc, char** argv)\n"
+    "{\n"
+    "    uint64_t maxCycles = 100000000;\n"
+    "    int dumpFirst = 0;\n"
+    "    int dumpLast = -1;\n"
+    "    for (int i = 1; i < argc; ++i)\n"
+    "    {\n"
+    "        int address, value;\n"
+    "        if (strcmp(argv[i], \"-cycles\") == 0 && i + 1 < argc) maxCycles = strtoull(argv[++i], 0, 10);\n"
+    "        else if (strcmp(argv[i], \"-set\") == 0 && i + 1 < argc && sscanf(argv[++i], \"%d=%d\", &address, &value) == 2) ram[address & 0xFFFF] = (uint16_t)value;\n"
+    "        else if (strcmp(argv[i], \"-dump\") == 0 && i + 2 < argc) { dumpFirst = atoi(argv[++i]); dumpLast = atoi(argv[++i]); }\n"
+    "        else { printf(\"Usage: %s [-cycles n] [-set address=value]... [-dump first last]\\n\", argv[0]); return 1; }\n"
+    "    }\n"
+    "\n"
+    "    uint16_t A = 0, D = 0, out, address;\n"
+    "    uint32_t pc = 0;\n"
+    "    uint64_t cycles = 0;\n"
+    "    int reason = STOP_CYCLE_LIMIT;\n"
+    "    clock_t start = clock();\n"
+    "\n"
+    "dispatch:\n"
+    "    switch (pc)\n"
+    "    {\n";
+
+const char* runtimeEpilogue =
+    "        default:\n"
+    "            goto interpret;\n"
+    "    }\n"
+    "\n"
+    "interpret:\n"
+    "    if (cycles >= maxCycles) goto done;\n"
+    "    if (pc >= ROM_SIZE) { reason = STOP_END_OF_PROGRAM; goto done; }\n"
+    "    {\n"
+    "        uint16_t word = rom[pc];\n"
+    "        ++cycles;\n"
+    "        if (!(word & 0x8000)) { A = word; ++pc; goto dispatch; }\n"
+    "        address = A;\n"
+    "        out = alu((word >> 6) & 63, D, (word & 0x1000) ? ram[A] : A);\n"
+    "        if (word & 8) ram[address] = out;\n"
+    "        if (word & 32) A = out;\n"
+    "        if (word & 16) D = out;\n"
+    "        int jump = word & 7;\n"
+    "        int condition = (int16_t)out < 0 ? 4 : (out == 0 ? 2 : 1);\n"
+    "        if (jump & condition)\n"
+    "        {\n"
+    "            if (!(word & 0x38) && address + 1 == pc && rom[address] == address) { pc = address; reason = STOP_HALTED; goto done; }\n"
+    "            pc = address;\n"
+    "        }\n"
+    "        else\n"
+    "        {\n"
+    "            ++pc;\n"
+    "        }\n"
+    "    }\n"
+    "    goto dispatch;\n"
+    "\n"
+    "done:\n"
+    "    {\n"
+    "        double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;\n"
+    "        if (reason == STOP_CYCLE_LIMIT) printf(\"Reached the cycle limit at pc %u\\n\", pc);\n"
+    "        else if (reason == STOP_HALTED) printf(\"Halted at pc %u\\n\", pc);\n"
+    "        else printf(\"Ran past the end of the program\\n\");\n"
+    "        printf(\"%llu cycles in %.3fs (%.1f million per second)\\n\", (unsigned long long)cycles, seconds, seconds > 0 ? cycles / seconds / 1000000.0 : 0.0);\n"
+    "        for (int i = dumpFirst; i <= dumpLast; ++i) printf(\"RAM[%d] = %d\\n\", i, (int16_t)ram[i]);\n"
+    "    }\n"
+    "\n"
+    "    return 0;\n"
+    "}\n";
+
+const char* OperationExpression(Operation op)
+{
+    switch (op)
+    {
+        case OP_ZERO: return "0";
+        case OP_ONE: return "1";
+        case OP_NEG_ONE: return "0xFFFF";
+        case OP_D: return "D";
+        case OP_A: return "A";
+        case OP_M: return "ram[A]";
+        case OP_NOT_D: return "~D";
+        case OP_NOT_A: return "~A";
+        case OP_NOT_M: return "~ram[A]";
+        case OP_NEG_D: return "-D";
+        case OP_NEG_A: return "-A";
+        case OP_NEG_M: return "-ram[A]";
+        case OP_D_PLUS_ONE: return "D + 1";
+        case OP_A_PLUS_ONE: return "A + 1";
+        case OP_M_PLUS_ONE: return "ram[A] + 1";
+        case OP_D_MINUS_ONE: return "D - 1";
+        case OP_A_MINUS_ONE: return "A - 1";
+        case OP_M_MINUS_ONE: return "ram[A] - 1";
+        case OP_D_PLUS_A: return "D + A";
+        case OP_D_PLUS_M: return "D + ram[A]";
+        case OP_D_MINUS_A: return "D - A";
+        case OP_D_MINUS_M: return "D - ram[A]";
+        case OP_A_MINUS_D: return "A - D";
+        case OP_M_MINUS_D: return "ram[A] - D";
+        case OP_D_AND_A: return "D & A";
+        case OP_D_AND_M: return "D & ram[A]";
+        case OP_D_OR_A: return "D | A";
+        case OP_D_OR_M: return "D | ram[A]";
+        default: return 0;
+    }
+}
+
+const char* JumpExpression(uint8_t jump)
+{
+    switch (jump)
+    {
+        case JUMP_GT: return "(int16_t)out > 0";
+        case JUMP_EQ: return "out == 0";
+        case JUMP_GT | JUMP_EQ: return "(int16_t)out >= 0";
+        case JUMP_LT: return "(int16_t)out < 0";
+        case JUMP_LT | JUMP_GT: return "out != 0";
+        case JUMP_LT | JUMP_EQ: return "(int16_t)out <= 0";
+        default: return "1";
+    }
+}
+
+bool IsJump(uint32_t word)
+{
+    return (word & 0x8000) && (word & 0b111);
+}
+
+}
+
+void TranslateRom(HackCPU* cpu, FILE* outputFile)
+{
+    // Block leaders: the entry point, anything following a jump, and every address an
+    // A instruction loads. Computed jumps can only reach addresses that came from an A
+    // instruction at some point, and anything else falls back to the interpreter anyway.
+    bool* isLeader = (bool*)calloc(cpu->romSize + 1, sizeof(bool));
+    isLeader[0] = true;
+    for (int pc = 0; pc < cpu->romSize; ++pc)
+    {
+        uint32_t word = cpu->rom[pc];
+        if (!(word & 0x8000) && word < (uint32_t)cpu->romSize)
+        {
+            isLeader[word] = true;
+        }
+
+        if (IsJump(word))
+        {
+            isLeader[pc + 1] = true;
+        }
+    }
+
+    fprintf(outputFile, "%s", runtimeSupport);
+    fprintf(outputFile, "#define ROM_SIZE %d\n", cpu->romSize);
+    fprintf(outputFile, "static const uint16_t rom[ROM_SIZE] = {");
+    for (int pc = 0; pc < cpu->romSize; ++pc)
+    {
+        fprintf(outputFile, "%s%u,", pc % 16 ? " " : "\n    ", cpu->rom[pc]);
+    }
+
+    fprintf(outputFile, "\n};\n\n%s", runtimeMain);
+
+    int blockStart = 0;
+    while (blockStart < cpu->romSize)
+    {
+        int blockEnd = blockStart + 1;
+        while (blockEnd < cpu->romSize && !isLeader[blockEnd])
+        {
+            ++blockEnd;
+        }
+
+        // Cycles are charged up front, so a block only runs natively when all of it fits
+        // under the limit and the interpreter steps through whatever is left
+        fprintf(outputFile, "        case %d: block%d:\n", blockStart, blockStart);
+        fprintf(outputFile, "            if (cycles + %d > maxCycles) { pc = %d; goto interpret; }\n", blockEnd - blockStart, blockStart);
+        fprintf(outputFile, "            cycles += %d;\n", blockEnd - blockStart);
+
+        // -1 when A isn't known at translation time
+        int knownA = -1;
+        for (int pc = blockStart; pc < blockEnd; ++pc)
+        {
+            uint32_t word = cpu->rom[pc];
+            DecodedInstruction instruction = decodeTable[word];
+            if (instruction.op == OP_LOAD_A)
+            {
+                fprintf(outputFile, "            A = %u;\n", word);
+                knownA = word;
+                continue;
+            }
+
+            const char* expression = OperationExpression(instruction.op);
+            if (expression)
+            {
+                fprintf(outputFile, "            out = (uint16_t)(%s);\n", expression);
+            }
+            else
+            {
+                fprintf(outputFile, "            out = alu(%d, D, %s);\n", instruction.comp, instruction.op == OP_GENERIC_M ? "ram[A]" : "A");
+            }
+
+            // Everything in the instruction sees A as it was before the instruction
+            bool needsAddress = instruction.jump && knownA < 0 && (instruction.dest & DEST_A);
+            if (needsAddress) fprintf(outputFile, "            address = A;\n");
+            if (instruction.dest & DEST_M) fprintf(outputFile, "            ram[A] = out;\n");
+            if (instruction.dest & DEST_A) fprintf(outputFile, "            A = out;\n");
+            if (instruction.dest & DEST_D) fprintf(outputFile, "            D = out;\n");
+
+            if (instruction.jump)
+            {
+                const char* condition = JumpExpression(instruction.jump);
+                bool canHalt = !instruction.dest && pc > 0 && cpu->rom[pc - 1] == (uint32_t)(pc - 1);
+                if (knownA < 0 && canHalt)
+                {
+                    // The halt loop's A instruction starts a block of its own when something
+                    // else in the program loads the same constant
+                    fprintf(outputFile, "            if (%s) { if (A == %d) { pc = A; reason = STOP_HALTED; goto done; } pc = A; goto dispatch; }\n", condition, pc - 1);
+                }
+                else if (knownA < 0)
+                {
+                    fprintf(outputFile, "            if (%s) { pc = %s; goto dispatch; }\n", condition, needsAddress ? "address" : "A");
+                }
+                else if (canHalt && knownA == pc - 1)
+                {
+                    fprintf(outputFile, "            if (%s) { pc = %d; reason = STOP_HALTED; goto done; }\n", condition, knownA);
+                }
+                else if (knownA < cpu->romSize)
+                {
+                    // Every in-range constant is a leader, so static jumps chain block to block
+                    fprintf(outputFile, "            if (%s) goto block%d;\n", condition, knownA);
+                }
+                else
+                {
+                    fprintf(outputFile, "            if (%s) { pc = %d; goto interpret; }\n", condition, knownA);
+                }
+            }
+
+            if (instruction.dest & DEST_A)
+            {
+                knownA = -1;
+            }
+        }
+
+        blockStart = blockEnd;
+    }
+
+    // The last block falls through to here
+    fprintf(outputFile, "            pc = ROM_SIZE;\n");
+    fprintf(outputFile, "            goto interpret;\n");
+    fprintf(outputFile, "%s", runtimeEpilogue);
+
+    free(isLeader);
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdio>
+#include "../emulator/hackcpu.h"
+
+// Writes the rom loaded into cpu out as one C program, each basic block straight-line code in a
+// switch on the program counter. Built with any C99 compiler, it runs the program natively and
+// stops at exactly the same cycle, pc and ram as the emulator. It takes the emulator's -cycles,
+// -set and -dump options and prints the same report, so the two can be diffed.
+void TranslateRom(HackCPU* cpu, FILE* outputFile);
@@ -0,0 +1,391 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../assembler/assemble.h"
+#include "../vmtranslator/translator.h"
+#include "../vmtranslator/vmops.h"
+#include "../jackcompiler/compilationengine.h"
+#include "../emulator/hackcpu.h"
+#include "../common/fileio.h"
+
+struct BuildOptions
+{
+    CompilerOptions compiler;
+    char* outputPath = 0;
+    bool writeVM = false;
+    bool writeAssembly = false;
+    bool writeMap = false;
+    bool writeSymbols = false;
+    bool keepAll = false;
+};
+
+// A class compiled straight to VM commands, and the .jack it came from
+struct BuildClass
+{
+    std::string name;
+    std::string path;
+    VMProgram program;
+};
+
+// Reports every call to a function no class defines, and a missing Sys.init, which the bootstrap
+// calls. The assembler would otherwise take the label for a variable and the rom would jump into ram.
+bool CheckCalls(std::vector<BuildClass*>& classes)
+{
+    std::unordered_set<std::string> functions;
+    for (BuildClass* buildClass : classes)
+    {
+        VMProgram* program = &buildClass->program;
+        for (int i = 0; i < program->opCount; ++i)
+        {
+            VMOp* op = &program->ops[i];
+            if (op->opcode == VMOP_FUNCTION)
+            {
+                functions.insert(std::string(program->names + op->name, op->nameLength));
+            }
+        }
+    }
+
+    bool valid = true;
+    if (!functions.count("Sys.init"))
+    {
+        printf("No class defines Sys.init, which the program starts at\n");
+        valid = false;
+    }
+
+    for (BuildClass* buildClass : classes)
+    {
+        VMProgram* program = &buildClass->program;
+        VMOp* function = 0;
+        for (int i = 0; i < program->opCount; ++i)
+        {
+            VMOp* op = &program->ops[i];
+            if (op->opcode == VMOP_FUNCTION)
+            {
+                function = op;
+            }
+            else if (op->opcode == VMOP_CALL && !functions.count(std::string(program->names + op->name, op->nameLength)))
+            {
+                printf("%s: %.*s calls unknown function %.*s\n", buildClass->path.c_str(), function ? function->nameLength : 0,
+                    function ? program->names + function->name : "", op->nameLength, program->names + op->name);
+                valid = false;
+            }
+        }
+    }
+
+    return valid;
+}
+
+// Drops every function Sys.init can't reach, as vmdiff does with the .vm text. The whole OS
+// translates to more than the rom holds, but what one program calls of it usually fits.
+void PruneUnreachable(std::vector<BuildClass*>& classes)
+{
+    struct FunctionRange
+    {
+        VMProgram* program;
+        int first;
+        int end;
+        bool reached;
+    };
+
+    std::unordered_map<std::string, FunctionRange> functions;
+    for (BuildClass* buildClass : classes)
+    {
+        VMProgram* program = &buildClass->program;
+        FunctionRange* current = 0;
+        for (int i = 0; i < program->opCount; ++i)
+        {
+            VMOp* op = &program->ops[i];
+            if (op->opcode == VMOP_FUNCTION)
+            {
+                if (current)
+                {
+                    current->end = i;
+                }
+
+                current = &functions[std::string(program->names + op->name, op->nameLength)];
+                *current = { program, i, program->opCount, false };
+            }
+        }
+    }
+
+    std::vector<std::string> pending = { "Sys.init" };
+    while (!pending.empty())
+    {
+        auto found = functions.find(pending.back());
+        pending.pop_back();
+        if (found == functions.end() || found->second.reached)
+        {
+            continue;
+        }
+
+        FunctionRange* range = &found->second;
+        range->reached = true;
+        for (int i = range->first; i < range->end; ++i)
+        {
+            VMOp* op = &range->program->ops[i];
+            if (op->opcode == VMOP_CALL)
+            {
+                pending.push_back(std::string(range->program->names + op->name, op->nameLength));
+            }
+        }
+    }
+
+    // The names stay where they are, only the commands of what's dropped go
+    for (BuildClass* buildClass : classes)
+    {
+        VMProgram* program = &buildClass->program;
+        int kept = 0;
+        bool keeping = true;
+        for (int i = 0; i < program->opCount; ++i)
+        {
+            VMOp* op = &program->ops[i];
+            if (op->opcode == VMOP_FUNCTION)
+            {
+                keeping = functions[std::string(program->names + op->name, op->nameLength)].reached;
+            }
+
+            if (keeping)
+            {
+                program->ops[kept++] = *op;
+            }
+        }
+
+        program->opCount = kept;
+    }
+}
+
+bool WriteText(char* path, char* text)
+{
+    if (!WriteWholeFile(path, text, strlen(text)))
+    {
+        printf("Failed to open output file: %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+void ReplaceExtension(char* path, const char* extension)
+{
+    char* dot = 0;
+    for (char* At = path; *At; ++At)
+    {
+        if (*At == '.')
+        {
+            dot = At;
+        }
+        else if (*At == '/' || *At == '\\')
+        {
+            dot = 0;
+        }
+    }
+
+    strcpy(dot ? dot : path + strlen(path), extension);
+}
+
+void PrintUsage()
+{
+    printf("Usage: jack2hack [options] <folder>...\n");
+    printf("Compiles every .jack file in the folders, translates and assembles it in memory and writes the rom.\n");
+    printf("A class in an earlier folder replaces one of the same name in a later one, so the OS goes last.\n");
+    printf("  -o <file.hack>  Where the rom goes (default: in the first folder, named after it)\n");
+    printf("  -vm             Also write every class's .vm next to its .jack\n");
+    printf("  -asm            Also write the assembly next to the rom\n");
+    printf("  -map            Also write the call map next to the rom, for the emulator's profiler\n");
+    printf("  -symbols        Also write the variable addresses next to the rom\n");
+    printf("  -all            Keep the functions Sys.init never reaches\n");
+    printf("  -nostringpool   Build every string literal where it's used\n");
+    printf("  -rotateloops    Test while loops at the bottom\n");
+}
+
+int main(int argc, char** argv)
+{
+    BuildOptions options;
+    std::vector<char*> folders;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            options.outputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-vm") == 0)
+        {
+            options.writeVM = true;
+        }
+        else if (strcmp(argv[i], "-asm") == 0)
+        {
+            options.writeAssembly = true;
+        }
+        else if (strcmp(argv[i], "-map") == 0)
+        {
+            options.writeMap = true;
+        }
+        else if (strcmp(argv[i], "-symbols") == 0)
+        {
+            options.writeSymbols = true;
+        }
+        else if (strcmp(argv[i], "-all") == 0)
+        {
+            options.keepAll = true;
+        }
+        else if (strcmp(argv[i], "-nostringpool") == 0)
+        {
+            options.compiler.poolStrings = false;
+        }
+        else if (strcmp(argv[i], "-rotateloops") == 0)
+        {
+            options.compiler.rotateLoops = true;
+        }
+        else if (argv[i][0] == '-')
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+        else
+        {
+            folders.push_back(argv[i]);
+        }
+    }
+
+    if (folders.empty())
+    {
+        PrintUsage();
+        return 0;
+    }
+
+    char hackPath[MAX_PATH];
+    if (options.outputPath)
+    {
+        strcpy(hackPath, options.outputPath);
+    }
+    else
+    {
+        AssemblyPathFor(folders[0], hackPath);
+        ReplaceExtension(hackPath, ".hack");
+    }
+
+    char asmPath[MAX_PATH];
+    char mapPath[MAX_PATH];
+    char symbolPath[MAX_PATH];
+    strcpy(asmPath, hackPath);
+    strcpy(mapPath, hackPath);
+    strcpy(symbolPath, hackPath);
+    ReplaceExtension(asmPath, ".asm");
+    ReplaceExtension(mapPath, ".map");
+    ReplaceExtension(symbolPath, ".sym");
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<BuildClass*> classes;
+    for (char* folder : folders)
+    {
+        for (std::string& name : ListFiles(folder, ".jack"))
+        {
+            std::string className = name.substr(0, name.size() - 5);
+            bool replaced = false;
+            for (BuildClass* buildClass : classes)
+            {
+                replaced |= buildClass->name == className;
+            }
+
+            if (replaced)
+            {
+                continue;
+            }
+
+            BuildClass* buildClass = new BuildClass();
+            buildClass->name = className;
+            buildClass->path = std::string(folder) + PATH_SEPARATOR + name;
+            strncpy(buildClass->program.module, className.c_str(), sizeof(buildClass->program.module) - 1);
+
+            char vmPath[MAX_PATH];
+            strcpy(vmPath, buildClass->path.c_str());
+            ReplaceExtension(vmPath, ".vm");
+
+            CompilationEngine* engine = new CompilationEngine((char*)buildClass->path.c_str(), &buildClass->program,
+                options.writeVM ? vmPath : 0, options.compiler);
+            engine->compileClass();
+            delete engine;
+            classes.push_back(buildClass);
+        }
+    }
+
+    if (classes.empty())
+    {
+        printf("No .jack files found\n");
+        return 1;
+    }
+
+    auto compiled = std::chrono::high_resolution_clock::now();
+
+    if (!CheckCalls(classes))
+    {
+        return 1;
+    }
+
+    if (!options.keepAll)
+    {
+        PruneUnreachable(classes);
+    }
+
+    std::vector<VMProgram> programs;
+    for (BuildClass* buildClass : classes)
+    {
+        programs.push_back(buildClass->program);
+    }
+
+    HackEncoder* encoder = CreateEncoder();
+    AssemblyLineSink encode = [](void* context, char* line) { return EncodeLine((HackEncoder*)context, line); };
+    if (!TranslateVMPrograms(programs.data(), (int)programs.size(), encode, encoder,
+        options.writeAssembly ? asmPath : 0, options.writeMap ? mapPath : 0))
+    {
+        long unused;
+        free(FinishEncoder(encoder, &unused));
+        return 1;
+    }
+
+    long hackSize = 0;
+    char* variables = 0;
+    char* hack = FinishEncoder(encoder, &hackSize, options.writeSymbols ? &variables : 0);
+    if (!hack)
+    {
+        printf("Failed to assemble\n");
+        return 1;
+    }
+
+    auto assembled = std::chrono::high_resolution_clock::now();
+
+    long words = hackSize / 17;
+    printf("%d classes, %ld instructions: compiled in %.2f ms, translated and assembled in %.2f ms\n", (int)classes.size(), words,
+        std::chrono::duration<double, std::milli>(compiled - start).count(),
+        std::chrono::duration<double, std::milli>(assembled - compiled).count());
+
+    // A rom that doesn't fit would wrap the program counter, so there's nothing worth writing
+    if (words > ROM_SIZE)
+    {
+        printf("The program doesn't fit the %d word rom\n", ROM_SIZE);
+        free(hack);
+        free(variables);
+        return 1;
+    }
+
+    if (!WriteText(hackPath, hack) || (variables && !WriteText(symbolPath, variables)))
+    {
+        return 1;
+    }
+
+    free(hack);
+    free(variables);
+    for (BuildClass* buildClass : classes)
+    {
+        buildClass->program.Free();
+        delete buildClass;
+    }
+
+    return 0;
+}
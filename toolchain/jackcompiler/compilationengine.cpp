@@ -1,14 +1,26 @@
 #include <stdlib.h>
 #include "compilationengine.h"
 
-CompilationEngine::CompilationEngine(char* inputPath, char* outputPath)
-    :mTokenizer(inputPath), mVMWriter(outputPath), mCurrentToken(),
-    mInputPath(inputPath), mClassName(), mIsMethod(false), mConstructor(false),
-    mWhileCount(0), mIfCount(0)
+// Past this many vm commands an inlined multiply costs more rom than it saves in cycles
+#define MAX_INLINE_MULTIPLY_COMMANDS 32
+
+CompilationEngine::CompilationEngine(char* inputPath, char* outputPath, CompilerOptions options)
+    :mTokenizer(inputPath), mVMWriter(outputPath, options.bytecode), mCurrentToken(),
+    mClassName(), mInputPath(inputPath),
+    mWhileCount(0), mIfCount(0), mStringCount(0), mIsMethod(false), mOptions(options), mStringPoolCount(0),
+    mThatValid(false), mThatBase(), mThatIndex(), mIsBooleanResult(false)
 {
     
 }
 
+CompilationEngine::CompilationEngine(char* inputPath, VMProgram* program, char* outputPath, CompilerOptions options)
+    :mTokenizer(inputPath), mVMWriter(program, outputPath), mCurrentToken(),
+    mClassName(), mInputPath(inputPath),
+    mWhileCount(0), mIfCount(0), mStringCount(0), mIsMethod(false), mOptions(options), mStringPoolCount(0),
+    mThatValid(false), mThatBase(), mThatIndex(), mIsBooleanResult(false)
+{
+}
+
 void CompilationEngine::compileClass()
 {
     // 'class' className '{' classVarDec* subRoutineDec* '}'
@@ -43,6 +55,8 @@ void CompilationEngine::compileClass()
     }
 
     verifySymbol('}');
+    mVMWriter.close();
+    mTokenizer.close();
 }
 
 void CompilationEngine::compileClassVarDec()
@@ -62,13 +76,13 @@ void CompilationEngine::compileClassVarDec()
     Buffer type = mCurrentToken.toString();
 
     mCurrentToken = mTokenizer.getToken();
-    mSymbolTable.define(mCurrentToken.toString(), type, kind);
+    defineSymbol(mCurrentToken.toString(), type, kind);
 
     mCurrentToken = mTokenizer.getToken();
     while (mCurrentToken.isSymbol(','))
     {
         mCurrentToken = mTokenizer.getToken();
-        mSymbolTable.define(mCurrentToken.toString(), type, kind);
+        defineSymbol(mCurrentToken.toString(), type, kind);
 
         mCurrentToken = mTokenizer.getToken();
     }
@@ -80,6 +94,8 @@ void CompilationEngine::compileSubroutine()
     mSymbolTable.startSubroutine();
     mWhileCount = 0;
     mIfCount = 0;
+    mStringCount = 0;
+    mThatValid = false;
 
     Keyword subroutineType = mCurrentToken.keyword;
     mCurrentToken = mTokenizer.getToken();
@@ -118,14 +134,12 @@ void CompilationEngine::compileSubroutine()
     else if (subroutineType == KEYWORD_CONSTRUCTOR)
     {
         mVMWriter.writePush(SEGMENT_CONST, mSymbolTable.varCount(SYMBOL_FIELD));
-        mVMWriter.writeCall("Memory.alloc", 1);
+        emitCall("Memory.alloc", 1);
         mVMWriter.writePop(VMSegment::SEGMENT_POINTER, 0);
-        mConstructor = true;
     }
 
     compileStatements();
     mIsMethod = false;
-    mConstructor = false;
 
     verifySymbol('}');
 }
@@ -139,7 +153,7 @@ void CompilationEngine::compileParameterList()
         Buffer type = mCurrentToken.toString();
 
         mCurrentToken = mTokenizer.getToken();
-        mSymbolTable.define(mCurrentToken.toString(), type, SYMBOL_ARG);
+        defineSymbol(mCurrentToken.toString(), type, SYMBOL_ARG);
         
         mCurrentToken = mTokenizer.getToken();
     }
@@ -152,7 +166,7 @@ void CompilationEngine::compileParameterList()
 
         // varName
         mCurrentToken = mTokenizer.getToken();
-        mSymbolTable.define(mCurrentToken.toString(), type, SYMBOL_ARG);
+        defineSymbol(mCurrentToken.toString(), type, SYMBOL_ARG);
 
         mCurrentToken = mTokenizer.getToken();
     }
@@ -165,13 +179,13 @@ void CompilationEngine::compileVarDec()
     Buffer type = mCurrentToken.toString();
 
     mCurrentToken = mTokenizer.getToken();
-    mSymbolTable.define(mCurrentToken.toString(), type, SYMBOL_VAR);
+    defineSymbol(mCurrentToken.toString(), type, SYMBOL_VAR);
 
     mCurrentToken = mTokenizer.getToken();
     while (mCurrentToken.isSymbol(','))
     {
         mCurrentToken = mTokenizer.getToken();
-        mSymbolTable.define(mCurrentToken.toString(), type, SYMBOL_VAR);
+        defineSymbol(mCurrentToken.toString(), type, SYMBOL_VAR);
         
         mCurrentToken = mTokenizer.getToken();
     }
@@ -233,7 +247,6 @@ void CompilationEngine::compileSubroutineCall(Buffer subRoutineName, bool isDo)
 {
     Buffer className = {};
     int nArgs = 0;
-    bool shouldRestoreThis = false;
 
     // Class or object call
     if (mCurrentToken.isSymbol('.'))
@@ -249,12 +262,7 @@ void CompilationEngine::compileSubroutineCall(Buffer subRoutineName, bool isDo)
         }
         else
         {
-            shouldRestoreThis = mIsMethod || mConstructor;
-            if (shouldRestoreThis)
-            {
-                mVMWriter.writePush(SEGMENT_POINTER, 0);
-            }
-
+            // No need to save pointer 0 around the call, the vm call protocol restores it on return
             className = symbol.type;
             ++nArgs;
             pushSymbol(symbol);
@@ -277,22 +285,12 @@ void CompilationEngine::compileSubroutineCall(Buffer subRoutineName, bool isDo)
     nArgs += compileExpressionList();
     verifySymbol(')');
 
-    mVMWriter.writeCall(className, subRoutineName, nArgs);
+    emitCall(className, subRoutineName, nArgs);
 
     // pop the stack with do calls to avoid bleeding garbage values
     if (isDo)
     {
         mVMWriter.writePop(SEGMENT_TEMP, 0);
-        if (shouldRestoreThis)
-        {
-            mVMWriter.writePop(SEGMENT_POINTER, 0);
-        }
-    }
-    else if (shouldRestoreThis)
-    {
-        mVMWriter.writePop(SEGMENT_TEMP, 0);
-        mVMWriter.writePop(SEGMENT_POINTER, 0);
-        mVMWriter.writePush(SEGMENT_TEMP, 0);
     }
 }
 
@@ -310,22 +308,114 @@ void CompilationEngine::compileLet()
     if (mCurrentToken.isSymbol('['))
     {
         mCurrentToken = mTokenizer.getToken();
-        compileExpression();
-        pushSymbol(symbol);
-        mVMWriter.writeArithmetic(COMMAND_ADD);
 
-        verifySymbol(']');
-        mCurrentToken = mTokenizer.getToken();
+        // Without side effects the value can be computed before the address, which lets
+        // it go straight into that 0 instead of round tripping through temp 0
+        bool isSideEffectFree = isStatementSideEffectFree();
+        ArrayIndex index;
+        if (readSimpleArrayIndex(&index))
+        {
+            mCurrentToken = mTokenizer.getToken();
+            verifySymbol(']');
+            readSymbol('=');
 
-        verifySymbol('=');
+            if (isSideEffectFree)
+            {
+                mCurrentToken = mTokenizer.getToken();
+                compileExpression();
+                pointThatAt(symbol, index);
+            }
+            else
+            {
+                if (!index.isConstant)
+                {
+                    pushSymbol(index.variable);
+                }
 
-        mCurrentToken = mTokenizer.getToken();
-        compileExpression();
+                pushSymbol(symbol);
+                if (!index.isConstant)
+                {
+                    mVMWriter.writeArithmetic(COMMAND_ADD);
+                }
 
-        mVMWriter.writePop(SEGMENT_TEMP, 0);
-        mVMWriter.writePop(SEGMENT_POINTER, 1);
-        mVMWriter.writePush(SEGMENT_TEMP, 0);
-        mVMWriter.writePop(SEGMENT_THAT, 0);
+                mCurrentToken = mTokenizer.getToken();
+                compileExpression();
+
+                mVMWriter.writePop(SEGMENT_TEMP, 0);
+                mVMWriter.writePop(SEGMENT_POINTER, 1);
+                mVMWriter.writePush(SEGMENT_TEMP, 0);
+                mThatValid = false;
+            }
+
+            mVMWriter.writePop(SEGMENT_THAT, index.isConstant ? index.constant : 0);
+        }
+        else if (isSideEffectFree)
+        {
+            // Skip over the index, compile the value, then come back for the index
+            JackTokenizer indexTokenizer = mTokenizer;
+            Token indexToken = mCurrentToken;
+
+            int depth = 0;
+            while (depth > 0 || !mCurrentToken.isSymbol(']'))
+            {
+                if (mCurrentToken.isSymbol('['))
+                {
+                    ++depth;
+                }
+                else if (mCurrentToken.isSymbol(']'))
+                {
+                    --depth;
+                }
+                else if (mCurrentToken.type == TOKEN_EOF)
+                {
+                    unexpectedToken();
+                }
+
+                mCurrentToken = mTokenizer.getToken();
+            }
+
+            readSymbol('=');
+
+            mCurrentToken = mTokenizer.getToken();
+            compileExpression();
+
+            JackTokenizer endTokenizer = mTokenizer;
+            Token endToken = mCurrentToken;
+
+            mTokenizer = indexTokenizer;
+            mCurrentToken = indexToken;
+            compileExpression();
+            verifySymbol(']');
+
+            pushSymbol(symbol);
+            mVMWriter.writeArithmetic(COMMAND_ADD);
+            mVMWriter.writePop(SEGMENT_POINTER, 1);
+            mVMWriter.writePop(SEGMENT_THAT, 0);
+            mThatValid = false;
+
+            mTokenizer = endTokenizer;
+            mCurrentToken = endToken;
+        }
+        else
+        {
+            compileExpression();
+            pushSymbol(symbol);
+            mVMWriter.writeArithmetic(COMMAND_ADD);
+
+            verifySymbol(']');
+            mCurrentToken = mTokenizer.getToken();
+
+            verifySymbol('=');
+
+            mCurrentToken = mTokenizer.getToken();
+            compileExpression();
+
+            mVMWriter.writePop(SEGMENT_TEMP, 0);
+            mVMWriter.writePop(SEGMENT_POINTER, 1);
+            mVMWriter.writePush(SEGMENT_TEMP, 0);
+            mVMWriter.writePop(SEGMENT_THAT, 0);
+            mThatValid = false;
+        }
     }
     else
     {
@@ -347,9 +437,11 @@ void CompilationEngine::compileWhile()
     // Using the same name scheme as the example OS vm code
     char whileExpLabel[64];
     sprintf(whileExpLabel, "WHILE_EXP%d", mWhileCount);
-    mVMWriter.writeLabel(whileExpLabel);
+    emitLabel(whileExpLabel);
 
     mCurrentToken = mTokenizer.getToken();
+    JackTokenizer conditionTokenizer = mTokenizer;
+    Token conditionToken = mCurrentToken;
     compileExpression();
     verifySymbol(')');
     readSymbol('{');
@@ -359,13 +451,42 @@ void CompilationEngine::compileWhile()
     mVMWriter.writeArithmetic(COMMAND_NOT);
     mVMWriter.writeIf(whileEndLabel);
 
+    // The rotated loop repeats the test at the bottom and branches straight back on true.
+    // if-goto takes any non zero value while the top test only continues on -1, so this
+    // is only equivalent when the condition is known to be a proper boolean.
+    bool rotate = mOptions.rotateLoops && mIsBooleanResult;
+    char whileBodyLabel[64];
+    sprintf(whileBodyLabel, "WHILE_BODY%d", mWhileCount);
+    if (rotate)
+    {
+        emitLabel(whileBodyLabel);
+    }
+
     mCurrentToken = mTokenizer.getToken();
     ++mWhileCount;
     compileStatements();
     verifySymbol('}');
 
-    mVMWriter.writeGoto(whileExpLabel);
-    mVMWriter.writeLabel(whileEndLabel);
+    if (rotate)
+    {
+        JackTokenizer endTokenizer = mTokenizer;
+        Token endToken = mCurrentToken;
+
+        mTokenizer = conditionTokenizer;
+        mCurrentToken = conditionToken;
+        compileExpression();
+        verifySymbol(')');
+        mVMWriter.writeIf(whileBodyLabel);
+
+        mTokenizer = endTokenizer;
+        mCurrentToken = endToken;
+    }
+    else
+    {
+        mVMWriter.writeGoto(whileExpLabel);
+    }
+
+    emitLabel(whileEndLabel);
 }
 
 void CompilationEngine::compileReturn()
@@ -408,7 +529,7 @@ void CompilationEngine::compileIf()
     ++mIfCount;
 
     mVMWriter.writeGoto(ifFalseLabel);
-    mVMWriter.writeLabel(ifTrueLabel);
+    emitLabel(ifTrueLabel);
 
     mCurrentToken = mTokenizer.getToken();
     compileStatements();
@@ -419,7 +540,7 @@ void CompilationEngine::compileIf()
     if (mCurrentToken.isKeyword(KEYWORD_ELSE))
     {
         mVMWriter.writeGoto(ifEndLabel);
-        mVMWriter.writeLabel(ifFalseLabel);
+        emitLabel(ifFalseLabel);
 
         readSymbol('{');
 
@@ -429,11 +550,11 @@ void CompilationEngine::compileIf()
         verifySymbol('}');
 
         mCurrentToken = mTokenizer.getToken();
-        mVMWriter.writeLabel(ifEndLabel);
+        emitLabel(ifEndLabel);
     }
     else
     {
-        mVMWriter.writeLabel(ifFalseLabel);
+        emitLabel(ifFalseLabel);
     }
 
 }
@@ -442,14 +563,68 @@ void CompilationEngine::compileExpression()
 {
     // term (op term)*
     // op: '+ | '-' | '*' | '/' | '&' | '|' | '<' | '>' | '='
-    compileTerm();
+    if (mCurrentToken.type == TOKEN_INTEGERCONST)
+    {
+        // A leading constant multiplier is handled like a trailing one since the constant has no side effects
+        int constant = mCurrentToken.value;
+        mCurrentToken = mTokenizer.getToken();
+        if (mCurrentToken.isSymbol('*'))
+        {
+            mCurrentToken = mTokenizer.getToken();
+            compileTerm();
+            compileMultiplyByConstant(constant);
+            mIsBooleanResult = false;
+        }
+        else
+        {
+            mVMWriter.writePush(SEGMENT_CONST, constant);
+            mIsBooleanResult = constant == 0;
+        }
+    }
+    else
+    {
+        compileTerm();
+    }
 
+    bool isBoolean = mIsBooleanResult;
     while (isOperator())
     {
         char op = mCurrentToken.text[0];
         mCurrentToken = mTokenizer.getToken();
+
+        if ((op == '*' || op == '/') && mCurrentToken.type == TOKEN_INTEGERCONST)
+        {
+            int constant = mCurrentToken.value;
+            mCurrentToken = mTokenizer.getToken();
+            if (op == '*')
+            {
+                compileMultiplyByConstant(constant);
+            }
+            else
+            {
+                compileDivideByConstant(constant);
+            }
+
+            isBoolean = false;
+            continue;
+        }
+
         compileTerm();
 
+        // Comparisons always produce 0 or -1, and so do bitwise ops between those
+        if (op == '<' || op == '>' || op == '=')
+        {
+            isBoolean = true;
+        }
+        else if (op == '&' || op == '|')
+        {
+            isBoolean = isBoolean && mIsBooleanResult;
+        }
+        else
+        {
+            isBoolean = false;
+        }
+
         switch (op)
         {
             case '+':
@@ -461,11 +636,11 @@ void CompilationEngine::compileExpression()
                 break;
 
             case '*':
-                mVMWriter.writeCall("Math.multiply", 2);
+                emitCall("Math.multiply", 2);
                 break;
 
             case '/':
-                mVMWriter.writeCall("Math.divide", 2);
+                emitCall("Math.divide", 2);
                 break;
 
             case '&':
@@ -489,6 +664,8 @@ void CompilationEngine::compileExpression()
                 break;
         }
     }
+
+    mIsBooleanResult = isBoolean;
 }
 
 void CompilationEngine::compileTerm()
@@ -497,35 +674,40 @@ void CompilationEngine::compileTerm()
     if (mCurrentToken.type == TOKEN_INTEGERCONST)
     {
         mVMWriter.writePush(SEGMENT_CONST, mCurrentToken.value);
+        mIsBooleanResult = mCurrentToken.value == 0;
         mCurrentToken = mTokenizer.getToken();
     }
     else if(mCurrentToken.type == TOKEN_STRINGCONST)
     {
-        // Create string using sitring constructor and assign the values
-        mVMWriter.writePush(SEGMENT_CONST, mCurrentToken.length);
-        mVMWriter.writeCall("String.new", 1);
-        for (int i = 0; i < mCurrentToken.length; ++i)
+        if (mOptions.poolStrings)
+        {
+            compilePooledString(mCurrentToken.toString());
+        }
+        else
         {
-            mVMWriter.writePush(SEGMENT_CONST, mCurrentToken.text[i]);
-            mVMWriter.writeCall("String.appendChar", 2);
+            compileStringConstruction(mCurrentToken.toString());
         }
 
+        mIsBooleanResult = false;
         mCurrentToken = mTokenizer.getToken();
     }
     else if (mCurrentToken.isKeyword(KEYWORD_TRUE))
     {
         mVMWriter.writePush(SEGMENT_CONST, 0);
         mVMWriter.writeArithmetic(COMMAND_NOT);
+        mIsBooleanResult = true;
         mCurrentToken = mTokenizer.getToken();
     }
     else if (mCurrentToken.isKeyword(KEYWORD_FALSE) || mCurrentToken.isKeyword(KEYWORD_NULL))
     {
         mVMWriter.writePush(SEGMENT_CONST, 0);
+        mIsBooleanResult = true;
         mCurrentToken = mTokenizer.getToken();
     }
     else if (mCurrentToken.isKeyword(KEYWORD_THIS))
     {
         mVMWriter.writePush(SEGMENT_POINTER, 0);
+        mIsBooleanResult = false;
         mCurrentToken = mTokenizer.getToken();
     }
     // term: '(' expression ')'
@@ -542,6 +724,7 @@ void CompilationEngine::compileTerm()
         mCurrentToken = mTokenizer.getToken();
         compileTerm();
         mVMWriter.writeArithmetic(COMMAND_NEG);
+        mIsBooleanResult = false;
     }
     else if (mCurrentToken.isSymbol('~'))
     {
@@ -562,13 +745,27 @@ void CompilationEngine::compileTerm()
             Symbol symbol = mSymbolTable.find(varName);
 
             mCurrentToken = mTokenizer.getToken();
-            compileExpression();
-            verifySymbol(']');
 
-            pushSymbol(symbol);
-            mVMWriter.writeArithmetic(COMMAND_ADD);
-            mVMWriter.writePop(SEGMENT_POINTER, 1);
-            mVMWriter.writePush(SEGMENT_THAT, 0);
+            ArrayIndex index;
+            if (readSimpleArrayIndex(&index))
+            {
+                mCurrentToken = mTokenizer.getToken();
+                verifySymbol(']');
+
+                pointThatAt(symbol, index);
+                mVMWriter.writePush(SEGMENT_THAT, index.isConstant ? index.constant : 0);
+            }
+            else
+            {
+                compileExpression();
+                verifySymbol(']');
+
+                pushSymbol(symbol);
+                mVMWriter.writeArithmetic(COMMAND_ADD);
+                mVMWriter.writePop(SEGMENT_POINTER, 1);
+                mVMWriter.writePush(SEGMENT_THAT, 0);
+                mThatValid = false;
+            }
 
             mCurrentToken = mTokenizer.getToken();
         }
@@ -584,9 +781,147 @@ void CompilationEngine::compileTerm()
             Symbol symbol = mSymbolTable.find(varName);
             pushSymbol(symbol);
         }
+
+        mIsBooleanResult = false;
     }
 }
 
+void CompilationEngine::compileMultiplyByConstant(int multiplier)
+{
+    // The left operand is already on the stack, so it gets stashed in temp 0 and doubled there.
+    // Every doubling costs 4 vm commands, which is still far cheaper than a Math.multiply call,
+    // but large multipliers would bloat the rom so those still go through the OS.
+    int highestBit = 0;
+    int setBits = 0;
+    for (int bit = 0; bit < 15; ++bit)
+    {
+        if (multiplier & (1 << bit))
+        {
+            highestBit = bit;
+            ++setBits;
+        }
+    }
+
+    if (multiplier == 0)
+    {
+        mVMWriter.writePop(SEGMENT_TEMP, 0);
+        mVMWriter.writePush(SEGMENT_CONST, 0);
+    }
+    else if (multiplier == 1)
+    {
+        // x * 1 is just x
+    }
+    else if (setBits == 1 && highestBit * 4 <= MAX_INLINE_MULTIPLY_COMMANDS)
+    {
+        // x * 2^n: double the top of the stack n times
+        for (int i = 0; i < highestBit; ++i)
+        {
+            mVMWriter.writePop(SEGMENT_TEMP, 0);
+            mVMWriter.writePush(SEGMENT_TEMP, 0);
+            mVMWriter.writePush(SEGMENT_TEMP, 0);
+            mVMWriter.writeArithmetic(COMMAND_ADD);
+        }
+    }
+    else if (1 + highestBit * 4 + setBits * 2 - 1 <= MAX_INLINE_MULTIPLY_COMMANDS)
+    {
+        // Shift and add: sum x * 2^bit into the stack for every set bit of the multiplier
+        mVMWriter.writePop(SEGMENT_TEMP, 0);
+
+        bool hasPartial = false;
+        for (int bit = 0; bit <= highestBit; ++bit)
+        {
+            if (multiplier & (1 << bit))
+            {
+                mVMWriter.writePush(SEGMENT_TEMP, 0);
+                if (hasPartial)
+                {
+                    mVMWriter.writeArithmetic(COMMAND_ADD);
+                }
+
+                hasPartial = true;
+            }
+
+            if (bit < highestBit)
+            {
+                mVMWriter.writePush(SEGMENT_TEMP, 0);
+                mVMWriter.writePush(SEGMENT_TEMP, 0);
+                mVMWriter.writeArithmetic(COMMAND_ADD);
+                mVMWriter.writePop(SEGMENT_TEMP, 0);
+            }
+        }
+    }
+    else
+    {
+        mVMWriter.writePush(SEGMENT_CONST, multiplier);
+        emitCall("Math.multiply", 2);
+    }
+}
+
+void CompilationEngine::compileDivideByConstant(int divisor)
+{
+    // Hack has no right shift and Math.divide truncates toward zero, so the only
+    // divisor we can safely skip the call for is 1. Zero still goes through the OS
+    // so that it reports the error.
+    if (divisor != 1)
+    {
+        mVMWriter.writePush(SEGMENT_CONST, divisor);
+        emitCall("Math.divide", 2);
+    }
+}
+
+void CompilationEngine::compileStringConstruction(Buffer text)
+{
+    // Create string using sitring constructor and assign the values
+    mVMWriter.writePush(SEGMENT_CONST, text.size);
+    emitCall("String.new", 1);
+    for (int i = 0; i < text.size; ++i)
+    {
+        mVMWriter.writePush(SEGMENT_CONST, text.memory[i]);
+        emitCall("String.appendChar", 2);
+    }
+}
+
+void CompilationEngine::compilePooledString(Buffer text)
+{
+    // Each distinct literal in the class gets a hidden static slot. It's built the first time
+    // the literal is evaluated and every later evaluation just pushes the existing string.
+    int poolIndex = 0;
+    while (poolIndex < mStringPoolCount && !mStringPool[poolIndex].text.equals(text))
+    {
+        ++poolIndex;
+    }
+
+    if (poolIndex == mStringPoolCount)
+    {
+        // The class's own statics are all declared before its first subroutine, so whatever's
+        // left of the segment can go to literals. Unnamed statics can never be found by an
+        // identifier lookup.
+        int staticIndex = mStringPoolCount < MAX_POOLED_STRINGS ? mSymbolTable.define(Buffer(), Buffer(), SYMBOL_STATIC) : -1;
+        if (staticIndex < 0)
+        {
+            compileStringConstruction(text);
+            return;
+        }
+
+        mStringPool[poolIndex].text = text;
+        mStringPool[poolIndex].staticIndex = staticIndex;
+        ++mStringPoolCount;
+    }
+
+    int staticIndex = mStringPool[poolIndex].staticIndex;
+
+    char stringReadyLabel[64];
+    sprintf(stringReadyLabel, "STRING_READY%d", mStringCount);
+    ++mStringCount;
+
+    mVMWriter.writePush(SEGMENT_STATIC, staticIndex);
+    mVMWriter.writeIf(stringReadyLabel);
+    compileStringConstruction(text);
+    mVMWriter.writePop(SEGMENT_STATIC, staticIndex);
+    emitLabel(stringReadyLabel);
+    mVMWriter.writePush(SEGMENT_STATIC, staticIndex);
+}
+
 int CompilationEngine::compileExpressionList()
 {
     int numExpressions = 0;
@@ -637,6 +972,16 @@ void CompilationEngine::unexpectedToken()
     exit(1);
 }
 
+void CompilationEngine::defineSymbol(Buffer name, Buffer type, SymbolKind kind)
+{
+    if (mSymbolTable.define(name, type, kind) < 0)
+    {
+        const char* limit = kind == SYMBOL_STATIC && mSymbolTable.varCount(SYMBOL_STATIC) == MAX_STATICS ? "statics than the static segment holds" : "variables than the symbol table holds";
+        printf("More %s in %s at line %d, col %d\n", limit, mInputPath, mCurrentToken.lineNumber, mCurrentToken.column);
+        exit(1);
+    }
+}
+
 void CompilationEngine::verifySymbol(char expectedSymbol)
 {
     if (expectedSymbol && !mCurrentToken.isSymbol(expectedSymbol) || !mCurrentToken.isSymbol())
@@ -711,6 +1056,11 @@ void CompilationEngine::pushSymbol(Symbol symbol)
 
 void CompilationEngine::popToSymbol(Symbol symbol)
 {
+    if (mThatValid && (isSameSymbol(symbol, mThatBase) || isSameSymbol(symbol, mThatIndex)))
+    {
+        mThatValid = false;
+    }
+
     switch (symbol.kind)
     {
         case SYMBOL_STATIC:
@@ -726,4 +1076,117 @@ void CompilationEngine::popToSymbol(Symbol symbol)
             mVMWriter.writePop(SEGMENT_ARG, mIsMethod ? symbol.index + 1: symbol.index);
             break;
     }
-}
\ No newline at end of file
+}
+
+bool CompilationEngine::readSimpleArrayIndex(ArrayIndex* index)
+{
+    // Only a lone constant or variable counts, so look one token past it for the closing bracket
+    JackTokenizer lookahead = mTokenizer;
+    if (!lookahead.getToken().isSymbol(']'))
+    {
+        return false;
+    }
+
+    if (mCurrentToken.type == TOKEN_INTEGERCONST)
+    {
+        index->isConstant = true;
+        index->constant = mCurrentToken.value;
+        return true;
+    }
+
+    if (mCurrentToken.type == TOKEN_IDENTIFIER)
+    {
+        index->isConstant = false;
+        index->variable = mSymbolTable.find(mCurrentToken.toString());
+        return index->variable.kind != SYMBOL_NONE;
+    }
+
+    return false;
+}
+
+void CompilationEngine::pointThatAt(Symbol base, ArrayIndex index)
+{
+    // Constant indices address off the base through that k, so pointer 1 only needs the base
+    Symbol indexSymbol = index.isConstant ? Symbol() : index.variable;
+    if (mThatValid && isSameSymbol(base, mThatBase) && isSameSymbol(indexSymbol, mThatIndex))
+    {
+        return;
+    }
+
+    if (!index.isConstant)
+    {
+        pushSymbol(index.variable);
+    }
+
+    pushSymbol(base);
+    if (!index.isConstant)
+    {
+        mVMWriter.writeArithmetic(COMMAND_ADD);
+    }
+
+    mVMWriter.writePop(SEGMENT_POINTER, 1);
+
+    mThatValid = base.kind != SYMBOL_NONE;
+    mThatBase = base;
+    mThatIndex = indexSymbol;
+}
+
+bool CompilationEngine::isStatementSideEffectFree()
+{
+    // Scans ahead to the end of the statement for subroutine calls or string constants,
+    // which are the only things in an expression that can modify variables
+    JackTokenizer lookahead = mTokenizer;
+    Token token = mCurrentToken;
+    while (token.type != TOKEN_EOF && !token.isSymbol(';'))
+    {
+        Token next = lookahead.getToken();
+        if (token.type == TOKEN_STRINGCONST)
+        {
+            return false;
+        }
+
+        if (token.type == TOKEN_IDENTIFIER && (next.isSymbol('(') || next.isSymbol('.')))
+        {
+            return false;
+        }
+
+        token = next;
+    }
+
+    return true;
+}
+
+bool CompilationEngine::isSameSymbol(Symbol a, Symbol b)
+{
+    return a.kind == b.kind && a.index == b.index;
+}
+
+void CompilationEngine::emitLabel(char* label)
+{
+    // Control can arrive here from anywhere, so nothing is known about pointer 1
+    mVMWriter.writeLabel(label);
+    mThatValid = false;
+}
+
+void CompilationEngine::emitCall(const char* name, int nArgs)
+{
+    mVMWriter.writeCall(name, nArgs);
+    forgetThatAfterCall();
+}
+
+void CompilationEngine::emitCall(Buffer className, Buffer functionName, int nArgs)
+{
+    mVMWriter.writeCall(className, functionName, nArgs);
+    forgetThatAfterCall();
+}
+
+void CompilationEngine::forgetThatAfterCall()
+{
+    // The call protocol restores pointer 1 on return, but the callee may have changed
+    // statics or fields that the cached base or index was read from
+    if (mThatBase.kind == SYMBOL_STATIC || mThatBase.kind == SYMBOL_FIELD ||
+        mThatIndex.kind == SYMBOL_STATIC || mThatIndex.kind == SYMBOL_FIELD)
+    {
+        mThatValid = false;
+    }
+}
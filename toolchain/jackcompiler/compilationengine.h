@@ -3,13 +3,49 @@
 #include "symboltable.h"
 #include "vmwriter.h"
 
+// Every class of a program shares the static segment, so a class only pools this many literals
+// and builds any others in place
+#define MAX_POOLED_STRINGS 32
+
+struct CompilerOptions
+{
+    // Build each distinct string literal once into a hidden static and reuse it afterwards.
+    // Code that modifies or disposes of literals needs this off.
+    bool poolStrings = true;
+
+    // Compile while loops with the test at the bottom so each iteration takes one branch instead of two
+    bool rotateLoops = false;
+
+    // Write the compact .vmb bytecode instead of .vm text
+    bool bytecode = false;
+};
+
+struct PooledString
+{
+    Buffer text;
+    int staticIndex;
+};
+
+struct ArrayIndex
+{
+    bool isConstant;
+    int constant;
+    Symbol variable;
+};
+
 class CompilationEngine
 {
     public:
         /// <summary>
         /// Creates a new compilation engine with the given input and output. The next routine called must be compileClass
         /// </summary>
-        CompilationEngine(char* inputPath, char* outputPath);
+        CompilationEngine(char* inputPath, char* outputPath, CompilerOptions options = CompilerOptions());
+
+        /// <summary>
+        /// Creates a compilation engine that adds the class's commands to program, and writes them to outputPath
+        /// too if it's given
+        /// </summary>
+        CompilationEngine(char* inputPath, VMProgram* program, char* outputPath = 0, CompilerOptions options = CompilerOptions());
 
         /// <summary>
         /// Compiles a complete class.
@@ -83,6 +119,26 @@ class CompilationEngine
         /// </summary>
         int compileExpressionList();
 
+        /// <summary>
+        /// Multiplies the value on top of the stack by a constant, using repeated doubling when it's cheaper than Math.multiply.
+        /// </summary>
+        void compileMultiplyByConstant(int multiplier);
+
+        /// <summary>
+        /// Divides the value on top of the stack by a constant, skipping Math.divide when the result is known.
+        /// </summary>
+        void compileDivideByConstant(int divisor);
+
+        /// <summary>
+        /// Builds a new string from a literal with String.new and String.appendChar.
+        /// </summary>
+        void compileStringConstruction(Buffer text);
+
+        /// <summary>
+        /// Pushes a literal string, constructing it into its class static on first use.
+        /// </summary>
+        void compilePooledString(Buffer text);
+
     private:
         JackTokenizer mTokenizer;
         SymbolTable mSymbolTable;
@@ -92,8 +148,21 @@ class CompilationEngine
         char* mInputPath;
         int mWhileCount;
         int mIfCount;
+        int mStringCount;
         bool mIsMethod;
-        bool mConstructor;
+        CompilerOptions mOptions;
+
+        PooledString mStringPool[MAX_POOLED_STRINGS];
+        int mStringPoolCount;
+
+        // What pointer 1 currently holds, so repeated accesses to the same array element can skip recomputing it.
+        // mThatIndex has no kind when pointer 1 is the base itself.
+        bool mThatValid;
+        Symbol mThatBase;
+        Symbol mThatIndex;
+
+        // Set by compileExpression and compileTerm when the value they left on the stack can only be 0 or -1
+        bool mIsBooleanResult;
 
         /// <summary>
         /// Read the next token and verify it as the given keyword
@@ -115,6 +184,11 @@ class CompilationEngine
 
         void unexpectedToken();
 
+        /// <summary>
+        /// Adds a symbol to the symbol table, stopping with an error if there's no room for it
+        /// </summary>
+        void defineSymbol(Buffer name, Buffer type, SymbolKind kind);
+
         void verifySymbol(char expectedSymbol);
 
         bool isOperator();
@@ -122,4 +196,26 @@ class CompilationEngine
 
         void pushSymbol(Symbol symbol);
         void popToSymbol(Symbol symbol);
+
+        /// <summary>
+        /// Checks whether the current array index is a single constant or variable. If it is, fills in index without consuming any tokens.
+        /// </summary>
+        bool readSimpleArrayIndex(ArrayIndex* index);
+
+        /// <summary>
+        /// Sets pointer 1 for accessing base[index], unless it's already there.
+        /// </summary>
+        void pointThatAt(Symbol base, ArrayIndex index);
+
+        /// <summary>
+        /// Looks ahead from the current token to the end of the statement to see if evaluating it could modify any variables.
+        /// </summary>
+        bool isStatementSideEffectFree();
+
+        bool isSameSymbol(Symbol a, Symbol b);
+
+        void emitLabel(char* label);
+        void emitCall(const char* name, int nArgs);
+        void emitCall(Buffer className, Buffer functionName, int nArgs);
+        void forgetThatAfterCall();
 };
\ No newline at end of file
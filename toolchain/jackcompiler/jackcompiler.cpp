@@ -1,54 +1,67 @@
-#include <windows.h>
+#include <cstdio>
+#include <cstring>
 #include "util.h"
+#include "../common/fileio.h"
 #include "compilationengine.h"
 
-void compileFile(char* path)
+void compileFile(char* path, CompilerOptions options)
 {
     char outputPath[256] = {};
     strcpy(outputPath, path);
 
     char* ext = extension(outputPath);
-    strcpy(ext, ".vm");
+    strcpy(ext, options.bytecode ? ".vmb" : ".vm");
 
-    CompilationEngine parser = CompilationEngine(path, outputPath);
+    CompilationEngine parser = CompilationEngine(path, outputPath, options);
     parser.compileClass();
 }
 
 int main(int argc, char** argv)
 {
-    if (argc != 2)
+    CompilerOptions options;
+    int argIndex = 1;
+    while (argIndex < argc - 1 && argv[argIndex][0] == '-')
     {
-        printf("Usage: jackcompiler <file.jack | folder>\n");
+        if (strcmp(argv[argIndex], "-nostringpool") == 0)
+        {
+            options.poolStrings = false;
+        }
+        else if (strcmp(argv[argIndex], "-rotateloops") == 0)
+        {
+            options.rotateLoops = true;
+        }
+        else if (strcmp(argv[argIndex], "-vmb") == 0)
+        {
+            options.bytecode = true;
+        }
+        else
+        {
+            printf("Unknown option: %s\n", argv[argIndex]);
+            return 0;
+        }
+
+        ++argIndex;
+    }
+
+    if (argIndex != argc - 1)
+    {
+        printf("Usage: jackcompiler [-nostringpool] [-rotateloops] [-vmb] <file.jack | folder>\n");
         return 0;
     }
 
-    char* path = argv[1];
-    bool isDir = isDirectory(path);
-    if (isDir)
+    char* path = argv[argIndex];
+    if (IsDirectory(path))
     {
-        char searchPath[MAX_PATH];
         char filePath[MAX_PATH];
-        sprintf(searchPath, "%s\\*.jack", path);
-
-        WIN32_FIND_DATAA fdFile;
-        HANDLE hFind = FindFirstFileA(searchPath, &fdFile);
-        if (hFind != INVALID_HANDLE_VALUE)
+        for (std::string& name : ListFiles(path, ".jack"))
         {
-            do
-            {
-                if ((fdFile.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
-                {
-                    sprintf(filePath, "%s\\%s", path, fdFile.cFileName);
-                    compileFile(filePath);
-                }
-            } while (FindNextFileA(hFind, &fdFile));
-
-            FindClose(hFind);
+            snprintf(filePath, sizeof(filePath), "%s" PATH_SEPARATOR "%s", path, name.c_str());
+            compileFile(filePath, options);
         }
     }
     else
     {
-        compileFile(path);
+        compileFile(path, options);
     }
 
     return 0;
@@ -1,5 +1,6 @@
 #include <cstring>
 #include "jacktokenizer.h"
+#include "../common/textscan.h"
 
 Buffer Token::toString()
 {
@@ -101,16 +102,6 @@ bool isLower(char v)
     return v >= 'a' && v <= 'z';
 }
 
-bool isEOL(char v)
-{
-    return v == '\r' || v == '\n';
-}
-
-bool isWhitespace(char v)
-{
-    return v == ' ' || v == '\t';
-}
-
 int toDigit(char v)
 {
     return v - '0';
@@ -119,13 +110,24 @@ int toDigit(char v)
 JackTokenizer::JackTokenizer(char* path)
     : mAt(0), mPath(path), mLine(1), mCol(1), mCurrentSymbol(0)
 {
-    Buffer input = readWholeFile(mPath);
-    if (!input.size) { return; }
-    mAt = input.memory;
+    if (!mInput.Open(mPath))
+    {
+        printf("Failed to open file: %s\n", mPath);
+        return;
+    }
+
+    mAt = mInput.text;
     mCurrentSymbol = *mAt;
     eatAllWhitespace();
 }
 
+void JackTokenizer::close()
+{
+    mInput.Close();
+    mAt = 0;
+    mCurrentSymbol = 0;
+}
+
 void JackTokenizer::advance(int amount)
 {
     mAt += amount;
@@ -133,48 +135,45 @@ void JackTokenizer::advance(int amount)
     mCurrentSymbol = *mAt;
 }
 
-void JackTokenizer::eatAllWhitespace()
+void JackTokenizer::skipTo(char* end)
 {
-    while (mCurrentSymbol)
+    int lines = CountNewlines(mAt, end);
+    if (lines)
     {
-        if (isWhitespace(mCurrentSymbol))
+        char* lineStart = end;
+        while (lineStart[-1] != '\n')
         {
-            advance();
-        }
-        else if (mAt[0] == '\r' && mAt[1] == '\n')
-        {
-            advance(2);
-            mCol = 1;
-            ++mLine;
-        }
-        else if (isEOL(mCurrentSymbol))
-        {
-            advance();
-            mCol = 1;
-            ++mLine;
+            --lineStart;
         }
+
+        mLine += lines;
+        mCol = (int)(end - lineStart) + 1;
+    }
+    else
+    {
+        mCol += (int)(end - mAt);
+    }
+
+    mAt = end;
+    mCurrentSymbol = *mAt;
+}
+
+void JackTokenizer::eatAllWhitespace()
+{
+    while (mCurrentSymbol)
+    {
+        skipTo(SkipWhitespace(mAt));
+
         // single line comments
-        else if (mAt[0] == '/' && mAt[1] == '/')
+        if (mAt[0] == '/' && mAt[1] == '/')
         {
-            advance(2);
-            while (mCurrentSymbol && !isEOL(mCurrentSymbol))
-            {
-                advance();
-            }
+            skipTo(FindLineEnd(mAt + 2));
         }
         // block comment
         else if (mAt[0] == '/' && mAt[1] == '*')
         {
-            advance(2);
-            while (mCurrentSymbol && !(mAt[0] == '*' && mAt[1] == '/'))
-            {
-                advance();
-            }
-
-            if (mCurrentSymbol)
-            {
-                advance(2);
-            }
+            char* end = FindCommentEnd(mAt + 2);
+            skipTo(*end ? end + 2 : end);
         }
         else
         {
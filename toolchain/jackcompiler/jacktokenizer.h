@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdio>
 #include "util.h"
+#include "../common/fileio.h"
 
 enum TokenType
 {
@@ -69,7 +70,11 @@ class JackTokenizer
         Token getToken();
         void writeToFile();
 
+        // Lets go of the input, which every token's text points into
+        void close();
+
     private:
+        FileView mInput;
         char* mAt;
         char* mPath;
         int mLine;
@@ -78,4 +83,7 @@ class JackTokenizer
 
         void eatAllWhitespace();
         void advance(int amount = 1);
+
+        // Moves on to end, counting the lines and columns passed over
+        void skipTo(char* end);
 };
@@ -21,6 +21,11 @@ int SymbolTable::define(Buffer name, Buffer type, SymbolKind kind)
     int index = 0;
     if (kind == SYMBOL_STATIC || kind == SYMBOL_FIELD)
     {
+        if (mClassTableCount == MAX_CLASS_SYMBOLS || (kind == SYMBOL_STATIC && mVarCounts[kind] == MAX_STATICS))
+        {
+            return -1;
+        }
+
         index = mVarCounts[kind]++;
         mClassTable[mClassTableCount].name = name;
         mClassTable[mClassTableCount].type = type;
@@ -30,6 +35,11 @@ int SymbolTable::define(Buffer name, Buffer type, SymbolKind kind)
     }
     else
     {
+        if (mSubroutineTableCount == MAX_SUBROUTINE_SYMBOLS)
+        {
+            return -1;
+        }
+
         index = mVarCounts[kind]++;
         mSubroutineTable[mSubroutineTableCount].name = name;
         mSubroutineTable[mSubroutineTableCount].type = type;
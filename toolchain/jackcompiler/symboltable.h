@@ -1,6 +1,12 @@
 #pragma once
 #include "util.h"
 
+#define MAX_CLASS_SYMBOLS 300
+#define MAX_SUBROUTINE_SYMBOLS 300
+
+// The words of Hack's static segment, RAM 16 to 255, which every class of a program shares
+#define MAX_STATICS 240
+
 enum SymbolKind
 {
     SYMBOL_NONE,
@@ -29,6 +35,10 @@ class SymbolTable
         /// </summary>
         void startSubroutine();
 
+        /// <summary>
+        /// Adds a symbol and returns its index in its segment, or -1 if its table is full or a
+        /// static would take more words than the static segment has.
+        /// </summary>
         int define(Buffer name, Buffer type, SymbolKind kind);
         int varCount(SymbolKind kind);
 
@@ -39,10 +49,10 @@ class SymbolTable
         Symbol find(Buffer name);
 
     private:
-        Symbol mClassTable[300];
+        Symbol mClassTable[MAX_CLASS_SYMBOLS];
         int mClassTableCount;
 
-        Symbol mSubroutineTable[300];
+        Symbol mSubroutineTable[MAX_SUBROUTINE_SYMBOLS];
         int mSubroutineTableCount;
 
         int mVarCounts[SYMBOL_COUNT];
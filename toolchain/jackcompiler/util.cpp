@@ -1,32 +1,16 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
-#include <windows.h>
 #include "util.h"
+#include "../common/fileio.h"
 
 Buffer readWholeFile(char* path)
 {
     Buffer result = {};
-    FILE* file = fopen(path, "rb");
-    if (file)
-    {
-        fseek(file, 0, SEEK_END);
-        result.size = ftell(file);
-        fseek(file, 0, SEEK_SET);
-        int pos = ftell(file);
-
-        result.memory = (char*)malloc(result.size + 1);
-        size_t readResult = fread(result.memory, 1, result.size, file);
-        if (readResult != result.size)
-        {
-            perror("The following error occurred");
-            exit(3);
-        }
-
-        result.memory[result.size] = 0;
-        fclose(file);
-    }
-    else
+    size_t size = 0;
+    result.memory = ReadWholeFile(path, &size);
+    result.size = (long)size;
+    if (!result.memory)
     {
         printf("Failed to open file: %s\n", path);
     }
@@ -36,8 +20,7 @@ Buffer readWholeFile(char* path)
 
 bool isDirectory(char* path)
 {
-    DWORD attributes = GetFileAttributesA(path);
-    return attributes != INVALID_FILE_ATTRIBUTES && ((attributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+    return IsDirectory(path);
 }
 
 char* extension(char* path)
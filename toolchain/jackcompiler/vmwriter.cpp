@@ -1,183 +1,174 @@
 #include "vmwriter.h"
 
-VMWriter::VMWriter(char* outputPath)
+static const char* commandNames[] = { "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not" };
+
+VMWriter::VMWriter(char* outputPath, bool bytecode)
+    :mOutput(), mProgram(0), mBytecodeFile(0)
 {
-    mOutputFile = fopen(outputPath, "w");
-    if (!mOutputFile)
+    bool opened;
+    if (bytecode)
+    {
+        mBytecodeFile = fopen(outputPath, "wb");
+        mProgram = &mBytecode;
+        opened = mBytecodeFile != 0;
+    }
+    else
+    {
+        opened = mOutput.Open(outputPath);
+    }
+
+    if (!opened)
     {
         printf("Failed to open output file: %s\n", outputPath);
     }
 }
 
-void VMWriter::writePush(VMSegment segment, int index)
+VMWriter::VMWriter(VMProgram* program, char* outputPath)
+    :mOutput(), mProgram(program), mBytecodeFile(0)
 {
-    switch (segment)
+    if (outputPath && !mOutput.Open(outputPath))
     {
-        case SEGMENT_CONST:
-            fprintf(mOutputFile, "push constant %d\n", index);
-            break;
-
-        case SEGMENT_ARG:
-            fprintf(mOutputFile, "push argument %d\n", index);
-            break;
-
-        case SEGMENT_LOCAL:
-            fprintf(mOutputFile, "push local %d\n", index);
-            break;
-
-        case SEGMENT_STATIC:
-            fprintf(mOutputFile, "push static %d\n", index);
-            break;
-
-        case SEGMENT_THIS:
-            fprintf(mOutputFile, "push this %d\n", index);
-            break;
-
-        case SEGMENT_THAT:
-            fprintf(mOutputFile, "push that %d\n", index);
-            break;
+        printf("Failed to open output file: %s\n", outputPath);
+    }
+}
 
-        case SEGMENT_POINTER:
-            fprintf(mOutputFile, "push pointer %d\n", index);
-            break;
+void VMWriter::writePush(VMSegment segment, int index)
+{
+    if (mOutput.IsOpen())
+    {
+        mOutput.Print("push %s %d\n", vmSegmentNames[segment], index);
+    }
 
-        case SEGMENT_TEMP:
-            fprintf(mOutputFile, "push temp %d\n", index);
-            break;
+    if (mProgram)
+    {
+        mProgram->Add(VMOP_PUSH, (VMOpSegment)segment, index);
     }
 }
 
 void VMWriter::writePop(VMSegment segment, int index)
 {
-    switch (segment)
+    if (mOutput.IsOpen())
     {
-        case SEGMENT_CONST:
-            fprintf(mOutputFile, "pop constant %d\n", index);
-            break;
-
-        case SEGMENT_ARG:
-            fprintf(mOutputFile, "pop argument %d\n", index);
-            break;
-
-        case SEGMENT_LOCAL:
-            fprintf(mOutputFile, "pop local %d\n", index);
-            break;
-
-        case SEGMENT_STATIC:
-            fprintf(mOutputFile, "pop static %d\n", index);
-            break;
-
-        case SEGMENT_THIS:
-            fprintf(mOutputFile, "pop this %d\n", index);
-            break;
-
-        case SEGMENT_THAT:
-            fprintf(mOutputFile, "pop that %d\n", index);
-            break;
-
-        case SEGMENT_POINTER:
-            fprintf(mOutputFile, "pop pointer %d\n", index);
-            break;
+        mOutput.Print("pop %s %d\n", vmSegmentNames[segment], index);
+    }
 
-        case SEGMENT_TEMP:
-            fprintf(mOutputFile, "pop temp %d\n", index);
-            break;
+    if (mProgram)
+    {
+        mProgram->Add(VMOP_POP, (VMOpSegment)segment, index);
     }
 }
 
 void VMWriter::writeArithmetic(VMCommand command)
 {
-    switch (command)
+    if (mOutput.IsOpen())
     {
-        case COMMAND_ADD:
-            fprintf(mOutputFile, "add\n");
-            break;
-
-        case COMMAND_SUB:
-            fprintf(mOutputFile, "sub\n");
-            break;
-
-        case COMMAND_NEG:
-            fprintf(mOutputFile, "neg\n");
-            break;
-
-        case COMMAND_EQ:
-            fprintf(mOutputFile, "eq\n");
-            break;
-
-        case COMMAND_GT:
-            fprintf(mOutputFile, "gt\n");
-            break;
-
-        case COMMAND_LT:
-            fprintf(mOutputFile, "lt\n");
-            break;
+        mOutput.Print("%s\n", commandNames[command]);
+    }
 
-        case COMMAND_AND:
-            fprintf(mOutputFile, "and\n");
-            break;
+    if (mProgram)
+    {
+        mProgram->Add((VMOpcode)(VMOP_ADD + command));
+    }
+}
 
-        case COMMAND_OR:
-            fprintf(mOutputFile, "or\n");
-            break;
+void VMWriter::writeNamed(VMOpcode opcode, const char* command, const char* name, int length, int value, bool hasValue)
+{
+    if (mOutput.IsOpen())
+    {
+        if (hasValue)
+        {
+            mOutput.Print("%s %.*s %d\n", command, length, name, value);
+        }
+        else
+        {
+            mOutput.Print("%s %.*s\n", command, length, name);
+        }
+    }
 
-        case COMMAND_NOT:
-            fprintf(mOutputFile, "not\n");
-            break;
+    if (mProgram)
+    {
+        mProgram->Add(opcode, name, length, value);
     }
 }
 
 void VMWriter::writeLabel(char* label)
 {
-    fprintf(mOutputFile, "label %s\n", label);
+    writeNamed(VMOP_LABEL, "label", label, (int)strlen(label), 0, false);
 }
 
 void VMWriter::writeLabel(Buffer label)
 {
-    fprintf(mOutputFile, "label %.*s\n", label.size, label.memory);
+    writeNamed(VMOP_LABEL, "label", label.memory, label.size, 0, false);
 }
 
 void VMWriter::writeGoto(char* label)
 {
-    fprintf(mOutputFile, "goto %s\n", label);
+    writeNamed(VMOP_GOTO, "goto", label, (int)strlen(label), 0, false);
 }
 
 void VMWriter::writeGoto(Buffer label)
 {
-    fprintf(mOutputFile, "goto %.*s\n", label.size, label.memory);
+    writeNamed(VMOP_GOTO, "goto", label.memory, label.size, 0, false);
 }
 
 void VMWriter::writeIf(char* label)
 {
-    fprintf(mOutputFile, "if-goto %s\n", label);
+    writeNamed(VMOP_IF_GOTO, "if-goto", label, (int)strlen(label), 0, false);
 }
 
 void VMWriter::writeIf(Buffer label)
 {
-    fprintf(mOutputFile, "if-goto %.*s\n", label.size, label.memory);
+    writeNamed(VMOP_IF_GOTO, "if-goto", label.memory, label.size, 0, false);
 }
 
 void VMWriter::writeCall(const char* label, int nArgs)
 {
-    fprintf(mOutputFile, "call %s %d\n", label, nArgs);
+    writeNamed(VMOP_CALL, "call", label, (int)strlen(label), nArgs, true);
 }
 
 void VMWriter::writeCall(Buffer className, Buffer functionName, int nArgs)
 {
-    fprintf(mOutputFile, "call %.*s.%.*s %d\n", className.size, className.memory, functionName.size, functionName.memory, nArgs);
+    char name[512];
+    int length = snprintf(name, sizeof(name), "%.*s.%.*s", (int)className.size, className.memory, (int)functionName.size, functionName.memory);
+    writeNamed(VMOP_CALL, "call", name, length, nArgs, true);
 }
 
 void VMWriter::writeFunction(Buffer className, Buffer functionName, int nLocals)
 {
-    fprintf(mOutputFile, "function %.*s.%.*s %d\n", className.size, className.memory, functionName.size, functionName.memory, nLocals);
+    char name[512];
+    int length = snprintf(name, sizeof(name), "%.*s.%.*s", (int)className.size, className.memory, (int)functionName.size, functionName.memory);
+    writeNamed(VMOP_FUNCTION, "function", name, length, nLocals, true);
 }
 
 void VMWriter::writeReturn()
 {
-    fprintf(mOutputFile, "return\n");
+    if (mOutput.IsOpen())
+    {
+        mOutput.Print("return\n");
+    }
+
+    if (mProgram)
+    {
+        mProgram->Add(VMOP_RETURN);
+    }
 }
 
 void VMWriter::close()
 {
-    fclose(mOutputFile);
+    if (mOutput.IsOpen() && !mOutput.Close())
+    {
+        printf("Failed to write output file\n");
+    }
+
+    if (mBytecodeFile)
+    {
+        if (!WriteVMBytecode(&mBytecode, mBytecodeFile))
+        {
+            printf("Failed to write bytecode\n");
+        }
+
+        fclose(mBytecodeFile);
+        mBytecodeFile = 0;
+        mBytecode.Free();
+    }
 }
@@ -1,5 +1,8 @@
 #pragma once
 #include <cstdio>
+#include "../vmtranslator/vmops.h"
+#include "../vmtranslator/vmbytecode.h"
+#include "../common/fileio.h"
 #include "util.h"
 
 enum VMSegment
@@ -30,7 +33,15 @@ enum VMCommand
 class VMWriter
 {
     public:
-        VMWriter(char* outputPath);
+        /// <summary>
+        /// Writes .vm text to outputPath, or with bytecode the .vmb format once it's closed
+        /// </summary>
+        VMWriter(char* outputPath, bool bytecode = false);
+
+        /// <summary>
+        /// Adds the commands to program instead, and writes them to outputPath as well if it's given
+        /// </summary>
+        VMWriter(VMProgram* program, char* outputPath = 0);
 
         void writePush(VMSegment segment, int index);
         void writePop(VMSegment segment, int index);
@@ -48,5 +59,12 @@ class VMWriter
         void close();
 
     private:
-        FILE* mOutputFile;
+        void writeNamed(VMOpcode opcode, const char* command, const char* name, int length, int value, bool hasValue);
+
+        FileWriter mOutput;
+        VMProgram* mProgram;
+
+        // Bytecode is collected in memory and written all at once, with its names table first
+        VMProgram mBytecode;
+        FILE* mBytecodeFile;
 };
\ No newline at end of file
@@ -0,0 +1,1037 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#endif
+#include "../assembler/assemble.h"
+#include "../vmtranslator/translator.h"
+#include "../jackcompiler/compilationengine.h"
+#include "../jackcompiler/util.h"
+#include "../emulator/hackcpu.h"
+#include "../vmemulator/vmmachine.h"
+#include "../common/fileio.h"
+
+#define MAX_OUTPUT_COLUMNS 64
+#define MAX_MESSAGE 256
+
+enum TestStatus
+{
+    TEST_PASSED,
+    TEST_FAILED,
+    TEST_ERROR,
+    TEST_SKIPPED,
+};
+
+const char* statusNames[] = { "pass", "fail", "error", "skip" };
+
+struct TestCase
+{
+    char scriptPath[MAX_PATH];
+    char folder[MAX_PATH];
+    char name[MAX_PATH];
+
+    TestStatus status;
+    char message[MAX_MESSAGE];
+    double seconds;
+    uint64_t cycles;
+};
+
+struct RunnerOptions
+{
+    char* osFolder;
+    char* buildRoot;
+    uint32_t builtinClasses;
+};
+
+bool FileExists(char* path)
+{
+    struct stat info;
+    return stat(path, &info) == 0 && !(info.st_mode & S_IFDIR);
+}
+
+void MakeFolder(char* path)
+{
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+bool HasExtension(const char* name, const char* ext)
+{
+    size_t nameLength = strlen(name);
+    size_t extLength = strlen(ext);
+    return nameLength > extLength && strcmp(name + nameLength - extLength, ext) == 0;
+}
+
+void DiscoverTests(char* folder, std::vector<TestCase*>& tests)
+{
+    char path[MAX_PATH];
+    for (const std::string& name : ListFiles(folder, ".tst"))
+    {
+        // The VME scripts drive the Java VM emulator directly, the plain ones cover the same programs
+        if (HasExtension(name.c_str(), "VME.tst"))
+        {
+            continue;
+        }
+
+        if (!FormatPath(path, "%s" PATH_SEPARATOR "%s", folder, name.c_str()))
+        {
+            printf("Skipped %s in %s, the path is too long\n", name.c_str(), folder);
+            continue;
+        }
+
+        TestCase* test = (TestCase*)calloc(1, sizeof(TestCase));
+        strcpy(test->scriptPath, path);
+        strcpy(test->folder, folder);
+        strcpy(test->name, path);
+        tests.push_back(test);
+    }
+
+    for (const std::string& name : ListFolders(folder))
+    {
+        if (!FormatPath(path, "%s" PATH_SEPARATOR "%s", folder, name.c_str()))
+        {
+            printf("Skipped %s in %s, the path is too long\n", name.c_str(), folder);
+            continue;
+        }
+
+        DiscoverTests(path, tests);
+    }
+}
+
+struct ScriptToken
+{
+    char* text;
+    int length;
+
+    bool Equals(const char* match)
+    {
+        return (int)strlen(match) == length && strncmp(text, match, length) == 0;
+    }
+
+    bool IsSeparator()
+    {
+        return length == 1 && strchr(",;{}", *text);
+    }
+};
+
+// Splits a test script into words, with the separators , ; { } as tokens of their own.
+// A quoted string stays one token including its quotes.
+std::vector<ScriptToken> TokenizeScript(char* source)
+{
+    std::vector<ScriptToken> tokens;
+    char* At = source;
+    while (*At)
+    {
+        if (At[0] == '/' && At[1] == '/')
+        {
+            while (*At && *At != '\n') ++At;
+        }
+        else if (At[0] == '/' && At[1] == '*')
+        {
+            At += 2;
+            while (*At && !(At[0] == '*' && At[1] == '/')) ++At;
+            if (*At) At += 2;
+        }
+        else if (*At == ' ' || *At == '\t' || *At == '\r' || *At == '\n')
+        {
+            ++At;
+        }
+        else if (strchr(",;{}", *At))
+        {
+            tokens.push_back({ At, 1 });
+            ++At;
+        }
+        else if (*At == '"')
+        {
+            char* start = At++;
+            while (*At && *At != '"') ++At;
+            if (*At) ++At;
+            tokens.push_back({ start, (int)(At - start) });
+        }
+        else
+        {
+            char* start = At;
+            while (*At && !strchr(" \t\r\n,;{}", *At) && !(At[0] == '/' && (At[1] == '/' || At[1] == '*'))) ++At;
+            tokens.push_back({ start, (int)(At - start) });
+        }
+    }
+
+    return tokens;
+}
+
+struct OutputColumn
+{
+    char name[32];
+    int address;
+    char format;
+    int padLeft;
+    int length;
+    int padRight;
+};
+
+// Compiles and runs one test script. Everything it needs lives here so tests never share state.
+struct TestRun
+{
+    TestCase* test;
+    RunnerOptions* options;
+    HackCPU* cpu;
+
+    // Set for whole VM programs, which run on the VM interpreter instead of cpu
+    VMMachine* vm;
+    char buildFolder[MAX_PATH];
+
+    std::vector<ScriptToken> tokens;
+    OutputColumn columns[MAX_OUTPUT_COLUMNS];
+    int columnCount;
+    char comparePath[MAX_PATH];
+    std::vector<char> output;
+
+    bool Fail(TestStatus status, const char* format, ...);
+    bool Build(char* target);
+    bool BuildVMProgram();
+    bool Execute();
+    bool ExecuteCommand(size_t& index);
+    bool ParseColumn(ScriptToken token, OutputColumn* column);
+    void WriteHeader();
+    void WriteValues();
+    bool ReadRegister(ScriptToken token, int* value, bool allowRam);
+    void Compare();
+};
+
+bool TestRun::Fail(TestStatus status, const char* format, ...)
+{
+    test->status = status;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(test->message, MAX_MESSAGE, format, args);
+    va_end(args);
+    return false;
+}
+
+bool TestRun::BuildVMProgram()
+{
+    bool failed = false;
+    char inputPath[MAX_PATH];
+    char outputPath[MAX_PATH];
+
+    // Whatever an earlier run left behind would otherwise be taken for a class already added
+    for (const std::string& name : ListFiles(buildFolder, ".vm"))
+    {
+        if (!FormatPath(outputPath, "%s" PATH_SEPARATOR "%s", buildFolder, name.c_str()))
+        {
+            return Fail(TEST_ERROR, "the path to %s in %s is too long", name.c_str(), buildFolder);
+        }
+
+        remove(outputPath);
+    }
+
+    // The test's own classes first, then whichever OS classes it doesn't replace
+    auto addFile = [&](char* folder, const char* name)
+    {
+        if (failed)
+        {
+            return;
+        }
+
+        if (!FormatPath(inputPath, "%s" PATH_SEPARATOR "%s", folder, name) || !FormatPath(outputPath, "%s" PATH_SEPARATOR "%s", buildFolder, name))
+        {
+            failed = true;
+            Fail(TEST_ERROR, "the path to %s is too long", name);
+            return;
+        }
+
+        if (HasExtension(name, ".jack"))
+        {
+            strcpy(outputPath + strlen(outputPath) - 5, ".vm");
+            if (FileExists(outputPath))
+            {
+                return;
+            }
+
+            CompilationEngine* engine = new CompilationEngine(inputPath, outputPath);
+            engine->compileClass();
+            delete engine;
+        }
+        else if (HasExtension(name, ".vm"))
+        {
+            if (FileExists(outputPath))
+            {
+                return;
+            }
+
+            Buffer vm = readWholeFile(inputPath);
+            if (!vm.memory || !WriteWholeFile(outputPath, vm.memory, (size_t)vm.size))
+            {
+                failed = true;
+                Fail(TEST_ERROR, "failed to copy %s into %s", inputPath, buildFolder);
+            }
+
+            free(vm.memory);
+        }
+    };
+
+    for (const std::string& name : ListFiles(test->folder))
+    {
+        addFile(test->folder, name.c_str());
+    }
+
+    if (options->osFolder)
+    {
+        for (const std::string& name : ListFiles(options->osFolder))
+        {
+            addFile(options->osFolder, name.c_str());
+        }
+    }
+
+    if (failed)
+    {
+        return false;
+    }
+
+    // On the VM interpreter vmstep counts commands exactly, and the full OS isn't held to the rom size
+    vm = (VMMachine*)malloc(sizeof(VMMachine));
+    vm->Reset();
+    vm->builtinClasses = options->builtinClasses;
+    return vm->Load(buildFolder) || Fail(TEST_ERROR, "failed to load the VM program in %s", buildFolder);
+}
+
+bool TestRun::Build(char* target)
+{
+    // Keep every test's intermediate files apart, named after the script
+    if (!FormatPath(buildFolder, "%s" PATH_SEPARATOR "%s", options->buildRoot, test->scriptPath))
+    {
+        return Fail(TEST_ERROR, "the path to its build folder in %s is too long", options->buildRoot);
+    }
+
+    for (char* At = buildFolder + strlen(options->buildRoot) + 1; *At; ++At)
+    {
+        if (*At == '/' || *At == '\\' || *At == ':' || *At == '.') *At = '_';
+    }
+
+    char asmPath[MAX_PATH];
+    if (!FormatPath(asmPath, "%s" PATH_SEPARATOR "program.asm", buildFolder))
+    {
+        return Fail(TEST_ERROR, "the path to program.asm in %s is too long", buildFolder);
+    }
+
+    MakeFolder(buildFolder);
+
+    if (HasExtension(target, ".hdl") || HasExtension(target, ".out"))
+    {
+        return Fail(TEST_SKIPPED, "chip tests need the hardware simulator");
+    }
+
+    if (HasExtension(target, ".asm") || HasExtension(target, ".hack"))
+    {
+        // Hand written programs are used as they are, VM tests are translated from the .vm files
+        // next to the script, as one program with bootstrap when Sys.vm is among them
+        int vmCount = 0;
+        bool hasSys = false;
+        char vmPath[MAX_PATH] = {};
+        for (const std::string& name : ListFiles(test->folder, ".vm"))
+        {
+            ++vmCount;
+            hasSys |= name == "Sys.vm";
+            if (!FormatPath(vmPath, "%s" PATH_SEPARATOR "%s", test->folder, name.c_str()))
+            {
+                return Fail(TEST_ERROR, "the path to %s is too long", name.c_str());
+            }
+        }
+
+        char sourcePath[MAX_PATH];
+        if (!FormatPath(sourcePath, "%s" PATH_SEPARATOR "%s", test->folder, target))
+        {
+            return Fail(TEST_ERROR, "the path to %s is too long", target);
+        }
+        if (vmCount > 0)
+        {
+            if (!TranslateVMPath(hasSys || vmCount > 1 ? test->folder : vmPath, asmPath))
+            {
+                return Fail(TEST_ERROR, "failed to translate into %s", asmPath);
+            }
+
+            strcpy(sourcePath, asmPath);
+        }
+        else if (HasExtension(target, ".hack"))
+        {
+            Buffer hack = readWholeFile(sourcePath);
+            bool loaded = hack.memory && cpu->LoadHack(hack.memory);
+            free(hack.memory);
+            return loaded || Fail(TEST_ERROR, "failed to load %s", sourcePath);
+        }
+
+        Buffer source = readWholeFile(sourcePath);
+        if (!source.memory)
+        {
+            return Fail(TEST_ERROR, "failed to read %s", sourcePath);
+        }
+
+        strcpy(asmPath, sourcePath);
+        long hackSize = 0;
+        char* hack = AssembleSource(source.memory, &hackSize);
+        free(source.memory);
+        bool loaded = hack && cpu->LoadHack(hack);
+        free(hack);
+        return loaded || Fail(TEST_ERROR, "failed to assemble and load %s", asmPath);
+    }
+
+    if (*target && !HasExtension(target, ".vm"))
+    {
+        return Fail(TEST_ERROR, "don't know how to load %s", target);
+    }
+
+    // "load," or a .vm target is a whole VM program, compiled from the Jack next to the script
+    return BuildVMProgram();
+}
+
+bool TestRun::ParseColumn(ScriptToken token, OutputColumn* column)
+{
+    char text[64];
+    if (token.length >= (int)sizeof(text))
+    {
+        return false;
+    }
+
+    memcpy(text, token.text, token.length);
+    text[token.length] = 0;
+
+    // name%Xleft.length.right, the format being optional for the default %B1.16.1
+    char* percent = strchr(text, '%');
+    column->format = 'B';
+    column->padLeft = 1;
+    column->length = 16;
+    column->padRight = 1;
+    if (percent)
+    {
+        *percent = 0;
+        column->format = percent[1];
+        if (sscanf(percent + 2, "%d.%d.%d", &column->padLeft, &column->length, &column->padRight) != 3)
+        {
+            return false;
+        }
+    }
+
+    if (strlen(text) >= sizeof(column->name))
+    {
+        return false;
+    }
+
+    strcpy(column->name, text);
+    if (strncmp(text, "RAM[", 4) == 0)
+    {
+        column->address = atoi(text + 4);
+        return column->address >= 0 && column->address < ADDRESS_SPACE;
+    }
+
+    // Registers are stored as negative addresses
+    if (strcmp(text, "A") == 0) column->address = -1;
+    else if (strcmp(text, "D") == 0) column->address = -2;
+    else if (strcmp(text, "PC") == 0) column->address = -3;
+    else if (strcmp(text, "time") == 0) column->address = -4;
+    else return false;
+    return true;
+}
+
+void TestRun::WriteHeader()
+{
+    output.push_back('|');
+    for (int i = 0; i < columnCount; ++i)
+    {
+        OutputColumn* column = &columns[i];
+        int width = column->padLeft + column->length + column->padRight;
+        int nameLength = (int)strlen(column->name);
+        if (nameLength > width)
+        {
+            nameLength = width;
+        }
+
+        int left = (width - nameLength) / 2;
+        for (int j = 0; j < left; ++j) output.push_back(' ');
+        output.insert(output.end(), column->name, column->name + nameLength);
+        for (int j = left + nameLength; j < width; ++j) output.push_back(' ');
+        output.push_back('|');
+    }
+
+    output.push_back('\n');
+}
+
+void TestRun::WriteValues()
+{
+    output.push_back('|');
+    for (int i = 0; i < columnCount; ++i)
+    {
+        OutputColumn* column = &columns[i];
+        uint64_t value = 0;
+        if (vm)
+        {
+            // A VM program has no A or D, its pc and time are in commands
+            switch (column->address)
+            {
+                case -1: case -2: value = 0; break;
+                case -3: value = vm->pc; break;
+                case -4: value = vm->steps; break;
+                default: value = vm->ram[column->address]; break;
+            }
+        }
+        else switch (column->address)
+        {
+            case -1: value = cpu->A; break;
+            case -2: value = cpu->D; break;
+            case -3: value = cpu->PC; break;
+            case -4: value = cpu->cycles; break;
+            default: value = cpu->ram[column->address]; break;
+        }
+
+        char text[32];
+        switch (column->format)
+        {
+            case 'D': sprintf(text, "%d", column->address == -4 ? (int)value : (int16_t)value); break;
+            case 'X': sprintf(text, "%04X", (unsigned)(value & 0xFFFF)); break;
+            case 'S': sprintf(text, "%c", (char)value); break;
+            default:
+                for (int bit = 0; bit < 16; ++bit)
+                {
+                    text[bit] = (value >> (15 - bit)) & 1 ? '1' : '0';
+                }
+
+                text[16] = 0;
+                break;
+        }
+
+        // Numbers are right aligned in their field, the rightmost digits kept if they don't fit
+        int textLength = (int)strlen(text);
+        char* shown = textLength > column->length ? text + textLength - column->length : text;
+        for (int j = 0; j < column->padLeft; ++j) output.push_back(' ');
+        for (int j = textLength; j < column->length; ++j) output.push_back(' ');
+        output.insert(output.end(), shown, shown + strlen(shown));
+        for (int j = 0; j < column->padRight; ++j) output.push_back(' ');
+        output.push_back('|');
+    }
+
+    output.push_back('\n');
+}
+
+bool TestRun::ReadRegister(ScriptToken token, int* value, bool allowRam)
+{
+    if (token.Equals("A")) *value = -1;
+    else if (token.Equals("D")) *value = -2;
+    else if (token.Equals("PC")) *value = -3;
+    else if (allowRam && token.length > 4 && strncmp(token.text, "RAM[", 4) == 0)
+    {
+        *value = atoi(token.text + 4);
+        return *value >= 0 && *value < ADDRESS_SPACE;
+    }
+    else return false;
+    return true;
+}
+
+bool TestRun::ExecuteCommand(size_t& index)
+{
+    ScriptToken command = tokens[index++];
+    std::vector<ScriptToken> arguments;
+    while (index < tokens.size() && !tokens[index].IsSeparator())
+    {
+        arguments.push_back(tokens[index++]);
+    }
+
+    if (command.Equals("repeat"))
+    {
+        if (arguments.empty())
+        {
+            return Fail(TEST_SKIPPED, "repeats forever, the script is meant to be run by hand");
+        }
+
+        if (arguments.size() != 1 || index >= tokens.size() || !tokens[index].Equals("{"))
+        {
+            return Fail(TEST_ERROR, "repeat expects a count and a block");
+        }
+
+        int count = atoi(arguments[0].text);
+        size_t blockStart = ++index;
+
+        // A block of nothing but ticktock or vmstep is a cycle or step budget, run it in one go
+        bool simple = true;
+        uint64_t cyclesPerIteration = 0;
+        uint64_t stepsPerIteration = 0;
+        size_t blockEnd = blockStart;
+        int depth = 1;
+        for (; blockEnd < tokens.size(); ++blockEnd)
+        {
+            ScriptToken token = tokens[blockEnd];
+            if (token.Equals("{")) ++depth;
+            else if (token.Equals("}") && --depth == 0) break;
+            else if (token.Equals("ticktock")) cyclesPerIteration += 1;
+            else if (token.Equals("vmstep")) stepsPerIteration += 1;
+            else if (!token.Equals(",") && !token.Equals(";")) simple = false;
+        }
+
+        if (blockEnd == tokens.size())
+        {
+            return Fail(TEST_ERROR, "repeat block is missing its closing }");
+        }
+
+        if (simple && (vm ? cyclesPerIteration : stepsPerIteration) == 0)
+        {
+            if (vm) vm->Run(vm->steps + count * stepsPerIteration);
+            else cpu->Run(cpu->cycles + count * cyclesPerIteration);
+        }
+        else
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                for (size_t at = blockStart; at < blockEnd;)
+                {
+                    if (tokens[at].IsSeparator())
+                    {
+                        ++at;
+                    }
+                    else if (!ExecuteCommand(at))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        index = blockEnd + 1;
+        return true;
+    }
+
+    if (index < tokens.size())
+    {
+        ++index;
+    }
+
+    bool clock = command.Equals("ticktock") || command.Equals("tick") || command.Equals("tock");
+    if ((clock && vm) || (command.Equals("vmstep") && !vm))
+    {
+        return Fail(TEST_ERROR, vm ? "a VM program runs with vmstep" : "only VM programs run with vmstep");
+    }
+
+    if (clock)
+    {
+        // tick and tock are the two halves of one cycle, and only tock executes anything
+        if (!command.Equals("tick"))
+        {
+            cpu->Run(cpu->cycles + 1);
+        }
+    }
+    else if (command.Equals("vmstep"))
+    {
+        vm->Run(vm->steps + 1);
+    }
+    else if (command.Equals("set"))
+    {
+        int target = 0;
+        if (arguments.size() != 2 || !ReadRegister(arguments[0], &target, true))
+        {
+            return Fail(TEST_ERROR, "set expects a register or RAM[n] and a value");
+        }
+
+        uint16_t value = (uint16_t)strtol(arguments[1].text, 0, 10);
+        if (vm)
+        {
+            if (target < 0)
+            {
+                return Fail(TEST_ERROR, "a VM program only has RAM to set");
+            }
+
+            vm->ram[target] = value;
+        }
+        else switch (target)
+        {
+            case -1: cpu->A = value; break;
+            case -2: cpu->D = value; break;
+            case -3: cpu->PC = value; break;
+            default: cpu->ram[target] = value; break;
+        }
+    }
+    else if (command.Equals("output-list"))
+    {
+        columnCount = 0;
+        for (ScriptToken argument : arguments)
+        {
+            if (columnCount == MAX_OUTPUT_COLUMNS || !ParseColumn(argument, &columns[columnCount++]))
+            {
+                return Fail(TEST_ERROR, "bad output column %.*s", argument.length, argument.text);
+            }
+        }
+
+        WriteHeader();
+    }
+    else if (command.Equals("output"))
+    {
+        WriteValues();
+    }
+    else if (command.Equals("compare-to"))
+    {
+        if (arguments.size() == 1)
+        {
+            if (!FormatPath(comparePath, "%s" PATH_SEPARATOR "%.*s", test->folder, arguments[0].length, arguments[0].text))
+            {
+                return Fail(TEST_ERROR, "the path to %.*s is too long", arguments[0].length, arguments[0].text);
+            }
+        }
+    }
+    else if (command.Equals("load") || command.Equals("output-file") || command.Equals("echo") || command.Equals("clear-echo") || command.Equals("breakpoint") || command.Equals("clear-breakpoints"))
+    {
+        // Loading happened up front, the rest only matters to the interactive tools
+    }
+    else
+    {
+        return Fail(TEST_ERROR, "unsupported command %.*s", command.length, command.text);
+    }
+
+    return true;
+}
+
+bool TestRun::Execute()
+{
+    Buffer script = readWholeFile(test->scriptPath);
+    if (!script.memory)
+    {
+        return Fail(TEST_ERROR, "failed to read the script");
+    }
+
+    tokens = TokenizeScript(script.memory);
+
+    // Build whatever the first load names before running anything
+    char target[MAX_PATH] = {};
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        if (tokens[i].Equals("load"))
+        {
+            if (i + 1 < tokens.size() && !tokens[i + 1].IsSeparator())
+            {
+                if (tokens[i + 1].length >= MAX_PATH)
+                {
+                    free(script.memory);
+                    return Fail(TEST_ERROR, "the name after load is too long");
+                }
+
+                memcpy(target, tokens[i + 1].text, tokens[i + 1].length);
+            }
+
+            break;
+        }
+    }
+
+    bool result = Build(target);
+    for (size_t index = 0; result && index < tokens.size();)
+    {
+        result = tokens[index].IsSeparator() ? (++index, true) : ExecuteCommand(index);
+    }
+
+    free(script.memory);
+    return result;
+}
+
+void TestRun::Compare()
+{
+    if (!*comparePath)
+    {
+        Fail(TEST_SKIPPED, "no compare-to, the script is meant to be run by hand");
+        return;
+    }
+
+    Buffer expected = readWholeFile(comparePath);
+    if (!expected.memory)
+    {
+        Fail(TEST_ERROR, "failed to read %s", comparePath);
+        return;
+    }
+
+    // Line by line, ignoring trailing whitespace and line endings
+    char* expectedAt = expected.memory;
+    char* actualAt = output.data();
+    char* actualEnd = actualAt + output.size();
+    int line = 1;
+    test->status = TEST_PASSED;
+    while (*expectedAt || actualAt < actualEnd)
+    {
+        char* expectedLine = expectedAt;
+        while (*expectedAt && *expectedAt != '\n') ++expectedAt;
+        char* expectedLineEnd = expectedAt;
+        if (*expectedAt) ++expectedAt;
+        while (expectedLineEnd > expectedLine && strchr(" \t\r", expectedLineEnd[-1])) --expectedLineEnd;
+
+        char* actualLine = actualAt;
+        while (actualAt < actualEnd && *actualAt != '\n') ++actualAt;
+        char* actualLineEnd = actualAt;
+        if (actualAt < actualEnd) ++actualAt;
+        while (actualLineEnd > actualLine && strchr(" \t\r", actualLineEnd[-1])) --actualLineEnd;
+
+        // A * in the .cmp file stands for anything, used for values that depend on the implementation
+        bool matches = expectedLineEnd - expectedLine == actualLineEnd - actualLine;
+        for (long i = 0; matches && i < expectedLineEnd - expectedLine; ++i)
+        {
+            matches = expectedLine[i] == actualLine[i] || expectedLine[i] == '*';
+        }
+
+        if (!matches)
+        {
+            Fail(TEST_FAILED, "comparison failure at line %d", line);
+            break;
+        }
+
+        ++line;
+    }
+
+    free(expected.memory);
+}
+
+void RunTest(TestCase* test, RunnerOptions* options)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    TestRun* run = new TestRun();
+    run->test = test;
+    run->options = options;
+    run->cpu = (HackCPU*)malloc(sizeof(HackCPU));
+    run->cpu->Reset();
+    run->cpu->skipIdleLoops = true;
+
+    if (run->Execute())
+    {
+        run->Compare();
+        if (*run->comparePath && test->status != TEST_SKIPPED)
+        {
+            // Keep what was produced next to the rest of the build output, like the .out of the Java tools
+            char outputPath[MAX_PATH];
+            if (FormatPath(outputPath, "%s" PATH_SEPARATOR "output.out", run->buildFolder))
+            {
+                WriteWholeFile(outputPath, run->output.data(), run->output.size());
+            }
+            else
+            {
+                run->Fail(TEST_ERROR, "the path to output.out in %s is too long", run->buildFolder);
+            }
+        }
+    }
+
+    test->cycles = run->vm ? run->vm->steps : run->cpu->cycles;
+    free(run->cpu);
+    if (run->vm)
+    {
+        run->vm->Free();
+        free(run->vm);
+    }
+
+    delete run;
+
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    test->seconds = elapsed.count();
+}
+
+// Each worker starts on its own share of the tests, newest first, and once that runs out
+// takes the oldest test from someone else's queue
+struct WorkQueue
+{
+    std::mutex lock;
+    std::deque<TestCase*> tests;
+};
+
+std::mutex printLock;
+
+void Worker(int index, std::vector<WorkQueue>* queues, RunnerOptions* options)
+{
+    int queueCount = (int)queues->size();
+    for (;;)
+    {
+        TestCase* test = 0;
+        {
+            WorkQueue& own = (*queues)[index];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tests.empty())
+            {
+                test = own.tests.back();
+                own.tests.pop_back();
+            }
+        }
+
+        for (int i = 1; !test && i < queueCount; ++i)
+        {
+            WorkQueue& victim = (*queues)[(index + i) % queueCount];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tests.empty())
+            {
+                test = victim.tests.front();
+                victim.tests.pop_front();
+            }
+        }
+
+        if (!test)
+        {
+            return;
+        }
+
+        RunTest(test, options);
+
+        std::lock_guard<std::mutex> guard(printLock);
+        printf("%-5s %8.3fs %12llu cycles  %s", statusNames[test->status], test->seconds, (unsigned long long)test->cycles, test->name);
+        printf(*test->message ? "  (%s)\n" : "\n", test->message);
+    }
+}
+
+void WriteJsonString(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (; *text; ++text)
+    {
+        if (*text == '"' || *text == '\\') fputc('\\', file);
+        fputc(*text, file);
+    }
+
+    fputc('"', file);
+}
+
+void WriteJson(char* path, std::vector<TestCase*>& tests, int threadCount, double seconds, int* counts)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        printf("Failed to open output file: %s\n", path);
+        return;
+    }
+
+    fprintf(file, "{\n  \"threads\": %d,\n  \"seconds\": %.6f,\n", threadCount, seconds);
+    fprintf(file, "  \"passed\": %d,\n  \"failed\": %d,\n  \"errors\": %d,\n  \"skipped\": %d,\n", counts[TEST_PASSED], counts[TEST_FAILED], counts[TEST_ERROR], counts[TEST_SKIPPED]);
+    fprintf(file, "  \"tests\": [\n");
+    for (size_t i = 0; i < tests.size(); ++i)
+    {
+        TestCase* test = tests[i];
+        fprintf(file, "    { \"name\": ");
+        WriteJsonString(file, test->name);
+        fprintf(file, ", \"status\": \"%s\", \"seconds\": %.6f, \"cycles\": %llu, \"message\": ", statusNames[test->status], test->seconds, (unsigned long long)test->cycles);
+        WriteJsonString(file, test->message);
+        fprintf(file, i + 1 < tests.size() ? " },\n" : " }\n");
+    }
+
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
+
+void PrintUsage()
+{
+    printf("Usage: testrunner [options] <folder>...\n");
+    printf("Finds every .tst script under the folders, builds its program and runs it against the .cmp file\n");
+    printf("  -threads <n>       Worker threads (default one per core)\n");
+    printf("  -os <folder>       OS classes, .jack or .vm, added to VM tests that don't provide their own\n");
+    printf("  -build <folder>    Where build output goes (default testbuild)\n");
+    printf("  -builtin <classes> OS classes, comma separated or \"all\", that VM tests run on native builtins\n");
+    printf("  -json <file>       Write a summary with every test's status, wall time and cycle count\n");
+}
+
+int main(int argc, char** argv)
+{
+    RunnerOptions options = {};
+    options.buildRoot = (char*)"testbuild";
+    char* jsonPath = 0;
+    int threadCount = (int)std::thread::hardware_concurrency();
+    std::vector<char*> folders;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-os") == 0 && i + 1 < argc)
+        {
+            options.osFolder = argv[++i];
+        }
+        else if (strcmp(argv[i], "-build") == 0 && i + 1 < argc)
+        {
+            options.buildRoot = argv[++i];
+        }
+        else if (strcmp(argv[i], "-builtin") == 0 && i + 1 < argc)
+        {
+            if (!ParseBuiltinClasses(argv[++i], &options.builtinClasses))
+            {
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            PrintUsage();
+            return 1;
+        }
+        else
+        {
+            folders.push_back(argv[i]);
+        }
+    }
+
+    if (folders.empty())
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+
+    std::vector<TestCase*> tests;
+    for (char* folder : folders)
+    {
+        DiscoverTests(folder, tests);
+    }
+
+    BuildDecodeTable();
+    MakeFolder(options.buildRoot);
+
+    // Deal the tests out round robin so every worker starts with a similar mix
+    std::vector<WorkQueue> queues(threadCount);
+    for (size_t i = 0; i < tests.size(); ++i)
+    {
+        queues[i % threadCount].tests.push_back(tests[i]);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        workers.emplace_back(Worker, i, &queues, &options);
+    }
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    int counts[4] = {};
+    for (TestCase* test : tests)
+    {
+        ++counts[test->status];
+    }
+
+    printf("%d passed, %d failed, %d errors, %d skipped in %.3fs on %d threads\n", counts[TEST_PASSED], counts[TEST_FAILED], counts[TEST_ERROR], counts[TEST_SKIPPED], elapsed.count(), threadCount);
+    if (jsonPath)
+    {
+        WriteJson(jsonPath, tests, threadCount, elapsed.count(), counts);
+    }
+
+    return counts[TEST_FAILED] || counts[TEST_ERROR] ? 1 : 0;
+}
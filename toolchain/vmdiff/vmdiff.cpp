@@ -0,0 +1,1407 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#endif
+#include "../assembler/assemble.h"
+#include "../vmtranslator/translator.h"
+#include "../jackcompiler/compilationengine.h"
+#include "../jackcompiler/util.h"
+#include "../emulator/hackcpu.h"
+#include "../hack2c/romtranslator.h"
+#include "../vmemulator/vmmachine.h"
+#include "../common/fileio.h"
+
+#define SP 0
+#define LCL 1
+#define ARG 2
+#define THIS 3
+#define THAT 4
+#define FIRST_STATIC 16
+#define HEAP_BASE 2048
+
+// The translated program may take this many instructions for one VM command before it's
+// taken to be stuck. A call or return with its frame is well under a hundred.
+#define MAX_CYCLES_PER_COMMAND 256
+
+// How many differing words a divergence report lists
+#define MAX_REPORTED_DIFFERENCES 8
+
+#ifdef _WIN32
+#define EXECUTABLE_EXTENSION ".exe"
+#else
+#define EXECUTABLE_EXTENSION ""
+#endif
+
+// With -hack2c, each rom's native build is compared with the emulator after this many cycles:
+// one instruction, a run that stops in the middle of a block, and one that mostly reaches the end
+const uint64_t nativeCycleLimits[] = { 1, 1000, 1000000 };
+
+enum DiffStatus
+{
+    DIFF_AGREED,
+    DIFF_DIVERGED,
+    DIFF_ERROR,
+    DIFF_SKIPPED,
+};
+
+const char* statusNames[] = { "agree", "diverge", "error", "skip" };
+
+// The points both machines stop at to be compared: right after every call and return, which
+// the VM interpreter knows from its bytecode and the translated program from its call map
+enum SyncKind
+{
+    SYNC_CALL,
+    SYNC_RETURN,
+    SYNC_HALTED,
+    SYNC_END_OF_PROGRAM,
+    SYNC_LIMIT,
+};
+
+struct SyncPoint
+{
+    SyncKind kind;
+    // The callee, or the function returning
+    const char* function;
+};
+
+struct Assignment
+{
+    int address;
+    int value;
+};
+
+struct SourceFile
+{
+    std::string name;
+    std::vector<std::string> lines;
+};
+
+struct DiffOptions
+{
+    char* osFolder;
+    char* buildRoot;
+    uint64_t maxSteps;
+    bool reduce;
+    std::vector<Assignment> inputs;
+    bool inputsGiven;
+
+    // With -hack2c, the C compiler that builds the native programs the roms are compared with
+    char* compiler;
+};
+
+struct DiffResult
+{
+    DiffStatus status;
+    std::string report;
+
+    // Where the divergence showed and the region of the first word that differed, so
+    // reductions can keep to the same one
+    std::string signature;
+    uint64_t steps;
+    int syncCount;
+};
+
+// The call and return sites of the translated program, each covered by an END_OF_PROGRAM
+// word so Run stops in front of it the way it stops at the end of rom
+struct HackSite
+{
+    uint8_t kind;
+    uint32_t word;
+    std::string function;
+};
+
+enum HackSiteKind : uint8_t
+{
+    SITE_NONE,
+    SITE_CALL,
+    SITE_RETURN,
+};
+
+void MakeFolder(char* path)
+{
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+bool HasExtension(const char* name, const char* ext)
+{
+    size_t nameLength = strlen(name);
+    size_t extLength = strlen(ext);
+    return nameLength > extLength && strcmp(name + nameLength - extLength, ext) == 0;
+}
+
+std::vector<std::string> SplitLines(char* text)
+{
+    std::vector<std::string> lines;
+    for (char* At = text; *At;)
+    {
+        char* line = At;
+        while (*At && *At != '\n') ++At;
+        char* end = At;
+        if (*At) ++At;
+        while (end > line && end[-1] == '\r') --end;
+        lines.push_back(std::string(line, end - line));
+    }
+
+    return lines;
+}
+
+// Reads the command and its first argument, leaving both empty for blank and comment lines
+void ParseCommand(const std::string& line, char* command, char* name)
+{
+    *command = 0;
+    *name = 0;
+    sscanf(line.c_str(), " %63s %255s", command, name);
+    if (strncmp(command, "//", 2) == 0)
+    {
+        *command = 0;
+    }
+}
+
+// One program to compare: its .vm source, with any Jack compiled and the OS classes added
+struct DiffProgram
+{
+    char folder[MAX_PATH];
+    char buildFolder[MAX_PATH];
+
+    // A folder runs behind the bootstrap from Sys.init, a lone file from its first command
+    bool wholeFolder;
+    std::vector<SourceFile> files;
+
+    // The ram a test script next to the program sets up before running it
+    std::vector<Assignment> scriptInputs;
+
+    bool Gather(DiffOptions* options, std::string* error);
+    void ReadScriptInputs(char* path);
+    void PruneUnreachable();
+    bool Write(std::vector<SourceFile>& source, char* programPath, std::string* error);
+    char* Assemble(char* programPath, char* mapPath, DiffResult* result);
+};
+
+// Names the folder under the build root that a program's output goes to after its path
+bool MakeBuildFolder(char* buildFolder, const char* path, DiffOptions* options, std::string* error)
+{
+    if (!FormatPath(buildFolder, "%s" PATH_SEPARATOR "%s", options->buildRoot, path))
+    {
+        *error = std::string("the path to its build folder in ") + options->buildRoot + " is too long";
+        return false;
+    }
+
+    for (char* At = buildFolder + strlen(options->buildRoot) + 1; *At; ++At)
+    {
+        if (*At == '/' || *At == '\\' || *At == ':' || *At == '.') *At = '_';
+    }
+
+    MakeFolder(buildFolder);
+    return true;
+}
+
+// Takes the "set RAM[address] value" lines, the VME scripts set the same through segment names
+void DiffProgram::ReadScriptInputs(char* path)
+{
+    Buffer script = readWholeFile(path);
+    if (!script.memory)
+    {
+        return;
+    }
+
+    for (std::string& line : SplitLines(script.memory))
+    {
+        Assignment input = {};
+        if (sscanf(line.c_str(), " set RAM[%d] %d", &input.address, &input.value) == 2 && input.address >= 0 && input.address < ADDRESS_SPACE)
+        {
+            scriptInputs.push_back(input);
+        }
+    }
+
+    free(script.memory);
+}
+
+bool DiffProgram::Gather(DiffOptions* options, std::string* error)
+{
+    if (!MakeBuildFolder(buildFolder, folder, options, error))
+    {
+        return false;
+    }
+
+    bool failed = false;
+    bool hasJack = false;
+    bool hasSys = false;
+    auto addFile = [&](char* from, const char* name)
+    {
+        char inputPath[MAX_PATH];
+        char outputPath[MAX_PATH];
+        if (!FormatPath(inputPath, "%s" PATH_SEPARATOR "%s", from, name))
+        {
+            *error = std::string("the path to ") + name + " in " + from + " is too long";
+            failed = true;
+            return;
+        }
+
+        if (from == folder && HasExtension(name, ".tst") && !HasExtension(name, "VME.tst"))
+        {
+            ReadScriptInputs(inputPath);
+            return;
+        }
+
+        if (!HasExtension(name, ".jack") && !HasExtension(name, ".vm"))
+        {
+            return;
+        }
+
+        std::string className(name, strrchr(name, '.') - name);
+        for (SourceFile& file : files)
+        {
+            if (file.name == className)
+            {
+                return;
+            }
+        }
+
+        if (HasExtension(name, ".jack"))
+        {
+            if (!FormatPath(outputPath, "%s" PATH_SEPARATOR "%s.vm", buildFolder, className.c_str()))
+            {
+                *error = std::string("the path to ") + className + ".vm in " + buildFolder + " is too long";
+                failed = true;
+                return;
+            }
+
+            CompilationEngine* engine = new CompilationEngine(inputPath, outputPath);
+            engine->compileClass();
+            delete engine;
+            strcpy(inputPath, outputPath);
+            hasJack = true;
+        }
+
+        Buffer source = readWholeFile(inputPath);
+        if (!source.memory)
+        {
+            *error = std::string("failed to read ") + inputPath;
+            failed = true;
+            return;
+        }
+
+        files.push_back({ className, SplitLines(source.memory) });
+        hasSys |= className == "Sys";
+        free(source.memory);
+    };
+
+    for (const std::string& name : ListFiles(folder))
+    {
+        addFile(folder, name.c_str());
+    }
+
+    // Like the test runner: one program with bootstrap when Sys is among several files,
+    // and compiled Jack always needs the OS around it
+    wholeFolder = hasSys || hasJack || files.size() > 1;
+    if (wholeFolder && options->osFolder)
+    {
+        for (const std::string& name : ListFiles(options->osFolder))
+        {
+            addFile(options->osFolder, name.c_str());
+        }
+    }
+
+    return !failed;
+}
+
+// Drops every function Sys.init can't reach. The whole OS translates to more than the rom
+// holds, but what one program calls of it usually fits.
+void DiffProgram::PruneUnreachable()
+{
+    char command[64];
+    char name[256];
+    std::unordered_map<std::string, std::vector<std::string>> callees;
+    for (SourceFile& file : files)
+    {
+        std::vector<std::string>* calls = 0;
+        for (std::string& line : file.lines)
+        {
+            ParseCommand(line, command, name);
+            if (strcmp(command, "function") == 0)
+            {
+                calls = &callees[name];
+            }
+            else if (strcmp(command, "call") == 0 && calls)
+            {
+                calls->push_back(name);
+            }
+        }
+    }
+
+    // Without a Sys class of its own the interpreter's builtin Sys.init starts the program, and
+    // that calls Main.main
+    std::unordered_map<std::string, bool> reached;
+    std::vector<std::string> pending = { "Sys.init" };
+    if (!callees.count("Sys.init"))
+    {
+        pending.push_back("Main.main");
+    }
+
+    while (!pending.empty())
+    {
+        std::string function = pending.back();
+        pending.pop_back();
+        if (reached[function])
+        {
+            continue;
+        }
+
+        reached[function] = true;
+        for (std::string& callee : callees[function])
+        {
+            pending.push_back(callee);
+        }
+    }
+
+    std::vector<SourceFile> kept;
+    for (SourceFile& file : files)
+    {
+        SourceFile pruned = { file.name, {} };
+        bool keeping = true;
+        for (std::string& line : file.lines)
+        {
+            ParseCommand(line, command, name);
+            if (strcmp(command, "function") == 0)
+            {
+                keeping = reached[name];
+            }
+
+            if (keeping)
+            {
+                pruned.lines.push_back(line);
+            }
+        }
+
+        if (!pruned.lines.empty())
+        {
+            kept.push_back(pruned);
+        }
+    }
+
+    files = kept;
+}
+
+// Writes source over whatever .vm files the folder had and returns the path to run: the
+// folder, or the one file
+bool DiffProgram::Write(std::vector<SourceFile>& source, char* programPath, std::string* error)
+{
+    char path[MAX_PATH];
+    for (const std::string& name : ListFiles(buildFolder, ".vm"))
+    {
+        if (!FormatPath(path, "%s" PATH_SEPARATOR "%s", buildFolder, name.c_str()))
+        {
+            *error = std::string("the path to ") + name + " in " + buildFolder + " is too long";
+            return false;
+        }
+
+        remove(path);
+    }
+
+    for (SourceFile& file : source)
+    {
+        std::string text;
+        for (std::string& line : file.lines)
+        {
+            text += line;
+            text += '\n';
+        }
+
+        if (!FormatPath(path, "%s" PATH_SEPARATOR "%s.vm", buildFolder, file.name.c_str()))
+        {
+            *error = std::string("the path to ") + file.name + ".vm in " + buildFolder + " is too long";
+            return false;
+        }
+
+        if (!WriteWholeFile(path, text.c_str(), text.size()))
+        {
+            *error = std::string("failed to write the program to ") + buildFolder;
+            return false;
+        }
+    }
+
+    if (wholeFolder)
+    {
+        strcpy(programPath, buildFolder);
+    }
+    else if (!FormatPath(programPath, "%s" PATH_SEPARATOR "%s.vm", buildFolder, source[0].name.c_str()))
+    {
+        *error = std::string("the path to ") + source[0].name + ".vm in " + buildFolder + " is too long";
+        return false;
+    }
+
+    return true;
+}
+
+// Translates the written program and assembles it, returning the hack text for the caller to
+// free, and where the call map went
+char* DiffProgram::Assemble(char* programPath, char* mapPath, DiffResult* result)
+{
+    char asmPath[MAX_PATH];
+    result->status = DIFF_ERROR;
+    if (!FormatPath(asmPath, "%s" PATH_SEPARATOR "program.asm", buildFolder) ||
+        !FormatPath(mapPath, "%s" PATH_SEPARATOR "program.map", buildFolder))
+    {
+        result->report = std::string("the path to program.asm in ") + buildFolder + " is too long";
+        return 0;
+    }
+
+    if (!TranslateVMPath(programPath, asmPath, mapPath))
+    {
+        result->report = std::string("failed to translate ") + programPath;
+        return 0;
+    }
+
+    Buffer assembly = readWholeFile(asmPath);
+    long hackSize = 0;
+    char* hack = assembly.memory ? AssembleSource(assembly.memory, &hackSize) : 0;
+    free(assembly.memory);
+    if (!hack)
+    {
+        result->report = std::string("failed to assemble ") + asmPath;
+    }
+
+    return hack;
+}
+
+const char* RegionName(int address, uint16_t sp)
+{
+    if (address <= THAT) return "pointer";
+    if (address < FIRST_STATIC) return "temp";
+    if (address < VM_STACK_BASE) return "static";
+    if (address < sp) return "stack";
+    if (address < HEAP_BASE) return "above the stack";
+    if (address < SCREEN_ADDRESS) return "heap";
+    if (address < KEYBOARD_ADDRESS) return "screen";
+    return "keyboard";
+}
+
+const char* SyncName(SyncKind kind)
+{
+    switch (kind)
+    {
+        case SYNC_CALL: return "calls";
+        case SYNC_RETURN: return "returns from";
+        case SYNC_HALTED: return "halts";
+        case SYNC_END_OF_PROGRAM: return "runs past its end";
+        default: return "runs on";
+    }
+}
+
+std::string Describe(SyncPoint point)
+{
+    return *point.function ? std::string(SyncName(point.kind)) + " " + point.function : SyncName(point.kind);
+}
+
+// Both machines, run side by side from one sync point to the next
+struct DiffRun
+{
+    VMMachine* vm;
+    HackCPU* cpu;
+    std::vector<VMOperation> vmOperations;
+    std::vector<HackSite> hackSites;
+
+    // Every stack word a call has written a return address to. The two machines write
+    // different ones, a bytecode index and a rom address, so those words aren't compared.
+    std::vector<bool> returnSlots;
+
+    bool Load(DiffProgram* program, std::vector<SourceFile>& source, DiffResult* result);
+    bool LoadCallMap(char* source);
+    SyncPoint NextVMSync(uint64_t maxSteps);
+    SyncPoint NextHackSync(uint64_t maxCycles);
+    bool CompareRam(DiffResult* result);
+    void Run(std::vector<Assignment>& inputs, uint64_t maxSteps, DiffResult* result);
+};
+
+bool DiffRun::Load(DiffProgram* program, std::vector<SourceFile>& source, DiffResult* result)
+{
+    char programPath[MAX_PATH];
+    char mapPath[MAX_PATH];
+    result->status = DIFF_ERROR;
+    if (!program->Write(source, programPath, &result->report))
+    {
+        return false;
+    }
+
+    vm->Free();
+    if (!vm->Load(programPath))
+    {
+        result->report = "the VM interpreter failed to load it";
+        return false;
+    }
+
+    // Builtins have nothing to stand for them in the translated program
+    for (int i = 0; i < vm->codeSize; ++i)
+    {
+        if (vm->code[i].op == VM_CALL_BUILTIN)
+        {
+            result->status = DIFF_SKIPPED;
+            result->report = std::string("calls ") + vmBuiltins[vm->code[i].target].name + " without defining it, give the OS with -os";
+            return false;
+        }
+    }
+
+    char* hack = program->Assemble(programPath, mapPath, result);
+    if (!hack)
+    {
+        return false;
+    }
+
+    Buffer map = readWholeFile(mapPath);
+    cpu->Reset();
+    bool loaded = cpu->LoadHack(hack);
+    bool mapped = loaded && map.memory && LoadCallMap(map.memory);
+    free(hack);
+    free(map.memory);
+    if (!loaded)
+    {
+        // Most often the rom size, the loader has said why
+        result->status = DIFF_SKIPPED;
+        result->report = "the translated program doesn't load into the rom";
+        return false;
+    }
+
+    if (!mapped)
+    {
+        result->report = std::string("failed to read the call map ") + mapPath;
+        return false;
+    }
+
+    vmOperations.resize(vm->codeSize);
+    for (int i = 0; i < vm->codeSize; ++i)
+    {
+        vmOperations[i] = vm->code[i].op;
+        if (vmOperations[i] == VM_CALL || vmOperations[i] == VM_RETURN)
+        {
+            vm->code[i].op = VM_END;
+        }
+    }
+
+    return true;
+}
+
+bool DiffRun::LoadCallMap(char* source)
+{
+    hackSites.assign(ADDRESS_SPACE, HackSite());
+    for (std::string& line : SplitLines(source))
+    {
+        char kind[16];
+        char name[256];
+        int address = 0;
+        if (sscanf(line.c_str(), "%15s %d %255s", kind, &address, name) != 3 || address < 0 || address >= ROM_SIZE)
+        {
+            continue;
+        }
+
+        uint8_t siteKind = strcmp(kind, "call") == 0 ? SITE_CALL : (strcmp(kind, "return") == 0 ? SITE_RETURN : SITE_NONE);
+        if (siteKind != SITE_NONE)
+        {
+            HackSite* site = &hackSites[address];
+            site->kind = siteKind;
+            site->word = cpu->rom[address];
+            site->function = name;
+            cpu->rom[address] = END_OF_PROGRAM;
+        }
+    }
+
+    return true;
+}
+
+SyncPoint DiffRun::NextVMSync(uint64_t maxSteps)
+{
+    VMStopReason reason = vm->Run(maxSteps);
+    if (reason == VM_STOP_STEP_LIMIT)
+    {
+        return { SYNC_LIMIT, "" };
+    }
+
+    if (reason == VM_STOP_HALTED)
+    {
+        return { SYNC_HALTED, "" };
+    }
+
+    if (vm->pc == (uint32_t)vm->codeSize)
+    {
+        return { SYNC_END_OF_PROGRAM, "" };
+    }
+
+    // Put the command back for one step
+    uint32_t site = vm->pc;
+    VMInstruction* instruction = &vm->code[site];
+    instruction->op = vmOperations[site];
+    int function = instruction->op == VM_CALL ? vm->functionOf[instruction->target] : vm->functionOf[site];
+    SyncPoint point = { instruction->op == VM_CALL ? SYNC_CALL : SYNC_RETURN, vm->functionNames[function] };
+    vm->Run(vm->steps + 1);
+    instruction->op = VM_END;
+    return point;
+}
+
+SyncPoint DiffRun::NextHackSync(uint64_t maxCycles)
+{
+    StopReason reason = cpu->Run(maxCycles);
+    if (reason == STOP_CYCLE_LIMIT)
+    {
+        return { SYNC_LIMIT, "" };
+    }
+
+    if (reason == STOP_HALTED)
+    {
+        return { SYNC_HALTED, "" };
+    }
+
+    HackSite* site = &hackSites[cpu->PC];
+    if (site->kind == SITE_NONE)
+    {
+        return { SYNC_END_OF_PROGRAM, "" };
+    }
+
+    uint16_t address = cpu->PC;
+    cpu->rom[address] = site->word;
+    cpu->Run(cpu->cycles + 1);
+    cpu->rom[address] = END_OF_PROGRAM;
+    return { site->kind == SITE_CALL ? SYNC_CALL : SYNC_RETURN, site->function.c_str() };
+}
+
+// Compares everything but R13-R15, which the translated program uses as scratch, and the
+// return addresses: those of the frames still live, found down the chain of saved LCLs,
+// and those left above the stack by calls that have returned
+bool DiffRun::CompareRam(DiffResult* result)
+{
+    uint16_t* vmRam = vm->ram;
+    uint16_t* hackRam = cpu->ram;
+    uint16_t sp = vmRam[SP];
+
+    std::vector<uint16_t> liveSlots;
+    if (vmRam[LCL] == hackRam[LCL])
+    {
+        for (uint16_t frame = vmRam[LCL]; frame >= VM_STACK_BASE + 5 && frame <= sp && frame < HEAP_BASE;)
+        {
+            liveSlots.push_back(frame - 5);
+            uint16_t caller = vmRam[frame - 4];
+            if (caller >= frame || caller != hackRam[frame - 4])
+            {
+                break;
+            }
+
+            frame = caller;
+        }
+    }
+
+    int differences = 0;
+    char line[256];
+    auto compare = [&](int first, int last)
+    {
+        // Nearly every sync point matches, so only look word by word once a range doesn't
+        if (first >= last || memcmp(vmRam + first, hackRam + first, (last - first) * sizeof(uint16_t)) == 0)
+        {
+            return;
+        }
+
+        for (int address = first; address < last; ++address)
+        {
+            if (vmRam[address] != hackRam[address] && differences == 0)
+            {
+                result->signature += std::string(" in ") + RegionName(address, sp);
+            }
+
+            if (vmRam[address] != hackRam[address] && differences++ < MAX_REPORTED_DIFFERENCES)
+            {
+                snprintf(line, sizeof(line), "\n    RAM[%d] (%s): VM %d, Hack %d", address, RegionName(address, sp), (int16_t)vmRam[address], (int16_t)hackRam[address]);
+                result->report += line;
+            }
+        }
+    };
+
+    compare(0, 13);
+    compare(FIRST_STATIC, VM_STACK_BASE);
+
+    // The live frames come down from the top of the stack, compare what's between them
+    int next = sp < HEAP_BASE ? sp : HEAP_BASE;
+    for (uint16_t slot : liveSlots)
+    {
+        compare(slot + 1, next);
+        next = slot;
+    }
+
+    compare(VM_STACK_BASE, next);
+    for (int address = sp; address < HEAP_BASE; ++address)
+    {
+        if (vmRam[address] != hackRam[address] && !returnSlots[address])
+        {
+            compare(address, address + 1);
+        }
+    }
+
+    compare(HEAP_BASE, KEYBOARD_ADDRESS + 1);
+    if (differences > MAX_REPORTED_DIFFERENCES)
+    {
+        snprintf(line, sizeof(line), "\n    and %d more", differences - MAX_REPORTED_DIFFERENCES);
+        result->report += line;
+    }
+
+    return differences == 0;
+}
+
+void DiffRun::Run(std::vector<Assignment>& inputs, uint64_t maxSteps, DiffResult* result)
+{
+    for (Assignment& input : inputs)
+    {
+        vm->ram[input.address] = (uint16_t)input.value;
+        cpu->ram[input.address] = (uint16_t)input.value;
+    }
+
+    returnSlots.assign(HEAP_BASE, false);
+    result->syncCount = 0;
+    for (;;)
+    {
+        uint64_t stepsBefore = vm->steps;
+        SyncPoint vmPoint = NextVMSync(maxSteps);
+        result->steps = vm->steps;
+        if (vmPoint.kind == SYNC_LIMIT)
+        {
+            char line[128];
+            snprintf(line, sizeof(line), "agreed at %d sync points, then reached the step limit", result->syncCount);
+            result->status = DIFF_AGREED;
+            result->report = line;
+            return;
+        }
+
+        SyncPoint hackPoint = NextHackSync(cpu->cycles + (vm->steps - stepsBefore + 1) * MAX_CYCLES_PER_COMMAND);
+        ++result->syncCount;
+
+        char line[512];
+        snprintf(line, sizeof(line), "at sync point %d, step %llu, cycle %llu: the VM %s",
+            result->syncCount, (unsigned long long)vm->steps, (unsigned long long)cpu->cycles, Describe(vmPoint).c_str());
+        result->signature = Describe(vmPoint);
+        if (hackPoint.kind != vmPoint.kind || strcmp(hackPoint.function, vmPoint.function) != 0)
+        {
+            result->status = DIFF_DIVERGED;
+            result->report = line;
+            result->report += " but the translated program " + Describe(hackPoint);
+            result->signature += " against " + Describe(hackPoint);
+            return;
+        }
+
+        if (vmPoint.kind == SYNC_CALL && vm->ram[LCL] >= VM_STACK_BASE + 5 && vm->ram[LCL] < HEAP_BASE)
+        {
+            returnSlots[vm->ram[LCL] - 5] = true;
+        }
+
+        result->report = line;
+        if (!CompareRam(result))
+        {
+            result->status = DIFF_DIVERGED;
+            return;
+        }
+
+        if (vmPoint.kind == SYNC_HALTED || vmPoint.kind == SYNC_END_OF_PROGRAM)
+        {
+            snprintf(line, sizeof(line), "agreed at %d sync points, the last when the program %s", result->syncCount, SyncName(vmPoint.kind));
+            result->status = DIFF_AGREED;
+            result->report = line;
+            return;
+        }
+    }
+}
+
+// Zeller's ddmin, dropping ever smaller chunks of the items for as long as what's left
+// still diverges
+template <typename T, typename StillDiverges>
+std::vector<T> Minimize(std::vector<T> items, StillDiverges stillDiverges)
+{
+    size_t chunks = 2;
+    while (!items.empty())
+    {
+        chunks = chunks < items.size() ? chunks : items.size();
+        size_t chunkSize = (items.size() + chunks - 1) / chunks;
+        bool reduced = false;
+        for (size_t start = 0; start < items.size() && !reduced; start += chunkSize)
+        {
+            std::vector<T> rest(items.begin(), items.begin() + start);
+            rest.insert(rest.end(), items.begin() + (start + chunkSize < items.size() ? start + chunkSize : items.size()), items.end());
+            if (stillDiverges(rest))
+            {
+                items = rest;
+                chunks = chunks > 2 ? chunks - 1 : 2;
+                reduced = true;
+            }
+        }
+
+        if (!reduced)
+        {
+            if (chunkSize == 1)
+            {
+                break;
+            }
+
+            chunks *= 2;
+        }
+    }
+
+    return items;
+}
+
+struct LineReference
+{
+    int file;
+    int line;
+};
+
+// Shrinks the inputs, then the program, to what still diverges in the same way, and
+// leaves the smallest program in a "reduced" folder next to the build output
+void Reduce(DiffProgram* program, DiffRun* run, DiffOptions* options, DiffResult* original)
+{
+    // Anything that runs much longer than the original divergence has lost it
+    uint64_t maxSteps = original->steps * 2 + 100000;
+    maxSteps = maxSteps < options->maxSteps ? maxSteps : options->maxSteps;
+    std::vector<Assignment> inputs = options->inputs;
+    std::vector<SourceFile> source = program->files;
+    int attempts = 0;
+    auto stillDiverges = [&](std::vector<Assignment>& tryInputs, std::vector<SourceFile>& trySource)
+    {
+        ++attempts;
+        DiffResult result = {};
+        if (!run->Load(program, trySource, &result))
+        {
+            return false;
+        }
+
+        run->Run(tryInputs, maxSteps, &result);
+        return result.status == DIFF_DIVERGED && result.signature == original->signature;
+    };
+
+    auto minimizeInputs = [&](std::vector<SourceFile>& trySource)
+    {
+        inputs = Minimize(inputs, [&](std::vector<Assignment>& tryInputs) { return stillDiverges(tryInputs, trySource); });
+    };
+
+    minimizeInputs(source);
+
+    // Function and label lines stay so every candidate still links
+    char command[64];
+    char name[256];
+    std::vector<LineReference> removable;
+    for (int file = 0; file < (int)source.size(); ++file)
+    {
+        for (int line = 0; line < (int)source[file].lines.size(); ++line)
+        {
+            ParseCommand(source[file].lines[line], command, name);
+            if (*command && strcmp(command, "function") != 0 && strcmp(command, "label") != 0)
+            {
+                removable.push_back({ file, line });
+            }
+        }
+    }
+
+    auto buildSource = [&](std::vector<LineReference>& lines)
+    {
+        std::vector<std::vector<bool>> keep(source.size());
+        for (size_t file = 0; file < source.size(); ++file)
+        {
+            keep[file].assign(source[file].lines.size(), false);
+            for (size_t line = 0; line < source[file].lines.size(); ++line)
+            {
+                ParseCommand(source[file].lines[line], command, name);
+                keep[file][line] = strcmp(command, "function") == 0 || strcmp(command, "label") == 0;
+            }
+        }
+
+        for (LineReference& reference : lines)
+        {
+            keep[reference.file][reference.line] = true;
+        }
+
+        std::vector<SourceFile> reduced;
+        for (size_t file = 0; file < source.size(); ++file)
+        {
+            SourceFile kept = { source[file].name, {} };
+            for (size_t line = 0; line < source[file].lines.size(); ++line)
+            {
+                if (keep[file][line])
+                {
+                    kept.lines.push_back(source[file].lines[line]);
+                }
+            }
+
+            reduced.push_back(kept);
+        }
+
+        return reduced;
+    };
+
+    size_t total = removable.size();
+    removable = Minimize(removable, [&](std::vector<LineReference>& lines)
+    {
+        std::vector<SourceFile> trySource = buildSource(lines);
+        return stillDiverges(inputs, trySource);
+    });
+
+    // Commands that went may have taken the need for some inputs with them
+    std::vector<SourceFile> reduced = buildSource(removable);
+    minimizeInputs(reduced);
+    char reducedFolder[MAX_PATH];
+    char programPath[MAX_PATH];
+    std::string error;
+    bool written = false;
+    if (FormatPath(reducedFolder, "%s" PATH_SEPARATOR "reduced", program->buildFolder))
+    {
+        MakeFolder(reducedFolder);
+        char savedFolder[MAX_PATH];
+        strcpy(savedFolder, program->buildFolder);
+        strcpy(program->buildFolder, reducedFolder);
+        written = program->Write(reduced, programPath, &error);
+        strcpy(program->buildFolder, savedFolder);
+    }
+    else
+    {
+        error = std::string("the path to reduced in ") + program->buildFolder + " is too long";
+    }
+
+    char line[512];
+    snprintf(line, sizeof(line), "\n  reduced in %d runs to %d of %d commands", attempts, (int)removable.size(), (int)total);
+    original->report += line;
+    original->report += written ? std::string(" in ") + programPath : ", but " + error;
+    if (!inputs.empty())
+    {
+        original->report += "\n  with";
+        for (Assignment& input : inputs)
+        {
+            snprintf(line, sizeof(line), " -set %d=%d", input.address, input.value);
+            original->report += line;
+        }
+    }
+}
+
+// Without inputs of its own, a lone file runs with the ram its test sets up, or at least a stack
+std::vector<Assignment> ProgramInputs(DiffProgram* program, DiffOptions* options)
+{
+    if (options->inputsGiven || program->wholeFolder)
+    {
+        return options->inputs;
+    }
+
+    std::vector<Assignment> inputs = program->scriptInputs;
+    if (inputs.empty())
+    {
+        inputs.push_back({ SP, VM_STACK_BASE });
+    }
+
+    return inputs;
+}
+
+DiffResult DiffFolder(char* folder, DiffRun* run, DiffOptions* options)
+{
+    DiffResult result = {};
+    DiffProgram* program = new DiffProgram();
+    if (!FormatPath(program->folder, "%s", folder))
+    {
+        result.status = DIFF_ERROR;
+        result.report = "the path is too long";
+        delete program;
+        return result;
+    }
+
+    if (!program->Gather(options, &result.report))
+    {
+        result.status = DIFF_ERROR;
+        delete program;
+        return result;
+    }
+
+    if (program->wholeFolder)
+    {
+        program->PruneUnreachable();
+    }
+
+    DiffOptions programOptions = *options;
+    programOptions.inputs = ProgramInputs(program, options);
+
+    if (run->Load(program, program->files, &result))
+    {
+        run->Run(programOptions.inputs, options->maxSteps, &result);
+        if (result.status == DIFF_DIVERGED && options->reduce)
+        {
+            Reduce(program, run, &programOptions, &result);
+        }
+    }
+
+    delete program;
+    return result;
+}
+
+// The hack text of a program to build natively, an .asm file assembled or a VM program
+// translated the way DiffFolder translates it, along with the ram it starts with
+char* AssembleProgram(char* path, DiffOptions* options, char* buildFolder, std::vector<Assignment>* inputs, DiffResult* result)
+{
+    result->status = DIFF_ERROR;
+    if (HasExtension(path, ".asm"))
+    {
+        *inputs = options->inputs;
+        if (!MakeBuildFolder(buildFolder, path, options, &result->report))
+        {
+            return 0;
+        }
+
+        Buffer source = readWholeFile(path);
+        long hackSize = 0;
+        char* hack = source.memory ? AssembleSource(source.memory, &hackSize) : 0;
+        free(source.memory);
+        if (!hack)
+        {
+            result->report = "failed to assemble it";
+        }
+
+        return hack;
+    }
+
+    DiffProgram* program = new DiffProgram();
+    char programPath[MAX_PATH];
+    char mapPath[MAX_PATH];
+    char* hack = 0;
+    if (!FormatPath(program->folder, "%s", path))
+    {
+        result->report = "the path is too long";
+    }
+    else if (program->Gather(options, &result->report))
+    {
+        if (program->wholeFolder)
+        {
+            program->PruneUnreachable();
+        }
+
+        if (program->Write(program->files, programPath, &result->report))
+        {
+            hack = program->Assemble(programPath, mapPath, result);
+        }
+    }
+
+    strcpy(buildFolder, program->buildFolder);
+    *inputs = ProgramInputs(program, options);
+    delete program;
+    return hack;
+}
+
+// cmd strips the outer quotes off a command line that starts with one, so it gets a pair to strip
+int RunCommand(std::string command)
+{
+#ifdef _WIN32
+    command = "\"" + command + "\"";
+#endif
+    return system(command.c_str());
+}
+
+// Runs the emulator and the native build of the rom for limit cycles and compares where they
+// stopped, after how many cycles, and all of ram
+bool CompareNative(HackCPU* cpu, char* hack, char* exePath, char* outputPath, std::vector<Assignment>& inputs, uint64_t limit, DiffResult* result)
+{
+    cpu->Reset();
+    cpu->LoadHack(hack);
+    std::string command = std::string("\"") + exePath + "\" -cycles " + std::to_string(limit);
+    for (Assignment& input : inputs)
+    {
+        cpu->ram[input.address] = (uint16_t)input.value;
+        command += " -set " + std::to_string(input.address) + "=" + std::to_string(input.value);
+    }
+
+    command += " -dump 0 " + std::to_string(KEYBOARD_ADDRESS) + " > \"" + outputPath + "\"";
+    StopReason reason = cpu->Run(limit);
+
+    char expected[128];
+    if (reason == STOP_CYCLE_LIMIT) snprintf(expected, sizeof(expected), "Reached the cycle limit at pc %u", cpu->PC);
+    else if (reason == STOP_HALTED) snprintf(expected, sizeof(expected), "Halted at pc %u", cpu->PC);
+    else snprintf(expected, sizeof(expected), "Ran past the end of the program");
+
+    char line[512];
+    snprintf(line, sizeof(line), "after %llu cycles", (unsigned long long)limit);
+    result->report = line;
+    if (RunCommand(command) != 0)
+    {
+        result->status = DIFF_ERROR;
+        result->report = std::string("the native build failed to run ") + result->report;
+        return false;
+    }
+
+    Buffer output = readWholeFile(outputPath);
+    std::vector<std::string> lines = output.memory ? SplitLines(output.memory) : std::vector<std::string>();
+    free(output.memory);
+
+    unsigned long long cycles = 0;
+    result->status = DIFF_DIVERGED;
+    if (lines.size() < 2 || lines[0] != expected || sscanf(lines[1].c_str(), "%llu cycles", &cycles) != 1 || cycles != cpu->cycles)
+    {
+        snprintf(line, sizeof(line), ": the emulator stopped after %llu cycles, \"%s\", but the native build said \"%s\" \"%s\"",
+            (unsigned long long)cpu->cycles, expected, lines.size() > 0 ? lines[0].c_str() : "", lines.size() > 1 ? lines[1].c_str() : "");
+        result->report += line;
+        return false;
+    }
+
+    int differences = 0;
+    for (int address = 0; address <= KEYBOARD_ADDRESS; ++address)
+    {
+        int value = 0;
+        int native = 0;
+        bool read = (size_t)address + 2 < lines.size() && sscanf(lines[address + 2].c_str(), "RAM[%d] = %d", &value, &native) == 2;
+        if ((!read || (int16_t)cpu->ram[address] != native) && differences++ < MAX_REPORTED_DIFFERENCES)
+        {
+            snprintf(line, sizeof(line), read ? "\n    RAM[%d]: Hack %d, native %d" : "\n    RAM[%d]: Hack %d, native missing",
+                address, (int16_t)cpu->ram[address], native);
+            result->report += line;
+        }
+    }
+
+    if (differences > MAX_REPORTED_DIFFERENCES)
+    {
+        snprintf(line, sizeof(line), "\n    and %d more", differences - MAX_REPORTED_DIFFERENCES);
+        result->report += line;
+    }
+
+    if (differences > 0)
+    {
+        return false;
+    }
+
+    result->status = DIFF_AGREED;
+    result->report = expected;
+    return true;
+}
+
+// Translates the rom to C with hack2c, builds it with the compiler and runs it against the
+// emulator at each of the cycle limits
+DiffResult DiffNative(char* path, DiffRun* run, DiffOptions* options)
+{
+    DiffResult result = {};
+    char buildFolder[MAX_PATH] = {};
+    std::vector<Assignment> inputs;
+    char* hack = AssembleProgram(path, options, buildFolder, &inputs, &result);
+    if (!hack)
+    {
+        return result;
+    }
+
+    char cPath[MAX_PATH];
+    char exePath[MAX_PATH];
+    char outputPath[MAX_PATH];
+    FILE* cFile = 0;
+    run->cpu->Reset();
+    if (!FormatPath(cPath, "%s" PATH_SEPARATOR "program.c", buildFolder) ||
+        !FormatPath(exePath, "%s" PATH_SEPARATOR "program" EXECUTABLE_EXTENSION, buildFolder) ||
+        !FormatPath(outputPath, "%s" PATH_SEPARATOR "native.txt", buildFolder))
+    {
+        result.report = std::string("the path to program.c in ") + buildFolder + " is too long";
+    }
+    else if (!run->cpu->LoadHack(hack))
+    {
+        result.status = DIFF_SKIPPED;
+        result.report = "the program doesn't load into the rom";
+    }
+    else if (!(cFile = fopen(cPath, "wb")))
+    {
+        result.report = std::string("failed to open ") + cPath;
+    }
+    else
+    {
+        TranslateRom(run->cpu, cFile);
+        bool written = !ferror(cFile);
+        written &= fclose(cFile) == 0;
+        if (!written)
+        {
+            result.report = std::string("failed to write ") + cPath;
+        }
+        else if (RunCommand(std::string(options->compiler) + " -o \"" + exePath + "\" \"" + cPath + "\"") != 0)
+        {
+            result.report = std::string("failed to build ") + cPath + " with " + options->compiler;
+        }
+        else
+        {
+            std::string limits;
+            bool agreed = true;
+            for (uint64_t limit : nativeCycleLimits)
+            {
+                limits += (limits.empty() ? "" : ", ") + std::to_string(limit);
+                agreed = agreed && CompareNative(run->cpu, hack, exePath, outputPath, inputs, limit, &result);
+            }
+
+            if (agreed)
+            {
+                result.report = "the native build agreed after " + limits + " cycles, the last run ending: " + result.report;
+            }
+        }
+    }
+
+    free(hack);
+    return result;
+}
+
+// A program to compare, and the OS it gets when -os doesn't give one
+struct ProgramFolder
+{
+    std::string folder;
+    std::string osFolder;
+};
+
+// A folder with .vm or .jack files in it is a program, unless its Jack has no Main class to start
+// at. Then it's an OS, like projects/12, and the programs under it use it. Subfolders are searched
+// either way, since programs can hold more. With withAssembly, each .asm file in a folder
+// without VM code or Jack is a program too.
+void DiscoverPrograms(char* folder, std::string osFolder, bool withAssembly, std::vector<ProgramFolder>& programs)
+{
+    bool hasVM = false;
+    bool hasJack = false;
+    bool hasMain = false;
+    std::vector<std::string> assemblyFiles;
+    for (const std::string& name : ListFiles(folder))
+    {
+        hasVM |= HasExtension(name.c_str(), ".vm");
+        hasJack |= HasExtension(name.c_str(), ".jack");
+        hasMain |= name == "Main.jack";
+        if (HasExtension(name.c_str(), ".asm"))
+        {
+            assemblyFiles.push_back(std::string(folder) + PATH_SEPARATOR + name);
+        }
+    }
+
+    if (hasJack && !hasMain)
+    {
+        osFolder = folder;
+    }
+    else if (hasJack || hasVM)
+    {
+        programs.push_back({ folder, osFolder });
+    }
+    else if (withAssembly)
+    {
+        for (std::string& path : assemblyFiles)
+        {
+            programs.push_back({ path, "" });
+        }
+    }
+
+    for (const std::string& name : ListFolders(folder))
+    {
+        std::string subfolder = std::string(folder) + PATH_SEPARATOR + name;
+        DiscoverPrograms((char*)subfolder.c_str(), osFolder, withAssembly, programs);
+    }
+}
+
+void PrintUsage()
+{
+    printf("Usage: vmdiff [options] <folder>...\n");
+    printf("Runs every VM program under the folders on the VM interpreter and, translated and assembled, on\n");
+    printf("the Hack emulator, comparing ram after every call and return. Jack is compiled first.\n");
+    printf("A folder of Jack classes without a Main, like projects/12, is the OS for the programs under it.\n");
+    printf("  -os <folder>            OS classes, .jack or .vm, added to programs that don't provide their own.\n");
+    printf("                          Programs that call an OS need one, the Hack CPU has no builtins.\n");
+    printf("  -build <folder>         Where build output goes (default diffbuild)\n");
+    printf("  -steps <n>              Stop comparing after n VM commands (default 50000000)\n");
+    printf("  -set <address>=<value>  Write a ram value before starting, may be repeated. Without any, a\n");
+    printf("                          lone .vm file gets the ram its .tst script sets.\n");
+    printf("  -reduce                 Shrink the inputs and the program of every divergence to what's needed\n");
+    printf("  -hack2c <compiler>      Instead, translate each program's rom to C with hack2c, build it with the\n");
+    printf("                          compiler, like gcc or clang, and compare it with the Hack emulator after\n");
+    printf("                          1, 1000 and 1000000 cycles. .asm files are programs too.\n");
+}
+
+int main(int argc, char** argv)
+{
+    DiffOptions options = {};
+    options.buildRoot = (char*)"diffbuild";
+    options.maxSteps = 50000000;
+    std::vector<char*> folders;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-os") == 0 && i + 1 < argc)
+        {
+            options.osFolder = argv[++i];
+        }
+        else if (strcmp(argv[i], "-build") == 0 && i + 1 < argc)
+        {
+            options.buildRoot = argv[++i];
+        }
+        else if (strcmp(argv[i], "-steps") == 0 && i + 1 < argc)
+        {
+            options.maxSteps = strtoull(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "-set") == 0 && i + 1 < argc)
+        {
+            Assignment input = {};
+            if (sscanf(argv[++i], "%d=%d", &input.address, &input.value) != 2 || input.address < 0 || input.address >= ADDRESS_SPACE)
+            {
+                printf("Invalid ram assignment: %s\n", argv[i]);
+                return 1;
+            }
+
+            options.inputs.push_back(input);
+            options.inputsGiven = true;
+        }
+        else if (strcmp(argv[i], "-reduce") == 0)
+        {
+            options.reduce = true;
+        }
+        else if (strcmp(argv[i], "-hack2c") == 0 && i + 1 < argc)
+        {
+            options.compiler = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            PrintUsage();
+            return 1;
+        }
+        else
+        {
+            folders.push_back(argv[i]);
+        }
+    }
+
+    if (folders.empty())
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<ProgramFolder> programs;
+    for (char* folder : folders)
+    {
+        DiscoverPrograms(folder, "", options.compiler != 0, programs);
+    }
+
+    BuildDecodeTable();
+    MakeFolder(options.buildRoot);
+
+    DiffRun run = {};
+    run.vm = (VMMachine*)malloc(sizeof(VMMachine));
+    run.vm->Reset();
+    run.cpu = (HackCPU*)malloc(sizeof(HackCPU));
+    memset(run.cpu, 0, sizeof(HackCPU));
+
+    int counts[4] = {};
+    for (ProgramFolder& program : programs)
+    {
+        DiffOptions programOptions = options;
+        if (!options.osFolder && !program.osFolder.empty())
+        {
+            programOptions.osFolder = (char*)program.osFolder.c_str();
+        }
+
+        DiffResult result = options.compiler ?
+            DiffNative((char*)program.folder.c_str(), &run, &programOptions) :
+            DiffFolder((char*)program.folder.c_str(), &run, &programOptions);
+        ++counts[result.status];
+        printf("%-8s %s: %s\n", statusNames[result.status], program.folder.c_str(), result.report.c_str());
+    }
+
+    printf("%d agreed, %d diverged, %d errors, %d skipped\n", counts[DIFF_AGREED], counts[DIFF_DIVERGED], counts[DIFF_ERROR], counts[DIFF_SKIPPED]);
+    return counts[DIFF_DIVERGED] || counts[DIFF_ERROR] ? 1 : 0;
+}
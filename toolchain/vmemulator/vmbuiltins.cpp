@@ -0,0 +1,999 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include "vmmachine.h"
+
+#define SCREEN_ADDRESS 16384
+#define KEYBOARD_ADDRESS 24576
+#define SCREEN_WIDTH 512
+#define SCREEN_HEIGHT 256
+#define HEAP_BASE 2048
+#define HEAP_END SCREEN_ADDRESS
+
+#define TEXT_ROWS 23
+#define TEXT_COLUMNS 64
+#define GLYPH_HEIGHT 11
+
+#define NEW_LINE 128
+#define BACK_SPACE 129
+
+// The OS font, the first glyph standing in for anything unprintable and the rest for 32-126
+static const uint8_t font[96][GLYPH_HEIGHT] =
+{
+    { 63, 63, 63, 63, 63, 63, 63, 63, 63,  0,  0 }, // black square
+    {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 }, // space
+    { 12, 30, 30, 30, 12, 12,  0, 12, 12,  0,  0 }, // !
+    { 54, 54, 20,  0,  0,  0,  0,  0,  0,  0,  0 }, // "
+    {  0, 18, 18, 63, 18, 18, 63, 18, 18,  0,  0 }, // #
+    { 12, 30, 51,  3, 30, 48, 51, 30, 12, 12,  0 }, // $
+    {  0,  0, 35, 51, 24, 12,  6, 51, 49,  0,  0 }, // %
+    { 12, 30, 30, 12, 54, 27, 27, 27, 54,  0,  0 }, // &
+    { 12, 12,  6,  0,  0,  0,  0,  0,  0,  0,  0 }, // '
+    { 24, 12,  6,  6,  6,  6,  6, 12, 24,  0,  0 }, // (
+    {  6, 12, 24, 24, 24, 24, 24, 12,  6,  0,  0 }, // )
+    {  0,  0,  0, 51, 30, 63, 30, 51,  0,  0,  0 }, // *
+    {  0,  0,  0, 12, 12, 63, 12, 12,  0,  0,  0 }, // +
+    {  0,  0,  0,  0,  0,  0,  0, 12, 12,  6,  0 }, // ,
+    {  0,  0,  0,  0,  0, 63,  0,  0,  0,  0,  0 }, // -
+    {  0,  0,  0,  0,  0,  0,  0, 12, 12,  0,  0 }, // .
+    {  0,  0, 32, 48, 24, 12,  6,  3,  1,  0,  0 }, // /
+    { 12, 30, 51, 51, 51, 51, 51, 30, 12,  0,  0 }, // 0
+    { 12, 14, 15, 12, 12, 12, 12, 12, 63,  0,  0 }, // 1
+    { 30, 51, 48, 24, 12,  6,  3, 51, 63,  0,  0 }, // 2
+    { 30, 51, 48, 48, 28, 48, 48, 51, 30,  0,  0 }, // 3
+    { 16, 24, 28, 26, 25, 63, 24, 24, 60,  0,  0 }, // 4
+    { 63,  3,  3, 31, 48, 48, 48, 51, 30,  0,  0 }, // 5
+    { 28,  6,  3,  3, 31, 51, 51, 51, 30,  0,  0 }, // 6
+    { 63, 49, 48, 48, 24, 12, 12, 12, 12,  0,  0 }, // 7
+    { 30, 51, 51, 51, 30, 51, 51, 51, 30,  0,  0 }, // 8
+    { 30, 51, 51, 51, 62, 48, 48, 24, 14,  0,  0 }, // 9
+    {  0,  0, 12, 12,  0,  0, 12, 12,  0,  0,  0 }, // :
+    {  0,  0, 12, 12,  0,  0, 12, 12,  6,  0,  0 }, // ;
+    {  0,  0, 24, 12,  6,  3,  6, 12, 24,  0,  0 }, // <
+    {  0,  0,  0, 63,  0,  0, 63,  0,  0,  0,  0 }, // =
+    {  0,  0,  3,  6, 12, 24, 12,  6,  3,  0,  0 }, // >
+    { 30, 51, 51, 24, 12, 12,  0, 12, 12,  0,  0 }, // ?
+    { 30, 51, 51, 59, 59, 59, 27,  3, 30,  0,  0 }, // @
+    { 12, 30, 51, 51, 63, 51, 51, 51, 51,  0,  0 }, // A
+    { 31, 51, 51, 51, 31, 51, 51, 51, 31,  0,  0 }, // B
+    { 28, 54, 35,  3,  3,  3, 35, 54, 28,  0,  0 }, // C
+    { 15, 27, 51, 51, 51, 51, 51, 27, 15,  0,  0 }, // D
+    { 63, 51, 35, 11, 15, 11, 35, 51, 63,  0,  0 }, // E
+    { 63, 51, 35, 11, 15, 11,  3,  3,  3,  0,  0 }, // F
+    { 28, 54, 35,  3, 59, 51, 51, 54, 44,  0,  0 }, // G
+    { 51, 51, 51, 51, 63, 51, 51, 51, 51,  0,  0 }, // H
+    { 30, 12, 12, 12, 12, 12, 12, 12, 30,  0,  0 }, // I
+    { 60, 24, 24, 24, 24, 24, 27, 27, 14,  0,  0 }, // J
+    { 51, 51, 51, 27, 15, 27, 51, 51, 51,  0,  0 }, // K
+    {  3,  3,  3,  3,  3,  3, 35, 51, 63,  0,  0 }, // L
+    { 33, 51, 63, 63, 51, 51, 51, 51, 51,  0,  0 }, // M
+    { 51, 51, 55, 55, 63, 59, 59, 51, 51,  0,  0 }, // N
+    { 30, 51, 51, 51, 51, 51, 51, 51, 30,  0,  0 }, // O
+    { 31, 51, 51, 51, 31,  3,  3,  3,  3,  0,  0 }, // P
+    { 30, 51, 51, 51, 51, 51, 63, 59, 30, 48,  0 }, // Q
+    { 31, 51, 51, 51, 31, 27, 51, 51, 51,  0,  0 }, // R
+    { 30, 51, 51,  6, 28, 48, 51, 51, 30,  0,  0 }, // S
+    { 63, 63, 45, 12, 12, 12, 12, 12, 30,  0,  0 }, // T
+    { 51, 51, 51, 51, 51, 51, 51, 51, 30,  0,  0 }, // U
+    { 51, 51, 51, 51, 51, 30, 30, 12, 12,  0,  0 }, // V
+    { 51, 51, 51, 51, 51, 63, 63, 63, 18,  0,  0 }, // W
+    { 51, 51, 30, 30, 12, 30, 30, 51, 51,  0,  0 }, // X
+    { 51, 51, 51, 51, 30, 12, 12, 12, 30,  0,  0 }, // Y
+    { 63, 51, 49, 24, 12,  6, 35, 51, 63,  0,  0 }, // Z
+    { 30,  6,  6,  6,  6,  6,  6,  6, 30,  0,  0 }, // [
+    {  0,  0,  1,  3,  6, 12, 24, 48, 32,  0,  0 }, // backslash
+    { 30, 24, 24, 24, 24, 24, 24, 24, 30,  0,  0 }, // ]
+    {  8, 28, 54,  0,  0,  0,  0,  0,  0,  0,  0 }, // ^
+    {  0,  0,  0,  0,  0,  0,  0,  0,  0, 63,  0 }, // _
+    {  6, 12, 24,  0,  0,  0,  0,  0,  0,  0,  0 }, // `
+    {  0,  0,  0, 14, 24, 30, 27, 27, 54,  0,  0 }, // a
+    {  3,  3,  3, 15, 27, 51, 51, 51, 30,  0,  0 }, // b
+    {  0,  0,  0, 30, 51,  3,  3, 51, 30,  0,  0 }, // c
+    { 48, 48, 48, 60, 54, 51, 51, 51, 30,  0,  0 }, // d
+    {  0,  0,  0, 30, 51, 63,  3, 51, 30,  0,  0 }, // e
+    { 28, 54, 38,  6, 15,  6,  6,  6, 15,  0,  0 }, // f
+    {  0,  0, 30, 51, 51, 51, 62, 48, 51, 30,  0 }, // g
+    {  3,  3,  3, 27, 55, 51, 51, 51, 51,  0,  0 }, // h
+    { 12, 12,  0, 14, 12, 12, 12, 12, 30,  0,  0 }, // i
+    { 48, 48,  0, 56, 48, 48, 48, 48, 51, 30,  0 }, // j
+    {  3,  3,  3, 51, 27, 15, 15, 27, 51,  0,  0 }, // k
+    { 14, 12, 12, 12, 12, 12, 12, 12, 30,  0,  0 }, // l
+    {  0,  0,  0, 29, 63, 43, 43, 43, 43,  0,  0 }, // m
+    {  0,  0,  0, 29, 51, 51, 51, 51, 51,  0,  0 }, // n
+    {  0,  0,  0, 30, 51, 51, 51, 51, 30,  0,  0 }, // o
+    {  0,  0,  0, 30, 51, 51, 51, 31,  3,  3,  0 }, // p
+    {  0,  0,  0, 30, 51, 51, 51, 62, 48, 48,  0 }, // q
+    {  0,  0,  0, 29, 55, 51,  3,  3,  7,  0,  0 }, // r
+    {  0,  0,  0, 30, 51,  6, 24, 51, 30,  0,  0 }, // s
+    {  4,  6,  6, 15,  6,  6,  6, 54, 28,  0,  0 }, // t
+    {  0,  0,  0, 27, 27, 27, 27, 27, 54,  0,  0 }, // u
+    {  0,  0,  0, 51, 51, 51, 51, 30, 12,  0,  0 }, // v
+    {  0,  0,  0, 51, 51, 51, 63, 63, 18,  0,  0 }, // w
+    {  0,  0,  0, 51, 30, 12, 12, 30, 51,  0,  0 }, // x
+    {  0,  0,  0, 51, 51, 51, 62, 48, 24, 15,  0 }, // y
+    {  0,  0,  0, 63, 27, 12,  6, 51, 63,  0,  0 }, // z
+    { 56, 12, 12, 12,  7, 12, 12, 12, 56,  0,  0 }, // {
+    { 12, 12, 12, 12, 12, 12, 12, 12, 12,  0,  0 }, // |
+    {  7, 12, 12, 12, 56, 12, 12, 12,  7,  0,  0 }, // }
+    { 38, 45, 25,  0,  0,  0,  0,  0,  0,  0,  0 }, // ~
+};
+
+// Runs an OS function for a builtin: natively when its class is builtin too or the program
+// has no code for it, otherwise the program's own compiled version
+static VMBuiltinResult CallOS(VMMachine* machine, VMBuiltinId id, uint16_t* result, std::initializer_list<uint16_t> arguments)
+{
+    uint16_t args[4] = {};
+    int count = 0;
+    for (uint16_t argument : arguments)
+    {
+        args[count++] = argument;
+    }
+
+    uint16_t ignored = 0;
+    if (!result)
+    {
+        result = &ignored;
+    }
+
+    int entry = machine->builtinEntries[id];
+    if (entry < 0)
+    {
+        *result = 0;
+        return vmBuiltins[id].function(machine, args, result);
+    }
+
+    return machine->CallFunction(entry, args, count, result) ? VM_BUILTIN_RETURNED : VM_BUILTIN_INTERRUPTED;
+}
+
+#define CALL_OS(...) \
+    do \
+    { \
+        VMBuiltinResult outcome = CallOS(__VA_ARGS__); \
+        if (outcome != VM_BUILTIN_RETURNED) return outcome; \
+    } \
+    while (0)
+
+// Error codes are the ones the OS specification lists for each function
+static VMBuiltinResult Error(VMMachine* machine, int code)
+{
+    VMBuiltinResult outcome = CallOS(machine, VM_BUILTIN_SYS_ERROR, nullptr, { (uint16_t)code });
+    return outcome == VM_BUILTIN_RETURNED ? VM_BUILTIN_HALTED : outcome;
+}
+
+static VMBuiltinResult ArrayNew(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    if ((int16_t)args[0] <= 0)
+    {
+        return Error(machine, 2);
+    }
+
+    return CallOS(machine, VM_BUILTIN_MEMORY_ALLOC, result, { args[0] });
+}
+
+static VMBuiltinResult ArrayDispose(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    return CallOS(machine, VM_BUILTIN_MEMORY_DEALLOC, nullptr, { args[0] });
+}
+
+// Waits for a key to be pressed and released, echoing it like the OS's Keyboard.readChar
+static VMBuiltinResult ReadKey(VMMachine* machine, uint16_t* key)
+{
+    VMBuiltinState& state = machine->builtins;
+    if (state.keyPhase == 0)
+    {
+        CALL_OS(machine, VM_BUILTIN_OUTPUT_PRINT_CHAR, nullptr, { 0 });
+        state.keyPhase = 1;
+    }
+
+    uint16_t pressed = machine->ram[KEYBOARD_ADDRESS];
+    if (state.keyPhase == 1)
+    {
+        if (!pressed)
+        {
+            return VM_BUILTIN_WAITING;
+        }
+
+        state.keyPhase = 2;
+    }
+
+    if (pressed)
+    {
+        state.key = pressed;
+        return VM_BUILTIN_WAITING;
+    }
+
+    state.keyPhase = 0;
+    CALL_OS(machine, VM_BUILTIN_OUTPUT_PRINT_CHAR, nullptr, { BACK_SPACE });
+    CALL_OS(machine, VM_BUILTIN_OUTPUT_PRINT_CHAR, nullptr, { state.key });
+    *key = state.key;
+    return VM_BUILTIN_RETURNED;
+}
+
+// Reads keys into state.line up to a new line, after showing the message
+static VMBuiltinResult ReadLine(VMMachine* machine, uint16_t message)
+{
+    VMBuiltinState& state = machine->builtins;
+    if (state.linePhase == 0)
+    {
+        CALL_OS(machine, VM_BUILTIN_OUTPUT_PRINT_STRING, nullptr, { message });
+        state.lineLength = 0;
+        state.linePhase = 1;
+    }
+
+    for (;;)
+    {
+        uint16_t key = 0;
+        VMBuiltinResult outcome = ReadKey(machine, &key);
+        if (outcome != VM_BUILTIN_RETURNED)
+        {
+            return outcome;
+        }
+
+        if (key == NEW_LINE)
+        {
+            state.linePhase = 0;
+            return VM_BUILTIN_RETURNED;
+        }
+
+        if (key == BACK_SPACE)
+        {
+            if (state.lineLength > 0)
+            {
+                --state.lineLength;
+            }
+        }
+        else if (state.lineLength < VM_LINE_LENGTH)
+        {
+            state.line[state.lineLength++] = key;
+        }
+    }
+}
+
+// The digits up to the first non-digit, after an optional minus, like String.intValue
+static uint16_t ParseInt(const uint16_t* chars, int length)
+{
+    int index = length > 0 && chars[0] == '-' ? 1 : 0;
+    int value = 0;
+    for (int i = index; i < length && chars[i] >= '0' && chars[i] <= '9'; ++i)
+    {
+        value = value * 10 + (chars[i] - '0');
+    }
+
+    return (uint16_t)(index ? -value : value);
+}
+
+static VMBuiltinResult KeyboardInit(VMMachine* machine, uint16_t*, uint16_t*)
+{
+    machine->builtins.keyPhase = 0;
+    machine->builtins.linePhase = 0;
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult KeyboardKeyPressed(VMMachine* machine, uint16_t*, uint16_t* result)
+{
+    *result = machine->ram[KEYBOARD_ADDRESS];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult KeyboardReadChar(VMMachine* machine, uint16_t*, uint16_t* result)
+{
+    return ReadKey(machine, result);
+}
+
+static VMBuiltinResult KeyboardReadLine(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    VMBuiltinResult outcome = ReadLine(machine, args[0]);
+    if (outcome != VM_BUILTIN_RETURNED)
+    {
+        return outcome;
+    }
+
+    VMBuiltinState& state = machine->builtins;
+    CALL_OS(machine, VM_BUILTIN_STRING_NEW, result, { VM_LINE_LENGTH });
+    for (int i = 0; i < state.lineLength; ++i)
+    {
+        CALL_OS(machine, VM_BUILTIN_STRING_APPEND_CHAR, nullptr, { *result, state.line[i] });
+    }
+
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult KeyboardReadInt(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    VMBuiltinResult outcome = ReadLine(machine, args[0]);
+    if (outcome == VM_BUILTIN_RETURNED)
+    {
+        *result = ParseInt(machine->builtins.line, machine->builtins.lineLength);
+    }
+
+    return outcome;
+}
+
+static VMBuiltinResult MathInit(VMMachine*, uint16_t*, uint16_t*)
+{
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult MathAbs(VMMachine*, uint16_t* args, uint16_t* result)
+{
+    *result = (int16_t)args[0] < 0 ? (uint16_t)-args[0] : args[0];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult MathMultiply(VMMachine*, uint16_t* args, uint16_t* result)
+{
+    *result = (uint16_t)((int16_t)args[0] * (int16_t)args[1]);
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult MathDivide(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    if (args[1] == 0)
+    {
+        return Error(machine, 3);
+    }
+
+    *result = (uint16_t)((int16_t)args[0] / (int16_t)args[1]);
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult MathMin(VMMachine*, uint16_t* args, uint16_t* result)
+{
+    *result = (int16_t)args[0] < (int16_t)args[1] ? args[0] : args[1];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult MathMax(VMMachine*, uint16_t* args, uint16_t* result)
+{
+    *result = (int16_t)args[0] > (int16_t)args[1] ? args[0] : args[1];
+    return VM_BUILTIN_RETURNED;
+}
+
+static int SquareRoot(int value)
+{
+    int root = 0;
+    while ((root + 1) * (root + 1) <= value)
+    {
+        ++root;
+    }
+
+    return root;
+}
+
+static VMBuiltinResult MathSqrt(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    if ((int16_t)args[0] < 0)
+    {
+        return Error(machine, 4);
+    }
+
+    *result = (uint16_t)SquareRoot(args[0]);
+    return VM_BUILTIN_RETURNED;
+}
+
+// Free blocks are [size, next] with size counting both words, allocated ones keep their
+// size in the word before the address handed out
+static void InitHeap(VMMachine* machine)
+{
+    machine->ram[HEAP_BASE] = HEAP_END - HEAP_BASE;
+    machine->ram[HEAP_BASE + 1] = 0;
+    machine->builtins.freeList = HEAP_BASE;
+    machine->builtins.heapReady = true;
+}
+
+static VMBuiltinResult MemoryInit(VMMachine* machine, uint16_t*, uint16_t*)
+{
+    InitHeap(machine);
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult MemoryPeek(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    *result = machine->ram[args[0]];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult MemoryPoke(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    machine->ram[args[0]] = args[1];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult MemoryAlloc(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    if ((int16_t)args[0] < 1)
+    {
+        return Error(machine, 5);
+    }
+
+    // Programs that skip Memory.init still get a heap
+    if (!machine->builtins.heapReady)
+    {
+        InitHeap(machine);
+    }
+
+    uint16_t* ram = machine->ram;
+    uint16_t size = args[0] + 1;
+    uint16_t previous = 0;
+    uint16_t block = machine->builtins.freeList;
+    while (block && ram[block] < size)
+    {
+        previous = block;
+        block = ram[block + 1];
+    }
+
+    if (!block)
+    {
+        return Error(machine, 6);
+    }
+
+    // First fit, splitting off the rest when it's big enough to be a block of its own
+    uint16_t next = ram[block + 1];
+    if (ram[block] - size >= 2)
+    {
+        uint16_t rest = block + size;
+        ram[rest] = ram[block] - size;
+        ram[rest + 1] = next;
+        ram[block] = size;
+        next = rest;
+    }
+
+    if (previous)
+    {
+        ram[previous + 1] = next;
+    }
+    else
+    {
+        machine->builtins.freeList = next;
+    }
+
+    *result = block + 1;
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult MemoryDeAlloc(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    uint16_t* ram = machine->ram;
+    uint16_t block = args[0] - 1;
+    if (!machine->builtins.heapReady || block < HEAP_BASE || block >= HEAP_END)
+    {
+        return VM_BUILTIN_RETURNED;
+    }
+
+    uint16_t previous = 0;
+    uint16_t next = machine->builtins.freeList;
+    while (next && next < block)
+    {
+        previous = next;
+        next = ram[next + 1];
+    }
+
+    // Merge with the free neighbours so the heap doesn't fragment
+    ram[block + 1] = next;
+    if (next && block + ram[block] == next)
+    {
+        ram[block] += ram[next];
+        ram[block + 1] = ram[next + 1];
+    }
+
+    if (previous && previous + ram[previous] == block)
+    {
+        ram[previous] += ram[block];
+        ram[previous + 1] = ram[block + 1];
+    }
+    else if (previous)
+    {
+        ram[previous + 1] = block;
+    }
+    else
+    {
+        machine->builtins.freeList = block;
+    }
+
+    return VM_BUILTIN_RETURNED;
+}
+
+// Characters are 8 pixels wide, two to a screen word with the even column in the low byte.
+// Like the OS, text starts one pixel row down from the top of the screen.
+static void DrawChar(VMMachine* machine, uint16_t c)
+{
+    const uint8_t* glyph = font[(c < 32 || c > 126) ? 0 : c - 31];
+    VMBuiltinState& state = machine->builtins;
+    uint16_t* word = machine->ram + SCREEN_ADDRESS + (1 + state.cursorRow * GLYPH_HEIGHT) * 32 + state.cursorColumn / 2;
+    bool high = state.cursorColumn & 1;
+    for (int line = 0; line < GLYPH_HEIGHT; ++line, word += 32)
+    {
+        *word = high ? (uint16_t)((*word & 0x00FF) | (glyph[line] << 8)) : (uint16_t)((*word & 0xFF00) | glyph[line]);
+    }
+}
+
+static void Println(VMMachine* machine)
+{
+    VMBuiltinState& state = machine->builtins;
+    state.cursorColumn = 0;
+    state.cursorRow = (state.cursorRow + 1) % TEXT_ROWS;
+}
+
+static void BackSpace(VMMachine* machine)
+{
+    VMBuiltinState& state = machine->builtins;
+    if (state.cursorColumn > 0)
+    {
+        --state.cursorColumn;
+    }
+    else
+    {
+        state.cursorColumn = TEXT_COLUMNS - 1;
+        state.cursorRow = (state.cursorRow + TEXT_ROWS - 1) % TEXT_ROWS;
+    }
+
+    DrawChar(machine, ' ');
+}
+
+static void PrintChar(VMMachine* machine, uint16_t c)
+{
+    if (c == NEW_LINE)
+    {
+        Println(machine);
+    }
+    else if (c == BACK_SPACE)
+    {
+        BackSpace(machine);
+    }
+    else
+    {
+        DrawChar(machine, c);
+        if (++machine->builtins.cursorColumn == TEXT_COLUMNS)
+        {
+            Println(machine);
+        }
+    }
+}
+
+static VMBuiltinResult OutputInit(VMMachine* machine, uint16_t*, uint16_t*)
+{
+    machine->builtins.cursorRow = 0;
+    machine->builtins.cursorColumn = 0;
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult OutputMoveCursor(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    int row = (int16_t)args[0];
+    int column = (int16_t)args[1];
+    if (row < 0 || row >= TEXT_ROWS || column < 0 || column >= TEXT_COLUMNS)
+    {
+        return Error(machine, 20);
+    }
+
+    machine->builtins.cursorRow = row;
+    machine->builtins.cursorColumn = column;
+    DrawChar(machine, ' ');
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult OutputPrintChar(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    PrintChar(machine, args[0]);
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult OutputPrintString(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    uint16_t length = 0;
+    CALL_OS(machine, VM_BUILTIN_STRING_LENGTH, &length, { args[0] });
+    for (uint16_t i = 0; i < length; ++i)
+    {
+        uint16_t c = 0;
+        CALL_OS(machine, VM_BUILTIN_STRING_CHAR_AT, &c, { args[0], i });
+        PrintChar(machine, c);
+    }
+
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult OutputPrintInt(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    char text[8];
+    sprintf(text, "%d", (int16_t)args[0]);
+    for (char* c = text; *c; ++c)
+    {
+        PrintChar(machine, *c);
+    }
+
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult OutputPrintln(VMMachine* machine, uint16_t*, uint16_t*)
+{
+    Println(machine);
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult OutputBackSpace(VMMachine* machine, uint16_t*, uint16_t*)
+{
+    BackSpace(machine);
+    return VM_BUILTIN_RETURNED;
+}
+
+// Screen words hold 16 pixels with the leftmost in the lowest bit
+static void DrawSpan(VMMachine* machine, int x1, int x2, int y)
+{
+    if (y < 0 || y >= SCREEN_HEIGHT)
+    {
+        return;
+    }
+
+    if (x1 < 0) x1 = 0;
+    if (x2 >= SCREEN_WIDTH) x2 = SCREEN_WIDTH - 1;
+
+    uint16_t* row = machine->ram + SCREEN_ADDRESS + y * 32;
+    bool black = machine->builtins.black;
+    for (int x = x1; x <= x2;)
+    {
+        int first = x & 15;
+        int last = (x2 >> 4) == (x >> 4) ? (x2 & 15) : 15;
+        uint16_t mask = (uint16_t)((0xFFFFu >> (15 - last)) & (0xFFFFu << first));
+        row[x >> 4] = black ? (row[x >> 4] | mask) : (row[x >> 4] & ~mask);
+        x += last - first + 1;
+    }
+}
+
+static bool OnScreen(int x, int y)
+{
+    return x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT;
+}
+
+static VMBuiltinResult ScreenInit(VMMachine* machine, uint16_t*, uint16_t*)
+{
+    machine->builtins.black = true;
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult ScreenClearScreen(VMMachine* machine, uint16_t*, uint16_t*)
+{
+    memset(machine->ram + SCREEN_ADDRESS, 0, (KEYBOARD_ADDRESS - SCREEN_ADDRESS) * sizeof(uint16_t));
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult ScreenSetColor(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    machine->builtins.black = args[0] != 0;
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult ScreenDrawPixel(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    int x = (int16_t)args[0];
+    int y = (int16_t)args[1];
+    if (!OnScreen(x, y))
+    {
+        return Error(machine, 7);
+    }
+
+    DrawSpan(machine, x, x, y);
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult ScreenDrawLine(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    int x1 = (int16_t)args[0];
+    int y1 = (int16_t)args[1];
+    int x2 = (int16_t)args[2];
+    int y2 = (int16_t)args[3];
+    if (!OnScreen(x1, y1) || !OnScreen(x2, y2))
+    {
+        return Error(machine, 8);
+    }
+
+    if (y1 == y2)
+    {
+        DrawSpan(machine, x1 < x2 ? x1 : x2, x1 < x2 ? x2 : x1, y1);
+        return VM_BUILTIN_RETURNED;
+    }
+
+    // Bresenham
+    int dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    int dy = y2 > y1 ? y1 - y2 : y2 - y1;
+    int stepX = x1 < x2 ? 1 : -1;
+    int stepY = y1 < y2 ? 1 : -1;
+    int error = dx + dy;
+    for (;;)
+    {
+        DrawSpan(machine, x1, x1, y1);
+        if (x1 == x2 && y1 == y2)
+        {
+            break;
+        }
+
+        int doubled = 2 * error;
+        if (doubled >= dy)
+        {
+            error += dy;
+            x1 += stepX;
+        }
+
+        if (doubled <= dx)
+        {
+            error += dx;
+            y1 += stepY;
+        }
+    }
+
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult ScreenDrawRectangle(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    int x1 = (int16_t)args[0];
+    int y1 = (int16_t)args[1];
+    int x2 = (int16_t)args[2];
+    int y2 = (int16_t)args[3];
+    if (!OnScreen(x1, y1) || !OnScreen(x2, y2) || x1 > x2 || y1 > y2)
+    {
+        return Error(machine, 9);
+    }
+
+    for (int y = y1; y <= y2; ++y)
+    {
+        DrawSpan(machine, x1, x2, y);
+    }
+
+    return VM_BUILTIN_RETURNED;
+}
+
+// The four rows one midpoint step fills, mirrored the same way as the OS's drawSymetric
+static void DrawCircleRows(VMMachine* machine, int x, int y, int a, int b)
+{
+    DrawSpan(machine, x - abs(a), x + abs(a), y - b);
+    DrawSpan(machine, x - abs(a), x + abs(a), y + b);
+    DrawSpan(machine, x - abs(b), x + abs(b), y - a);
+    DrawSpan(machine, x - abs(b), x + abs(b), y + a);
+}
+
+static VMBuiltinResult ScreenDrawCircle(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    int x = (int16_t)args[0];
+    int y = (int16_t)args[1];
+    int r = (int16_t)args[2];
+    if (!OnScreen(x, y))
+    {
+        return Error(machine, 12);
+    }
+
+    if (x - r < 0 || x + r >= SCREEN_WIDTH || y - r < 0 || y + r >= SCREEN_HEIGHT)
+    {
+        return Error(machine, 13);
+    }
+
+    // The same midpoint walk as the OS, so every row ends on the same pixel
+    int a = 0;
+    int b = r;
+    int decision = 1 - r;
+    DrawCircleRows(machine, x, y, a, b);
+    while (b > a)
+    {
+        if (decision < 0)
+        {
+            decision += 2 * a + 3;
+        }
+        else
+        {
+            decision += 2 * (a - b) + 5;
+            --b;
+        }
+
+        ++a;
+        DrawCircleRows(machine, x, y, a, b);
+    }
+
+    return VM_BUILTIN_RETURNED;
+}
+
+// A string object is [capacity, length, characters...]
+static VMBuiltinResult StringNew(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    if ((int16_t)args[0] < 0)
+    {
+        return Error(machine, 14);
+    }
+
+    CALL_OS(machine, VM_BUILTIN_MEMORY_ALLOC, result, { (uint16_t)(args[0] + 2) });
+    machine->ram[*result] = args[0];
+    machine->ram[(uint16_t)(*result + 1)] = 0;
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringDispose(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    return CallOS(machine, VM_BUILTIN_MEMORY_DEALLOC, nullptr, { args[0] });
+}
+
+static VMBuiltinResult StringLength(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    *result = machine->ram[(uint16_t)(args[0] + 1)];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringCharAt(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    uint16_t* string = machine->ram + args[0];
+    if ((int16_t)args[1] < 0 || args[1] >= string[1])
+    {
+        return Error(machine, 15);
+    }
+
+    *result = string[2 + args[1]];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringSetCharAt(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    uint16_t* string = machine->ram + args[0];
+    if ((int16_t)args[1] < 0 || args[1] >= string[1])
+    {
+        return Error(machine, 16);
+    }
+
+    string[2 + args[1]] = args[2];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringAppendChar(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    uint16_t* string = machine->ram + args[0];
+    if (string[1] >= string[0])
+    {
+        return Error(machine, 17);
+    }
+
+    string[2 + string[1]++] = args[1];
+    *result = args[0];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringEraseLastChar(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    uint16_t* string = machine->ram + args[0];
+    if (string[1] == 0)
+    {
+        return Error(machine, 18);
+    }
+
+    --string[1];
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringIntValue(VMMachine* machine, uint16_t* args, uint16_t* result)
+{
+    uint16_t* string = machine->ram + args[0];
+    *result = ParseInt(string + 2, string[1]);
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringSetInt(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    uint16_t* string = machine->ram + args[0];
+    char text[8];
+    int length = sprintf(text, "%d", (int16_t)args[1]);
+    if (length > string[0])
+    {
+        return Error(machine, 19);
+    }
+
+    for (int i = 0; i < length; ++i)
+    {
+        string[2 + i] = text[i];
+    }
+
+    string[1] = (uint16_t)length;
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringNewLine(VMMachine*, uint16_t*, uint16_t* result)
+{
+    *result = NEW_LINE;
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringBackSpace(VMMachine*, uint16_t*, uint16_t* result)
+{
+    *result = BACK_SPACE;
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult StringDoubleQuote(VMMachine*, uint16_t*, uint16_t* result)
+{
+    *result = '"';
+    return VM_BUILTIN_RETURNED;
+}
+
+static VMBuiltinResult SysHalt(VMMachine*, uint16_t*, uint16_t*)
+{
+    return VM_BUILTIN_HALTED;
+}
+
+static VMBuiltinResult SysError(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    for (char c : { 'E', 'R', 'R' })
+    {
+        CALL_OS(machine, VM_BUILTIN_OUTPUT_PRINT_CHAR, nullptr, { (uint16_t)c });
+    }
+
+    CALL_OS(machine, VM_BUILTIN_OUTPUT_PRINT_INT, nullptr, { args[0] });
+    return VM_BUILTIN_HALTED;
+}
+
+// There's no clock to wait for, the time only matters to programs running in real time
+static VMBuiltinResult SysWait(VMMachine* machine, uint16_t* args, uint16_t*)
+{
+    if ((int16_t)args[0] < 0)
+    {
+        return Error(machine, 1);
+    }
+
+    return VM_BUILTIN_RETURNED;
+}
+
+#define VM_BUILTIN_TABLE_ENTRY(id, name, arguments, owner, function) { name, arguments, owner, function },
+const VMBuiltin vmBuiltins[VM_BUILTIN_COUNT] =
+{
+    VM_BUILTINS(VM_BUILTIN_TABLE_ENTRY)
+};
+#undef VM_BUILTIN_TABLE_ENTRY
+
+int FindBuiltin(const char* name)
+{
+    for (int i = 0; i < VM_BUILTIN_COUNT; ++i)
+    {
+        if (strcmp(vmBuiltins[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool ParseBuiltinClasses(const char* list, uint32_t* classes)
+{
+#define VM_CLASS_NAME(id, name) name,
+    static const char* classNames[VM_CLASS_COUNT] = { VM_OS_CLASSES(VM_CLASS_NAME) };
+#undef VM_CLASS_NAME
+
+    *classes = 0;
+    if (strcmp(list, "all") == 0)
+    {
+        *classes = VM_ALL_OS_CLASSES;
+        return true;
+    }
+
+    for (const char* At = list; *At;)
+    {
+        size_t length = strcspn(At, ",");
+        int found = -1;
+        for (int i = 0; i < VM_CLASS_COUNT; ++i)
+        {
+            if (strlen(classNames[i]) == length && strncmp(classNames[i], At, length) == 0)
+            {
+                found = i;
+            }
+        }
+
+        if (found < 0)
+        {
+            printf("Unknown OS class: %.*s\n", (int)length, At);
+            return false;
+        }
+
+        *classes |= 1u << found;
+        At += length;
+        if (*At == ',')
+        {
+            ++At;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <cstdint>
+
+struct VMMachine;
+
+// The OS classes, each of which runs either on its compiled .vm code or on the builtins below
+#define VM_OS_CLASSES(X) \
+    X(VM_CLASS_ARRAY, "Array") \
+    X(VM_CLASS_KEYBOARD, "Keyboard") \
+    X(VM_CLASS_MATH, "Math") \
+    X(VM_CLASS_MEMORY, "Memory") \
+    X(VM_CLASS_OUTPUT, "Output") \
+    X(VM_CLASS_SCREEN, "Screen") \
+    X(VM_CLASS_STRING, "String") \
+    X(VM_CLASS_SYS, "Sys")
+
+#define VM_CLASS_ENTRY(id, name) id,
+enum VMOSClass
+{
+    VM_OS_CLASSES(VM_CLASS_ENTRY)
+    VM_CLASS_COUNT
+};
+#undef VM_CLASS_ENTRY
+
+#define VM_ALL_OS_CLASSES ((1u << VM_CLASS_COUNT) - 1)
+
+// Every builtin with its argument count, this included for methods, and the function in
+// vmbuiltins.cpp that implements it. Sys.init has none, the loader writes it as ordinary
+// bytecode so Main.main doesn't run nested inside a builtin.
+#define VM_BUILTINS(X) \
+    X(VM_BUILTIN_ARRAY_NEW, "Array.new", 1, VM_CLASS_ARRAY, ArrayNew) \
+    X(VM_BUILTIN_ARRAY_DISPOSE, "Array.dispose", 1, VM_CLASS_ARRAY, ArrayDispose) \
+    X(VM_BUILTIN_KEYBOARD_INIT, "Keyboard.init", 0, VM_CLASS_KEYBOARD, KeyboardInit) \
+    X(VM_BUILTIN_KEYBOARD_KEY_PRESSED, "Keyboard.keyPressed", 0, VM_CLASS_KEYBOARD, KeyboardKeyPressed) \
+    X(VM_BUILTIN_KEYBOARD_READ_CHAR, "Keyboard.readChar", 0, VM_CLASS_KEYBOARD, KeyboardReadChar) \
+    X(VM_BUILTIN_KEYBOARD_READ_LINE, "Keyboard.readLine", 1, VM_CLASS_KEYBOARD, KeyboardReadLine) \
+    X(VM_BUILTIN_KEYBOARD_READ_INT, "Keyboard.readInt", 1, VM_CLASS_KEYBOARD, KeyboardReadInt) \
+    X(VM_BUILTIN_MATH_INIT, "Math.init", 0, VM_CLASS_MATH, MathInit) \
+    X(VM_BUILTIN_MATH_ABS, "Math.abs", 1, VM_CLASS_MATH, MathAbs) \
+    X(VM_BUILTIN_MATH_MULTIPLY, "Math.multiply", 2, VM_CLASS_MATH, MathMultiply) \
+    X(VM_BUILTIN_MATH_DIVIDE, "Math.divide", 2, VM_CLASS_MATH, MathDivide) \
+    X(VM_BUILTIN_MATH_MIN, "Math.min", 2, VM_CLASS_MATH, MathMin) \
+    X(VM_BUILTIN_MATH_MAX, "Math.max", 2, VM_CLASS_MATH, MathMax) \
+    X(VM_BUILTIN_MATH_SQRT, "Math.sqrt", 1, VM_CLASS_MATH, MathSqrt) \
+    X(VM_BUILTIN_MEMORY_INIT, "Memory.init", 0, VM_CLASS_MEMORY, MemoryInit) \
+    X(VM_BUILTIN_MEMORY_PEEK, "Memory.peek", 1, VM_CLASS_MEMORY, MemoryPeek) \
+    X(VM_BUILTIN_MEMORY_POKE, "Memory.poke", 2, VM_CLASS_MEMORY, MemoryPoke) \
+    X(VM_BUILTIN_MEMORY_ALLOC, "Memory.alloc", 1, VM_CLASS_MEMORY, MemoryAlloc) \
+    X(VM_BUILTIN_MEMORY_DEALLOC, "Memory.deAlloc", 1, VM_CLASS_MEMORY, MemoryDeAlloc) \
+    X(VM_BUILTIN_OUTPUT_INIT, "Output.init", 0, VM_CLASS_OUTPUT, OutputInit) \
+    X(VM_BUILTIN_OUTPUT_MOVE_CURSOR, "Output.moveCursor", 2, VM_CLASS_OUTPUT, OutputMoveCursor) \
+    X(VM_BUILTIN_OUTPUT_PRINT_CHAR, "Output.printChar", 1, VM_CLASS_OUTPUT, OutputPrintChar) \
+    X(VM_BUILTIN_OUTPUT_PRINT_STRING, "Output.printString", 1, VM_CLASS_OUTPUT, OutputPrintString) \
+    X(VM_BUILTIN_OUTPUT_PRINT_INT, "Output.printInt", 1, VM_CLASS_OUTPUT, OutputPrintInt) \
+    X(VM_BUILTIN_OUTPUT_PRINTLN, "Output.println", 0, VM_CLASS_OUTPUT, OutputPrintln) \
+    X(VM_BUILTIN_OUTPUT_BACK_SPACE, "Output.backSpace", 0, VM_CLASS_OUTPUT, OutputBackSpace) \
+    X(VM_BUILTIN_SCREEN_INIT, "Screen.init", 0, VM_CLASS_SCREEN, ScreenInit) \
+    X(VM_BUILTIN_SCREEN_CLEAR_SCREEN, "Screen.clearScreen", 0, VM_CLASS_SCREEN, ScreenClearScreen) \
+    X(VM_BUILTIN_SCREEN_SET_COLOR, "Screen.setColor", 1, VM_CLASS_SCREEN, ScreenSetColor) \
+    X(VM_BUILTIN_SCREEN_DRAW_PIXEL, "Screen.drawPixel", 2, VM_CLASS_SCREEN, ScreenDrawPixel) \
+    X(VM_BUILTIN_SCREEN_DRAW_LINE, "Screen.drawLine", 4, VM_CLASS_SCREEN, ScreenDrawLine) \
+    X(VM_BUILTIN_SCREEN_DRAW_RECTANGLE, "Screen.drawRectangle", 4, VM_CLASS_SCREEN, ScreenDrawRectangle) \
+    X(VM_BUILTIN_SCREEN_DRAW_CIRCLE, "Screen.drawCircle", 3, VM_CLASS_SCREEN, ScreenDrawCircle) \
+    X(VM_BUILTIN_STRING_NEW, "String.new", 1, VM_CLASS_STRING, StringNew) \
+    X(VM_BUILTIN_STRING_DISPOSE, "String.dispose", 1, VM_CLASS_STRING, StringDispose) \
+    X(VM_BUILTIN_STRING_LENGTH, "String.length", 1, VM_CLASS_STRING, StringLength) \
+    X(VM_BUILTIN_STRING_CHAR_AT, "String.charAt", 2, VM_CLASS_STRING, StringCharAt) \
+    X(VM_BUILTIN_STRING_SET_CHAR_AT, "String.setCharAt", 3, VM_CLASS_STRING, StringSetCharAt) \
+    X(VM_BUILTIN_STRING_APPEND_CHAR, "String.appendChar", 2, VM_CLASS_STRING, StringAppendChar) \
+    X(VM_BUILTIN_STRING_ERASE_LAST_CHAR, "String.eraseLastChar", 1, VM_CLASS_STRING, StringEraseLastChar) \
+    X(VM_BUILTIN_STRING_INT_VALUE, "String.intValue", 1, VM_CLASS_STRING, StringIntValue) \
+    X(VM_BUILTIN_STRING_SET_INT, "String.setInt", 2, VM_CLASS_STRING, StringSetInt) \
+    X(VM_BUILTIN_STRING_NEW_LINE, "String.newLine", 0, VM_CLASS_STRING, StringNewLine) \
+    X(VM_BUILTIN_STRING_BACK_SPACE, "String.backSpace", 0, VM_CLASS_STRING, StringBackSpace) \
+    X(VM_BUILTIN_STRING_DOUBLE_QUOTE, "String.doubleQuote", 0, VM_CLASS_STRING, StringDoubleQuote) \
+    X(VM_BUILTIN_SYS_HALT, "Sys.halt", 0, VM_CLASS_SYS, SysHalt) \
+    X(VM_BUILTIN_SYS_ERROR, "Sys.error", 1, VM_CLASS_SYS, SysError) \
+    X(VM_BUILTIN_SYS_WAIT, "Sys.wait", 1, VM_CLASS_SYS, SysWait)
+
+#define VM_BUILTIN_ENTRY(id, name, arguments, owner, function) id,
+enum VMBuiltinId
+{
+    VM_BUILTINS(VM_BUILTIN_ENTRY)
+    VM_BUILTIN_COUNT
+};
+#undef VM_BUILTIN_ENTRY
+
+enum VMBuiltinResult
+{
+    VM_BUILTIN_RETURNED,
+    // Waiting for the keyboard, the call runs again on the next step
+    VM_BUILTIN_WAITING,
+    VM_BUILTIN_HALTED,
+    // VM code the builtin called stopped before returning, the machine is left inside it
+    VM_BUILTIN_INTERRUPTED,
+};
+
+// args points at the call's arguments on the stack, result starts out 0 for the void ones
+typedef VMBuiltinResult (*VMBuiltinFunction)(VMMachine* machine, uint16_t* args, uint16_t* result);
+
+struct VMBuiltin
+{
+    const char* name;
+    int argumentCount;
+    VMOSClass owner;
+    VMBuiltinFunction function;
+};
+
+extern const VMBuiltin vmBuiltins[VM_BUILTIN_COUNT];
+
+#define VM_LINE_LENGTH 80
+
+// What the builtin OS keeps outside ram, where the compiled OS would use its statics
+struct VMBuiltinState
+{
+    // Free blocks of the heap, in address order
+    uint16_t freeList;
+    bool heapReady;
+
+    int cursorRow;
+    int cursorColumn;
+    bool black;
+
+    // Where a keyboard read that's waiting has got to
+    int keyPhase;
+    uint16_t key;
+    int linePhase;
+    uint16_t line[VM_LINE_LENGTH];
+    int lineLength;
+};
+
+/// <summary>
+/// Returns the builtin with the given full name, or -1
+/// </summary>
+int FindBuiltin(const char* name);
+
+/// <summary>
+/// Reads a comma separated list of OS class names, or "all", into a mask of VMOSClass bits
+/// </summary>
+bool ParseBuiltinClasses(const char* list, uint32_t* classes);
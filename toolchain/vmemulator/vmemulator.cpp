@@ -0,0 +1,115 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "vmmachine.h"
+
+void PrintUsage()
+{
+    printf("Usage: vmemulator <file.vm | folder> [options]\n");
+    printf("  -steps <n>              Stop after n VM commands (default 100000000)\n");
+    printf("  -set <address>=<value>  Write a ram value before starting, may be repeated\n");
+    printf("  -dump <first> <last>    Print ram[first..last] when the program stops\n");
+    printf("  -builtin <classes>      Run these OS classes, comma separated or \"all\", on native builtins\n");
+    printf("                          instead of their .vm code. Classes the program lacks always are.\n");
+    printf("A folder runs every .vm file in it, starting at Sys.init like the translated program\n");
+}
+
+void PrintStop(VMStopReason reason, VMMachine* machine)
+{
+    int function = machine->functionOf[machine->pc];
+    const char* name = function >= 0 ? machine->functionNames[function] : "no function";
+    switch (reason)
+    {
+        case VM_STOP_STEP_LIMIT:
+            printf("Reached the step limit at command %u in %s\n", machine->pc, name);
+            break;
+
+        case VM_STOP_HALTED:
+            printf("Halted at command %u in %s\n", machine->pc, name);
+            break;
+
+        case VM_STOP_END_OF_PROGRAM:
+            printf("Ran past the end of the program\n");
+            break;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        PrintUsage();
+        return 0;
+    }
+
+    VMMachine* machine = (VMMachine*)malloc(sizeof(VMMachine));
+    machine->Reset();
+
+    uint64_t maxSteps = 100000000;
+    int dumpFirst = 0;
+    int dumpLast = -1;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-steps") == 0 && i + 1 < argc)
+        {
+            maxSteps = strtoull(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "-set") == 0 && i + 1 < argc)
+        {
+            int address = 0;
+            int value = 0;
+            if (sscanf(argv[++i], "%d=%d", &address, &value) != 2 || address < 0 || address >= VM_ADDRESS_SPACE)
+            {
+                printf("Invalid ram assignment: %s\n", argv[i]);
+                return 1;
+            }
+
+            machine->ram[address] = (uint16_t)value;
+        }
+        else if (strcmp(argv[i], "-dump") == 0 && i + 2 < argc)
+        {
+            dumpFirst = atoi(argv[++i]);
+            dumpLast = atoi(argv[++i]);
+            if (dumpFirst < 0 || dumpLast >= VM_ADDRESS_SPACE)
+            {
+                printf("Dump range must be within 0-%d\n", VM_ADDRESS_SPACE - 1);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-builtin") == 0 && i + 1 < argc)
+        {
+            if (!ParseBuiltinClasses(argv[++i], &machine->builtinClasses))
+            {
+                return 1;
+            }
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (!machine->Load(argv[1]))
+    {
+        return 1;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    VMStopReason reason = machine->Run(maxSteps);
+    auto end = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    PrintStop(reason, machine);
+    printf("%llu steps in %.3fs (%.1f million per second)\n",
+        (unsigned long long)machine->steps, seconds, seconds > 0 ? machine->steps / seconds / 1000000.0 : 0.0);
+
+    for (int address = dumpFirst; address <= dumpLast; ++address)
+    {
+        printf("RAM[%d] = %d\n", address, (int16_t)machine->ram[address]);
+    }
+
+    return 0;
+}
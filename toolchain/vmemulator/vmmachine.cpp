@@ -0,0 +1,624 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "vmmachine.h"
+#include "../common/fileio.h"
+
+// Threaded dispatch jumps straight from each operation to the next one's handler, which
+// needs the labels as values extension. MSVC doesn't have it and gets a switch instead.
+#ifndef VM_THREADED_DISPATCH
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_THREADED_DISPATCH 1
+#else
+#define VM_THREADED_DISPATCH 0
+#endif
+#endif
+
+#define SP 0
+#define LCL 1
+#define ARG 2
+#define THIS 3
+#define THAT 4
+#define TEMP 5
+#define FIRST_STATIC 16
+
+namespace
+{
+
+struct PendingTarget
+{
+    int instruction;
+    std::string name;
+    std::string file;
+    int line;
+};
+
+// Everything that's only needed while the program is put together
+struct Loader
+{
+    std::vector<VMInstruction> code;
+    std::vector<int> functionOf;
+    std::vector<std::string> functionNames;
+
+    std::unordered_map<std::string, int> labels;
+    std::unordered_map<std::string, int> functions;
+    std::unordered_map<std::string, int> statics;
+    int nextStatic = FIRST_STATIC;
+
+    std::vector<PendingTarget> jumps;
+    std::vector<PendingTarget> calls;
+
+    std::string module;
+    std::string scope;
+
+    void Emit(VMOperation op, int value = 0, uint32_t target = 0)
+    {
+        VMInstruction instruction = {};
+        instruction.op = op;
+        instruction.value = (uint16_t)value;
+        instruction.target = target;
+        code.push_back(instruction);
+        functionOf.push_back((int)functionNames.size() - 1);
+    }
+
+    // Labels inside a function are local to it, the same name mangling the translator uses
+    std::string ScopedLabel(const char* name)
+    {
+        return scope.empty() ? std::string(name) : scope + "$" + name;
+    }
+
+    // The assembler gives each static its address the first time the translated program
+    // mentions it, and the translator writes files and commands in the order they're read here
+    int StaticAddress(int index)
+    {
+        std::string name = module + "." + std::to_string(index);
+        auto found = statics.find(name);
+        if (found != statics.end())
+        {
+            return found->second;
+        }
+
+        statics[name] = nextStatic;
+        return nextStatic++;
+    }
+
+    bool LoadFile(const char* path);
+    bool LoadFolder(const char* path);
+    void EmitSysInit();
+    bool Link(VMMachine* machine);
+};
+
+bool Loader::LoadFile(const char* path)
+{
+    size_t size;
+    char* source = ReadWholeFile(path, &size);
+    if (!source)
+    {
+        printf("Failed to open file: %s\n", path);
+        return false;
+    }
+
+    // Statics are named after the file, without its folder or extension
+    const char* name = path;
+    for (const char* At = path; *At; ++At)
+    {
+        if (*At == '/' || *At == '\\') name = At + 1;
+    }
+
+    module = name;
+    size_t dot = module.rfind('.');
+    if (dot != std::string::npos)
+    {
+        module.resize(dot);
+    }
+
+    scope.clear();
+
+    bool valid = true;
+    int lineNumber = 1;
+    for (char* At = source; *At && valid; ++lineNumber)
+    {
+        char* line = At;
+        while (*At && *At != '\n') ++At;
+        if (*At) *At++ = 0;
+
+        char* comment = strstr(line, "//");
+        if (comment)
+        {
+            *comment = 0;
+        }
+
+        char command[64] = {};
+        char argument[256] = {};
+        int number = 0;
+        int fields = sscanf(line, "%63s %255s %d", command, argument, &number);
+        if (fields <= 0)
+        {
+            continue;
+        }
+
+        auto fail = [&](const char* message)
+        {
+            printf("%s:%d: %s\n", path, lineNumber, message);
+            valid = false;
+        };
+
+        if (strcmp(command, "push") == 0 || strcmp(command, "pop") == 0)
+        {
+            bool push = command[1] == 'u';
+            if (fields != 3 || number < 0 || number > 32767)
+            {
+                fail("expected a segment and an index");
+            }
+            else if (strcmp(argument, "constant") == 0)
+            {
+                if (push) Emit(VM_PUSH_CONSTANT, number);
+                else fail("can't pop to constant");
+            }
+            else if (strcmp(argument, "local") == 0) Emit(push ? VM_PUSH_LOCAL : VM_POP_LOCAL, number);
+            else if (strcmp(argument, "argument") == 0) Emit(push ? VM_PUSH_ARGUMENT : VM_POP_ARGUMENT, number);
+            else if (strcmp(argument, "this") == 0) Emit(push ? VM_PUSH_THIS : VM_POP_THIS, number);
+            else if (strcmp(argument, "that") == 0) Emit(push ? VM_PUSH_THAT : VM_POP_THAT, number);
+            else if (strcmp(argument, "pointer") == 0) Emit(push ? VM_PUSH_ADDRESS : VM_POP_ADDRESS, number ? THAT : THIS);
+            else if (strcmp(argument, "temp") == 0) Emit(push ? VM_PUSH_ADDRESS : VM_POP_ADDRESS, TEMP + number);
+            else if (strcmp(argument, "static") == 0) Emit(push ? VM_PUSH_ADDRESS : VM_POP_ADDRESS, StaticAddress(number));
+            else fail("unrecognized segment");
+        }
+        else if (strcmp(command, "add") == 0) Emit(VM_ADD);
+        else if (strcmp(command, "sub") == 0) Emit(VM_SUB);
+        else if (strcmp(command, "neg") == 0) Emit(VM_NEG);
+        else if (strcmp(command, "eq") == 0) Emit(VM_EQ);
+        else if (strcmp(command, "gt") == 0) Emit(VM_GT);
+        else if (strcmp(command, "lt") == 0) Emit(VM_LT);
+        else if (strcmp(command, "and") == 0) Emit(VM_AND);
+        else if (strcmp(command, "or") == 0) Emit(VM_OR);
+        else if (strcmp(command, "not") == 0) Emit(VM_NOT);
+        else if (strcmp(command, "label") == 0)
+        {
+            if (fields < 2) fail("expected a label name");
+            else labels[ScopedLabel(argument)] = (int)code.size();
+        }
+        else if (strcmp(command, "goto") == 0 || strcmp(command, "if-goto") == 0)
+        {
+            if (fields < 2)
+            {
+                fail("expected a label name");
+            }
+            else
+            {
+                jumps.push_back({ (int)code.size(), ScopedLabel(argument), path, lineNumber });
+                Emit(command[0] == 'g' ? VM_GOTO : VM_IF_GOTO);
+            }
+        }
+        else if (strcmp(command, "function") == 0)
+        {
+            if (fields != 3 || number < 0)
+            {
+                fail("expected a function name and a local count");
+            }
+            else
+            {
+                scope = argument;
+                functions[argument] = (int)code.size();
+                functionNames.push_back(argument);
+                Emit(VM_FUNCTION, number);
+            }
+        }
+        else if (strcmp(command, "call") == 0)
+        {
+            if (fields != 3 || number < 0)
+            {
+                fail("expected a function name and an argument count");
+            }
+            else
+            {
+                calls.push_back({ (int)code.size(), argument, path, lineNumber });
+                Emit(VM_CALL, number);
+            }
+        }
+        else if (strcmp(command, "return") == 0) Emit(VM_RETURN);
+        else fail("unrecognized command");
+    }
+
+    free(source);
+    return valid;
+}
+
+bool Loader::LoadFolder(const char* path)
+{
+    bool valid = true;
+    for (const std::string& name : ListFiles(path, ".vm"))
+    {
+        valid &= LoadFile((std::string(path) + PATH_SEPARATOR + name).c_str());
+    }
+
+    return valid;
+}
+
+// What the OS's Sys.init does, as bytecode so Main.main doesn't run nested inside a builtin
+void Loader::EmitSysInit()
+{
+    static const char* initCalls[] = { "Memory.init", "Math.init", "Screen.init", "Output.init", "Keyboard.init", "Main.main", "Sys.halt" };
+
+    scope = "Sys.init";
+    functions[scope] = (int)code.size();
+    functionNames.push_back(scope);
+    Emit(VM_FUNCTION, 0);
+    for (const char* name : initCalls)
+    {
+        calls.push_back({ (int)code.size(), name, "builtin Sys.init", 0 });
+        Emit(VM_CALL, 0);
+        Emit(VM_POP_ADDRESS, TEMP);
+    }
+}
+
+bool Loader::Link(VMMachine* machine)
+{
+    bool valid = true;
+    bool callsSysInit = false;
+    for (PendingTarget& call : calls)
+    {
+        callsSysInit |= call.name == "Sys.init";
+    }
+
+    if (callsSysInit && ((machine->builtinClasses & (1u << VM_CLASS_SYS)) || !functions.count("Sys.init")))
+    {
+        EmitSysInit();
+    }
+
+    for (PendingTarget& jump : jumps)
+    {
+        auto found = labels.find(jump.name);
+        if (found == labels.end())
+        {
+            printf("%s:%d: unknown label %s\n", jump.file.c_str(), jump.line, jump.name.c_str());
+            valid = false;
+            continue;
+        }
+
+        // A goto to itself can never leave, stop there like the emulator stops at "@HERE 0;JMP"
+        VMInstruction& instruction = code[jump.instruction];
+        instruction.target = found->second;
+        if (instruction.op == VM_GOTO && instruction.target == (uint32_t)jump.instruction)
+        {
+            instruction.op = VM_HALT;
+        }
+    }
+
+    for (PendingTarget& call : calls)
+    {
+        VMInstruction& instruction = code[call.instruction];
+        auto found = functions.find(call.name);
+        int builtin = FindBuiltin(call.name.c_str());
+        if (builtin >= 0 && (found == functions.end() || (machine->builtinClasses & (1u << vmBuiltins[builtin].owner))))
+        {
+            if (instruction.value != vmBuiltins[builtin].argumentCount)
+            {
+                printf("%s:%d: %s takes %d arguments\n", call.file.c_str(), call.line, call.name.c_str(), vmBuiltins[builtin].argumentCount);
+                valid = false;
+                continue;
+            }
+
+            instruction.op = VM_CALL_BUILTIN;
+            instruction.target = builtin;
+            continue;
+        }
+
+        if (found == functions.end())
+        {
+            printf("%s:%d: call to unknown function %s\n", call.file.c_str(), call.line, call.name.c_str());
+            valid = false;
+            continue;
+        }
+
+        instruction.target = found->second;
+    }
+
+    for (int i = 0; i < VM_BUILTIN_COUNT; ++i)
+    {
+        auto found = functions.find(vmBuiltins[i].name);
+        bool builtin = found == functions.end() || (machine->builtinClasses & (1u << vmBuiltins[i].owner));
+        machine->builtinEntries[i] = builtin ? -1 : found->second;
+    }
+
+    if (code.size() > VM_MAX_CODE_SIZE)
+    {
+        printf("The program has %d commands, more than the %d a return address can hold\n", (int)code.size(), VM_MAX_CODE_SIZE);
+        valid = false;
+    }
+
+    if (!valid)
+    {
+        return false;
+    }
+
+    machine->codeSize = (int)code.size();
+    machine->code = (VMInstruction*)malloc(sizeof(VMInstruction) * (code.size() + 1));
+    memcpy(machine->code, code.data(), sizeof(VMInstruction) * code.size());
+    machine->code[code.size()] = { VM_END, 0, 0 };
+
+    machine->functionOf = (int*)malloc(sizeof(int) * (code.size() + 1));
+    memcpy(machine->functionOf, functionOf.data(), sizeof(int) * code.size());
+    machine->functionOf[code.size()] = -1;
+
+    machine->functionCount = (int)functionNames.size();
+    machine->functionNames = (char**)malloc(sizeof(char*) * (functionNames.size() + 1));
+    for (size_t i = 0; i < functionNames.size(); ++i)
+    {
+        machine->functionNames[i] = (char*)malloc(functionNames[i].size() + 1);
+        strcpy(machine->functionNames[i], functionNames[i].c_str());
+    }
+
+    return true;
+}
+
+}
+
+void VMMachine::Reset()
+{
+    memset(ram, 0, sizeof(ram));
+    code = nullptr;
+    codeSize = 0;
+    functionNames = nullptr;
+    functionOf = nullptr;
+    functionCount = 0;
+    pc = 0;
+    steps = 0;
+    builtinClasses = 0;
+    builtins = {};
+    builtins.black = true;
+    stepLimit = 0;
+}
+
+void VMMachine::Free()
+{
+    for (int i = 0; i < functionCount; ++i)
+    {
+        free(functionNames[i]);
+    }
+
+    free(functionNames);
+    free(functionOf);
+    free(code);
+    Reset();
+}
+
+bool VMMachine::CallFunction(uint32_t entry, const uint16_t* args, int count, uint16_t* result)
+{
+    uint32_t callerPc = pc;
+    uint16_t sp = ram[SP];
+    for (int i = 0; i < count; ++i)
+    {
+        ram[sp++] = args[i];
+    }
+
+    // The frame VM_CALL builds, returning to the VM_END after the last command so Run stops there
+    ram[sp] = (uint16_t)codeSize;
+    ram[(uint16_t)(sp + 1)] = ram[LCL];
+    ram[(uint16_t)(sp + 2)] = ram[ARG];
+    ram[(uint16_t)(sp + 3)] = ram[THIS];
+    ram[(uint16_t)(sp + 4)] = ram[THAT];
+    sp += 5;
+    ram[ARG] = sp - 5 - count;
+    ram[LCL] = sp;
+    ram[SP] = sp;
+
+    pc = entry;
+    VMStopReason reason = Run(stepLimit);
+    if (reason != VM_STOP_END_OF_PROGRAM || pc != (uint32_t)codeSize)
+    {
+        nestedStop = reason;
+        return false;
+    }
+
+    *result = ram[--ram[SP]];
+    pc = callerPc;
+    return true;
+}
+
+bool VMMachine::Load(char* path)
+{
+    Loader* loader = new Loader();
+    bool valid;
+    if (IsDirectory(path))
+    {
+        // The translator's bootstrap: sp = 256, call Sys.init 0
+        loader->Emit(VM_BOOTSTRAP, VM_STACK_BASE);
+        loader->calls.push_back({ 1, "Sys.init", path, 0 });
+        loader->Emit(VM_CALL, 0);
+        valid = loader->LoadFolder(path);
+    }
+    else
+    {
+        valid = loader->LoadFile(path);
+    }
+
+    valid = valid && loader->Link(this);
+    delete loader;
+    pc = 0;
+    return valid;
+}
+
+VMStopReason VMMachine::Run(uint64_t maxSteps)
+{
+    // Work on locals so the compiler can keep them in registers. Nothing else writes
+    // ram[SP] while running, so the stack pointer only goes back at the end.
+    uint16_t* memory = ram;
+    const VMInstruction* base = code;
+    const VMInstruction* end = code + codeSize;
+    const VMInstruction* ip = code + pc;
+    const VMInstruction* instruction;
+    uint16_t sp = memory[SP];
+    uint64_t step = steps;
+    VMStopReason reason = VM_STOP_STEP_LIMIT;
+
+#if VM_THREADED_DISPATCH
+#define VM_LABEL_ADDRESS(name) &&name##_HANDLER,
+    static void* const dispatch[] = { VM_OPERATIONS(VM_LABEL_ADDRESS) };
+#undef VM_LABEL_ADDRESS
+
+#define VM_CASE(name) name##_HANDLER:
+#define VM_NEXT() \
+    if (step >= maxSteps) goto stopped; \
+    instruction = ip++; \
+    ++step; \
+    goto *dispatch[instruction->op]
+
+    VM_NEXT();
+#else
+#define VM_CASE(name) case name:
+#define VM_NEXT() continue
+
+    for (;;)
+    {
+        if (step >= maxSteps) goto stopped;
+        instruction = ip++;
+        ++step;
+
+        switch (instruction->op)
+        {
+#endif
+            VM_CASE(VM_PUSH_CONSTANT) memory[sp++] = instruction->value; VM_NEXT();
+            VM_CASE(VM_PUSH_LOCAL) memory[sp++] = memory[(uint16_t)(memory[LCL] + instruction->value)]; VM_NEXT();
+            VM_CASE(VM_PUSH_ARGUMENT) memory[sp++] = memory[(uint16_t)(memory[ARG] + instruction->value)]; VM_NEXT();
+            VM_CASE(VM_PUSH_THIS) memory[sp++] = memory[(uint16_t)(memory[THIS] + instruction->value)]; VM_NEXT();
+            VM_CASE(VM_PUSH_THAT) memory[sp++] = memory[(uint16_t)(memory[THAT] + instruction->value)]; VM_NEXT();
+            VM_CASE(VM_PUSH_ADDRESS) memory[sp++] = memory[instruction->value]; VM_NEXT();
+            VM_CASE(VM_POP_LOCAL) memory[(uint16_t)(memory[LCL] + instruction->value)] = memory[--sp]; VM_NEXT();
+            VM_CASE(VM_POP_ARGUMENT) memory[(uint16_t)(memory[ARG] + instruction->value)] = memory[--sp]; VM_NEXT();
+            VM_CASE(VM_POP_THIS) memory[(uint16_t)(memory[THIS] + instruction->value)] = memory[--sp]; VM_NEXT();
+            VM_CASE(VM_POP_THAT) memory[(uint16_t)(memory[THAT] + instruction->value)] = memory[--sp]; VM_NEXT();
+            VM_CASE(VM_POP_ADDRESS) memory[instruction->value] = memory[--sp]; VM_NEXT();
+
+            VM_CASE(VM_ADD) --sp; memory[(uint16_t)(sp - 1)] += memory[sp]; VM_NEXT();
+            VM_CASE(VM_SUB) --sp; memory[(uint16_t)(sp - 1)] -= memory[sp]; VM_NEXT();
+            VM_CASE(VM_NEG) memory[(uint16_t)(sp - 1)] = -memory[(uint16_t)(sp - 1)]; VM_NEXT();
+            VM_CASE(VM_AND) --sp; memory[(uint16_t)(sp - 1)] &= memory[sp]; VM_NEXT();
+            VM_CASE(VM_OR) --sp; memory[(uint16_t)(sp - 1)] |= memory[sp]; VM_NEXT();
+            VM_CASE(VM_NOT) memory[(uint16_t)(sp - 1)] = ~memory[(uint16_t)(sp - 1)]; VM_NEXT();
+
+            // Comparisons are on the signed values, true being -1
+            VM_CASE(VM_EQ) --sp; memory[(uint16_t)(sp - 1)] = memory[(uint16_t)(sp - 1)] == memory[sp] ? 0xFFFF : 0; VM_NEXT();
+            VM_CASE(VM_GT) --sp; memory[(uint16_t)(sp - 1)] = (int16_t)memory[(uint16_t)(sp - 1)] > (int16_t)memory[sp] ? 0xFFFF : 0; VM_NEXT();
+            VM_CASE(VM_LT) --sp; memory[(uint16_t)(sp - 1)] = (int16_t)memory[(uint16_t)(sp - 1)] < (int16_t)memory[sp] ? 0xFFFF : 0; VM_NEXT();
+
+            VM_CASE(VM_GOTO) ip = base + instruction->target; VM_NEXT();
+            VM_CASE(VM_IF_GOTO)
+                if (memory[--sp])
+                {
+                    ip = base + instruction->target;
+                }
+
+                VM_NEXT();
+
+            // Same frame as the translated call: return address, LCL, ARG, THIS, THAT
+            VM_CASE(VM_CALL)
+                memory[sp] = (uint16_t)(ip - base);
+                memory[(uint16_t)(sp + 1)] = memory[LCL];
+                memory[(uint16_t)(sp + 2)] = memory[ARG];
+                memory[(uint16_t)(sp + 3)] = memory[THIS];
+                memory[(uint16_t)(sp + 4)] = memory[THAT];
+                sp += 5;
+                memory[ARG] = sp - 5 - instruction->value;
+                memory[LCL] = sp;
+                ip = base + instruction->target;
+                VM_NEXT();
+
+            // Builtins see the machine as it is at the call, and may run VM code of their own
+            VM_CASE(VM_CALL_BUILTIN)
+            {
+                memory[SP] = sp;
+                pc = (uint32_t)(ip - base);
+                steps = step;
+                stepLimit = maxSteps;
+
+                uint16_t result = 0;
+                VMBuiltinResult outcome = vmBuiltins[instruction->target].function(this, memory + (uint16_t)(sp - instruction->value), &result);
+                step = steps;
+                if (outcome == VM_BUILTIN_RETURNED)
+                {
+                    sp = memory[SP] - instruction->value;
+                    memory[sp++] = result;
+                    VM_NEXT();
+                }
+
+                ip = instruction;
+                if (outcome == VM_BUILTIN_WAITING)
+                {
+                    VM_NEXT();
+                }
+
+                if (outcome == VM_BUILTIN_HALTED)
+                {
+                    --step;
+                    reason = VM_STOP_HALTED;
+                    goto stopped;
+                }
+
+                ip = base + pc;
+                sp = memory[SP];
+                reason = nestedStop;
+                goto stopped;
+            }
+
+            VM_CASE(VM_FUNCTION)
+                for (int i = 0; i < instruction->value; ++i)
+                {
+                    memory[sp++] = 0;
+                }
+
+                VM_NEXT();
+
+            VM_CASE(VM_RETURN)
+            {
+                // The return address is read before the result can overwrite it, which
+                // it does when the function had no arguments
+                uint16_t frame = memory[LCL];
+                uint16_t returnAddress = memory[(uint16_t)(frame - 5)];
+                uint16_t result = memory[(uint16_t)(sp - 1)];
+                uint16_t argument = memory[ARG];
+                memory[THAT] = memory[(uint16_t)(frame - 1)];
+                memory[THIS] = memory[(uint16_t)(frame - 2)];
+                memory[ARG] = memory[(uint16_t)(frame - 3)];
+                memory[LCL] = memory[(uint16_t)(frame - 4)];
+                memory[argument] = result;
+                sp = argument + 1;
+                ip = base + returnAddress;
+                if (ip > end)
+                {
+                    ip = end;
+                }
+
+                VM_NEXT();
+            }
+
+            VM_CASE(VM_BOOTSTRAP) sp = instruction->value; VM_NEXT();
+
+            VM_CASE(VM_HALT)
+                --ip;
+                --step;
+                reason = VM_STOP_HALTED;
+                goto stopped;
+
+            VM_CASE(VM_END)
+                --ip;
+                --step;
+                reason = VM_STOP_END_OF_PROGRAM;
+                goto stopped;
+#if !VM_THREADED_DISPATCH
+        }
+    }
+#endif
+
+#undef VM_CASE
+#undef VM_NEXT
+
+stopped:
+    memory[SP] = sp;
+    pc = (uint32_t)(ip - base);
+    steps = step;
+    return reason;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include "vmbuiltins.h"
+
+// Like HackCPU's ram, one word for every address a 16 bit pointer can hold so no access
+// needs a bounds check
+#define VM_ADDRESS_SPACE 65536
+
+// Return addresses are kept in ram like the translated program keeps them, so the
+// bytecode has to fit in a word
+#define VM_MAX_CODE_SIZE 65535
+
+#define VM_STACK_BASE 256
+
+// Every bytecode operation, in the order of the dispatch table
+#define VM_OPERATIONS(X) \
+    X(VM_PUSH_CONSTANT) \
+    X(VM_PUSH_LOCAL) \
+    X(VM_PUSH_ARGUMENT) \
+    X(VM_PUSH_THIS) \
+    X(VM_PUSH_THAT) \
+    X(VM_PUSH_ADDRESS) \
+    X(VM_POP_LOCAL) \
+    X(VM_POP_ARGUMENT) \
+    X(VM_POP_THIS) \
+    X(VM_POP_THAT) \
+    X(VM_POP_ADDRESS) \
+    X(VM_ADD) \
+    X(VM_SUB) \
+    X(VM_NEG) \
+    X(VM_EQ) \
+    X(VM_GT) \
+    X(VM_LT) \
+    X(VM_AND) \
+    X(VM_OR) \
+    X(VM_NOT) \
+    X(VM_GOTO) \
+    X(VM_IF_GOTO) \
+    X(VM_CALL) \
+    X(VM_CALL_BUILTIN) \
+    X(VM_FUNCTION) \
+    X(VM_RETURN) \
+    X(VM_BOOTSTRAP) \
+    X(VM_HALT) \
+    X(VM_END)
+
+#define VM_ENUM_ENTRY(name) name,
+enum VMOperation : uint8_t
+{
+    VM_OPERATIONS(VM_ENUM_ENTRY)
+};
+#undef VM_ENUM_ENTRY
+
+// pointer, temp and static all come down to a fixed address and share VM_PUSH_ADDRESS
+// and VM_POP_ADDRESS. Jumps and calls carry the index of the instruction they go to, calls
+// to builtins the VMBuiltinId.
+struct VMInstruction
+{
+    VMOperation op;
+    uint16_t value;
+    uint32_t target;
+};
+
+enum VMStopReason
+{
+    VM_STOP_STEP_LIMIT,
+    // Reached a goto to itself
+    VM_STOP_HALTED,
+    VM_STOP_END_OF_PROGRAM,
+};
+
+struct VMMachine
+{
+    uint16_t ram[VM_ADDRESS_SPACE];
+
+    // codeSize instructions followed by a VM_END, so running off the end needs no check
+    VMInstruction* code;
+    int codeSize;
+
+    // Name of the function each instruction belongs to, for messages and profiles
+    char** functionNames;
+    int* functionOf;
+    int functionCount;
+
+    uint32_t pc;
+    uint64_t steps;
+
+    // VMOSClass bits of the classes that run on builtins. Set before Load; calls to OS
+    // functions the program doesn't define go to the builtins either way.
+    uint32_t builtinClasses;
+
+    // The compiled function each builtin stands in for, -1 where the builtin is used
+    int builtinEntries[VM_BUILTIN_COUNT];
+    VMBuiltinState builtins;
+
+    // Builtins calling compiled OS functions run them under the limit of the Run they're in
+    uint64_t stepLimit;
+    VMStopReason nestedStop;
+
+    /// <summary>
+    /// Clears ram and drops any loaded program
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Releases the loaded program
+    /// </summary>
+    void Free();
+
+    /// <summary>
+    /// Loads a .vm file, or every .vm file in a folder behind a bootstrap that sets up the
+    /// stack and calls Sys.init, the same way the translator lays the program out. Static
+    /// variables get the addresses the assembler would give the translated program.
+    /// </summary>
+    bool Load(char* path);
+
+    /// <summary>
+    /// Runs until maxSteps VM commands have executed in total, the program halts, or it
+    /// runs past its last command
+    /// </summary>
+    VMStopReason Run(uint64_t maxSteps);
+
+    /// <summary>
+    /// Runs the function at entry to its return, for builtins that call compiled code.
+    /// Returns false, with the reason in nestedStop, if it stops before then.
+    /// </summary>
+    bool CallFunction(uint32_t entry, const uint16_t* args, int count, uint16_t* result);
+};
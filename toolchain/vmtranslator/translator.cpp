@@ -0,0 +1,1254 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <unordered_set>
+#include "translator.h"
+#include "vmops.h"
+#include "vmbytecode.h"
+#include "../common/textscan.h"
+#include "../common/fileio.h"
+
+// Everything but the functions in translator.h stays local so the translator can be linked
+// into other tools
+namespace
+{
+
+char* extension(char* path)
+{
+    char* ext = 0;
+    while (*path)
+    {
+        if (*path == '.')
+        {
+            ext = path;
+        }
+
+        ++path;
+    }
+
+    if (!ext)
+    {
+        return path;
+    }
+
+    return ext;
+}
+
+char* baseName(char* path)
+{
+    char* filename = path;
+    while (*path)
+    {
+        if (*path == '\\' || *path == '/')
+        {
+            filename = path + 1;
+        }
+
+        ++path;
+    }
+
+    return filename;
+}
+
+// Every byte is one of these to the tokenizer, so scanning a token is one table lookup a byte
+enum CharClass : uint8_t
+{
+    CHAR_END = 0,
+    // What SkipWhitespace skips, every control character and the space
+    CHAR_WHITESPACE = 1 << 0,
+    CHAR_DIGIT = 1 << 1,
+    // Anything else belongs to a word
+    CHAR_WORD = 1 << 2,
+
+    CHAR_TOKEN = CHAR_DIGIT | CHAR_WORD,
+};
+
+struct CharClassTable
+{
+    uint8_t classes[256];
+};
+
+constexpr CharClassTable BuildCharClasses()
+{
+    CharClassTable table = {};
+    for (int c = 1; c < 256; ++c)
+    {
+        table.classes[c] = c <= ' ' ? CHAR_WHITESPACE : c >= '0' && c <= '9' ? CHAR_DIGIT : CHAR_WORD;
+    }
+
+    return table;
+}
+
+static constexpr CharClassTable charClasses = BuildCharClasses();
+
+inline uint8_t ClassOf(char v)
+{
+    return charClasses.classes[(uint8_t)v];
+}
+
+enum TokenType
+{
+    TOKEN_IDENTIFIER,
+    TOKEN_NUMBER,
+
+    TOKEN_EOF,
+};
+
+struct Token
+{
+    enum TokenType type;
+    const char* text;
+    int length;
+    int value;
+};
+
+struct Tokenizer 
+{
+    char* At;
+
+    void EatAllWhitespace()
+    {
+        for (;;)
+        {
+            At = SkipWhitespace(At);
+            if (At[0] != '/' || At[1] != '/')
+            {
+                break;
+            }
+
+            At = FindLineEnd(At + 2);
+        }
+    }
+
+    Token GetToken()
+    {
+        EatAllWhitespace();
+
+        Token token = {};
+        token.text = At;
+        token.length = 1;
+
+        uint8_t first = ClassOf(*At);
+        if (first == CHAR_END)
+        {
+            token.type = TOKEN_EOF;
+        }
+        else if (first == CHAR_DIGIT)
+        {
+            token.type = TOKEN_NUMBER;
+            do
+            {
+                token.value = token.value * 10 + (*At++ - '0');
+            } while (ClassOf(*At) == CHAR_DIGIT);
+            token.length = At - token.text;
+        }
+        else
+        {
+            token.type = TOKEN_IDENTIFIER;
+            while (ClassOf(*At) & CHAR_TOKEN) ++At;
+            token.length = At - token.text;
+        }
+
+        return token;
+    }
+};
+
+// The words a .vm file is made of, each the command or segment it names
+struct Keyword
+{
+    const char* text;
+    int length;
+    bool isSegment;
+    uint8_t value;
+};
+
+// The first entry is no keyword, what empty slots of the table point at
+static constexpr Keyword keywords[] =
+{
+    { "", 0, false, 0 },
+    { "push", 4, false, VMOP_PUSH },
+    { "pop", 3, false, VMOP_POP },
+    { "add", 3, false, VMOP_ADD },
+    { "sub", 3, false, VMOP_SUB },
+    { "neg", 3, false, VMOP_NEG },
+    { "eq", 2, false, VMOP_EQ },
+    { "gt", 2, false, VMOP_GT },
+    { "lt", 2, false, VMOP_LT },
+    { "and", 3, false, VMOP_AND },
+    { "or", 2, false, VMOP_OR },
+    { "not", 3, false, VMOP_NOT },
+    { "label", 5, false, VMOP_LABEL },
+    { "goto", 4, false, VMOP_GOTO },
+    { "if-goto", 7, false, VMOP_IF_GOTO },
+    { "function", 8, false, VMOP_FUNCTION },
+    { "call", 4, false, VMOP_CALL },
+    { "return", 6, false, VMOP_RETURN },
+    { "constant", 8, true, VMSEG_CONSTANT },
+    { "argument", 8, true, VMSEG_ARGUMENT },
+    { "local", 5, true, VMSEG_LOCAL },
+    { "static", 6, true, VMSEG_STATIC },
+    { "this", 4, true, VMSEG_THIS },
+    { "that", 4, true, VMSEG_THAT },
+    { "pointer", 7, true, VMSEG_POINTER },
+    { "temp", 4, true, VMSEG_TEMP },
+};
+
+static constexpr int keywordCount = sizeof(keywords) / sizeof(keywords[0]);
+
+// A power of two
+#define KEYWORD_SLOTS 64
+
+// Reads the first two characters and the last, and gives each keyword a slot of its own. A
+// one character token's second is whatever follows it, at worst the null at the end. The
+// constants were searched for and KeywordsCollide checks them when compiling.
+constexpr unsigned KeywordHash(const char* text, int length)
+{
+    return ((uint8_t)text[0] + ((uint8_t)text[1] + (uint8_t)text[length - 1]) * 5 + length) & (KEYWORD_SLOTS - 1);
+}
+
+struct KeywordTable
+{
+    uint8_t slots[KEYWORD_SLOTS];
+};
+
+constexpr KeywordTable BuildKeywordTable()
+{
+    KeywordTable table = {};
+    for (int i = 1; i < keywordCount; ++i)
+    {
+        table.slots[KeywordHash(keywords[i].text, keywords[i].length)] = (uint8_t)i;
+    }
+
+    return table;
+}
+
+constexpr bool KeywordsCollide()
+{
+    for (int i = 1; i < keywordCount; ++i)
+    {
+        for (int j = i + 1; j < keywordCount; ++j)
+        {
+            if (KeywordHash(keywords[i].text, keywords[i].length) == KeywordHash(keywords[j].text, keywords[j].length))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static_assert(!KeywordsCollide(), "Two keywords hash to the same slot, KeywordHash needs new constants");
+
+static constexpr KeywordTable keywordTable = BuildKeywordTable();
+
+// The keyword token is, or the empty first entry if it's none
+inline const Keyword* Classify(Token token)
+{
+    if (token.type == TOKEN_EOF)
+    {
+        return &keywords[0];
+    }
+
+    const Keyword* keyword = &keywords[keywordTable.slots[KeywordHash(token.text, token.length)]];
+    if (keyword->length != token.length || memcmp(keyword->text, token.text, token.length) != 0)
+    {
+        return &keywords[0];
+    }
+
+    return keyword;
+}
+
+enum CompareOps {
+    LESS_THAN,
+    GREATER_THAN,
+    EQUAL,
+    NUM_COMPARE_OPS
+};
+
+enum MarkerType
+{
+    MARKER_FUNCTION,
+    MARKER_CALL,
+    MARKER_RETURN,
+};
+
+// A place in the assembly the call map needs the rom address of: the address of the
+// instruction it's in front of
+struct MapMarker
+{
+    MarkerType type;
+    char* name;
+    int address;
+};
+
+// Statics live in RAM 16 to 255
+#define STATIC_SEGMENT_SIZE 240
+
+struct CodeWriter
+{
+    int compareCounts[NUM_COMPARE_OPS] = { 0, 0, 0 };
+    const char* compareStrings[NUM_COMPARE_OPS] = {"LT", "GT", "EQ"};
+    
+    char currentModule[256];
+    Token scope = {};
+    char scopeText[256];
+    FileWriter output;
+    bool comments = true;
+    int callCount = 0;
+
+    AssemblyLineSink lineSink = 0;
+    void* lineContext = 0;
+    int instructionCount = 0;
+
+    // Every static the code names. The assembler gives each one a word from RAM 16 up, and
+    // past 255 they'd run into the stack.
+    std::unordered_set<std::string> statics;
+
+    bool mapping = false;
+    int markerCount = 0;
+    int markerCapacity = 0;
+    MapMarker* markers = 0;
+
+    void Mark(MarkerType type, Token name)
+    {
+        if (!mapping)
+        {
+            return;
+        }
+
+        if (markerCount == markerCapacity)
+        {
+            markerCapacity = markerCapacity ? markerCapacity * 2 : 1024;
+            markers = (MapMarker*)realloc(markers, sizeof(MapMarker) * markerCapacity);
+        }
+
+        MapMarker* marker = &markers[markerCount++];
+        marker->type = type;
+        marker->name = (char*)malloc(name.length + 1);
+        memcpy(marker->name, name.text, name.length);
+        marker->name[name.length] = 0;
+        marker->address = instructionCount;
+    }
+
+    // Every line of assembly goes through here, to the .asm and the line sink. Comments only
+    // go to the .asm.
+    void Emit(const char* format, ...)
+    {
+        char line[1024];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+
+        if (output.IsOpen() && length > 0)
+        {
+            output.Write(line, length < (int)sizeof(line) ? length : sizeof(line) - 1);
+        }
+
+        if (line[0] == '/')
+        {
+            return;
+        }
+
+        if (lineSink)
+        {
+            lineSink(lineContext, line);
+        }
+
+        if (line[0] != '(')
+        {
+            ++instructionCount;
+        }
+    }
+
+    // Copies the current function's name, for when the input it points into is about to go
+    // but labels in the next file could still be scoped by it
+    void KeepScope()
+    {
+        if (scope.text && scope.text != scopeText)
+        {
+            scope.length = scope.length < (int)sizeof(scopeText) ? scope.length : (int)sizeof(scopeText) - 1;
+            memcpy(scopeText, scope.text, scope.length);
+            scope.text = scopeText;
+        }
+    }
+
+    void SetCurrentModule(char* path)
+    {
+        char* filename = baseName(path);
+        char* ext = extension(filename);
+
+        strncpy(currentModule, filename, ext - filename);
+        currentModule[ext - filename] = 0;
+    }
+
+    bool Open(char* outputPath)
+    {
+        return output.Open(outputPath);
+    }
+
+    void StaticAddress(int index)
+    {
+        char name[sizeof(currentModule) + 16];
+        snprintf(name, sizeof(name), "%s.%d", currentModule, index);
+        statics.insert(name);
+        Emit("@%s\n", name);
+    }
+
+    bool StaticsFit()
+    {
+        if (statics.size() <= STATIC_SEGMENT_SIZE)
+        {
+            return true;
+        }
+
+        printf("The program has %d statics, more than the %d words from RAM 16 to 255 hold\n", (int)statics.size(), STATIC_SEGMENT_SIZE);
+        return false;
+    }
+
+    void BasicSegmentAddress(const char* segment, int index)
+    {
+        Emit("@%s\n", segment);
+        Emit("AD=M\n");
+        if (index)
+        {
+            Emit("@%d\n", index);
+            Emit("AD=A+D\n");
+        }
+    }
+
+    void BasicSegmentValue(const char* segment, int index)
+    {
+        BasicSegmentAddress(segment, index);
+        Emit("D=M\n");
+    }
+
+    void Push(VMOpSegment segment, int index)
+    {
+        if (comments)
+        {
+            Emit("// push %s %d\n", vmSegmentNames[segment], index);
+        }
+
+        // Load segment value into D resgister
+        if (segment == VMSEG_CONSTANT)
+        {
+            // D = value
+            Emit("@%d\n", index);
+            Emit("D=A\n");
+        }
+        else if (segment == VMSEG_LOCAL)
+        {
+            BasicSegmentValue("LCL", index);
+        }
+        else if (segment == VMSEG_ARGUMENT)
+        {
+            BasicSegmentValue("ARG", index);
+        }
+        else if (segment == VMSEG_THIS)
+        {
+            BasicSegmentValue("THIS", index);
+        }
+        else if (segment == VMSEG_THAT)
+        {
+            BasicSegmentValue("THAT", index);
+        }
+        else if (segment == VMSEG_TEMP)
+        {
+            Emit("@R%d\n", index + 5);
+            Emit("D=M\n");
+        }
+        else if (segment == VMSEG_STATIC)
+        {
+            StaticAddress(index);
+            Emit("D=M\n");
+        }
+        else if (segment == VMSEG_POINTER)
+        {
+            if (index == 0)
+            {
+                Emit("@THIS\n");
+            }
+            else
+            {
+                Emit("@THAT\n");
+            }
+
+            Emit("D=M\n");
+        }
+
+        // set top stack to d
+        Emit("@SP\n");
+        Emit("AM=M+1\n");
+        Emit("A=A-1\n");
+        Emit("M=D\n");
+    }
+
+    void GlobalPop()
+    {
+        Emit("@SP\n");
+        Emit("AM=M-1\n");
+        Emit("D=M\n");
+    }
+
+    void Pop(VMOpSegment segment, int index)
+    {
+        if (comments)
+        {
+            Emit("// pop %s %d\n", vmSegmentNames[segment], index);
+        }
+
+        if (segment == VMSEG_LOCAL)
+        {
+            BasicSegmentAddress("LCL", index);
+        }
+        else if (segment == VMSEG_ARGUMENT)
+        {
+            BasicSegmentAddress("ARG", index);
+        }
+        else if (segment == VMSEG_THIS)
+        {
+            BasicSegmentAddress("THIS", index);
+        }
+        else if (segment == VMSEG_THAT)
+        {
+            BasicSegmentAddress("THAT", index);
+        }
+        else if (segment == VMSEG_TEMP)
+        {
+            Emit("@R%d\n", index + 5);
+            Emit("D=A\n");
+        }
+        else if (segment == VMSEG_STATIC)
+        {
+            StaticAddress(index);
+            Emit("D=A\n");
+        }
+        else if (segment == VMSEG_POINTER)
+        {
+            if (index == 0)
+            {
+                Emit("@THIS\n");
+            }
+            else
+            {
+                Emit("@THAT\n");
+            }
+
+            Emit("D=A\n");
+        }
+        else
+        {
+            printf("Can't pop to the constant segment\n");
+            exit(0);
+            return;
+        }
+
+        // mem[R15] = D
+        Emit("@R15\n");
+        Emit("M=D\n");
+
+        // D = mem[--mem[sp]]
+        GlobalPop();
+
+        // *(mem[R15]) = D
+        Emit("@R15\n");
+        Emit("A=M\n");
+        Emit("M=D\n");
+    }
+
+    void ArithmeticTwoParam(char op)
+    {
+        if (comments)
+        {
+            Emit("// x %c y\n", op);
+        }
+
+        GlobalPop();
+        Emit("A=A-1\n"); // M is x and return location
+        Emit("M=M%cD\n", op);
+    }
+
+    void ArithmeticOneParam(char op)
+    {
+        if (comments)
+        {
+            Emit("// %cy\n", op);
+        }
+
+        Emit("@SP\n");
+        Emit("A=M-1\n");
+        Emit("M=%cM\n", op);
+    }
+
+    void Compare(CompareOps type)
+    {
+        if (comments)
+        {
+            switch (type)
+            {
+                case LESS_THAN:
+                    Emit("// x < y\n");
+                    break;
+
+                case GREATER_THAN:
+                    Emit("// x > y\n");
+                    break;
+
+                case EQUAL:
+                    Emit("// x == y\n");
+                    break;
+            }
+        }
+
+        GlobalPop();
+        Emit("A=A-1\n");
+        Emit("D=M-D\n");
+        Emit("M=-1\n");
+        Emit("@END_%s%d\n", compareStrings[type], compareCounts[type]);
+        Emit("D;J%s\n", compareStrings[type]);
+        Emit("@SP\n");
+        Emit("A=M-1\n");
+        Emit("M=0\n");
+        Emit("(END_%s%d)\n", compareStrings[type], compareCounts[type]);
+        ++compareCounts[type];
+    }
+
+    void Label(Token name)
+    {
+        if (scope.text)
+        {
+            Emit("(%.*s$%.*s)\n", scope.length, scope.text, name.length, name.text);
+        }
+        else
+        {
+            Emit("(%.*s)\n", name.length, name.text);
+        }
+    }
+
+    void Goto(Token location)
+    {
+        if (comments)
+        {
+            Emit("// goto %.*s\n", location.length, location.text);
+        }
+
+        if (scope.text)
+        {
+            Emit("@%.*s$%.*s\n", scope.length, scope.text, location.length, location.text);
+        }
+        else
+        {
+            Emit("@%.*s\n", location.length, location.text);
+        }
+
+        Emit("0;JMP\n");
+    }
+
+    void IfGoto(Token location)
+    {
+        if (comments)
+        {
+            Emit("// if-goto %.*s\n", location.length, location.text);
+        }
+
+        GlobalPop();
+        if (scope.text)
+        {
+            Emit("@%.*s$%.*s\n", scope.length, scope.text, location.length, location.text);
+        }
+        else
+        {
+            Emit("@%.*s\n", location.length, location.text);
+        }
+
+        Emit("D;JNE\n");
+    }
+
+    void Function(Token name, int nLocals)
+    {
+        if (comments)
+        {
+            Emit("// function %.*s %d\n", name.length, name.text, nLocals);
+        }
+
+        scope = {};
+        Mark(MARKER_FUNCTION, name);
+        Label(name);
+        scope = name;
+
+        for (int i = 0; i < nLocals; ++i)
+        {
+            Emit("@SP\n");
+            Emit("AM=M+1\n");
+            Emit("A=A-1\n");
+            Emit("M=0\n");
+        }
+    }
+
+    void Call(Token name, int nArgs)
+    {
+        if (comments)
+        {
+            Emit("// call %.*s %d\n", name.length, name.text, nArgs);
+        }
+
+        Emit("@RETURN_ADDRESS_%d\n", callCount);
+        Emit("D=A\n");
+
+        Emit("@SP\n");
+        Emit("A=M\n");
+        Emit("M=D\n");
+
+        Emit("@LCL\n");
+        Emit("D=M\n");
+        Emit("@SP\n");
+        Emit("AM=M+1\n");
+        Emit("M=D\n");
+        
+        Emit("@ARG\n");
+        Emit("D=M\n");
+        Emit("@SP\n");
+        Emit("AM=M+1\n");
+        Emit("M=D\n");
+
+        Emit("@THIS\n");
+        Emit("D=M\n");
+        Emit("@SP\n");
+        Emit("AM=M+1\n");
+        Emit("M=D\n");
+
+        Emit("@THAT\n");
+        Emit("D=M\n");
+        Emit("@SP\n");
+        Emit("AM=M+1\n");
+        Emit("M=D\n");
+
+        Emit("@SP\n");
+        Emit("MD=M+1\n");
+
+        Emit("@LCL\n");
+        Emit("M=D\n");
+
+        Emit("@5\n");
+        Emit("D=D-A\n");
+
+        if (nArgs)
+        {
+            Emit("@%d\n", nArgs);
+            Emit("D=D-A\n");
+        }
+
+        Emit("@ARG\n");
+        Emit("M=D\n");
+        
+        Mark(MARKER_CALL, name);
+        Emit("@%.*s\n", name.length, name.text);
+        Emit("0;JMP\n");
+
+        Emit("(RETURN_ADDRESS_%d)\n", callCount);
+        ++callCount;
+    }
+
+    void Return()
+    {
+        if (comments)
+        {
+            Emit("// return\n");
+        }
+
+        // result = pop()
+        GlobalPop();
+        Emit("@R13\n");
+        Emit("M=D\n");
+
+        // endSP = arg + 1
+        Emit("@ARG\n");
+        Emit("D=M\n");
+        Emit("@R14\n");
+        Emit("M=D+1\n");
+
+        // sp = lcl
+        Emit("@LCL\n");
+        Emit("D=M\n");
+        Emit("@SP\n");
+        Emit("M=D\n");
+
+        // that = pop()
+        GlobalPop();
+        Emit("@THAT\n");
+        Emit("M=D\n");
+
+        // this = pop()
+        GlobalPop();
+        Emit("@THIS\n");
+        Emit("M=D\n");
+
+        // arg = pop()
+        GlobalPop();
+        Emit("@ARG\n");
+        Emit("M=D\n");
+
+        // lcl = pop()
+        GlobalPop();
+        Emit("@LCL\n");
+        Emit("M=D\n");
+
+        // returnAddress = pop()
+        GlobalPop();
+        Emit("@R15\n");
+        Emit("M=D\n");
+
+        // sp = endSP
+        Emit("@R14\n");
+        Emit("D=M\n");
+        Emit("@SP\n");
+        Emit("M=D\n");
+
+        // push result
+        Emit("@R13\n");
+        Emit("D=M\n");
+        Emit("@SP\n");
+        Emit("A=M-1\n");
+        Emit("M=D\n");
+
+        // goto ret
+        Emit("@R15\n");
+        Emit("A=M\n");
+        Mark(MARKER_RETURN, scope);
+        Emit("0;JMP\n");
+    }
+
+    void Bootstrap()
+    {
+        Emit("@256\n");
+        Emit("D=A\n");
+        Emit("@SP\n");
+        Emit("M=D\n");
+
+        Token name;
+        name.text = "Sys.init";
+        name.length = 8;
+
+        Call(name, 0);
+    }
+};
+
+// Generates the assembly for one command, whose name, if it has one, is in names
+void TranslateOp(VMOp* op, const char* names, CodeWriter* writer)
+{
+    Token name = {};
+    name.type = TOKEN_IDENTIFIER;
+    name.text = names + op->name;
+    name.length = op->nameLength;
+
+    switch (op->opcode)
+    {
+        case VMOP_PUSH: writer->Push(op->segment, op->value); break;
+        case VMOP_POP: writer->Pop(op->segment, op->value); break;
+        case VMOP_ADD: writer->ArithmeticTwoParam('+'); break;
+        case VMOP_SUB: writer->ArithmeticTwoParam('-'); break;
+        case VMOP_AND: writer->ArithmeticTwoParam('&'); break;
+        case VMOP_OR: writer->ArithmeticTwoParam('|'); break;
+        case VMOP_NEG: writer->ArithmeticOneParam('-'); break;
+        case VMOP_NOT: writer->ArithmeticOneParam('!'); break;
+        case VMOP_EQ: writer->Compare(EQUAL); break;
+        case VMOP_GT: writer->Compare(GREATER_THAN); break;
+        case VMOP_LT: writer->Compare(LESS_THAN); break;
+        case VMOP_LABEL: writer->Label(name); break;
+        case VMOP_GOTO: writer->Goto(name); break;
+        case VMOP_IF_GOTO: writer->IfGoto(name); break;
+        case VMOP_FUNCTION: writer->Function(name, op->value); break;
+        case VMOP_CALL: writer->Call(name, op->value); break;
+        case VMOP_RETURN: writer->Return(); break;
+    }
+}
+
+// Reads the next command into op, its name as an offset from base. Words that aren't
+// commands are skipped. Returns false at the end of the input.
+bool ParseCommand(Tokenizer* tokenizer, const char* base, VMOp* op)
+{
+    for (;;)
+    {
+        Token token = tokenizer->GetToken();
+        if (token.type == TOKEN_EOF)
+        {
+            return false;
+        }
+
+        if (token.type != TOKEN_IDENTIFIER)
+        {
+            printf("%d: %.*s\n", token.type, token.length, token.text);
+            continue;
+        }
+
+        const Keyword* keyword = Classify(token);
+        if (keyword->length == 0 || keyword->isSegment)
+        {
+            continue;
+        }
+
+        *op = {};
+        op->opcode = (VMOpcode)keyword->value;
+        switch (op->opcode)
+        {
+            case VMOP_PUSH:
+            case VMOP_POP:
+            {
+                Token segment = tokenizer->GetToken();
+                const Keyword* segmentKeyword = Classify(segment);
+                if (!segmentKeyword->isSegment)
+                {
+                    printf("Unrecognized segment: %.*s\n", segment.length, segment.text);
+                    exit(0);
+                }
+
+                op->segment = (VMOpSegment)segmentKeyword->value;
+                op->value = tokenizer->GetToken().value;
+                break;
+            }
+
+            case VMOP_LABEL:
+            case VMOP_GOTO:
+            case VMOP_IF_GOTO:
+            case VMOP_FUNCTION:
+            case VMOP_CALL:
+            {
+                Token name = tokenizer->GetToken();
+                op->name = (int)(name.text - base);
+                op->nameLength = name.length;
+                if (op->opcode == VMOP_FUNCTION || op->opcode == VMOP_CALL)
+                {
+                    op->value = tokenizer->GetToken().value;
+                }
+
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        return true;
+    }
+}
+
+void TranslateFile(char* path, CodeWriter* writer)
+{
+    FileView input;
+    if (!input.Open(path))
+    {
+        printf("Failed to open file: %s\n", path);
+        return;
+    }
+
+    Tokenizer tokenizer;
+    tokenizer.At = input.text;
+
+    VMOp op;
+    while (ParseCommand(&tokenizer, input.text, &op))
+    {
+        TranslateOp(&op, input.text, writer);
+    }
+
+    writer->KeepScope();
+    input.Close();
+}
+
+// Translates a .vmb straight from the mapped file, its names never copied
+bool TranslateBytecodeFile(char* path, CodeWriter* writer)
+{
+    FileView input;
+    if (!input.Open(path))
+    {
+        printf("Failed to open file: %s\n", path);
+        return false;
+    }
+
+    VMBytecodeReader reader;
+    bool valid = reader.Open((const uint8_t*)input.text, input.size);
+    VMOp op;
+    while (reader.Next(&op))
+    {
+        TranslateOp(&op, input.text, writer);
+    }
+
+    if (!valid || reader.failed)
+    {
+        printf("Malformed bytecode: %s\n", path);
+    }
+
+    writer->KeepScope();
+    reader.Close();
+    input.Close();
+    return valid && !reader.failed;
+}
+
+void TranslateAnyFile(char* path, CodeWriter* writer)
+{
+    if (strcmp(extension(path), ".vmb") == 0)
+    {
+        TranslateBytecodeFile(path, writer);
+    }
+    else
+    {
+        TranslateFile(path, writer);
+    }
+}
+
+// A .vm is left out of a folder when the compiler has written a .vmb of the same class next to it
+bool IsVMSource(std::vector<std::string>& names, std::string& name)
+{
+    char* ext = extension(&name[0]);
+    if (strcmp(ext, ".vmb") == 0)
+    {
+        return true;
+    }
+
+    if (strcmp(ext, ".vm") != 0)
+    {
+        return false;
+    }
+
+    return std::find(names.begin(), names.end(), name + "b") == names.end();
+}
+
+// Calls visit with the path and name of every .vm and .vmb file in folder that's translated
+template<typename Visit>
+void ForEachVMSource(char* folder, Visit visit)
+{
+    char filePath[MAX_PATH];
+    std::vector<std::string> names = ListFiles(folder);
+    for (std::string& name : names)
+    {
+        if (IsVMSource(names, name))
+        {
+            snprintf(filePath, sizeof(filePath), "%s" PATH_SEPARATOR "%s", folder, name.c_str());
+            visit(filePath, &name[0]);
+        }
+    }
+}
+
+// Writes the call map:
+//   function <name> <first address> <last address>
+//   call <address of the jump> <callee>
+//   return <address of the jump> <function>
+bool WriteCallMap(CodeWriter* writer, char* mapPath)
+{
+    FileWriter mapFile;
+    if (!mapFile.Open(mapPath))
+    {
+        printf("Failed to open output file: %s\n", mapPath);
+        return false;
+    }
+
+    int address = writer->instructionCount;
+    for (int i = 0; i < writer->markerCount; ++i)
+    {
+        MapMarker* current = &writer->markers[i];
+        switch (current->type)
+        {
+            case MARKER_FUNCTION:
+            {
+                // A function runs until the next one starts
+                int last = address - 1;
+                for (int next = i + 1; next < writer->markerCount; ++next)
+                {
+                    if (writer->markers[next].type == MARKER_FUNCTION)
+                    {
+                        last = writer->markers[next].address - 1;
+                        break;
+                    }
+                }
+
+                mapFile.Print("function %s %d %d\n", current->name, current->address, last);
+                break;
+            }
+
+            // The marker is on the @callee, the jump follows it
+            case MARKER_CALL:
+                mapFile.Print("call %d %s\n", current->address + 1, current->name);
+                break;
+
+            case MARKER_RETURN:
+                mapFile.Print("return %d %s\n", current->address, current->name);
+                break;
+        }
+
+        free(current->name);
+    }
+
+    free(writer->markers);
+    if (!mapFile.Close())
+    {
+        printf("Failed to write output file: %s\n", mapPath);
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+void AssemblyPathFor(char* path, char* outputPath)
+{
+    if (IsDirectory(path))
+    {
+        sprintf(outputPath, "%s" PATH_SEPARATOR "%s", path, baseName(path));
+    }
+    else
+    {
+        strcpy(outputPath, path);
+    }
+
+    char* ext = extension(outputPath);
+    strcpy(ext, ".asm");
+}
+
+bool TranslateVMPath(char* path, char* outputPath, char* mapPath)
+{
+    CodeWriter writer;
+    if (!writer.Open(outputPath))
+    {
+        printf("Failed to open output file: %s\n", outputPath);
+        return false;
+    }
+
+    writer.mapping = mapPath != 0;
+
+    if (IsDirectory(path))
+    {
+        writer.Bootstrap();
+
+        ForEachVMSource(path, [&](char* filePath, char* name)
+        {
+            writer.SetCurrentModule(name);
+            TranslateAnyFile(filePath, &writer);
+        });
+    }
+    else
+    {
+        writer.SetCurrentModule(path);
+        TranslateAnyFile(path, &writer);
+    }
+
+    bool fits = writer.StaticsFit();
+    bool written = writer.output.Close();
+    if (!written)
+    {
+        printf("Failed to write output file: %s\n", outputPath);
+    }
+
+    return (!mapPath || WriteCallMap(&writer, mapPath)) && written && fits;
+}
+
+bool TranslateVMPrograms(VMProgram* programs, int count, AssemblyLineSink lineSink, void* lineContext, char* outputPath, char* mapPath)
+{
+    CodeWriter writer;
+    if (outputPath && !writer.Open(outputPath))
+    {
+        printf("Failed to open output file: %s\n", outputPath);
+        return false;
+    }
+
+    // Comments are only any use to someone reading the .asm
+    writer.comments = outputPath != 0;
+    writer.mapping = mapPath != 0;
+    writer.lineSink = lineSink;
+    writer.lineContext = lineContext;
+    writer.Bootstrap();
+
+    for (int i = 0; i < count; ++i)
+    {
+        VMProgram* program = &programs[i];
+        strcpy(writer.currentModule, program->module);
+        for (int op = 0; op < program->opCount; ++op)
+        {
+            TranslateOp(&program->ops[op], program->names, &writer);
+        }
+    }
+
+    bool fits = writer.StaticsFit();
+    bool written = !outputPath || writer.output.Close();
+    if (!written)
+    {
+        printf("Failed to write output file: %s\n", outputPath);
+    }
+
+    return (!mapPath || WriteCallMap(&writer, mapPath)) && written && fits;
+}
+
+// Passes over the benchmark input, the fastest is the one reported
+#define BENCHMARK_PASSES 5
+
+bool BenchmarkVMParse(char* path, int copies, VMParseBenchmark* result)
+{
+    std::string source;
+    auto add = [&](char* filePath)
+    {
+        FileView input;
+        if (input.Open(filePath))
+        {
+            source.append(input.text, input.size);
+            source += '\n';
+            input.Close();
+        }
+    };
+
+    if (IsDirectory(path))
+    {
+        ForEachVMSource(path, [&](char* filePath, char* name)
+        {
+            if (strcmp(extension(name), ".vm") == 0)
+            {
+                add(filePath);
+            }
+        });
+    }
+    else
+    {
+        add(path);
+    }
+
+    if (source.empty())
+    {
+        return false;
+    }
+
+    std::string input;
+    input.reserve(source.size() * copies);
+    for (int i = 0; i < copies; ++i)
+    {
+        input += source;
+    }
+
+    *result = {};
+    result->bytes = (long long)input.size();
+    for (int pass = 0; pass < BENCHMARK_PASSES; ++pass)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        Tokenizer tokenizer;
+        tokenizer.At = &input[0];
+        long long commands = 0;
+        VMOp op;
+        while (ParseCommand(&tokenizer, input.data(), &op))
+        {
+            ++commands;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        if (pass == 0 || seconds < result->seconds)
+        {
+            result->seconds = seconds;
+        }
+
+        result->commands = commands;
+    }
+
+    return true;
+}
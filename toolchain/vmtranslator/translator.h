@@ -0,0 +1,50 @@
+#pragma once
+
+#ifndef MAX_PATH
+#define MAX_PATH 260
+#endif
+
+struct VMProgram;
+
+// Gets every line of assembly as it's generated, an instruction or a label ending in a
+// newline. The line is only good until it returns.
+typedef bool (*AssemblyLineSink)(void* context, char* line);
+
+/// <summary>
+/// Works out where the assembly for a .vm file or folder goes by default: next to the file,
+/// or inside the folder named after it
+/// </summary>
+void AssemblyPathFor(char* path, char* outputPath);
+
+/// <summary>
+/// Translates a .vm or .vmb file, or every one in a folder behind a bootstrap that calls
+/// Sys.init, into one Hack assembly file. A folder's .vmb is taken over a .vm of the same
+/// name. Returns false, having printed why, if the output can't be written or the program
+/// names more statics than RAM 16 to 255 holds. With a mapPath, also writes the rom range of
+/// every function and the address of every call and return jump there, for the emulator's
+/// call graph profiler.
+/// </summary>
+bool TranslateVMPath(char* path, char* outputPath, char* mapPath = 0);
+
+/// <summary>
+/// Translates classes already in memory, behind the same bootstrap a folder gets, handing
+/// every line to lineSink as it goes. Takes the place of writing the .vm files and translating
+/// their folder when the classes come straight from the compiler. The assembly is only written
+/// out if there's an outputPath, and the call map if there's a mapPath. Fails the same way as
+/// TranslateVMPath.
+/// </summary>
+bool TranslateVMPrograms(VMProgram* programs, int count, AssemblyLineSink lineSink, void* lineContext, char* outputPath = 0, char* mapPath = 0);
+
+struct VMParseBenchmark
+{
+    long long bytes;
+    long long commands;
+    double seconds;
+};
+
+/// <summary>
+/// Reads the .vm text at path, a file or every one in a folder, into one input repeated copies
+/// times and times parsing it the way translation does, without generating any assembly. For
+/// measuring the front end on more input than any real program has.
+/// </summary>
+bool BenchmarkVMParse(char* path, int copies, VMParseBenchmark* result);
@@ -0,0 +1,240 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "vmbytecode.h"
+
+#define VMB_VERSION 1
+
+// A varint of an int takes up to five bytes
+#define VMB_MAX_OP_BYTES (2 + 5 + 5)
+
+struct VMBytecodeHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nameCount;
+    uint32_t opCount;
+};
+
+static const char vmbMagic[8] = { 'H', 'A', 'C', 'K', 'V', 'M', 'B', 'C' };
+
+static uint8_t* PutVarint(uint8_t* At, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *At++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+
+    *At++ = (uint8_t)value;
+    return At;
+}
+
+static bool GetVarint(const uint8_t*& At, const uint8_t* end, uint32_t* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 35 && At < end; shift += 7)
+    {
+        uint8_t byte = *At++;
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool HasName(VMOpcode opcode)
+{
+    return opcode >= VMOP_LABEL && opcode <= VMOP_CALL;
+}
+
+static bool HasCount(VMOpcode opcode)
+{
+    return opcode == VMOP_FUNCTION || opcode == VMOP_CALL;
+}
+
+bool WriteVMBytecode(VMProgram* program, FILE* output)
+{
+    // Every call to a function repeats its name, the file only has it once
+    std::unordered_map<std::string, uint32_t> nameIndices;
+    std::vector<std::string> names;
+    std::vector<uint32_t> opNames(program->opCount);
+    for (int i = 0; i < program->opCount; ++i)
+    {
+        VMOp* op = &program->ops[i];
+        if (HasName(op->opcode))
+        {
+            std::string name(program->names + op->name, op->nameLength);
+            auto found = nameIndices.find(name);
+            if (found == nameIndices.end())
+            {
+                found = nameIndices.emplace(name, (uint32_t)names.size()).first;
+                names.push_back(name);
+            }
+
+            opNames[i] = found->second;
+        }
+    }
+
+    VMBytecodeHeader header = {};
+    memcpy(header.magic, vmbMagic, sizeof(vmbMagic));
+    header.version = VMB_VERSION;
+    header.nameCount = (uint32_t)names.size();
+    header.opCount = (uint32_t)program->opCount;
+
+    size_t capacity = (size_t)program->opCount * VMB_MAX_OP_BYTES;
+    for (std::string& name : names)
+    {
+        capacity += 5 + name.size();
+    }
+
+    uint8_t* bytes = (uint8_t*)malloc(capacity);
+    uint8_t* At = bytes;
+    for (std::string& name : names)
+    {
+        At = PutVarint(At, (uint32_t)name.size());
+        memcpy(At, name.data(), name.size());
+        At += name.size();
+    }
+
+    for (int i = 0; i < program->opCount; ++i)
+    {
+        VMOp* op = &program->ops[i];
+        *At++ = op->opcode;
+        if (op->opcode == VMOP_PUSH || op->opcode == VMOP_POP)
+        {
+            *At++ = op->segment;
+            At = PutVarint(At, (uint32_t)op->value);
+        }
+        else if (HasName(op->opcode))
+        {
+            At = PutVarint(At, opNames[i]);
+            if (HasCount(op->opcode))
+            {
+                At = PutVarint(At, (uint32_t)op->value);
+            }
+        }
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, output) == 1 &&
+        fwrite(bytes, 1, At - bytes, output) == (size_t)(At - bytes);
+    free(bytes);
+    return written;
+}
+
+bool VMBytecodeReader::Open(const uint8_t* bytes, size_t size)
+{
+    data = bytes;
+    At = bytes + sizeof(VMBytecodeHeader);
+    end = bytes + size;
+    nameOffsets = 0;
+    nameLengths = 0;
+    opsRead = 0;
+    failed = true;
+
+    VMBytecodeHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+
+    memcpy(&header, bytes, sizeof(header));
+    if (memcmp(header.magic, vmbMagic, sizeof(vmbMagic)) != 0 || header.version != VMB_VERSION ||
+        header.nameCount > size)
+    {
+        return false;
+    }
+
+    nameCount = (int)header.nameCount;
+    opCount = header.opCount;
+    nameOffsets = (int*)malloc(sizeof(int) * (nameCount + 1));
+    nameLengths = (int*)malloc(sizeof(int) * (nameCount + 1));
+    for (int i = 0; i < nameCount; ++i)
+    {
+        uint32_t length;
+        if (!GetVarint(At, end, &length) || length > (size_t)(end - At))
+        {
+            return false;
+        }
+
+        nameOffsets[i] = (int)(At - data);
+        nameLengths[i] = (int)length;
+        At += length;
+    }
+
+    failed = false;
+    return true;
+}
+
+bool VMBytecodeReader::Next(VMOp* op)
+{
+    if (failed || opsRead == opCount)
+    {
+        return false;
+    }
+
+    failed = true;
+    if (At == end || *At > VMOP_RETURN)
+    {
+        return false;
+    }
+
+    op->opcode = (VMOpcode)*At++;
+    op->segment = VMSEG_CONSTANT;
+    op->value = 0;
+    op->name = 0;
+    op->nameLength = 0;
+
+    uint32_t field;
+    if (op->opcode == VMOP_PUSH || op->opcode == VMOP_POP)
+    {
+        if (At == end || *At >= VMSEG_COUNT)
+        {
+            return false;
+        }
+
+        op->segment = (VMOpSegment)*At++;
+        if (!GetVarint(At, end, &field))
+        {
+            return false;
+        }
+
+        op->value = (int)field;
+    }
+    else if (HasName(op->opcode))
+    {
+        if (!GetVarint(At, end, &field) || field >= (uint32_t)nameCount)
+        {
+            return false;
+        }
+
+        op->name = nameOffsets[field];
+        op->nameLength = nameLengths[field];
+        if (HasCount(op->opcode))
+        {
+            if (!GetVarint(At, end, &field))
+            {
+                return false;
+            }
+
+            op->value = (int)field;
+        }
+    }
+
+    ++opsRead;
+    failed = false;
+    return true;
+}
+
+void VMBytecodeReader::Close()
+{
+    free(nameOffsets);
+    free(nameLengths);
+    nameOffsets = 0;
+    nameLengths = 0;
+}
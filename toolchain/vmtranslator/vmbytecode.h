@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "vmops.h"
+
+// The .vmb format, a compact alternative to .vm text for the compiler to hand the translator:
+//   header: "HACKVMBC", version, name count, command count
+//   names: each a varint length and its characters, every distinct name once
+//   commands: an opcode byte, then for push and pop a segment byte and a varint index, for
+//   labels and gotos a varint name, and for functions and calls a varint name and count
+// Varints are little endian, seven bits to a byte with the top bit set on all but the last.
+
+/// <summary>
+/// Writes program as .vmb. Returns false if the file couldn't be written.
+/// </summary>
+bool WriteVMBytecode(VMProgram* program, FILE* output);
+
+// Decodes a .vmb in memory a command at a time. The commands' names are offsets into the
+// bytes given to Open, which have to stay around as long as the names are used.
+struct VMBytecodeReader
+{
+    const uint8_t* data;
+    const uint8_t* At;
+    const uint8_t* end;
+
+    int nameCount;
+    int* nameOffsets;
+    int* nameLengths;
+
+    uint32_t opCount;
+    uint32_t opsRead;
+
+    /// <summary>
+    /// Checks the header and reads the names. Returns false if the bytes aren't a .vmb of this
+    /// version, or are cut short.
+    /// </summary>
+    bool Open(const uint8_t* bytes, size_t size);
+
+    /// <summary>
+    /// Decodes the next command into op. Returns false after the last one, and also on a
+    /// malformed command, which leaves failed set.
+    /// </summary>
+    bool Next(VMOp* op);
+    bool failed;
+
+    void Close();
+};
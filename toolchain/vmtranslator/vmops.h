@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+
+enum VMOpcode : unsigned char
+{
+    VMOP_PUSH,
+    VMOP_POP,
+
+    // In the order of the Jack compiler's VMCommand
+    VMOP_ADD,
+    VMOP_SUB,
+    VMOP_NEG,
+    VMOP_EQ,
+    VMOP_GT,
+    VMOP_LT,
+    VMOP_AND,
+    VMOP_OR,
+    VMOP_NOT,
+
+    VMOP_LABEL,
+    VMOP_GOTO,
+    VMOP_IF_GOTO,
+    VMOP_FUNCTION,
+    VMOP_CALL,
+    VMOP_RETURN,
+};
+
+// In the order of the Jack compiler's VMSegment
+enum VMOpSegment : unsigned char
+{
+    VMSEG_CONSTANT,
+    VMSEG_ARGUMENT,
+    VMSEG_LOCAL,
+    VMSEG_STATIC,
+    VMSEG_THIS,
+    VMSEG_THAT,
+    VMSEG_POINTER,
+    VMSEG_TEMP,
+
+    VMSEG_COUNT
+};
+
+// Spelled as in .vm files
+static const char* const vmSegmentNames[VMSEG_COUNT] =
+{
+    "constant", "argument", "local", "static", "this", "that", "pointer", "temp",
+};
+
+// One VM command. Labels, gotos, functions and calls keep their name in the names of the
+// program they belong to.
+struct VMOp
+{
+    VMOpcode opcode;
+    VMOpSegment segment;
+
+    // The push or pop index, a function's local count or a call's argument count
+    int value;
+    int name;
+    int nameLength;
+};
+
+// The commands of one class, what its .vm file holds, for handing compiled code to the
+// translator without writing and parsing text
+struct VMProgram
+{
+    // Statics are named after it, as the translator names them after the .vm file
+    char module[256] = {};
+
+    VMOp* ops = 0;
+    int opCount = 0;
+    int opCapacity = 0;
+
+    char* names = 0;
+    int namesSize = 0;
+    int namesCapacity = 0;
+
+    VMOp* Add(VMOpcode opcode, VMOpSegment segment = VMSEG_CONSTANT, int value = 0)
+    {
+        if (opCount == opCapacity)
+        {
+            opCapacity = opCapacity ? opCapacity * 2 : 1024;
+            ops = (VMOp*)realloc(ops, sizeof(VMOp) * opCapacity);
+        }
+
+        VMOp* op = &ops[opCount++];
+        op->opcode = opcode;
+        op->segment = segment;
+        op->value = value;
+        op->name = 0;
+        op->nameLength = 0;
+        return op;
+    }
+
+    VMOp* Add(VMOpcode opcode, const char* name, int nameLength, int value = 0)
+    {
+        if (namesSize + nameLength > namesCapacity)
+        {
+            namesCapacity = namesCapacity ? namesCapacity * 2 : 16384;
+            while (namesSize + nameLength > namesCapacity)
+            {
+                namesCapacity *= 2;
+            }
+
+            names = (char*)realloc(names, namesCapacity);
+        }
+
+        VMOp* op = Add(opcode, VMSEG_CONSTANT, value);
+        op->name = namesSize;
+        op->nameLength = nameLength;
+        memcpy(names + namesSize, name, nameLength);
+        namesSize += nameLength;
+        return op;
+    }
+
+    void Free()
+    {
+        free(ops);
+        free(names);
+        ops = 0;
+        names = 0;
+        opCount = opCapacity = 0;
+        namesSize = namesCapacity = 0;
+    }
+};